@@ -42,6 +42,48 @@ extern void dmr_byte_to_bits(uint8_t byte, bool bits[8]);
 extern void dmr_bytes_to_bits(uint8_t *bytes, size_t bytes_length, bool *bits, size_t bits_length);
 void _dmr_dump_hex(void *mem, size_t len, const char *func, size_t line);
 
+/* Packed bit vector, 64 bits per word. Bit 0 is the most significant bit of
+ * the first word, so the bit order matches the bytes it was loaded from. */
+typedef uint64_t dmr_bitvec;
+
+/** Number of words to hold n bits. */
+#define DMR_BITVEC_WORDS(n)         (((n) + 63) / 64)
+
+static inline bool dmr_bitvec_get(const dmr_bitvec *v, size_t i)
+{
+    return (v[i >> 6] >> (63 - (i & 63))) & 1;
+}
+
+static inline void dmr_bitvec_set(dmr_bitvec *v, size_t i, bool bit)
+{
+    uint64_t mask = 1ULL << (63 - (i & 63));
+    v[i >> 6] = bit ? (v[i >> 6] | mask) : (v[i >> 6] & ~mask);
+}
+
+static inline void dmr_bitvec_flip(dmr_bitvec *v, size_t i)
+{
+    v[i >> 6] ^= 1ULL << (63 - (i & 63));
+}
+
+/** Clear the words holding n bits. */
+extern void     dmr_bitvec_zero(dmr_bitvec *v, size_t n);
+/** Load len bytes, bits beyond len * 8 in the last word are cleared. */
+extern void     dmr_bitvec_from_bytes(dmr_bitvec *v, const uint8_t *bytes, size_t len);
+/** Store the first len * 8 bits as bytes. */
+extern void     dmr_bitvec_to_bytes(const dmr_bitvec *v, uint8_t *bytes, size_t len);
+/** Get len (up to 64) bits starting at offset, right aligned. */
+extern uint64_t dmr_bitvec_extract(const dmr_bitvec *v, size_t offset, uint8_t len);
+/** Set len (up to 64) bits starting at offset from the right aligned value. */
+extern void     dmr_bitvec_insert(dmr_bitvec *v, size_t offset, uint8_t len, uint64_t value);
+/** Copy len bits from src at src_offset to dst at dst_offset. */
+extern void     dmr_bitvec_copy(dmr_bitvec *dst, size_t dst_offset, const dmr_bitvec *src, size_t src_offset, size_t len);
+/** Deinterleave n bits, bit i of dst is bit schedule[i] of src. */
+extern void     dmr_bitvec_deinterleave(dmr_bitvec *dst, const dmr_bitvec *src, const uint8_t *schedule, size_t n);
+/** Interleave n bits, bit schedule[i] of dst is bit i of src. */
+extern void     dmr_bitvec_interleave(dmr_bitvec *dst, const dmr_bitvec *src, const uint8_t *schedule, size_t n);
+/** Number of bits set in the first n bits. */
+extern size_t   dmr_bitvec_popcount(const dmr_bitvec *v, size_t n);
+
 #define dmr_dump_hex(mem, len)      _dmr_dump_hex(mem, len, __FILE__, __LINE__)
 
 #endif // _DMR_BITS_H
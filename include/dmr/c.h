@@ -40,6 +40,13 @@ extern "C" {
     } \
 } while(0)
 
+/** Size of a CPU cache line. */
+#define DMR_CACHELINE 64
+
+/** Align a structure member on a cache line, to prevent false sharing
+ *  between members written by different threads. */
+#define DMR_CACHELINE_ALIGNED __attribute__((aligned(DMR_CACHELINE)))
+
 #ifdef __cplusplus
 }
 #endif
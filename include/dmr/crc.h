@@ -10,6 +10,7 @@ extern "C" {
 #endif
 
 #include <inttypes.h>
+#include <stddef.h>
 
 #define DMR_CRC8_MASK_VOICE_PI              (0x69)
 #define DMR_CRC8_MASK_VOICE_LC              (0x96)
@@ -17,10 +18,13 @@ extern "C" {
 
 extern void dmr_crc9(uint16_t *crc, uint8_t byte, uint8_t bitlen);
 extern void dmr_crc9_finish(uint16_t *crc, uint8_t bitlen);
+extern uint16_t dmr_crc9_block(const uint8_t *buf, size_t len);
 extern void dmr_crc16(uint16_t *crc, uint8_t byte);
 extern void dmr_crc16_finish(uint16_t *crc);
+extern uint16_t dmr_crc16_block(const uint8_t *buf, size_t len);
 extern void dmr_crc32(uint32_t *crc, uint8_t byte);
 extern void dmr_crc32_finish(uint32_t *crc);
+extern uint32_t dmr_crc32_block(const uint8_t *buf, size_t len);
 
 #ifdef __cplusplus
 }
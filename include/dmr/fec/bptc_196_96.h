@@ -9,12 +9,19 @@ extern "C" {
 #include <dmr/bits.h>
 #include <dmr/packet.h>
 
+/* Maximum number of row and column passes made by the decoder */
+#define DMR_BPTC_196_96_PASSES 4
+
 typedef struct {
-	bool raw[196];
-	bool deinterleaved_bits[196];
+	dmr_bitvec raw[DMR_BITVEC_WORDS(DMR_PAYLOAD_BITS)];
+	dmr_bitvec deinterleaved_bits[DMR_BITVEC_WORDS(DMR_PAYLOAD_BITS)];
+	uint8_t    repaired; /* bit errors repaired by the last decode */
 } dmr_bptc_196_96;
 
 int dmr_bptc_196_96_decode(dmr_packet packet, dmr_bptc_196_96 *bptc, uint8_t data[12]);
+/* Decode n bursts, ret[i] holds the result of decoding packets[i]. Returns
+ * the number of bursts that could not be decoded. */
+int dmr_bptc_196_96_decode_batch(dmr_packet *packets, size_t n, uint8_t (*data)[12], int *ret);
 int dmr_bptc_196_96_encode(dmr_packet packet, dmr_bptc_196_96 *bptc, uint8_t data[12]);
 
 #ifdef __cplusplus
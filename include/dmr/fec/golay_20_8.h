@@ -6,10 +6,26 @@ extern "C" {
 #endif
 
 #include <inttypes.h>
+#include <stddef.h>
+
+/* Number of codewords dmr_golay_20_8_decode_batch works on at a time */
+#define DMR_GOLAY_20_8_BATCH 64
+
+/* Codeword as used by the batch functions, from the 3 bytes passed to
+ * dmr_golay_20_8_decode */
+#define DMR_GOLAY_20_8_CODE(data) \
+    (((uint32_t)(data)[0] << 11) | ((uint32_t)(data)[1] << 3) | ((uint32_t)(data)[2] >> 5))
 
 extern uint8_t dmr_golay_20_8_decode(uint8_t data[3]);
 extern void dmr_golay_20_8_encode(uint8_t data[3]);
 
+/* Calculate the syndromes of n codewords, using SSE2 or AVX2 if the CPU
+ * supports it. */
+extern void dmr_golay_20_8_syndromes(const uint32_t *code, uint32_t *syndrome, size_t n);
+
+/* Decode n codewords, the data byte of code[i] is stored in data[i]. */
+extern void dmr_golay_20_8_decode_batch(const uint32_t *code, uint8_t *data, size_t n);
+
 #ifdef __cplusplus
 }
 #endif
@@ -19,6 +19,26 @@ extern bool dmr_hamming_16_11_4_decode(bool bits[16]);
 extern void dmr_hamming_17_12_3_encode(bool bits[17]);
 extern bool dmr_hamming_17_12_3_decode(bool bits[17]);
 
+/* Packed codewords, the first bit of the codeword is the most significant
+ * bit and the parity bits are the least significant bits. Encoding takes the
+ * k data bits and returns the n bit codeword. Decoding repairs a single bit
+ * error in place, it returns the number of bits repaired or -1 if the
+ * codeword can't be repaired. Both use lookup tables, see dmr_hamming_init. */
+extern uint32_t dmr_hamming_7_4_3_encode_word(uint32_t data);
+extern int      dmr_hamming_7_4_3_decode_word(uint32_t *word);
+extern uint32_t dmr_hamming_13_9_3_encode_word(uint32_t data);
+extern int      dmr_hamming_13_9_3_decode_word(uint32_t *word);
+extern uint32_t dmr_hamming_15_11_3_encode_word(uint32_t data);
+extern int      dmr_hamming_15_11_3_decode_word(uint32_t *word);
+extern uint32_t dmr_hamming_16_11_4_encode_word(uint32_t data);
+extern int      dmr_hamming_16_11_4_decode_word(uint32_t *word);
+extern uint32_t dmr_hamming_17_12_3_encode_word(uint32_t data);
+extern int      dmr_hamming_17_12_3_decode_word(uint32_t *word);
+
+/** Build the parity and syndrome lookup tables. Called by dmr_fec_init, the
+ * encoders and decoders also make sure it ran, so calling it is optional. */
+extern int      dmr_hamming_init(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -12,7 +12,10 @@ extern "C" {
 
 #include <inttypes.h>
 
+/** Check and repair a Reed-Solomon(12,9) codeword in place. Returns the
+ * number of repaired symbols, or -1 if the codeword can't be repaired. */
 extern int dmr_rs_12_9_4_decode(uint8_t bytes[12]);
+/** Calculate the 3 parity bytes over the 9 data bytes. */
 extern int dmr_rs_12_9_4_encode(uint8_t bytes[12]);
 
 #ifdef __cplusplus
@@ -13,8 +13,20 @@ extern "C" {
 #include <inttypes.h>
 #include <dmr/packet.h>
 
+/** Soft symbols are the nominal levels -3, -1, +1 and +3 times this scale. */
+#define DMR_TRELLIS_SYMBOL_SCALE 32
+
+/** Decode a rate 3/4 trellis coded burst using a Viterbi decoder. */
 extern int dmr_trellis_rate_34_decode(dmr_packet packet, uint8_t bytes[18]);
 
+/** Decode 98 received symbols, in the order they were transmitted, using a
+ * soft decision Viterbi decoder. Symbol values are in the range of the
+ * nominal levels times DMR_TRELLIS_SYMBOL_SCALE. */
+extern int dmr_trellis_rate_34_decode_soft(const int8_t symbols[98], uint8_t bytes[18]);
+
+/** Encode 18 bytes to a rate 3/4 trellis coded burst. */
+extern int dmr_trellis_rate_34_encode(dmr_packet packet, uint8_t bytes[18]);
+
 #ifdef __cplusplus
 }
 #endif
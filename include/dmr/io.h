@@ -1,6 +1,7 @@
 #ifndef _DMR_IO_H
 #define _DMR_IO_H
 
+#include <signal.h>
 #include <stdbool.h>
 #include <time.h>
 #include <sys/types.h>
@@ -9,6 +10,18 @@
 #include <dmr/platform.h>
 #include <dmr/queue.h>
 
+#if defined(DMR_HAVE_EPOLL)
+#include <sys/epoll.h>
+#if defined(DMR_HAVE_TIMERFD)
+#include <sys/timerfd.h>
+#endif
+#else
+#include <sys/select.h>
+#endif
+
+/** Maximum number of events returned by a single epoll_wait. */
+#define DMR_IO_EPOLL_EVENTS 64
+
 typedef enum {
     DMR_HANDLE_UNKNOWN = 0,
     DMR_HANDLE_TCP,
@@ -46,6 +59,7 @@ typedef int (*dmr_error_cb)(dmr_io *io, void *userdata, int fd);
 typedef int (*dmr_shutdown_cb)(dmr_io *io, void *userdata, int fd);
 typedef int (*dmr_close_cb)(dmr_io *io, void *userdata);
 typedef int (*dmr_timer_cb)(dmr_io *io, void *userdata);
+typedef int (*dmr_post_cb)(dmr_io *io, void *userdata);
 
 typedef struct dmr_io_entry {
     dmr_handle_type              handle;
@@ -53,38 +67,71 @@ typedef struct dmr_io_entry {
     void                         *cb;
     void                         *userdata;
     bool                         once;
+    bool                         removed;    /* pending removal */
     DMR_LIST_ENTRY(dmr_io_entry) entries;
+    DMR_LIST_ENTRY(dmr_io_entry) fd_entries; /* per-fd dispatch list */
+    DMR_LIST_ENTRY(dmr_io_entry) removals;   /* deferred removal list */
 } dmr_io_entry;
 
 typedef struct {
     DMR_LIST_HEAD(, dmr_io_entry) head;
 } dmr_io_entry_list;
 
+/** Per-fd dispatch slot, looked up by file descriptor. */
+typedef struct {
+    dmr_io_entry_list            read;
+    dmr_io_entry_list            write;
+    dmr_io_entry_list            error;
+    uint32_t                     events;     /* events registered with the backend */
+} dmr_io_fd;
+
+/** Timer handle, as returned by dmr_io_reg_timer. */
 typedef struct dmr_io_timer {
     struct timeval               timeout;    /* timeout when registered */
-    struct timeval               wallclock;  /* wall clock time for timeout */
+    uint64_t                     interval;   /* timeout in nanoseconds */
+    uint64_t                     deadline;   /* monotonic time for timeout */
     dmr_timer_cb                 cb;
     void                         *userdata;
     bool                         once;
-    DMR_LIST_ENTRY(dmr_io_timer) entries;
+    bool                         cancelled;  /* cancelled from its own callback */
+    size_t                       index;      /* position in the timer heap */
 } dmr_io_timer;
 
-typedef struct {
-    DMR_LIST_HEAD(, dmr_io_timer) head;
-} dmr_io_timer_list;
-
 struct dmr_io {
     dmr_io_entry_list *entry[DMR_REQUEST_TYPES];
-    dmr_io_timer_list *timer;
     struct timeval    timeout;
+    bool              persistent;           /* keep running with nothing registered, until closed */
     /* private */
     ssize_t           entries;              /* total number of entries in all lists */
     int               maxfd;                /* highest fd */
     struct timeval    wallclock;            /* wall clock time for io loop */
+    dmr_io_timer      **timer;              /* binary min-heap on deadline */
+    size_t            timers;               /* number of timers in the heap */
+    size_t            timers_size;          /* allocated size of the heap */
+    dmr_io_timer      *timer_running;       /* timer whose callback is running */
+    dmr_io_fd         **fd;                 /* per-fd dispatch table */
+    int               fds;                  /* size of the dispatch table */
+    dmr_io_entry_list removed;              /* entries removed during dispatch */
+    bool              dispatching;
+#if defined(DMR_HAVE_EPOLL)
+    int               epfd;
+#if defined(DMR_HAVE_TIMERFD)
+    int               tfd;                  /* timerfd armed for the first deadline */
+    uint64_t          tfd_deadline;
+#endif
+    struct epoll_event events[DMR_IO_EPOLL_EVENTS];
+#else
     fd_set            readers;
     fd_set            writers;
     fd_set            errors;
+#endif
     volatile bool     closed;
+    int               wake[2];              /* eventfd or pipe, wakes up the loop */
+    struct dmr_io_post *posted;             /* callbacks posted from other threads */
+    int               sig[2];               /* signalfd, or self-pipe written by the handler */
+#if defined(DMR_HAVE_SIGNALFD)
+    sigset_t          signals;              /* signals read from the signalfd */
+#endif
 };
 
 #include <dmr/protocol.h>
@@ -94,7 +141,18 @@ extern int dmr_io_add_protocol(dmr_io *io, dmr_protocol protocol, void *instance
 extern int dmr_io_free(dmr_io *io);
 extern int dmr_io_loop(dmr_io *io);
 extern int dmr_io_close(dmr_io *io);
-
+/** Run a callback on the loop thread at its next iteration.
+ * Safe to call from any thread, the loop is woken up if it is waiting.
+ * Callbacks posted from the same thread run in the order they were posted. */
+extern int dmr_io_post(dmr_io *io, dmr_post_cb cb, void *userdata);
+
+/** Register a signal callback.
+ * Signals are delivered as events inside dmr_io_loop, never from the signal
+ * handler. With signalfd the signal is blocked for the calling thread only,
+ * so register signals before starting other threads, they inherit the mask;
+ * a thread that still has the signal unblocked consumes it and the loop never
+ * sees it. Threads started by dmr_io_group_start block all signals.
+ * A signal is delivered to one loop only. */
 extern int dmr_io_reg_signal(dmr_io *io, int signal, dmr_signal_cb cb, void *userdata, bool once);
 
 extern int dmr_io_reg_read(dmr_io *io, int fd, dmr_read_cb cb, void *userdata, bool once);
@@ -106,11 +164,79 @@ extern int dmr_io_del_write(dmr_io *io, int fd, dmr_write_cb cb);
 extern int dmr_io_reg_error(dmr_io *io, int fd, dmr_error_cb cb, void *userdata, bool once);
 extern int dmr_io_del_error(dmr_io *io, int fd, dmr_error_cb cb);
 
-extern int dmr_io_reg_timer(dmr_io *io, struct timeval timeout, dmr_timer_cb cb, void *userdata, bool once);
+/** Register a timer.
+ * Returns a handle for dmr_io_cancel_timer, or NULL on error. The handle of
+ * a once timer is no longer valid after it has fired. */
+extern dmr_io_timer *dmr_io_reg_timer(dmr_io *io, struct timeval timeout, dmr_timer_cb cb, void *userdata, bool once);
+/** Cancel a timer by its handle. */
+extern int dmr_io_cancel_timer(dmr_io *io, dmr_io_timer *timer);
+/** Cancel the first timer found with the callback. */
 extern int dmr_io_del_timer(dmr_io *io, dmr_timer_cb cb);
 
 extern int dmr_io_reg_close(dmr_io *io, dmr_close_cb cb, void *userdata);
 
+#include <dmr/packetq.h>
+#include <dmr/thread.h>
+
+/** Default number of packets a handoff can hold. */
+#define DMR_IO_HANDOFF_SIZE 256
+
+typedef int (*dmr_io_handoff_cb)(dmr_io *io, void *userdata, dmr_parsed_packet *parsed);
+
+/** Packet handoff between two I/O loops.
+ * One loop (the producer) sends packets, the callback runs on the loop the
+ * handoff was registered with. Packets are copied through a single-producer
+ * single-consumer ring, use one handoff per producing loop. */
+typedef struct dmr_io_handoff {
+    dmr_io            *io;          /* receiving loop */
+    dmr_io_handoff_cb cb;
+    void              *userdata;
+    dmr_packetq_ring  *ring;
+    int               rfd;          /* wake up, eventfd or pipe */
+    int               wfd;
+    /* set by the producer when a wake up is pending */
+    bool              pending DMR_CACHELINE_ALIGNED;
+} dmr_io_handoff;
+
+/** Setup a new handoff to the loop io, size is the number of packets it can
+ * hold. Call this before the loop runs, or from the thread running the loop. */
+extern dmr_io_handoff *dmr_io_handoff_new(dmr_io *io, size_t size, dmr_io_handoff_cb cb, void *userdata);
+/** Destroy a handoff, same rules as dmr_io_handoff_new apply. */
+extern void dmr_io_handoff_free(dmr_io_handoff *handoff);
+/** Pass a packet to the receiving loop, producer only.
+ * Returns -1 if the handoff is full. */
+extern int dmr_io_handoff_send(dmr_io_handoff *handoff, dmr_parsed_packet *parsed);
+
+/** Group of I/O loops, each running on its own thread. */
+typedef struct dmr_io_group {
+    size_t            loops;
+    dmr_io            **io;
+    int               *cpu;         /* CPU a loop is pinned to, -1 for none */
+    size_t            *protocols;   /* protocols added per loop */
+    /* private */
+    dmr_thread_t      *thread;
+    bool              running;
+} dmr_io_group;
+
+/** Setup a group of I/O loops, each loop gets its own thread. */
+extern dmr_io_group *dmr_io_group_new(size_t loops);
+/** Destroy a group, the loops must have stopped. */
+extern int dmr_io_group_free(dmr_io_group *group);
+/** Pin a loop to a CPU, call before dmr_io_group_start. */
+extern int dmr_io_group_affinity(dmr_io_group *group, size_t loop, int cpu);
+/** Get a loop from the group, protocols are assigned to the loop with
+ * dmr_io_add_protocol. */
+extern dmr_io *dmr_io_group_loop(dmr_io_group *group, size_t loop);
+/** Add a protocol to the loop with the fewest protocols.
+ * Returns the loop number, or -1 on error. */
+extern int dmr_io_group_add_protocol(dmr_io_group *group, dmr_protocol protocol, void *instance);
+/** Start a thread for each loop, the threads start with all signals blocked. */
+extern int dmr_io_group_start(dmr_io_group *group);
+/** Request all loops to close, safe to call from any thread. */
+extern int dmr_io_group_close(dmr_io_group *group);
+/** Wait for all loop threads to finish. */
+extern int dmr_io_group_join(dmr_io_group *group);
+
 /* Unexport private data */
 #undef REQUEST_FIELDS
 
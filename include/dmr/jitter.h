@@ -0,0 +1,92 @@
+/**
+ * @file
+ * @brief Jitter buffer for network voice streams.
+ */
+#ifndef _DMR_JITTER_H
+#define _DMR_JITTER_H
+
+#include <dmr/c.h>
+#include <dmr/packet.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/** Bursts buffered per timeslot, a power of 2. */
+#define DMR_JITTER_SLOTS        32
+#define DMR_JITTER_MASK         (DMR_JITTER_SLOTS - 1)
+/** Interval between two bursts on a timeslot. */
+#define DMR_JITTER_BURST_MS     60
+/** Bounds of the adaptive playout delay. */
+#define DMR_JITTER_MIN_MS       60
+#define DMR_JITTER_MAX_MS       300
+/** Lost bursts concealed by repeating the previous burst, silence after that. */
+#define DMR_JITTER_REPEAT_MAX   2
+/** Playout ticks without buffered bursts before a stream is ended. */
+#define DMR_JITTER_STARVE_MAX   5
+
+/** Playout counters for one timeslot. */
+typedef struct {
+    uint64_t received;      /* bursts added */
+    uint64_t played;        /* bursts played out, including concealment */
+    uint64_t late;          /* bursts that arrived after their playout time */
+    uint64_t lost;          /* bursts that never arrived in time */
+    uint64_t reordered;     /* bursts that arrived out of order, in time */
+    uint64_t duplicate;     /* bursts that arrived twice */
+    uint64_t overflow;      /* bursts dropped from a full buffer */
+    uint64_t concealed;     /* repeat or silence bursts inserted */
+    uint64_t streams;       /* streams started */
+    unsigned depth;         /* bursts currently buffered */
+    unsigned delay_ms;      /* playout delay for the next stream */
+    unsigned jitter_ms;     /* smoothed interarrival jitter */
+} dmr_jitter_stats;
+
+/** Jitter buffer state for one timeslot. The bursts are indexed by their
+ * sequence number, so reordering is a matter of filling the right slot. */
+typedef struct {
+    uint32_t          stream_id;
+    bool              active;                   /* a stream is being buffered */
+    bool              ended;                    /* the stream with stream_id has ended */
+    bool              playing;                  /* playout has started */
+    uint8_t           next;                     /* sequence number to play next */
+    uint8_t           highest;                  /* highest sequence number received */
+    uint8_t           concealed;                /* consecutive concealed bursts */
+    uint8_t           starved;                  /* consecutive ticks without buffered bursts */
+    dmr_color_code    color_code;               /* for the EMB of concealed bursts */
+    uint64_t          first_arrival;            /* first burst of the stream, in ns */
+    uint64_t          last_arrival;             /* last in order burst, in ns */
+    uint8_t           last_sequence;
+    uint64_t          jitter;                   /* in ns, scaled by 16 */
+    bool              used[DMR_JITTER_SLOTS];
+    dmr_parsed_packet slot[DMR_JITTER_SLOTS];
+    bool              have_last;
+    dmr_parsed_packet last;                     /* last voice burst played out */
+    dmr_jitter_stats  stats;
+} dmr_jitter_ts;
+
+/** Reorders network voice bursts by sequence number and plays them out at
+ * the burst cadence after an adaptive delay, per timeslot. Gaps in a voice
+ * stream are concealed by repeating the previous burst, or with silence for
+ * longer gaps. All slots are allocated up front. */
+typedef struct {
+    dmr_jitter_ts ts[DMR_TS_INVALID];
+} dmr_jitter;
+
+/** Setup a new jitter buffer. */
+extern dmr_jitter * dmr_jitter_new(void);
+/** Destroy a jitter buffer. */
+extern void dmr_jitter_free(dmr_jitter *jitter);
+/** Copy a received burst into the buffer, now is the arrival time from
+ * dmr_time_monotonic. Late and duplicate bursts are dropped. */
+extern int dmr_jitter_add(dmr_jitter *jitter, dmr_parsed_packet *parsed, uint64_t now);
+/** Copy the burst to play out on ts into parsed_out, call once every
+ * DMR_JITTER_BURST_MS. Returns -1 if there is nothing to play. */
+extern int dmr_jitter_shift(dmr_jitter *jitter, dmr_ts ts, dmr_parsed_packet *parsed_out, uint64_t now);
+/** Copy the playout counters of ts into stats. */
+extern int dmr_jitter_stats_get(dmr_jitter *jitter, dmr_ts ts, dmr_jitter_stats *stats);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif // _DMR_JITTER_H
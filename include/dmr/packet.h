@@ -7,6 +7,7 @@
 #include <dmr/config.h>
 #include <dmr/bits.h>
 #include <dmr/type.h>
+#include <dmr/pool.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -14,6 +15,8 @@ extern "C" {
 
 #define DMR_PACKET_LEN      33
 #define DMR_PACKET_BITS     (DMR_PACKET_LEN * 8)
+/** Info bits in a burst, the 108 bits on either side of the SYNC or EMB. */
+#define DMR_PAYLOAD_BITS    196
 
 typedef enum {
     DMR_TS1 = 0,
@@ -89,6 +92,15 @@ typedef struct {
     uint8_t     data_length;
 } dmr_packet_data_block;
 
+/** Reference counted parsed packet.
+ * Owners sharing a reference must treat the packet as read-only, an owner
+ * that wants to modify it calls dmr_packet_ref_writable to get a private copy
+ * if the packet is shared. */
+typedef struct {
+    dmr_parsed_packet *parsed;
+    size_t            refs;
+} dmr_packet_ref;
+
 typedef int (*dmr_parsed_packet_cb)(dmr_parsed_packet *parsed, void *userdata);
 
 typedef int (*dmr_packet_cb)(dmr_packet packet, void *userdata);
@@ -96,13 +108,32 @@ typedef int (*dmr_packet_cb)(dmr_packet packet, void *userdata);
 extern void                dmr_dump_packet(dmr_packet packet);
 extern void                dmr_dump_parsed_packet(dmr_parsed_packet *packet);
 extern dmr_parsed_packet * dmr_packet_decode(dmr_packet packet);
+extern dmr_parsed_packet * dmr_parsed_packet_new(void);
+extern void                dmr_parsed_packet_free(dmr_parsed_packet *parsed);
+extern dmr_pool *          dmr_parsed_packet_pool(void);
+/** Wrap a parsed packet in a new reference, the reference takes ownership. */
+extern dmr_packet_ref *    dmr_packet_ref_new(dmr_parsed_packet *parsed);
+/** Take another reference. */
+extern dmr_packet_ref *    dmr_packet_ref_get(dmr_packet_ref *ref);
+/** Drop a reference, the packet is released with the last reference. */
+extern void                dmr_packet_ref_put(dmr_packet_ref *ref);
+/** Make the packet private to the reference in *ref, copying it if it is
+ * shared. *ref is replaced by the private reference. */
+extern dmr_parsed_packet * dmr_packet_ref_writable(dmr_packet_ref **ref);
 extern char *              dmr_flco_name(dmr_flco flco);
 extern char *              dmr_ts_name(dmr_ts ts);
 extern char *              dmr_fid_name(dmr_fid fid);
 extern char *              dmr_data_type_name(dmr_data_type data_type);
 extern char *              dmr_data_type_name_short(dmr_data_type data_type);
 extern int                 dmr_payload_bits(dmr_packet packet, void *bits);
+/** Get the 196 info bits of a burst as a packed bit vector. */
+extern int                 dmr_payload_bitvec(dmr_packet packet, dmr_bitvec bits[DMR_BITVEC_WORDS(DMR_PAYLOAD_BITS)]);
+/** Put the 196 info bits of a burst back, the SYNC or EMB is untouched. */
+extern int                 dmr_payload_bitvec_encode(dmr_packet packet, const dmr_bitvec bits[DMR_BITVEC_WORDS(DMR_PAYLOAD_BITS)]);
 extern int                 dmr_slot_type_decode(dmr_packet packet, dmr_color_code *color_code, dmr_data_type *data_type);
+/** Decode the slot type of n bursts, the Golay(20,8) syndromes are
+ * calculated for many bursts at once. */
+extern int                 dmr_slot_type_decode_batch(dmr_packet *packets, size_t n, dmr_color_code *color_code, dmr_data_type *data_type);
 extern int                 dmr_slot_type_encode(dmr_packet packet, dmr_color_code color_code, dmr_data_type data_type);
 
 #ifdef __cplusplus
@@ -1,6 +1,7 @@
 #ifndef _DMR_PACKETQ_H
 #define _DMR_PACKETQ_H
 
+#include <dmr/c.h>
 #include <dmr/packet.h>
 #include <dmr/queue.h>
 
@@ -24,6 +25,51 @@ extern int dmr_packetq_shift(dmr_packetq *q, dmr_parsed_packet **parsed_out);
 extern int dmr_packetq_shift_packet(dmr_packetq *q, dmr_packet packet_out);
 extern int dmr_packetq_foreach(dmr_packetq *q, dmr_parsed_packet_cb cb, void *userdata);
 extern int dmr_packetq_foreach_packet(dmr_packetq *q, dmr_packet_cb cb, void *userdata);
+/** Pool of queue entries for the calling thread. */
+extern dmr_pool *dmr_packetq_entry_pool(void);
+
+/** What to do if a packet ring is full. */
+typedef enum {
+    DMR_PACKETQ_REJECT = 0,         /* refuse the new packet */
+    DMR_PACKETQ_DROP_OLDEST         /* overwrite the oldest packet */
+} dmr_packetq_policy;
+
+/** Bounded single-producer/single-consumer ring of parsed packets.
+ * Packets are copied into preallocated slots, so adding and shifting never
+ * allocates. One thread may add while another thread shifts, without locks. */
+typedef struct {
+    size_t             size;        /* number of slots, a power of 2 */
+    size_t             mask;
+    dmr_packetq_policy policy;
+    dmr_parsed_packet  *slot;
+    /* written by the producer */
+    size_t             head DMR_CACHELINE_ALIGNED;
+    size_t             hwm;         /* high-water mark */
+    size_t             dropped;     /* packets rejected or overwritten */
+    /* written by the consumer, and by the producer when dropping */
+    size_t             tail DMR_CACHELINE_ALIGNED;
+} dmr_packetq_ring;
+
+/** Setup a new packet ring, size is rounded up to a power of 2. */
+extern dmr_packetq_ring * dmr_packetq_ring_new(size_t size, dmr_packetq_policy policy);
+/** Destroy a packet ring. */
+extern void dmr_packetq_ring_free(dmr_packetq_ring *r);
+/** Copy a parsed packet into the ring, producer only. */
+extern int dmr_packetq_ring_add(dmr_packetq_ring *r, dmr_parsed_packet *parsed);
+/** Copy a packet into the ring, producer only. */
+extern int dmr_packetq_ring_add_packet(dmr_packetq_ring *r, dmr_packet packet);
+/** Copy the oldest parsed packet out of the ring, consumer only.
+ * Returns -1 if the ring is empty. */
+extern int dmr_packetq_ring_shift(dmr_packetq_ring *r, dmr_parsed_packet *parsed_out);
+/** Copy the oldest packet out of the ring, consumer only. */
+extern int dmr_packetq_ring_shift_packet(dmr_packetq_ring *r, dmr_packet packet_out);
+/** Iterate over the queued packets without removing them, consumer only.
+ * With DMR_PACKETQ_DROP_OLDEST the producer may overwrite a slot that is
+ * being visited, use shift if that matters. */
+extern int dmr_packetq_ring_foreach(dmr_packetq_ring *r, dmr_parsed_packet_cb cb, void *userdata);
+extern int dmr_packetq_ring_foreach_packet(dmr_packetq_ring *r, dmr_packet_cb cb, void *userdata);
+/** Number of packets in the ring. */
+extern size_t dmr_packetq_ring_len(dmr_packetq_ring *r);
 
 #if defined(__cplusplus)
 }
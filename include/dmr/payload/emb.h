@@ -26,10 +26,29 @@ typedef struct {
 } dmr_emb;
 
 typedef struct {
-    bool bits[72];
-    bool checksum[5];
+    dmr_bitvec bits[DMR_BITVEC_WORDS(77)];  /* 72 bits, 77 when interleaved with the checksum */
+    uint8_t    checksum;                    /* 5 bit checksum */
 } dmr_emb_signalling_lc_bits;
 
+/** Rows in the embedded LC VBPTC(16,11) matrix. */
+#define DMR_EMB_LC_ROWS      8
+/** Number of fragments in an embedded LC, carried by voice bursts B-E. */
+#define DMR_EMB_LC_FRAGMENTS 4
+
+/** Embedded LC reassembly state for one timeslot. */
+typedef struct {
+    uint32_t        stream_id;
+    uint8_t         fragments;                                  /* fragments received in this superframe */
+    dmr_bitvec      matrix[DMR_BITVEC_WORDS(DMR_EMB_LC_ROWS * 16)];
+    dmr_vbptc_16_11 vbptc;                                      /* uses matrix as storage */
+} dmr_emb_lc_slot;
+
+/** Reassembles embedded LC fragments across the voice bursts of a superframe,
+ * per timeslot. The state is preallocated, so it can sit on the hot path. */
+typedef struct {
+    dmr_emb_lc_slot slot[DMR_TS_INVALID];
+} dmr_emb_lc_assembler;
+
 extern int    dmr_emb_decode(dmr_packet packet, dmr_emb *emb);
 extern int    dmr_emb_bytes_decode(dmr_packet packet, uint8_t bytes[4]);
 extern int    dmr_emb_encode(dmr_packet packet, dmr_emb *emb);
@@ -39,5 +58,11 @@ extern char * dmr_emb_lcss_name(dmr_emb_lcss lcss);
 extern dmr_emb_signalling_lc_bits * dmr_emb_signalling_lc_interlave(dmr_emb_signalling_lc_bits *emb_bits);
 extern int    dmr_emb_encode_signalling_lc_from_full_lc(dmr_full_lc *lc, dmr_emb_signalling_lc_bits *emb_bitss, dmr_data_type data_type);
 extern int    dmr_emb_lcss_fragment_encode(dmr_packet packet, dmr_emb *emb, dmr_vbptc_16_11 *vbptc, uint8_t fragment);
+extern void   dmr_emb_lc_assembler_init(dmr_emb_lc_assembler *assembler);
+/** Feed a burst to the assembler. Returns 1 and fills lc when the last
+ * fragment of a superframe completes a valid LC, 0 if no LC is available
+ * (yet) and -1 on error. The state of a timeslot is reset when the
+ * stream changes. */
+extern int    dmr_emb_lc_assembler_add(dmr_emb_lc_assembler *assembler, dmr_parsed_packet *parsed, dmr_full_lc *lc);
 
 #endif // _DMR_PAYLOAD_EMB_H
@@ -48,6 +48,8 @@ typedef struct {
 
 extern uint8_t dmr_crc_mask_lc[DMR_DATA_TYPE_COUNT];
 extern int     dmr_full_lc_decode(dmr_packet packet, dmr_full_lc *lc, dmr_data_type data_type);
+/** Parse the 9 LC bytes, without check data */
+extern int     dmr_full_lc_decode_bytes(const uint8_t bytes[9], dmr_full_lc *lc);
 extern int     dmr_full_lc_encode_bytes(dmr_full_lc *lc, uint8_t bytes[12]);
 /** Insert Link Control message with Reed-Solomon check data */
 extern int     dmr_full_lc_encode(dmr_packet packet, dmr_full_lc *lc, dmr_data_type data_type);
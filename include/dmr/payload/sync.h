@@ -8,6 +8,9 @@
 #include <inttypes.h>
 #include <dmr/packet.h>
 
+/** Number of bits in the SYNC field. */
+#define DMR_SYNC_PATTERN_BITS 48
+
 typedef enum {
     DMR_SYNC_PATTERN_BS_SOURCED_VOICE = 0x00,
     DMR_SYNC_PATTERN_BS_SOURCED_DATA,
@@ -22,6 +25,11 @@ typedef enum {
 } dmr_sync_pattern;
 
 extern dmr_sync_pattern dmr_sync_pattern_decode(dmr_packet packet);
+/** Find the closest SYNC pattern in a single pass over all patterns.
+ * The Hamming distance to the best match is stored in distance (if not NULL),
+ * also when the match is too far off and DMR_SYNC_PATTERN_UNKNOWN is returned,
+ * so it can be used as a link quality metric. */
+extern dmr_sync_pattern dmr_sync_pattern_classify(dmr_packet packet, uint8_t *distance);
 extern int              dmr_sync_pattern_encode(dmr_packet packet, dmr_sync_pattern pattern);
 extern char *           dmr_sync_pattern_name(dmr_sync_pattern sync_pattern);
 
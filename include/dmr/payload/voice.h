@@ -11,16 +11,12 @@
 #define DMR_DECODED_AMBE_FRAME_SAMPLES 160
 
 typedef struct {
-    bool bits[72];
+    dmr_bitvec bits[DMR_BITVEC_WORDS(72)];
 } dmr_voice_frame_t;
 
-typedef union {
-    struct {
-        bool bits[108 * 2];
-    } raw;
-    struct {
-        dmr_voice_frame_t frame[3];
-    } frames;
+/* The three 72 bit AMBE frames in the 216 voice bits of a burst */
+typedef struct {
+    dmr_bitvec bits[DMR_BITVEC_WORDS(108 * 2)];
 } dmr_voice_bits_t;
 
 typedef struct {
@@ -0,0 +1,54 @@
+/**
+ * @file   Fixed size object pools.
+ * @brief  ...
+ * @author Wijnand Modderman-Lenstra PD0MZ
+ */
+#ifndef _DMR_POOL_H
+#define _DMR_POOL_H
+
+#include <stddef.h>
+#include <dmr/c.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+typedef struct {
+    size_t in_use;                  /* objects handed out */
+    size_t peak;                    /* highest in_use seen */
+    size_t misses;                  /* gets that had to allocate */
+    size_t available;               /* objects on the free list */
+} dmr_pool_stats;
+
+/** Pool of fixed size objects.
+ * Objects returned with dmr_pool_put are kept on a free list and handed out
+ * again by dmr_pool_get, so a warmed up pool does not allocate. A pool is not
+ * thread safe, use one pool per thread or per io loop. Objects are regular
+ * talloc chunks, they may be put back into another pool of the same size or
+ * released with dmr_free. */
+typedef struct dmr_pool {
+    size_t         size;            /* object size */
+    size_t         limit;           /* free list size limit, 0 for no limit */
+    void           *head;           /* free list */
+    dmr_pool_stats stats;
+} dmr_pool;
+
+/** Setup a new pool for objects of size bytes and allocate prefill objects. */
+extern dmr_pool *dmr_pool_new(void *parent, size_t size, size_t prefill);
+/** Destroy a pool and all objects on its free list. */
+extern void dmr_pool_free(dmr_pool *pool);
+/** Allocate objects until at least n objects are available. */
+extern int dmr_pool_prefill(dmr_pool *pool, size_t n);
+/** Get a 0-initialized object from the pool. */
+extern void *dmr_pool_get(dmr_pool *pool);
+/** Return an object to the pool. */
+extern void dmr_pool_put(dmr_pool *pool, void *ptr);
+/** Get the pool of size bytes objects for the calling thread, setup on first
+ * use and destroyed when the thread exits. */
+extern dmr_pool *dmr_pool_local(dmr_pool **pool, size_t size);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif // _DMR_POOL_H
@@ -21,6 +21,17 @@ extern "C" {
 
 #define DMR_HOMEBREW_PORT 62030
 
+/** Size of a DMRD frame, and of the header in front of the DMR packet. */
+#define DMR_HOMEBREW_DMRD_LEN   53
+#define DMR_HOMEBREW_DMRD_HEAD  (DMR_HOMEBREW_DMRD_LEN - DMR_PACKET_LEN)
+
+/** Largest frame we receive, RPTC is 306 bytes. */
+#define DMR_HOMEBREW_FRAME_MAX  320
+/** Default number of datagrams received or sent per system call. */
+#define DMR_HOMEBREW_BATCH      32
+/** Upper limit for the batch size. */
+#define DMR_HOMEBREW_BATCH_MAX  256
+
 typedef enum {
     DMR_HOMEBREW_AUTH_NONE = 0,
     DMR_HOMEBREW_AUTH_INIT,
@@ -29,13 +40,38 @@ typedef enum {
     DMR_HOMEBREW_AUTH_FAILED
 } dmr_homebrew_state;
 
+/** Batched I/O counters, use these to tune the batch size. */
+typedef struct {
+    uint64_t rx_batches;            /* receive calls that returned datagrams */
+    uint64_t rx_frames;             /* datagrams received */
+    uint64_t rx_full;               /* receive calls that filled the batch */
+    uint64_t rx_max;                /* largest receive batch */
+    uint64_t tx_batches;            /* send calls that sent datagrams */
+    uint64_t tx_frames;             /* datagrams sent */
+    uint64_t tx_full;               /* send calls that filled the batch */
+    uint64_t tx_max;                /* largest send batch */
+    uint64_t tx_again;              /* flushes postponed by EAGAIN */
+    uint64_t tx_dropped;            /* datagrams dropped on error */
+} dmr_homebrew_stats;
+
+/** Pre-encoded DMRD frame.
+ * The header is encoded once per packet by dmr_homebrew_dmrd_encode, sending
+ * it to a peer only patches the peer specific bits. The DMR packet is
+ * referenced, not copied, so the parsed packet must stay around until the
+ * frame has been sent. */
+typedef struct {
+    uint8_t           head[DMR_HOMEBREW_DMRD_HEAD];
+    dmr_ts            ts;
+    dmr_parsed_packet *parsed;
+} dmr_homebrew_dmrd;
+
 typedef struct {
     char *id; /* identificaiton string */
     struct {
         char           *call;
         dmr_id         repeater_id;
-        uint16_t       rx_freq;
-        uint16_t       tx_freq;
+        uint32_t       rx_freq;   /* in Hz */
+        uint32_t       tx_freq;
         uint8_t        tx_power;
         dmr_color_code color_code;
         double         latitude;
@@ -62,6 +98,12 @@ typedef struct {
     dmr_rawq       *trq;            /* raw frames to be sent */
     struct timeval last_ping;       /* last ping sent */
     struct timeval last_pong;       /* last pong received */
+    void           *ping_timer;     /* ping timer handle */
+    size_t         batch;           /* datagrams per batch, set before adding to the I/O loop */
+    void           *io;             /* I/O loop we're registered with */
+    void           *ring;           /* preallocated batch buffers */
+    bool           tx_pending;      /* write callback registered */
+    dmr_homebrew_stats stats;
 } dmr_homebrew;
 
 /** Setup a new Homebrew instance.
@@ -82,13 +124,28 @@ extern int dmr_homebrew_close(dmr_homebrew *homebrew);
  * destination packet pointer to NULL. */
 extern int dmr_homebrew_read(dmr_homebrew *homebrew, dmr_parsed_packet **parsed_out);
 
+/** Process a frame received from the repeater.
+ * Same as dmr_homebrew_read, for frames received by the caller. */
+extern int dmr_homebrew_process(dmr_homebrew *homebrew, uint8_t *buf, size_t len, dmr_parsed_packet **parsed_out);
+
 /** Send a DMR frame to the repeater. */
 extern int dmr_homebrew_send(dmr_homebrew *homebrew, dmr_parsed_packet *parsed);
 
+/** Encode the DMRD frame for a parsed packet. */
+extern int dmr_homebrew_dmrd_encode(dmr_homebrew_dmrd *dmrd, dmr_parsed_packet *parsed);
+
+/** Replace the repeater ID in an encoded DMRD frame. */
+extern void dmr_homebrew_dmrd_repeater_id(dmr_homebrew_dmrd *dmrd, dmr_id repeater_id);
+
+/** Send an encoded DMRD frame to the repeater. */
+extern int dmr_homebrew_send_dmrd(dmr_homebrew *homebrew, dmr_homebrew_dmrd *dmrd);
+
 /** Send a raw buffer to the repeater. */
 extern int dmr_homebrew_send_buf(dmr_homebrew *homebrew, uint8_t *buf, size_t len);
 
-/** Send a raw packet to the repeater. */
+/** Send a raw packet to the repeater.
+ * When registered with an I/O loop, the packet is queued and the queue is
+ * flushed once per loop iteration. */
 extern int dmr_homebrew_send_raw(dmr_homebrew *homebrew, dmr_raw *raw);
 
 /** Parse a DMRD frame. */
@@ -0,0 +1,119 @@
+/**
+ * @file   Homebrew IPSC protocol master
+ * @brief  This implements the master (server) side of the Homebrew IP Site
+ *         Connect protocol, accepting many repeaters on a single socket.
+ * @author Wijnand Modderman-Lenstra PD0MZ
+ */
+#ifndef _DMR_PROTOCOL_HOMEBREW_MASTER_H
+#define _DMR_PROTOCOL_HOMEBREW_MASTER_H
+
+#include <sys/socket.h>
+#include <dmr/protocol/homebrew.h>
+#include <dmr/queue.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Default limit for the number of peers. */
+#define DMR_HOMEBREW_MASTER_PEERS       1024
+/** Default peer timeout, in seconds. */
+#define DMR_HOMEBREW_MASTER_TIMEOUT     30
+/** Interval between peer timeout sweeps, in seconds. */
+#define DMR_HOMEBREW_MASTER_SWEEP       5
+
+typedef struct dmr_homebrew_peer {
+    uint8_t                            ip[16];     /* IPv6 or IPv4 mapped address */
+    uint16_t                           port;
+    struct sockaddr_storage            addr;
+    socklen_t                          addrlen;
+    dmr_id                             repeater_id;
+    dmr_homebrew_state                 state;
+    uint8_t                            nonce[8];   /* nonce sent to the repeater */
+    char                               call[9];
+    uint32_t                           rx_freq;    /* from the config, in Hz */
+    uint32_t                           tx_freq;
+    uint64_t                           last_seen;  /* monotonic time in ns */
+    DMR_LIST_ENTRY(dmr_homebrew_peer)  hash;       /* address hash chain */
+    DMR_TAILQ_ENTRY(dmr_homebrew_peer) entries;    /* least recently seen first */
+} dmr_homebrew_peer;
+
+DMR_LIST_HEAD(dmr_homebrew_peer_list, dmr_homebrew_peer);
+
+typedef struct dmr_homebrew_master dmr_homebrew_master;
+
+/** Look up the secret for a repeater, return NULL to refuse the login. */
+typedef const char *(*dmr_homebrew_master_secret_cb)(dmr_homebrew_master *master, dmr_id repeater_id, void *userdata);
+
+struct dmr_homebrew_master {
+    char                          *id;          /* identification string */
+    char                          *secret;      /* shared secret for all repeaters */
+    dmr_homebrew_master_secret_cb secret_cb;    /* per repeater secret, overrides secret */
+    void                          *secret_data;
+    size_t                        peers_max;    /* peer limit, 0 for no limit */
+    uint64_t                      timeout;      /* peer timeout in ns */
+    dmr_packetq                   *rxq;         /* packets received from logged in peers */
+    /* private */
+    void                          *sock;
+    uint8_t                       bind_ip[16];
+    uint16_t                      bind_port;
+    struct dmr_homebrew_peer_list *bucket;      /* peers hashed by address */
+    size_t                        buckets;      /* number of buckets, a power of 2 */
+    size_t                        peers;
+    DMR_TAILQ_HEAD(dmr_homebrew_peer_lru, dmr_homebrew_peer) lru; /* all peers, least recently seen first */
+    uint64_t                      nonce_state;
+    void                          *ring;        /* receive buffers for the I/O loop */
+    void                          *io;          /* I/O loop we're registered with */
+    void                          *sweep_timer;
+};
+
+/** Setup a new Homebrew master listening on the bind address. */
+extern dmr_homebrew_master * dmr_homebrew_master_new(uint8_t bind_ip[16], uint16_t bind_port, char *secret);
+
+/** Destroy a Homebrew master, peers are not notified. */
+extern void dmr_homebrew_master_free(dmr_homebrew_master *master);
+
+/** Close the link with all peers. */
+extern int dmr_homebrew_master_close(dmr_homebrew_master *master);
+
+/** Receive and process a single frame, blocks until a frame arrives. */
+extern int dmr_homebrew_master_read(dmr_homebrew_master *master);
+
+/** Process a frame received from addr.
+ * DMR packets from logged in peers are added to the receive queue. */
+extern int dmr_homebrew_master_process(dmr_homebrew_master *master, const struct sockaddr *addr, socklen_t addrlen, uint8_t *buf, size_t len);
+
+/** Find a peer by address. */
+extern dmr_homebrew_peer * dmr_homebrew_master_peer(dmr_homebrew_master *master, const struct sockaddr *addr);
+
+/** Remove peers that have not been seen within the timeout.
+ * Returns the number of peers removed. */
+extern int dmr_homebrew_master_sweep(dmr_homebrew_master *master);
+
+/** Send an encoded DMRD frame to a peer. */
+extern int dmr_homebrew_master_send(dmr_homebrew_master *master, dmr_homebrew_peer *peer, dmr_homebrew_dmrd *dmrd);
+
+/** Send an encoded DMRD frame to all logged in peers, except one.
+ * Returns the number of peers the frame was sent to. */
+extern int dmr_homebrew_master_broadcast(dmr_homebrew_master *master, dmr_homebrew_dmrd *dmrd, dmr_homebrew_peer *except);
+
+#include <dmr/protocol.h>
+
+/** Protocol specification */
+extern dmr_protocol dmr_homebrew_master_protocol;
+
+#if defined(DMR_DEBUG)
+#define DMR_HM_DEBUG(fmt,...) dmr_log_debug("%s: "fmt, master->id, ##__VA_ARGS__)
+#else
+#define DMR_HM_DEBUG(fmt,...)
+#endif
+#define DMR_HM_INFO(fmt,...)  dmr_log_info ("%s: "fmt, master->id, ##__VA_ARGS__)
+#define DMR_HM_WARN(fmt,...)  dmr_log_warn ("%s: "fmt, master->id, ##__VA_ARGS__)
+#define DMR_HM_ERROR(fmt,...) dmr_log_error("%s: "fmt, master->id, ##__VA_ARGS__)
+#define DMR_HM_FATAL(fmt,...) dmr_log_critical("%s: "fmt, master->id, ##__VA_ARGS__)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _DMR_PROTOCOL_HOMEBREW_MASTER_H
@@ -19,10 +19,24 @@ extern "C" {
 
 /** Maximum size of a single MMDVM frame. */
 #define DMR_MMDVM_FRAME_MAX         0xff
+/** Receive ring buffer size, must be a power of two that fits a few frames. */
+#define DMR_MMDVM_RING_SIZE         1024
+#define DMR_MMDVM_RING_MASK         (DMR_MMDVM_RING_SIZE - 1)
 
 /** Default baud rate. */
 #define DMR_MMDVM_BAUD              115200
 
+/** Bursts are released to the modem at the TDMA cadence, one per timeslot
+ * every 60 ms. */
+#define DMR_MMDVM_TX_INTERVAL_MS    60
+/** Default jitter target, bursts are held back this long before a
+ * transmission starts. */
+#define DMR_MMDVM_TX_JITTER_MS      180
+/** Bursts queued per timeslot, the oldest burst is dropped when full. */
+#define DMR_MMDVM_TX_QUEUE          32
+/** Modem status poll interval, this refreshes the free buffer space. */
+#define DMR_MMDVM_STATUS_INTERVAL_MS 250
+
 typedef enum {
     DMR_MMDVM_GET_VERSION   	= 0x00,
     DMR_MMDVM_GET_STATUS    	= 0x01,
@@ -107,6 +121,27 @@ typedef enum {
 
 #define DMR_MMDVM_ACK_BUF_MAX 0xff
 
+/** Receive counters. */
+typedef struct {
+    uint64_t rx_bytes;              /* bytes received from the modem */
+    uint64_t rx_frames;             /* frames deframed */
+    uint64_t rx_resyncs;            /* times we had to hunt for a frame start */
+    uint64_t rx_dropped;            /* bytes skipped while hunting */
+    uint64_t tx_frames;             /* bursts released to the modem */
+    uint64_t tx_underruns;          /* ticks a transmitting timeslot had nothing queued */
+    uint64_t tx_overruns;           /* bursts held back or NAKed, the modem buffer was full */
+    uint64_t tx_dropped;            /* bursts dropped from a full queue */
+} dmr_mmdvm_stats;
+
+/** Transmit scheduler state for one timeslot. */
+typedef struct {
+    dmr_rawq *queue;                /* DMR frames waiting for their turn */
+    bool     active;                /* transmitting, the jitter buffer was primed */
+    uint8_t  wait;                  /* ticks spent priming the jitter buffer */
+    bool     reported;              /* the modem reported its buffer space */
+    uint8_t  space;                 /* free modem buffer slots */
+} dmr_mmdvm_tx_slot;
+
 typedef struct {
     char              *id;               /* ident */
     char              *port;
@@ -131,9 +166,16 @@ typedef struct {
     void              *serial;            /* internal serial struct */
     dmr_packetq       *rxq;               /* packets received from the modem */
     dmr_packetq       *txq;               /* packets to be transmitted by the modem */
-    dmr_mmdvm_frame   frame;              /* raw frame currently being decoded */
+    uint8_t           ring[DMR_MMDVM_RING_SIZE]; /* bytes received from the modem */
+    size_t            ring_rd, ring_wr;   /* free running ring offsets */
+    dmr_mmdvm_frame   frame;              /* frame wrapping around the end of the ring */
     dmr_rawq          *trq;               /* raw frame to be transmitted to the modem */
-    size_t            pos;
+    dmr_mmdvm_tx_slot tx[DMR_TS_INVALID]; /* transmit scheduler per timeslot */
+    unsigned          tx_jitter_ms;       /* jitter target */
+    bool              tx_scheduled;       /* the scheduler timer is running */
+    dmr_io_timer      *tx_timer;          /* transmit scheduler timer */
+    dmr_io_timer      *status_timer;      /* modem status poll timer */
+    dmr_mmdvm_stats   stats;
 } dmr_mmdvm;
 
 
@@ -147,14 +189,25 @@ extern dmr_mmdvm *dmr_mmdvm_new(const char *port, int baud, dmr_mmdvm_model mode
 /** Start serial communications with an MMDVM modem. */
 extern int dmr_mmdvm_start(dmr_mmdvm *mmdvm);
 
-/** Parse an MMDVM frame. */
-extern int dmr_mmdvm_parse_frame(dmr_mmdvm *mmdvm, dmr_mmdvm_frame frame, dmr_parsed_packet **parsed_out);
+/** Parse an MMDVM frame of len bytes.
+ * Frames too short for their command are rejected. */
+extern int dmr_mmdvm_parse_frame(dmr_mmdvm *mmdvm, dmr_mmdvm_frame frame, size_t len, dmr_parsed_packet **parsed_out);
 
 /** Read from the serial line.
  * This also processes communications with the MMDVM modem, if the
  * received frame does not contain a DMR packet, the function will set the
  * destination packet pointer to NULL. */
-extern int dmr_mmdvm_read(dmr_mmdvm *mmdvm, dmr_parsed_packet **packet_out);
+/** Read all available bytes from the modem and queue the DMR packets of
+ * every complete frame. Returns the number of queued packets or -1 on error. */
+extern int dmr_mmdvm_read(dmr_mmdvm *mmdvm, dmr_packetq *q);
+
+/** Append received bytes to the ring buffer, returns the number of bytes
+ * that fit. */
+extern size_t dmr_mmdvm_feed(dmr_mmdvm *mmdvm, const uint8_t *buf, size_t len);
+
+/** Parse every complete frame in the ring buffer and queue the DMR packets.
+ * Returns the number of queued packets or -1 on error. */
+extern int dmr_mmdvm_deframe(dmr_mmdvm *mmdvm, dmr_packetq *q);
 
 /** Send a get status command to the modem.
  * The results will be collected in the modem structure. */
@@ -187,6 +240,12 @@ extern int dmr_mmdvm_send_raw(dmr_mmdvm *mmdvm, dmr_raw *raw);
  * be sent, the function returns immediately */
 extern int dmr_mmdvm_write(dmr_mmdvm *mmdvm);
 
+/** Run the transmit scheduler, call every DMR_MMDVM_TX_INTERVAL_MS.
+ * Moves at most one burst per timeslot (two when falling behind) from the
+ * timeslot queues to the transmit queue, see dmr_mmdvm_write. Returns the
+ * number of released bursts. */
+extern int dmr_mmdvm_tx_tick(dmr_mmdvm *mmdvm);
+
 /** Send a parsed packet to the serial line. */
 extern int dmr_mmdvm_send(dmr_mmdvm *mmdvm, dmr_parsed_packet *parsed);
 
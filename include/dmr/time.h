@@ -12,6 +12,9 @@ extern "C" {
 uint32_t dmr_time_since(struct timeval tv);
 uint32_t dmr_time_ms_since(struct timeval tv);
 
+/** Monotonic clock time in nanoseconds. */
+uint64_t dmr_time_monotonic(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -202,6 +202,7 @@ void dump_homebrew(struct my_ip *ip_hdr, struct my_udpheader *udp, uint8_t *byte
         return;
 
     dump_dmr_packet(packet);
+    dmr_parsed_packet_free(packet);
 }
 
 int main(int argc, char **argv)
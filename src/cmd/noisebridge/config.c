@@ -8,6 +8,7 @@
 #include <dmr/error.h>
 #include <dmr/malloc.h>
 #include "config.h"
+#include "route.h"
 #include "common/byte.h"
 #include "common/format.h"
 #include "common/scan.h"
@@ -117,6 +118,34 @@ int read_config_repeater(char *line, char *filename, size_t lineno)
     return 0;
 }
 
+int read_config_route(char *line, char *filename, size_t lineno)
+{
+    dmr_log_debug("noisebridge: %s[%zu]: (route) %s", filename, lineno, line);
+    if (strlen(line) == 0 || line[0] == '#' || line[0] == ';') {
+        return 0;
+    }
+    if (!strcmp(line, "}")) {
+        dmr_log_debug("noisebridge: %s[%zu]: end of section route", filename, lineno);
+        config->section = read_config;
+        return 0;
+    }
+
+    char *k = NULL, *v = NULL;
+    if (!split(line, "=", &k, &v)) {
+        CONFIG_ERROR("syntax error \"%s\"", line);
+    }
+    if (config->routes >= NOISEBRIDGE_MAX_ROUTES) {
+        CONFIG_ERROR("too many routes, at most %d", NOISEBRIDGE_MAX_ROUTES);
+    }
+
+    route_rule *rule = route_rule_parse(config, k, v);
+    if (rule == NULL) {
+        CONFIG_ERROR("invalid route \"%s\"", k);
+    }
+    config->route[config->routes++] = rule;
+    return 0;
+}
+
 int read_config_dmrid(char *line, char *filename, size_t lineno)
 {
     dmr_log_debug("noisebridge: %s[%zu]: (dmrid) %s", filename, lineno, line);
@@ -284,6 +313,7 @@ int read_config_mmdvm(char *line, char *filename, size_t lineno)
     else CONFIG_INT(proto, "color_code", proto->settings.mmdvm.color_code)
     else CONFIG_INT(proto, "rx_freq", proto->settings.mmdvm.rx_freq)
     else CONFIG_INT(proto, "tx_freq", proto->settings.mmdvm.tx_freq)
+    else CONFIG_INT(proto, "tx_jitter", proto->settings.mmdvm.tx_jitter)
     else if (!strcmp(k, "port")) {
         if (v[0] == '/' || !strcmp(v, "COM")) {
             proto->settings.mmdvm.port = talloc_strdup(proto, v);
@@ -376,6 +406,10 @@ int read_config(char *line, char *filename, size_t lineno)
             dmr_log_debug("noisebridge: %s[%zu]: switch to section repeater", filename, lineno);
             config->section = read_config_repeater;
             return 0;
+        } else if (!strcmp(k, "route")) {
+            dmr_log_debug("noisebridge: %s[%zu]: switch to section route", filename, lineno);
+            config->section = read_config_route;
+            return 0;
         } else if (!strcmp(k, "dmrid")) {
             dmr_log_debug("noisebridge: %s[%zu]: switch to section dmrid", filename, lineno);
             config->section = read_config_dmrid;
@@ -510,6 +544,12 @@ int init_config(char *filename)
     }
     dmr_log_info("noisebridge: configuring %d protos", config->protos);
 
+    if ((ret = route_compile(config)) != 0) {
+        dmr_log_critical("noisebridge: %s: invalid routes", filename);
+        goto bail;
+    }
+    dmr_log_info("noisebridge: configuring %zu routes", config->routes);
+
     goto done;
 
 bail:
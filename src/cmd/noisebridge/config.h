@@ -5,6 +5,7 @@
 #include <lua.h>
 #include <lauxlib.h>
 #include <lualib.h>
+#include <dmr/jitter.h>
 #include <dmr/protocol.h>
 #include <dmr/protocol/homebrew.h>
 #if defined(WITH_MBELIB)
@@ -16,6 +17,7 @@
 #include "common/socket.h"
 
 #define NOISEBRIDGE_MAX_PROTOS 16
+#define NOISEBRIDGE_MAX_ROUTES 64
 
 typedef struct {
     dmr_protocol      protocol;
@@ -23,6 +25,7 @@ typedef struct {
     char              *name;
     void              *instance;
     int               fd;
+    dmr_jitter        *jitter;      /* network voice towards a modem */
     union {
         struct {
             //struct addrinfo *peer_addr;
@@ -53,10 +56,47 @@ typedef struct {
             dmr_color_code  color_code;
             uint32_t        rx_freq;
             uint32_t        tx_freq;
+            unsigned        tx_jitter;
         } mmdvm;
     } settings;
 } proto_t;
 
+typedef enum {
+    ROUTE_RULE_PERMIT = 0x00,
+    ROUTE_RULE_REJECT,
+    ROUTE_RULE_SCRIPT               /* pass the packet to route() in the script */
+} route_action;
+
+/* What a route rule matches on, besides the protos */
+#define ROUTE_MATCH_TS              0x01
+#define ROUTE_MATCH_FLCO            0x02
+#define ROUTE_MATCH_SRC_ID          0x04
+#define ROUTE_MATCH_DST_ID          0x08
+
+/* What a route rule rewrites in permitted packets */
+#define ROUTE_REWRITE_TS            0x01
+#define ROUTE_REWRITE_COLOR_CODE    0x02
+#define ROUTE_REWRITE_REPEATER_ID   0x04
+#define ROUTE_REWRITE_FLCO          0x08    /* script routes only */
+
+typedef struct {
+    char            *name;
+    route_action    action;
+    char            *src_name;      /* NULL matches any proto */
+    char            *dst_name;
+    proto_t         *src;           /* resolved by route_compile */
+    proto_t         *dst;
+    uint8_t         match;
+    dmr_ts          ts;
+    dmr_flco        flco;
+    dmr_id          src_id[2];      /* inclusive range */
+    dmr_id          dst_id[2];
+    uint8_t         rewrite;
+    dmr_ts          set_ts;
+    dmr_color_code  set_color_code;
+    dmr_id          set_repeater_id;
+} route_rule;
+
 typedef int (*parse_section_t)(char *line, char *filename, size_t lineno);
 
 typedef struct {
@@ -75,6 +115,8 @@ typedef struct {
         char     *script;
         uint16_t timeout;
     } repeater;
+    route_rule      *route[NOISEBRIDGE_MAX_ROUTES];
+    size_t          routes;
 } config_t;
 
 #if !defined(HAVE_GETLINE)
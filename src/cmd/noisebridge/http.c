@@ -9,6 +9,7 @@
 #include "http.h"
 #include "http_parser.h"
 #include "repeater.h"
+#include "route.h"
 #if defined(HAVE_FCNTL_H)
 #include <fcntl.h>
 #endif
@@ -452,7 +453,16 @@ static int respond_repeater_config(client_t *client)
         }
         S("    }");
     }
-    S("\n  ]\n}\n");
+    S("\n  ]");
+
+    repeater_t *repeater = load_repeater();
+    if (repeater != NULL && repeater->cache != NULL) {
+        S(",\n  \"route_cache\": {\n");
+        S("    \"hits\": %llu,\n", (unsigned long long)repeater->cache->hits);
+        S("    \"misses\": %llu\n", (unsigned long long)repeater->cache->misses);
+        S("  }");
+    }
+    S("\n}\n");
 #undef S
 
     headers_t *headers = headers_new(NULL);
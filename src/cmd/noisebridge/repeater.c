@@ -4,6 +4,8 @@
 #include <dmr/malloc.h>
 #include <dmr/packet.h>
 #include <dmr/packetq.h>
+#include <dmr/pool.h>
+#include <dmr/time.h>
 #include "common/format.h"
 #include "common/scan.h"
 #include "common/serial.h"
@@ -12,6 +14,11 @@
 #include "http.h"
 #include "script.h"
 #include "repeater.h"
+#include "route.h"
+
+/* Packets and queue entries allocated up front, enough for a couple of
+ * bursts per protocol in flight. */
+#define REPEATER_POOL_PREFILL 64
 
 #if defined(WITH_MBELIB) && defined(HAVE_LIBPORTAUDIO)
 #include <portaudio.h>
@@ -67,10 +74,10 @@ void kill_handler(int sig)
     }
 }
 
-route_policy route(proto_t *src, proto_t *dst, dmr_parsed_packet *parsed)
+/* route_script() may replace *ref with a private copy if the script modifies
+ * the packet, other destinations keep sharing the original. */
+static route_policy route_script(proto_t *src, proto_t *dst, dmr_packet_ref **ref)
 {
-    DMR_UNUSED(repeater);
-
     config_t *config = load_config();
     lua_State *L = config->L;
     route_policy policy = ROUTE_REJECT;
@@ -79,7 +86,7 @@ route_policy route(proto_t *src, proto_t *dst, dmr_parsed_packet *parsed)
     lua_getglobal(L, "route"); /* Call script.lua->route() */
     lua_pass_proto(L, src);
     lua_pass_proto(L, dst);
-    lua_pass_packet(L, parsed);
+    lua_pass_packet(L, (*ref)->parsed);
 
     /* Call route(), 3 arguments, 1 return */
     if (lua_pcall(L, 3, 1, 0) != 0) {
@@ -119,7 +126,13 @@ route_policy route(proto_t *src, proto_t *dst, dmr_parsed_packet *parsed)
 
     // Packet is modified
     if (policy == ROUTE_PERMIT) {
-        lua_modify_packet(L, parsed);
+        dmr_parsed_packet *parsed = dmr_packet_ref_writable(ref);
+        if (parsed == NULL) {
+            dmr_log_error("noisebridge: can't copy packet, out of memory");
+            policy = ROUTE_REJECT;
+        } else {
+            lua_modify_packet(L, parsed);
+        }
     }
 
     lua_pop(L, 1); /* pop returned value from stack */
@@ -141,6 +154,35 @@ bail:
     }
 }
 
+/* route() evaluates the configured route rules in order, the first match
+ * decides. Only rules with the script action call into Lua. Without any
+ * rules configured, every packet is passed to the script. */
+route_policy route(proto_t *src, proto_t *dst, dmr_packet_ref **ref)
+{
+    config_t *config = load_config();
+    if (config->routes == 0)
+        return route_script(src, dst, ref);
+
+    route_rule *rule = route_match(config, src, dst, (*ref)->parsed);
+    if (rule == NULL) {
+        dmr_log_trace("noisebridge: no route %s->%s, reject", src->name, dst->name);
+        return ROUTE_REJECT;
+    }
+    if (rule->action == ROUTE_RULE_SCRIPT)
+        return route_script(src, dst, ref);
+
+    return route_rule_apply(rule, ref);
+}
+
+static void end_io_timer(repeater_slot_t *rts)
+{
+    /* Cancel high resolution slot timeout timer. */
+    if (rts->timer != NULL) {
+        dmr_io_cancel_timer(repeater->io, rts->timer);
+        rts->timer = NULL;
+    }
+}
+
 int slot_timer(dmr_io *io, void *unused)
 {
     DMR_UNUSED(io);
@@ -161,21 +203,19 @@ int slot_timer(dmr_io *io, void *unused)
             dmr_log_info("noisebridge: timeout on %s after %ums",
                 dmr_ts_name(ts), ms);
             rts->state = STATE_IDLE;
+            end_io_timer(rts);
+            route_cache_invalidate(repeater->cache, ts);
         }
     }
 
     return 0;
 }
 
-static void end_io_timer(void)
-{
-    /* Cancel high resolution slot timeout timer. */
-    dmr_io_del_timer(repeater->io, slot_timer);
-}
-
-static void new_io_timer(void)
+static void new_io_timer(repeater_slot_t *rts)
 {
     config_t *config = load_config();
+    if (rts->timer != NULL)
+        return;
 
     /* Timeouts on timeslots */
     struct timeval slottimeout;
@@ -183,7 +223,7 @@ static void new_io_timer(void)
     slottimeout.tv_usec = ((config->repeater.timeout % 1000) * 1000);
 
     /* Register timer */
-    dmr_io_reg_timer(repeater->io, slottimeout, slot_timer, NULL, false);
+    rts->timer = dmr_io_reg_timer(repeater->io, slottimeout, slot_timer, NULL, false);
 }
 
 static void end_voice_call(dmr_parsed_packet *packet, bool kill_timer);
@@ -195,7 +235,7 @@ static void new_data_call(dmr_parsed_packet *parsed)
     if (rts->state == STATE_VOICE_CALL)
         end_voice_call(parsed, false);
     else
-        new_io_timer();
+        new_io_timer(rts);
 
     rts->state = STATE_DATA_CALL;
 
@@ -215,7 +255,7 @@ static void end_data_call(dmr_parsed_packet *parsed, bool kill_timer)
     rts->state = STATE_IDLE;
 
     if (kill_timer)
-        end_io_timer();
+        end_io_timer(rts);
 
     const char *src_name = dmr_id_name(parsed->src_id);
     const char *dst_name = dmr_id_name(parsed->dst_id);
@@ -233,9 +273,10 @@ static void new_voice_call(dmr_parsed_packet *parsed)
     if (rts->state == STATE_DATA_CALL)
         end_data_call(parsed, false);
     else
-        new_io_timer();
+        new_io_timer(rts);
 
     rts->state = STATE_VOICE_CALL;
+    route_cache_invalidate(repeater->cache, ts);
 
     const char *src_name = dmr_id_name(parsed->src_id);
     const char *dst_name = dmr_id_name(parsed->dst_id);
@@ -253,7 +294,7 @@ static void end_voice_call(dmr_parsed_packet *parsed, bool kill_timer)
     rts->state = STATE_IDLE;
 
     if (kill_timer)
-        end_io_timer();
+        end_io_timer(rts);
 
     const char *src_name = dmr_id_name(parsed->src_id);
     const char *dst_name = dmr_id_name(parsed->dst_id);
@@ -264,10 +305,42 @@ static void end_voice_call(dmr_parsed_packet *parsed, bool kill_timer)
         parsed->flco, parsed->repeater_id);
 }
 
-int push_proto(proto_t *src, dmr_parsed_packet *parsed)
+/* late_entry identifies a voice call that started without a voice LC header,
+ * from the embedded LC spread over the bursts of a superframe. Once known, the
+ * ids are filled in on voice bursts that don't carry them. */
+static void late_entry(repeater_slot_t *rts, dmr_parsed_packet *parsed)
+{
+    if (rts->src_id == 0 && rts->dst_id == 0) {
+        dmr_full_lc lc;
+        if (dmr_emb_lc_assembler_add(&repeater->emb_lc, parsed, &lc) != 1)
+            return;
+
+        rts->src_id = lc.src_id;
+        rts->dst_id = lc.dst_id;
+        /* routes cached so far were decided without the ids */
+        route_cache_invalidate(repeater->cache, parsed->ts);
+
+        const char *src_name = dmr_id_name(rts->src_id);
+        const char *dst_name = dmr_id_name(rts->dst_id);
+        dmr_log_info("noisebridge: late entry on %s from %u(%s) to %u(%s), flco=%u",
+            dmr_ts_name(parsed->ts),
+            rts->src_id, src_name == NULL ? "?" : src_name,
+            rts->dst_id, dst_name == NULL ? "?" : dst_name,
+            lc.flco_pdu);
+    }
+
+    if (parsed->src_id == 0 && parsed->dst_id == 0) {
+        parsed->src_id = rts->src_id;
+        parsed->dst_id = rts->dst_id;
+    }
+}
+
+int push_proto(proto_t *src, dmr_packet_ref *shared)
 {
     DMR_ERROR_IF_NULL(src, DMR_EINVAL);
-    DMR_ERROR_IF_NULL(parsed, DMR_EINVAL);
+    DMR_ERROR_IF_NULL(shared, DMR_EINVAL);
+
+    dmr_parsed_packet *parsed = shared->parsed;
 
     dmr_log_debug("noisebridge: pushing parsed packet");
 
@@ -351,6 +424,29 @@ int push_proto(proto_t *src, dmr_parsed_packet *parsed)
         break;
     }
 
+    if (rts->state == STATE_VOICE_CALL && parsed->data_type == DMR_DATA_TYPE_VOICE)
+        late_entry(rts, parsed);
+
+    /* the bursts of a voice stream reuse the route verdict cached for the
+     * stream, the voice LC header always runs route() and refreshes it */
+    bool cached = false;
+    switch (parsed->data_type) {
+    case DMR_DATA_TYPE_VOICE_SYNC:
+    case DMR_DATA_TYPE_VOICE:
+        cached = rts->state == STATE_VOICE_CALL;
+        break;
+    case DMR_DATA_TYPE_TERMINATOR_WITH_LC:
+        cached = true;
+        break;
+    default:
+        break;
+    }
+
+    /* the DMRD frame for unmodified packets is encoded once for all
+     * Homebrew destinations */
+    dmr_homebrew_dmrd dmrd;
+    bool dmrd_encoded = false;
+
     config_t *config = load_config();
     size_t i;
     for (i = 0; i < config->protos; i++) {
@@ -358,27 +454,41 @@ int push_proto(proto_t *src, dmr_parsed_packet *parsed)
         if (src == dst)
             continue;
 
-
-        dmr_parsed_packet *cloned = dmr_malloc(dmr_parsed_packet);
-        if (cloned == 0) {
-            dmr_log_error("noisebridge: can't clone packet, out of memory");
-            return dmr_error(DMR_ENOMEM);
-        }
-        byte_copy(cloned, parsed, sizeof(dmr_parsed_packet));
-
+        /* every destination shares the packet until its route modifies it */
+        dmr_packet_ref *ref = dmr_packet_ref_get(shared);
+        route_policy policy;
         int ret = 0;
-        switch (route(src, dst, cloned)) {
+        if (!cached || route_cache_lookup(repeater->cache, src, dst, &ref, &policy) != 0) {
+            policy = route(src, dst, &ref);
+            if (rts->state == STATE_VOICE_CALL && (cached || parsed->data_type == DMR_DATA_TYPE_VOICE_LC))
+                route_cache_store(repeater->cache, src, dst, parsed, ref->parsed, policy);
+        }
+        switch (policy) {
         case ROUTE_PERMIT:
         case ROUTE_PERMIT_UNMODIFIED:
             switch (dst->type) {
             case DMR_PROTOCOL_HOMEBREW: {
                     dmr_homebrew *homebrew = (dmr_homebrew *)dst->instance;
-                    ret = dmr_homebrew_send(homebrew, cloned);
+                    if (ref != shared) {
+                        ret = dmr_homebrew_send(homebrew, ref->parsed);
+                        break;
+                    }
+                    if (!dmrd_encoded) {
+                        dmr_homebrew_dmrd_encode(&dmrd, parsed);
+                        dmrd_encoded = true;
+                    }
+                    ret = dmr_homebrew_send_dmrd(homebrew, &dmrd);
                     break;
                 }                  
             case DMR_PROTOCOL_MMDVM: {
                     dmr_mmdvm *mmdvm = (dmr_mmdvm *)dst->instance;
-                    ret = dmr_mmdvm_send(mmdvm, cloned);
+                    /* network bursts are reordered and paced by the jitter
+                     * buffer, see playout_jitter */
+                    if (src->type == DMR_PROTOCOL_HOMEBREW && dst->jitter != NULL) {
+                        ret = dmr_jitter_add(dst->jitter, ref->parsed, dmr_time_monotonic());
+                        break;
+                    }
+                    ret = dmr_mmdvm_send(mmdvm, ref->parsed);
                     break;
                 }
             default:
@@ -395,11 +505,29 @@ int push_proto(proto_t *src, dmr_parsed_packet *parsed)
             dmr_log_error("noisebridge: send to %s failed: %s",
                 dst->name, dmr_error_get());
         }
+        dmr_packet_ref_put(ref);
     }
 
+    if (parsed->data_type == DMR_DATA_TYPE_TERMINATOR_WITH_LC)
+        route_cache_invalidate(repeater->cache, ts);
+
     return 0;
 }
 
+/* push_parsed hands a received packet to push_proto and releases it. */
+static int push_parsed(proto_t *src, dmr_parsed_packet *parsed)
+{
+    dmr_packet_ref *ref = dmr_packet_ref_new(parsed);
+    if (ref == NULL) {
+        dmr_parsed_packet_free(parsed);
+        return dmr_error(DMR_ENOMEM);
+    }
+
+    int ret = push_proto(src, ref);
+    dmr_packet_ref_put(ref);
+    return ret;
+}
+
 /* poll_* is triggered after a proto becomes readable and checks the received
  * parsed packet queue for new frames. */
 
@@ -424,7 +552,7 @@ int poll_proto_homebrew(dmr_io *io, void *homebrewptr, int fd)
                 dmr_packetq_shift(homebrew->rxq, &parsed);
                 if (parsed == NULL)
                     break;
-                push_proto(proto, parsed);
+                push_parsed(proto, parsed);
             }
         }
     }
@@ -466,7 +594,7 @@ int poll_proto_mmdvm(dmr_io *io, void *mmdvmptr, int fd)
         dmr_packetq_shift(mmdvm->rxq, &parsed);
         if (parsed == NULL)
             break;
-        push_proto(src, parsed);
+        push_parsed(src, parsed);
     }
     
     dmr_log_debug("noisebridge: poll after mmdvm read relayed %lu packets", i);
@@ -516,6 +644,30 @@ bail:
     return ret;
 }
 
+/* playout_jitter releases the network voice buffered for a modem, one burst
+ * per timeslot at the burst cadence. */
+static int playout_jitter(dmr_io *io, void *protoptr)
+{
+    DMR_UNUSED(io);
+    DMR_ERROR_IF_NULL(protoptr, DMR_EINVAL);
+
+    proto_t *proto = (proto_t *)protoptr;
+    dmr_mmdvm *mmdvm = (dmr_mmdvm *)proto->instance;
+    uint64_t now = dmr_time_monotonic();
+    dmr_parsed_packet parsed;
+    dmr_ts ts;
+    for (ts = 0; ts < DMR_TS_INVALID; ts++) {
+        if (dmr_jitter_shift(proto->jitter, ts, &parsed, now) != 0)
+            continue;
+        if (dmr_mmdvm_send(mmdvm, &parsed) != 0) {
+            dmr_log_error("noisebridge: send to %s failed: %s",
+                proto->name, dmr_error_get());
+        }
+    }
+
+    return 0;
+}
+
 int init_proto_mmdvm(config_t *config, proto_t *proto)
 {
     DMR_UNUSED(config);
@@ -532,14 +684,18 @@ int init_proto_mmdvm(config_t *config, proto_t *proto)
         proto->settings.mmdvm.model,
         proto->settings.mmdvm.color_code);
 
-    mmdvm->rx_freq = proto->settings.mmdvm.rx_freq;
-    mmdvm->tx_freq = proto->settings.mmdvm.tx_freq;
-
     if (mmdvm == NULL) {
         dmr_log_critical("repeater: mmdvm open failed: %s", dmr_error_get());
         return dmr_error(DMR_LASTERROR);
     }
 
+    mmdvm->rx_freq = proto->settings.mmdvm.rx_freq;
+    mmdvm->tx_freq = proto->settings.mmdvm.tx_freq;
+    if (proto->settings.mmdvm.tx_jitter != 0)
+        mmdvm->tx_jitter_ms = proto->settings.mmdvm.tx_jitter;
+    else /* the network delay is absorbed by the jitter buffer */
+        mmdvm->tx_jitter_ms = DMR_MMDVM_TX_INTERVAL_MS;
+
     serial_t *serial = (serial_t *)mmdvm->serial;
     proto->protocol  = dmr_mmdvm_protocol;
     proto->instance  = mmdvm;
@@ -548,6 +704,15 @@ int init_proto_mmdvm(config_t *config, proto_t *proto)
     /* Listen in on received packets */
     dmr_io_reg_read(repeater->io, proto->fd, poll_proto_mmdvm, mmdvm, false); 
 
+    /* Play out network voice through a jitter buffer */
+    if ((proto->jitter = dmr_jitter_new()) == NULL) {
+        dmr_log_critical("noisebridge: out of memory");
+        return DMR_OOM();
+    }
+    struct timeval playout = { 0, DMR_JITTER_BURST_MS * 1000 };
+    if (dmr_io_reg_timer(repeater->io, playout, playout_jitter, proto, false) == NULL)
+        return dmr_error(DMR_LASTERROR);
+
     return ret;
 }
 
@@ -569,11 +734,20 @@ int init_repeater(void)
         ret = DMR_OOM();
         goto bail;
     }
-    if ((repeater->io = dmr_io_new()) == NULL) {
+    if ((repeater->io = dmr_io_new()) == NULL ||
+        (repeater->cache = route_cache_new(repeater)) == NULL) {
         dmr_log_critical("noisebridge: out of memory");
         ret = DMR_OOM();
         goto bail;
     }
+    dmr_emb_lc_assembler_init(&repeater->emb_lc);
+
+    /* Fill the packet pools, so the packet path does not allocate */
+    if ((ret = dmr_pool_prefill(dmr_parsed_packet_pool(), REPEATER_POOL_PREFILL)) != 0 ||
+        (ret = dmr_pool_prefill(dmr_packetq_entry_pool(), REPEATER_POOL_PREFILL)) != 0) {
+        dmr_log_critical("noisebridge: out of memory");
+        goto bail;
+    }
 
     /* Close repeater on SIGINT (^C) */
     dmr_io_reg_signal(repeater->io, SIGINT, stop_repeater, NULL, true);
@@ -653,9 +827,35 @@ int loop_repeater(void)
     dmr_log_info("noisebridge: stopping repeater");
     stop_http();
 
+    dmr_pool *pool = dmr_parsed_packet_pool();
+    if (pool != NULL) {
+        dmr_log_info("noisebridge: packet pool: %lu in use, %lu peak, %lu misses",
+            pool->stats.in_use, pool->stats.peak, pool->stats.misses);
+    }
+    dmr_log_info("noisebridge: route cache: %llu hits, %llu misses",
+        (unsigned long long)repeater->cache->hits,
+        (unsigned long long)repeater->cache->misses);
+
     size_t i;
     for (i = 0; i < config->protos; i++) {
         proto_t *proto = config->proto[i];
+        if (proto->jitter != NULL) {
+            dmr_jitter_stats stats;
+            dmr_ts ts;
+            for (ts = 0; ts < DMR_TS_INVALID; ts++) {
+                dmr_jitter_stats_get(proto->jitter, ts, &stats);
+                dmr_log_info("noisebridge: %s jitter buffer %s: %llu played, %llu late, %llu lost, %llu reordered, %llu concealed, %ums delay",
+                    proto->name, dmr_ts_name(ts),
+                    (unsigned long long)stats.played,
+                    (unsigned long long)stats.late,
+                    (unsigned long long)stats.lost,
+                    (unsigned long long)stats.reordered,
+                    (unsigned long long)stats.concealed,
+                    stats.delay_ms);
+            }
+            dmr_jitter_free(proto->jitter);
+            proto->jitter = NULL;
+        }
         if (proto->instance == NULL)
             continue;
 
@@ -3,6 +3,7 @@
 
 #include <dmr/io.h>
 #include <dmr/protocol.h>
+#include <dmr/payload/emb.h>
 
 typedef enum {
     ROUTE_REJECT = 0x00,
@@ -24,15 +25,20 @@ typedef struct {
     slot_state     state;
     uint32_t       stream_id;
     struct timeval last_frame_received;
+    dmr_io_timer   *timer;
 } repeater_slot_t;
 
+typedef struct route_cache route_cache;
+
 typedef struct {
-    repeater_slot_t ts[2];
-    dmr_color_code  color_code;
-    dmr_io          *io;
+    repeater_slot_t      ts[2];
+    dmr_color_code       color_code;
+    dmr_io               *io;
+    route_cache          *cache;
+    dmr_emb_lc_assembler emb_lc;    /* late entry, ids from the embedded LC */
 } repeater_t;
 
-typedef route_policy (*repeater_route)(repeater_t *, proto_t *, proto_t *, dmr_parsed_packet *);
+typedef route_policy (*repeater_route)(repeater_t *, proto_t *, proto_t *, dmr_packet_ref **);
 
 repeater_t *load_repeater(void);
 int init_repeater(void);
@@ -0,0 +1,327 @@
+#include <stdlib.h>
+#include <string.h>
+#include <talloc.h>
+#include <dmr/error.h>
+#include <dmr/log.h>
+#include "route.h"
+
+static const char *route_rule_syntax = "<permit|reject|script> <src proto|*> <dst proto|*> [key=value ...]";
+
+static bool parse_ts(char *v, dmr_ts *ts)
+{
+    if (!strcmp(v, "1")) {
+        *ts = DMR_TS1;
+        return true;
+    }
+    if (!strcmp(v, "2")) {
+        *ts = DMR_TS2;
+        return true;
+    }
+    return false;
+}
+
+static bool parse_id(char *v, dmr_id *id)
+{
+    char *end;
+    unsigned long n = strtoul(v, &end, 10);
+    if (end == v || *end != '\0' || n > 0xffffffffUL)
+        return false;
+    *id = (dmr_id)n;
+    return true;
+}
+
+/* Parse <id> or <id>-<id> */
+static bool parse_id_range(char *v, dmr_id range[2])
+{
+    char *hi = strchr(v, '-');
+    if (hi != NULL)
+        *hi++ = '\0';
+    if (!parse_id(v, &range[0]))
+        return false;
+    if (hi == NULL) {
+        range[1] = range[0];
+        return true;
+    }
+    return parse_id(hi, &range[1]) && range[0] <= range[1];
+}
+
+route_rule *route_rule_parse(void *ctx, char *name, char *line)
+{
+    if (name == NULL || line == NULL) {
+        dmr_error(DMR_EINVAL);
+        return NULL;
+    }
+
+    route_rule *rule = talloc_zero(ctx, route_rule);
+    if (rule == NULL) {
+        dmr_error(DMR_ENOMEM);
+        return NULL;
+    }
+    rule->name = talloc_strdup(rule, name);
+
+    char *rest = NULL, *part;
+    if ((part = strtok_r(line, " \t", &rest)) == NULL) {
+        dmr_log_critical("noisebridge: route[%s]: missing action", name);
+        goto bail;
+    }
+    if (!strcmp(part, "permit")) {
+        rule->action = ROUTE_RULE_PERMIT;
+    } else if (!strcmp(part, "reject")) {
+        rule->action = ROUTE_RULE_REJECT;
+    } else if (!strcmp(part, "script")) {
+        rule->action = ROUTE_RULE_SCRIPT;
+    } else {
+        dmr_log_critical("noisebridge: route[%s]: invalid action \"%s\"", name, part);
+        goto bail;
+    }
+
+    if ((part = strtok_r(NULL, " \t", &rest)) == NULL) {
+        dmr_log_critical("noisebridge: route[%s]: missing src proto", name);
+        goto bail;
+    }
+    if (strcmp(part, "*"))
+        rule->src_name = talloc_strdup(rule, part);
+
+    if ((part = strtok_r(NULL, " \t", &rest)) == NULL) {
+        dmr_log_critical("noisebridge: route[%s]: missing dst proto", name);
+        goto bail;
+    }
+    if (strcmp(part, "*"))
+        rule->dst_name = talloc_strdup(rule, part);
+
+    while ((part = strtok_r(NULL, " \t", &rest)) != NULL) {
+        char *v = strchr(part, '=');
+        if (v == NULL) {
+            dmr_log_critical("noisebridge: route[%s]: expected key=value, got \"%s\"", name, part);
+            goto bail;
+        }
+        *v++ = '\0';
+
+        bool ok = true;
+        if (!strcmp(part, "ts")) {
+            rule->match |= ROUTE_MATCH_TS;
+            ok = parse_ts(v, &rule->ts);
+        } else if (!strcmp(part, "flco")) {
+            rule->match |= ROUTE_MATCH_FLCO;
+            if (!strcmp(v, "group")) {
+                rule->flco = DMR_FLCO_GROUP;
+            } else if (!strcmp(v, "private")) {
+                rule->flco = DMR_FLCO_PRIVATE;
+            } else {
+                ok = false;
+            }
+        } else if (!strcmp(part, "src_id")) {
+            rule->match |= ROUTE_MATCH_SRC_ID;
+            ok = parse_id_range(v, rule->src_id);
+        } else if (!strcmp(part, "dst_id")) {
+            rule->match |= ROUTE_MATCH_DST_ID;
+            ok = parse_id_range(v, rule->dst_id);
+        } else if (!strcmp(part, "set_ts")) {
+            rule->rewrite |= ROUTE_REWRITE_TS;
+            ok = parse_ts(v, &rule->set_ts);
+        } else if (!strcmp(part, "set_cc")) {
+            rule->rewrite |= ROUTE_REWRITE_COLOR_CODE;
+            dmr_id cc;
+            ok = parse_id(v, &cc) && cc <= 15;
+            rule->set_color_code = (dmr_color_code)cc;
+        } else if (!strcmp(part, "set_repeater_id")) {
+            rule->rewrite |= ROUTE_REWRITE_REPEATER_ID;
+            ok = parse_id(v, &rule->set_repeater_id);
+        } else {
+            dmr_log_critical("noisebridge: route[%s]: unknown key \"%s\"", name, part);
+            goto bail;
+        }
+        if (!ok) {
+            dmr_log_critical("noisebridge: route[%s]: invalid %s \"%s\"", name, part, v);
+            goto bail;
+        }
+    }
+
+    if (rule->rewrite != 0 && rule->action != ROUTE_RULE_PERMIT) {
+        dmr_log_critical("noisebridge: route[%s]: only permit rules can rewrite", name);
+        goto bail;
+    }
+
+    dmr_log_debug("noisebridge: route[%s]: action=%u, proto=%s->%s, match=%#02x, rewrite=%#02x",
+        rule->name, rule->action,
+        rule->src_name == NULL ? "*" : rule->src_name,
+        rule->dst_name == NULL ? "*" : rule->dst_name,
+        rule->match, rule->rewrite);
+    return rule;
+
+bail:
+    dmr_log_critical("noisebridge: expected %s", route_rule_syntax);
+    talloc_free(rule);
+    dmr_error(DMR_EINVAL);
+    return NULL;
+}
+
+static proto_t *route_find_proto(config_t *config, const char *name)
+{
+    size_t i;
+    for (i = 0; i < config->protos; i++) {
+        if (config->proto[i]->name != NULL && !strcmp(config->proto[i]->name, name))
+            return config->proto[i];
+    }
+    return NULL;
+}
+
+int route_compile(config_t *config)
+{
+    DMR_ERROR_IF_NULL(config, DMR_EINVAL);
+
+    size_t i;
+    for (i = 0; i < config->routes; i++) {
+        route_rule *rule = config->route[i];
+        if (rule->src_name != NULL && (rule->src = route_find_proto(config, rule->src_name)) == NULL) {
+            dmr_log_critical("noisebridge: route[%s]: unknown proto \"%s\"", rule->name, rule->src_name);
+            return dmr_error(DMR_EINVAL);
+        }
+        if (rule->dst_name != NULL && (rule->dst = route_find_proto(config, rule->dst_name)) == NULL) {
+            dmr_log_critical("noisebridge: route[%s]: unknown proto \"%s\"", rule->name, rule->dst_name);
+            return dmr_error(DMR_EINVAL);
+        }
+    }
+
+    return 0;
+}
+
+route_rule *route_match(config_t *config, proto_t *src, proto_t *dst, dmr_parsed_packet *parsed)
+{
+    size_t i;
+    for (i = 0; i < config->routes; i++) {
+        route_rule *rule = config->route[i];
+        if (rule->src != NULL && rule->src != src)
+            continue;
+        if (rule->dst != NULL && rule->dst != dst)
+            continue;
+        if ((rule->match & ROUTE_MATCH_TS) && parsed->ts != rule->ts)
+            continue;
+        if ((rule->match & ROUTE_MATCH_FLCO) && parsed->flco != rule->flco)
+            continue;
+        if ((rule->match & ROUTE_MATCH_SRC_ID) &&
+            (parsed->src_id < rule->src_id[0] || parsed->src_id > rule->src_id[1]))
+            continue;
+        if ((rule->match & ROUTE_MATCH_DST_ID) &&
+            (parsed->dst_id < rule->dst_id[0] || parsed->dst_id > rule->dst_id[1]))
+            continue;
+
+        dmr_log_trace("noisebridge: route[%s]: match %s->%s", rule->name, src->name, dst->name);
+        return rule;
+    }
+
+    return NULL;
+}
+
+route_policy route_rule_apply(route_rule *rule, dmr_packet_ref **ref)
+{
+    if (rule->action != ROUTE_RULE_PERMIT)
+        return ROUTE_REJECT;
+
+    /* only copy the packet if the rewrite changes anything */
+    dmr_parsed_packet *parsed = (*ref)->parsed;
+    if (!((rule->rewrite & ROUTE_REWRITE_TS) && parsed->ts != rule->set_ts) &&
+        !((rule->rewrite & ROUTE_REWRITE_COLOR_CODE) && parsed->color_code != rule->set_color_code) &&
+        !((rule->rewrite & ROUTE_REWRITE_REPEATER_ID) && parsed->repeater_id != rule->set_repeater_id))
+        return ROUTE_PERMIT_UNMODIFIED;
+
+    if ((parsed = dmr_packet_ref_writable(ref)) == NULL) {
+        dmr_log_error("noisebridge: can't copy packet, out of memory");
+        return ROUTE_REJECT;
+    }
+    if (rule->rewrite & ROUTE_REWRITE_TS)
+        parsed->ts = rule->set_ts;
+    if (rule->rewrite & ROUTE_REWRITE_COLOR_CODE)
+        parsed->color_code = rule->set_color_code;
+    if (rule->rewrite & ROUTE_REWRITE_REPEATER_ID)
+        parsed->repeater_id = rule->set_repeater_id;
+
+    return ROUTE_PERMIT;
+}
+
+route_cache *route_cache_new(void *ctx)
+{
+    route_cache *cache = talloc_zero(ctx, route_cache);
+    if (cache == NULL)
+        dmr_error(DMR_ENOMEM);
+    return cache;
+}
+
+static route_cache_entry *route_cache_slot(route_cache *cache, uint32_t stream_id, proto_t *src, proto_t *dst)
+{
+    uint32_t hash = stream_id * 2654435761U;
+    hash ^= (uint32_t)((uintptr_t)src >> 4) * 31;
+    hash ^= (uint32_t)((uintptr_t)dst >> 4);
+    return &cache->entry[(hash ^ (hash >> 16)) & (ROUTE_CACHE_SIZE - 1)];
+}
+
+int route_cache_lookup(route_cache *cache, proto_t *src, proto_t *dst, dmr_packet_ref **ref, route_policy *policy)
+{
+    dmr_parsed_packet *parsed = (*ref)->parsed;
+    route_cache_entry *entry = route_cache_slot(cache, parsed->stream_id, src, dst);
+    if (entry->dst != dst || entry->src != src || entry->stream_id != parsed->stream_id) {
+        cache->misses++;
+        return -1;
+    }
+    cache->hits++;
+
+    *policy = entry->policy;
+    if (entry->policy == ROUTE_REJECT || entry->rewrite == 0)
+        return 0;
+
+    if ((parsed = dmr_packet_ref_writable(ref)) == NULL) {
+        dmr_log_error("noisebridge: can't copy packet, out of memory");
+        *policy = ROUTE_REJECT;
+        return 0;
+    }
+    if (entry->rewrite & ROUTE_REWRITE_TS)
+        parsed->ts = entry->set_ts;
+    if (entry->rewrite & ROUTE_REWRITE_FLCO)
+        parsed->flco = entry->set_flco;
+    if (entry->rewrite & ROUTE_REWRITE_COLOR_CODE)
+        parsed->color_code = entry->set_color_code;
+    if (entry->rewrite & ROUTE_REWRITE_REPEATER_ID)
+        parsed->repeater_id = entry->set_repeater_id;
+    return 0;
+}
+
+void route_cache_store(route_cache *cache, proto_t *src, proto_t *dst, dmr_parsed_packet *in, dmr_parsed_packet *out, route_policy policy)
+{
+    route_cache_entry *entry = route_cache_slot(cache, in->stream_id, src, dst);
+    entry->stream_id = in->stream_id;
+    entry->src = src;
+    entry->dst = dst;
+    entry->ts = in->ts;
+    entry->policy = policy;
+    entry->rewrite = 0;
+    if (policy != ROUTE_PERMIT)
+        return;
+
+    if (out->ts != in->ts) {
+        entry->rewrite |= ROUTE_REWRITE_TS;
+        entry->set_ts = out->ts;
+    }
+    if (out->flco != in->flco) {
+        entry->rewrite |= ROUTE_REWRITE_FLCO;
+        entry->set_flco = out->flco;
+    }
+    if (out->color_code != in->color_code) {
+        entry->rewrite |= ROUTE_REWRITE_COLOR_CODE;
+        entry->set_color_code = out->color_code;
+    }
+    if (out->repeater_id != in->repeater_id) {
+        entry->rewrite |= ROUTE_REWRITE_REPEATER_ID;
+        entry->set_repeater_id = out->repeater_id;
+    }
+    if (entry->rewrite == 0)
+        entry->policy = ROUTE_PERMIT_UNMODIFIED;
+}
+
+void route_cache_invalidate(route_cache *cache, dmr_ts ts)
+{
+    size_t i;
+    for (i = 0; i < ROUTE_CACHE_SIZE; i++) {
+        if (cache->entry[i].dst != NULL && cache->entry[i].ts == ts)
+            cache->entry[i].dst = NULL;
+    }
+}
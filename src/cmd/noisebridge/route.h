@@ -0,0 +1,53 @@
+#ifndef _NOISEBRIDGE_ROUTE_H
+#define _NOISEBRIDGE_ROUTE_H
+
+#include <dmr/packet.h>
+#include "config.h"
+#include "repeater.h"
+
+/* Parse a route rule, name = <action> <src proto> <dst proto> [key=value ...] */
+route_rule *route_rule_parse(void *ctx, char *name, char *line);
+/* Resolve the proto names in the route rules, after all protos are configured */
+int route_compile(config_t *config);
+/* First rule that matches the packet, or NULL */
+route_rule *route_match(config_t *config, proto_t *src, proto_t *dst, dmr_parsed_packet *parsed);
+/* Apply a permit or reject rule, may replace *ref with a private copy */
+route_policy route_rule_apply(route_rule *rule, dmr_packet_ref **ref);
+
+/* Route cache slots, a power of 2 */
+#define ROUTE_CACHE_SIZE 64
+
+/* Route verdict and rewrite for the bursts of one stream to one destination */
+typedef struct {
+    uint32_t        stream_id;
+    proto_t         *src;
+    proto_t         *dst;           /* NULL if the slot is unused */
+    dmr_ts          ts;             /* timeslot the stream was received on */
+    route_policy    policy;
+    uint8_t         rewrite;        /* ROUTE_REWRITE_* fields the route changed */
+    dmr_ts          set_ts;
+    dmr_flco        set_flco;
+    dmr_color_code  set_color_code;
+    dmr_id          set_repeater_id;
+} route_cache_entry;
+
+/* Direct mapped cache of route verdicts, keyed by stream id and protos.
+ * Within a stream the fields routes decide on do not change, so the voice
+ * bursts following the header reuse its verdict without running route(). */
+struct route_cache {
+    route_cache_entry entry[ROUTE_CACHE_SIZE];
+    uint64_t          hits;
+    uint64_t          misses;
+};
+
+route_cache *route_cache_new(void *ctx);
+/* Apply the cached verdict, may replace *ref with a private copy. Returns -1
+ * if the stream has no verdict for dst. */
+int route_cache_lookup(route_cache *cache, proto_t *src, proto_t *dst, dmr_packet_ref **ref, route_policy *policy);
+/* Remember the verdict for a stream, the rewrite is the difference between
+ * the packet before (in) and after (out) routing. */
+void route_cache_store(route_cache *cache, proto_t *src, proto_t *dst, dmr_parsed_packet *in, dmr_parsed_packet *out, route_policy policy);
+/* Forget the verdicts for all streams on ts */
+void route_cache_invalidate(route_cache *cache, dmr_ts ts);
+
+#endif // _NOISEBRIDGE_ROUTE_H
@@ -52,6 +52,105 @@ void dmr_bytes_to_bits(uint8_t *bytes, size_t bytes_length, bool *bits, size_t b
         dmr_byte_to_bits(bytes[i], &bits[i * 8]);
 }
 
+void dmr_bitvec_zero(dmr_bitvec *v, size_t n)
+{
+    memset(v, 0, DMR_BITVEC_WORDS(n) * sizeof(dmr_bitvec));
+}
+
+void dmr_bitvec_from_bytes(dmr_bitvec *v, const uint8_t *bytes, size_t len)
+{
+    size_t i;
+    dmr_bitvec_zero(v, len * 8);
+    for (i = 0; i < len; i++) {
+        v[i >> 3] |= (uint64_t)bytes[i] << (56 - ((i & 7) << 3));
+    }
+}
+
+void dmr_bitvec_to_bytes(const dmr_bitvec *v, uint8_t *bytes, size_t len)
+{
+    size_t i;
+    for (i = 0; i < len; i++) {
+        bytes[i] = v[i >> 3] >> (56 - ((i & 7) << 3));
+    }
+}
+
+uint64_t dmr_bitvec_extract(const dmr_bitvec *v, size_t offset, uint8_t len)
+{
+    size_t word = offset >> 6, bit = offset & 63;
+    uint64_t value;
+
+    if (len == 0)
+        return 0;
+
+    /* Left align the bits at offset, pulling in the next word if needed */
+    value = v[word] << bit;
+    if (bit + len > 64)
+        value |= v[word + 1] >> (64 - bit);
+    return value >> (64 - len);
+}
+
+void dmr_bitvec_insert(dmr_bitvec *v, size_t offset, uint8_t len, uint64_t value)
+{
+    size_t word = offset >> 6, bit = offset & 63;
+    uint64_t mask;
+
+    if (len == 0)
+        return;
+
+    mask = len == 64 ? ~0ULL : ((1ULL << len) - 1);
+    value &= mask;
+
+    /* Left align the value, then split it over the words it covers */
+    mask <<= 64 - len;
+    value <<= 64 - len;
+    v[word] = (v[word] & ~(mask >> bit)) | (value >> bit);
+    if (bit + len > 64) {
+        v[word + 1] = (v[word + 1] & ~(mask << (64 - bit))) | (value << (64 - bit));
+    }
+}
+
+void dmr_bitvec_copy(dmr_bitvec *dst, size_t dst_offset, const dmr_bitvec *src, size_t src_offset, size_t len)
+{
+    while (len > 0) {
+        uint8_t n = len > 64 ? 64 : len;
+        dmr_bitvec_insert(dst, dst_offset, n, dmr_bitvec_extract(src, src_offset, n));
+        dst_offset += n;
+        src_offset += n;
+        len -= n;
+    }
+}
+
+void dmr_bitvec_deinterleave(dmr_bitvec *dst, const dmr_bitvec *src, const uint8_t *schedule, size_t n)
+{
+    size_t i;
+    dmr_bitvec_zero(dst, n);
+    for (i = 0; i < n; i++) {
+        dst[i >> 6] |= (uint64_t)dmr_bitvec_get(src, schedule[i]) << (63 - (i & 63));
+    }
+}
+
+void dmr_bitvec_interleave(dmr_bitvec *dst, const dmr_bitvec *src, const uint8_t *schedule, size_t n)
+{
+    size_t i;
+    dmr_bitvec_zero(dst, n);
+    for (i = 0; i < n; i++) {
+        if (dmr_bitvec_get(src, i))
+            dmr_bitvec_flip(dst, schedule[i]);
+    }
+}
+
+size_t dmr_bitvec_popcount(const dmr_bitvec *v, size_t n)
+{
+    size_t i, count = 0;
+    for (i = 0; i < n >> 6; i++) {
+        count += __builtin_popcountll(v[i]);
+    }
+    if (n & 63) {
+        count += __builtin_popcountll(v[i] >> (64 - (n & 63)));
+    }
+    return count;
+}
+
 void _dmr_dump_hex(void *mem, size_t len, const char *file, size_t line)
 {
     size_t i, j;
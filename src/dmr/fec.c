@@ -3,5 +3,5 @@
 
 int dmr_fec_init(void)
 {
-	return 0;
+	return dmr_hamming_init();
 }
@@ -6,6 +6,25 @@
 #include "dmr/fec/bptc_196_96.h"
 #include "dmr/fec/hamming.h"
 
+/* Deinterleaving schedule, bit i of the matrix is bit (i + 1) * 181 % 196
+ * of the info bits. */
+static const uint8_t bptc_196_96_schedule[196] = {
+	181, 166, 151, 136, 121, 106,  91,  76,  61,  46,  31,  16,   1, 182,
+	167, 152, 137, 122, 107,  92,  77,  62,  47,  32,  17,   2, 183, 168,
+	153, 138, 123, 108,  93,  78,  63,  48,  33,  18,   3, 184, 169, 154,
+	139, 124, 109,  94,  79,  64,  49,  34,  19,   4, 185, 170, 155, 140,
+	125, 110,  95,  80,  65,  50,  35,  20,   5, 186, 171, 156, 141, 126,
+	111,  96,  81,  66,  51,  36,  21,   6, 187, 172, 157, 142, 127, 112,
+	 97,  82,  67,  52,  37,  22,   7, 188, 173, 158, 143, 128, 113,  98,
+	 83,  68,  53,  38,  23,   8, 189, 174, 159, 144, 129, 114,  99,  84,
+	 69,  54,  39,  24,   9, 190, 175, 160, 145, 130, 115, 100,  85,  70,
+	 55,  40,  25,  10, 191, 176, 161, 146, 131, 116, 101,  86,  71,  56,
+	 41,  26,  11, 192, 177, 162, 147, 132, 117, 102,  87,  72,  57,  42,
+	 27,  12, 193, 178, 163, 148, 133, 118, 103,  88,  73,  58,  43,  28,
+	 13, 194, 179, 164, 149, 134, 119, 104,  89,  74,  59,  44,  29,  14,
+	195, 180, 165, 150, 135, 120, 105,  90,  75,  60,  45,  30,  15,   0
+};
+
 #if defined(DMR_DEBUG_BPTC)
 static void bptc_196_96_dump(dmr_bptc_196_96 *bptc)
 {
@@ -30,7 +49,7 @@ static void bptc_196_96_dump(dmr_bptc_196_96 *bptc)
 				printf(" | ");
 			}
 			// +1 because the first bit is R(3) and it's not used
-			if (bptc->deinterleaved_bits[(row * 15) + col /* + 1 */]) {
+			if (dmr_bitvec_get(bptc->deinterleaved_bits, (row * 15) + col /* + 1 */)) {
 				printf(" 1 ");
 			} else {
 				printf(" 0 ");
@@ -45,122 +64,175 @@ static void bptc_196_96_dump(dmr_bptc_196_96 *bptc)
 }
 #endif // DMR_DEBUG
 
+/* The matrix is kept as 13 rows of 15 bits, column 0 in the most significant
+ * bit. Each of the 15 columns is a Hamming(13,9,3) codeword, each row is a
+ * Hamming(15,11,3) codeword; this includes the column parity rows 9 to 12,
+ * because both codes are linear. */
+#define BPTC_ROWS	13
+#define BPTC_COLS	15
+#define BPTC_COL_BIT(col)	(1U << (BPTC_COLS - 1 - (col)))
+
+static void bptc_196_96_rows_load(uint16_t rows[BPTC_ROWS], const dmr_bitvec *raw)
+{
+	uint8_t i, row = 0, col = 0;
+	memset(rows, 0, BPTC_ROWS * sizeof(uint16_t));
+	for (i = 0; i < BPTC_ROWS * BPTC_COLS; i++) {
+		if (dmr_bitvec_get(raw, bptc_196_96_schedule[i]))
+			rows[row] |= BPTC_COL_BIT(col);
+		if (++col == BPTC_COLS) {
+			col = 0;
+			row++;
+		}
+	}
+}
+
+static void bptc_196_96_rows_store(dmr_bitvec *bits, const uint16_t rows[BPTC_ROWS])
+{
+	uint8_t row;
+	dmr_bitvec_zero(bits, 196);
+	for (row = 0; row < BPTC_ROWS; row++) {
+		dmr_bitvec_insert(bits, row * BPTC_COLS, BPTC_COLS, rows[row]);
+	}
+}
+
+static uint32_t bptc_196_96_col(const uint16_t rows[BPTC_ROWS], uint8_t col, uint8_t nrows)
+{
+	uint8_t row;
+	uint32_t word = 0;
+	for (row = 0; row < nrows; row++) {
+		word = (word << 1) | ((rows[row] & BPTC_COL_BIT(col)) != 0);
+	}
+	return word;
+}
+
+/* Run the row and column codes, returns the number of bits repaired and sets
+ * failed if any codeword could not be repaired. */
+static int bptc_196_96_pass(uint16_t rows[BPTC_ROWS], bool *failed)
+{
+	uint8_t row, col;
+	uint32_t word, diff;
+	int ret, repaired = 0;
+
+	*failed = false;
+	for (row = 0; row < BPTC_ROWS; row++) {
+		word = rows[row];
+		if ((ret = dmr_hamming_15_11_3_decode_word(&word)) < 0) {
+			*failed = true;
+		} else if (ret > 0) {
+			rows[row] = word;
+			repaired += ret;
+		}
+	}
+	for (col = 0; col < BPTC_COLS; col++) {
+		word = bptc_196_96_col(rows, col, BPTC_ROWS);
+		diff = word;
+		if ((ret = dmr_hamming_13_9_3_decode_word(&word)) < 0) {
+			*failed = true;
+		} else if (ret > 0) {
+			diff ^= word;
+			rows[BPTC_ROWS - 1 - __builtin_ctz(diff)] ^= BPTC_COL_BIT(col);
+			repaired += ret;
+		}
+	}
+	return repaired;
+}
+
 int dmr_bptc_196_96_decode(dmr_packet packet, dmr_bptc_196_96 *bptc, uint8_t data[12])
 {
 	if (bptc == NULL || packet == NULL || data == NULL)
 		return dmr_error(DMR_EINVAL);
 
 	dmr_log_trace("BPTC(196,96): decode");
-	uint8_t row, col, i;
-	bool bits[DMR_PACKET_BITS], data_bits[96];
-
-	dmr_bytes_to_bits(packet, DMR_PACKET_LEN, bits, DMR_PACKET_BITS);
-	memcpy(bptc->raw +  0, bits +   0, 98);
-	memcpy(bptc->raw + 98, bits + 166, 98);
-	//dmr_dump_hex(packet->payload, 96/8);
-	//dmr_dump_hex(bptc->raw, 196);
-
-	// Deinterleaver
-	for (i = 1; i < 197; i++) {
-		bptc->deinterleaved_bits[i - 1] = bptc->raw[(i * 181) % 196];
+	uint16_t rows[BPTC_ROWS];
+	uint8_t row, pass;
+	int repaired;
+	bool failed = false;
+	dmr_bitvec data_bits[DMR_BITVEC_WORDS(96)];
+
+	dmr_payload_bitvec(packet, bptc->raw);
+	bptc_196_96_rows_load(rows, bptc->raw);
+
+	// Repairs in one direction can make a codeword in the other direction
+	// repairable, so keep going while bits are repaired.
+	bptc->repaired = 0;
+	for (pass = 0; pass < DMR_BPTC_196_96_PASSES; pass++) {
+		repaired = bptc_196_96_pass(rows, &failed);
+		bptc->repaired += repaired;
+		if (repaired == 0)
+			break;
 	}
 
+	bptc_196_96_rows_store(bptc->deinterleaved_bits, rows);
 #if defined(DMR_DEBUG_BPTC)
 	bptc_196_96_dump(bptc);
 #endif
-
-	for (col = 0; col < 15; col++) {
-		bool data[13];
-		for (row = 0; row < 13; row++) {
-			data[row] = bptc->deinterleaved_bits[(row * 15) + 1];
-		}
-		if (!dmr_hamming_13_9_3_decode(data)) {
-			return -1;
-		}
-		for (row = 0; row < 13; row++) {
-			bptc->deinterleaved_bits[(row * 15) + 1] = data[row];
-		}
+	if (failed || repaired > 0) {
+		return dmr_error_set("BPTC(196,96): can't repair data, %u bits repaired", bptc->repaired);
 	}
-
-	for (row = 0; row < 9; row++) {
-		bool data[15];
-		for (col = 0; col < 15; col++) {
-			data[col] = bptc->deinterleaved_bits[(row * 15) + col];
-		}
-		if (!dmr_hamming_15_11_3_decode(data)) {
-			return -1;
-		}
-		for (col = 0; col < 11; col++) {
-			bptc->deinterleaved_bits[(row * 15) + col] = data[col];
-		}
+	if (bptc->repaired > 0) {
+		dmr_log_debug("BPTC(196,96): repaired %u bits", bptc->repaired);
 	}
 
-	for (col = 3, i = 0; col < 11; col++, i++) {
-		data_bits[i] = bptc->deinterleaved_bits[(0 * 15) + col];
-	}
+	// Row 0 starts with R(3) to R(1), which are not used
+	dmr_bitvec_zero(data_bits, 96);
+	dmr_bitvec_insert(data_bits, 0, 8, rows[0] >> 4);
 	for (row = 1; row < 9; row++) {
-		for (col = 0; col < 11; col++, i++) {
-			//dmr_log_trace("copy bit %u to %u", (row * 15) + col, i);
-			data_bits[i] = bptc->deinterleaved_bits[(row * 15) + col];
-		}
+		dmr_bitvec_insert(data_bits, 8 + (row - 1) * 11, 11, rows[row] >> 4);
 	}
 
-	dmr_bits_to_bytes(data_bits, 96, data, 12);
+	dmr_bitvec_to_bytes(data_bits, data, 12);
 	return 0;
 }
 
+int dmr_bptc_196_96_decode_batch(dmr_packet *packets, size_t n, uint8_t (*data)[12], int *ret)
+{
+	if (packets == NULL || data == NULL || ret == NULL)
+		return dmr_error(DMR_EINVAL);
+
+	dmr_bptc_196_96 bptc;
+	size_t i;
+	int failed = 0;
+	for (i = 0; i < n; i++) {
+		if ((ret[i] = dmr_bptc_196_96_decode(packets[i], &bptc, data[i])) != 0)
+			failed++;
+	}
+	return failed;
+}
+
 int dmr_bptc_196_96_encode(dmr_packet packet, dmr_bptc_196_96 *bptc, uint8_t data[12])
 {
 	if (bptc == NULL || packet == NULL || data == NULL)
 		return dmr_error(DMR_EINVAL);
 
 	dmr_log_trace("BPTC(196,96): encode");
-	uint8_t row, col, i;
-	bool data_bits[96], bits[DMR_PACKET_BITS], hc[15];
-
-	dmr_bytes_to_bits(data, 12, data_bits, 96);
-	memset(bptc->deinterleaved_bits, 0, sizeof(bptc->deinterleaved_bits));
+	uint16_t rows[BPTC_ROWS];
+	uint8_t row, col;
+	uint32_t word;
+	dmr_bitvec data_bits[DMR_BITVEC_WORDS(96)];
 
-	i = 0;
-	for (row = 0; row < 9; row++) {
-		memset(hc, 0, 15);
-		if (row == 0) {
-			for (col = 3; col < 11; col++) {
-				hc[col] = bptc->deinterleaved_bits[col] = data_bits[i++];
-			}
-		} else {
-			for (col = 0; col < 11; col++) {
-				hc[col] = bptc->deinterleaved_bits[(row * 15) + col] = data_bits[i++];
-			}
-		}
-		dmr_hamming_15_11_3_encode(hc);
-		for (col = 11; col < 15; col++) {
-			bptc->deinterleaved_bits[(row * 15) + col] = hc[col];
-		}
+	dmr_bitvec_from_bytes(data_bits, data, 12);
+	memset(rows, 0, sizeof(rows));
+	rows[0] = dmr_hamming_15_11_3_encode_word(dmr_bitvec_extract(data_bits, 0, 8));
+	for (row = 1; row < 9; row++) {
+		rows[row] = dmr_hamming_15_11_3_encode_word(dmr_bitvec_extract(data_bits, 8 + (row - 1) * 11, 11));
 	}
-	for (col = 0; col < 15; col++) {
-		for (row = 0; row < 9; row++) {
-			hc[row] = bptc->deinterleaved_bits[(row * 15) + col];
+	for (col = 0; col < BPTC_COLS; col++) {
+		word = dmr_hamming_13_9_3_encode_word(bptc_196_96_col(rows, col, 9));
+		for (row = 9; row < BPTC_ROWS; row++) {
+			if (word & (1U << (BPTC_ROWS - 1 - row)))
+				rows[row] |= BPTC_COL_BIT(col);
 		}
-		dmr_hamming_13_9_3_encode(hc);
-		bptc->deinterleaved_bits[col + 135] = hc[9];
-		bptc->deinterleaved_bits[col + 135 + 15] = hc[10];
-		bptc->deinterleaved_bits[col + 135 + 30] = hc[11];
-		bptc->deinterleaved_bits[col + 135 + 45] = hc[12];
 	}
 
+	bptc_196_96_rows_store(bptc->deinterleaved_bits, rows);
+	bptc->repaired = 0;
 #if defined(DMR_DEBUG_BPTC)
 	bptc_196_96_dump(bptc);
 #endif
 
 	// Interleaver
-	for (i = 1; i < 197; i++) {
-		bptc->raw[(i * 181) % 196] = bptc->deinterleaved_bits[i - 1];
-	}
-
-	memcpy(bits +   0, bptc->raw +  0, 98);
-	memcpy(bits + 166, bptc->raw + 98, 98);
-	dmr_bits_to_bytes(bits, DMR_PACKET_BITS, packet, DMR_PACKET_LEN);
+	dmr_bitvec_interleave(bptc->raw, bptc->deinterleaved_bits, bptc_196_96_schedule, 196);
+	dmr_payload_bitvec_encode(packet, bptc->raw);
 
 	return 0;
 }
@@ -1,3 +1,7 @@
+#include "dmr/config.h"
+#if defined(DMR_HAVE_SSE2) || defined(DMR_HAVE_AVX2)
+#include <immintrin.h>
+#endif
 #include "dmr/fec/golay_20_8.h"
 #include "dmr/log.h"
 
@@ -231,7 +235,7 @@ uint32_t dmr_golay_20_8_syndrome(uint32_t pattern)
 
 uint8_t dmr_golay_20_8_decode(uint8_t data[3])
 {
-    uint32_t code = (data[0] << 11) | (data[1] << 3) | (data[2] >> 5);
+    uint32_t code = DMR_GOLAY_20_8_CODE(data);
     uint32_t syndrome = dmr_golay_20_8_syndrome(code);
     uint32_t pattern = golay_20_8_decoder[syndrome];
     dmr_log_trace("Golay(20,8): decode %#04x", code);
@@ -250,3 +254,95 @@ void dmr_golay_20_8_encode(uint8_t data[3])
     data[1] = checksum;
     data[2] = checksum >> 8;
 }
+
+/* The syndrome is the codeword modulo g(x), so it is the sum of x^j mod g(x)
+ * over the set bits j of the codeword. */
+static const uint32_t golay_20_8_syndrome_column[20] = {
+    0x001, 0x002, 0x004, 0x008, 0x010, 0x020, 0x040, 0x080, 0x100, 0x200,
+    0x400, 0x475, 0x49f, 0x54b, 0x6e3, 0x1b3, 0x366, 0x6cc, 0x1ed, 0x3da
+};
+
+static void golay_20_8_syndromes_scalar(const uint32_t *code, uint32_t *syndrome, size_t n)
+{
+    size_t i;
+    uint8_t j;
+    for (i = 0; i < n; i++) {
+        syndrome[i] = 0;
+        for (j = 0; j < 20; j++) {
+            syndrome[i] ^= golay_20_8_syndrome_column[j] & -((code[i] >> j) & 1);
+        }
+    }
+}
+
+#if defined(DMR_HAVE_SSE2)
+__attribute__((target("sse2")))
+static size_t golay_20_8_syndromes_sse2(const uint32_t *code, uint32_t *syndrome, size_t n)
+{
+    size_t i;
+    uint8_t j;
+    __m128i c, s, mask;
+    for (i = 0; i + 4 <= n; i += 4) {
+        c = _mm_loadu_si128((const __m128i *)(code + i));
+        s = _mm_setzero_si128();
+        for (j = 0; j < 20; j++) {
+            /* Move bit j to the sign bit and spread it over the lane */
+            mask = _mm_srai_epi32(_mm_slli_epi32(c, 31 - j), 31);
+            s = _mm_xor_si128(s, _mm_and_si128(mask, _mm_set1_epi32(golay_20_8_syndrome_column[j])));
+        }
+        _mm_storeu_si128((__m128i *)(syndrome + i), s);
+    }
+    return i;
+}
+#endif
+
+#if defined(DMR_HAVE_AVX2)
+__attribute__((target("avx2")))
+static size_t golay_20_8_syndromes_avx2(const uint32_t *code, uint32_t *syndrome, size_t n)
+{
+    size_t i;
+    uint8_t j;
+    __m256i c, s, mask;
+    for (i = 0; i + 8 <= n; i += 8) {
+        c = _mm256_loadu_si256((const __m256i *)(code + i));
+        s = _mm256_setzero_si256();
+        for (j = 0; j < 20; j++) {
+            mask = _mm256_srai_epi32(_mm256_slli_epi32(c, 31 - j), 31);
+            s = _mm256_xor_si256(s, _mm256_and_si256(mask, _mm256_set1_epi32(golay_20_8_syndrome_column[j])));
+        }
+        _mm256_storeu_si256((__m256i *)(syndrome + i), s);
+    }
+    return i;
+}
+#endif
+
+void dmr_golay_20_8_syndromes(const uint32_t *code, uint32_t *syndrome, size_t n)
+{
+    size_t done = 0;
+#if defined(DMR_HAVE_AVX2)
+    if (__builtin_cpu_supports("avx2"))
+        done = golay_20_8_syndromes_avx2(code, syndrome, n);
+    else
+#endif
+#if defined(DMR_HAVE_SSE2)
+    if (__builtin_cpu_supports("sse2"))
+        done = golay_20_8_syndromes_sse2(code, syndrome, n);
+#endif
+    golay_20_8_syndromes_scalar(code + done, syndrome + done, n - done);
+}
+
+void dmr_golay_20_8_decode_batch(const uint32_t *code, uint8_t *data, size_t n)
+{
+    size_t i;
+    uint32_t syndrome[DMR_GOLAY_20_8_BATCH];
+
+    while (n > 0) {
+        size_t len = n < DMR_GOLAY_20_8_BATCH ? n : DMR_GOLAY_20_8_BATCH;
+        dmr_golay_20_8_syndromes(code, syndrome, len);
+        for (i = 0; i < len; i++) {
+            data[i] = (code[i] ^ golay_20_8_decoder[syndrome[i]]) >> 11;
+        }
+        code += len;
+        data += len;
+        n -= len;
+    }
+}
@@ -1,13 +1,20 @@
 #include <inttypes.h>
+#include <string.h>
 #include "dmr/fec/hamming.h"
 #include "dmr/bits.h"
 #include "dmr/log.h"
+#include "dmr/thread.h"
 
 typedef struct {
 	uint8_t n; 		/* block length */
 	uint8_t k; 		/* message length */
 	uint8_t d; 		/* distance */
 	uint8_t p;  	/* parity bits */
+	uint32_t h[5];	/* parity check masks on the packed codeword */
+	/* lookup tables, filled by hamming_init */
+	uint8_t parity_lo[256];	/* parity of the low 8 data bits */
+	uint8_t parity_hi[16];	/* parity of the data bits above those */
+	uint8_t error[32];	/* syndrome to error bit + 1, 0 if it can't be repaired */
 	uint8_t g[]; 	/* generator matrix */
 } hamming_t;
 
@@ -15,6 +22,7 @@ static hamming_t hamming_7_4_3 = {
 	.n = 7,
 	.k = 4,
 	.d = 3,
+	.h = { 0x00074, 0x0003a, 0x00069 },
 	.g = {
 		0x05, // 0b101
 		0x07, // 0b111
@@ -30,6 +38,7 @@ static hamming_t hamming_13_9_3 = {
 	.n = 13,
 	.k = 9,
 	.d = 3,
+	.h = { 0x01ac8, 0x01d64, 0x01eb2, 0x01591 },
 	.g = {
 		0x0f, // 0b1111
 		0x0e, // 0b1110
@@ -51,6 +60,7 @@ static hamming_t hamming_15_11_3 = {
 	.n = 15,
 	.k = 11,
 	.d = 3,
+	.h = { 0x07ac8, 0x03d64, 0x01eb2, 0x07591 },
 	.g = {
 		0x09, // 0b1001
 		0x0d, // 0b1101
@@ -74,6 +84,7 @@ static hamming_t hamming_16_11_4 = {
 	.n = 16,
 	.k = 11,
 	.d = 4,
+	.h = { 0x0f590, 0x07ac8, 0x03d64, 0x0eb22, 0x0a6e1 },
 	.g = {
 		0x13, // 0b10011
 		0x1a, // 0b11010
@@ -98,6 +109,7 @@ static hamming_t hamming_17_12_3 = {
 	.n = 17,
 	.k = 12,
 	.d = 3,
+	.h = { 0x1e690, 0x1f348, 0x0f9a4, 0x19a42, 0x1cd21 },
 	.g = {
 		0x1b, // 0b11011
 		0x1f, // 0b11111
@@ -119,59 +131,134 @@ static hamming_t hamming_17_12_3 = {
 	}
 };
 
-static void hamming_parity(hamming_t *h, bool *d, bool *p)
+/* Packed codewords hold the first bit in the most significant position, the
+ * n - k parity bits are in the least significant bits. Parity check x covers
+ * the bits in h[x], so the syndrome is a popcount per parity bit. */
+static uint8_t hamming_syndrome(hamming_t *h, uint32_t word)
 {
-	uint8_t x, y, b = h->n - h->k;
+	uint8_t x, b = h->n - h->k, s = 0;
 	for (x = 0; x < b; x++) {
-		p[x] = 0;
-		for (y = 0; y < h->k; y++) {
-			if (h->g[y] & (1 << (b - x - 1))) {
-				p[x] ^= d[y];
-			}
-		}
+		s = (s << 1) | (__builtin_popcount(word & h->h[x]) & 1);
 	}
+	return s;
 }
 
-static bool hamming_parity_check(hamming_t *h, bool *d)
+/* The parity bits are linear in the data bits, so the parity of a data word
+ * is the XOR of the parity of its low byte and the bits above it. */
+static void hamming_build(hamming_t *h)
 {
-	uint8_t i, pos = 0, b = h->n - h->k, err = 0;
-	bool p[b];
-	hamming_parity(h, d, p);
-
-check_again:
-	for (i = 0; i < b; i++) {
-		if (d[i + h->k] != p[i]) {
-			pos |= (1 << i);
-		}
+	uint8_t b = h->n - h->k;
+	uint16_t i;
+
+	for (i = 0; i < 256; i++) {
+		h->parity_lo[i] = hamming_syndrome(h, (uint32_t)(i & ((1U << h->k) - 1)) << b);
+	}
+	for (i = 0; i < 16; i++) {
+		h->parity_hi[i] = h->k > 8 ? hamming_syndrome(h, (uint32_t)i << (8 + b)) : 0;
 	}
-	if (pos == 0) {
-		return true;
+
+	// A single bit error gives the generator matrix row of that bit
+	memset(h->error, 0, sizeof(h->error));
+	for (i = 0; i < h->n; i++) {
+		h->error[h->g[i]] = i + 1;
 	}
+}
+
+static dmr_once_flag hamming_once = DMR_ONCE_FLAG_INIT;
+
+static void hamming_init_once(void)
+{
+	hamming_build(&hamming_7_4_3);
+	hamming_build(&hamming_13_9_3);
+	hamming_build(&hamming_15_11_3);
+	hamming_build(&hamming_16_11_4);
+	hamming_build(&hamming_17_12_3);
+}
 
-	// Check in our generator matrix what bit position this is for. Our parity
-	// error position is 1-indexed, while our generator matrix is 0-indexed.
-	pos = h->g[pos - 1];
-	dmr_log_debug("Hamming(%u,%u,%u): parity error at bit %u",
-		h->n, h->k, h->d, pos);
+int dmr_hamming_init(void)
+{
+	dmr_call_once(&hamming_once, hamming_init_once);
+	return 0;
+}
+
+static inline uint8_t hamming_parity(hamming_t *h, uint32_t data)
+{
+	return h->parity_lo[data & 0xff] ^ h->parity_hi[(data >> 8) & 0x0f];
+}
+
+static uint32_t hamming_encode_word(hamming_t *h, uint32_t data)
+{
+	uint8_t b = h->n - h->k;
+	data &= (1UL << h->k) - 1;
+	return (data << b) | hamming_parity(h, data);
+}
 
-	// Keep trying until we hit our max distance
-	if (++err < h->d) {
-		goto check_again;
+static int hamming_decode_word(hamming_t *h, uint32_t *word)
+{
+	uint8_t b = h->n - h->k, s, pos;
+
+	s = hamming_parity(h, *word >> b) ^ (*word & ((1U << b) - 1));
+	if (s == 0) {
+		return 0;
+	}
+	if ((pos = h->error[s]) == 0) {
+		return -1;
+	}
+	*word ^= 1UL << (h->n - pos);
+	return 1;
+}
+
+static uint32_t hamming_pack(bool *d, uint8_t len)
+{
+	uint8_t i;
+	uint32_t word = 0;
+	for (i = 0; i < len; i++) {
+		word = (word << 1) | (d[i] ? 1 : 0);
+	}
+	return word;
+}
+
+static void hamming_unpack(hamming_t *h, uint32_t word, bool *d)
+{
+	uint8_t i;
+	for (i = 0; i < h->n; i++) {
+		d[i] = (word >> (h->n - 1 - i)) & 1;
 	}
-	dmr_log_error("Hamming(%u,%u,%u): repair failed after %u attempts",
-		h->n, h->k, h->d, err);
-	return false;
 }
 
 #define HAMMING_CODE_DMR_NAME(b,fn) dmr_##b##_##fn
 #define HAMMING_CODE(b,_s) 			bool HAMMING_CODE_DMR_NAME(b, decode)(bool d[_s]) { \
 	dmr_log_trace("Hamming(%u,%u,%u): parity check", b.n, b.k, b.d); \
-	return hamming_parity_check(&b, d); \
+	uint32_t word = hamming_pack(d, b.n); \
+	dmr_hamming_init(); \
+	switch (hamming_decode_word(&b, &word)) { \
+	case 0: \
+		return true; \
+	case 1: \
+		dmr_log_debug("Hamming(%u,%u,%u): repaired bit error", b.n, b.k, b.d); \
+		hamming_unpack(&b, word, d); \
+		return true; \
+	default: \
+		dmr_log_error("Hamming(%u,%u,%u): uncorrectable error", b.n, b.k, b.d); \
+		return false; \
+	} \
 } \
 \
 void HAMMING_CODE_DMR_NAME(b, encode)(bool d[_s]) { \
 	dmr_log_trace("Hamming(%u,%u,%u): encode", b.n, b.k, b.d); \
-	return hamming_parity(&b, d, d + b.k); \
+	dmr_hamming_init(); \
+	uint32_t word = hamming_encode_word(&b, hamming_pack(d, b.k)); \
+	hamming_unpack(&b, word, d); \
+} \
+\
+uint32_t HAMMING_CODE_DMR_NAME(b, encode_word)(uint32_t data) { \
+	dmr_hamming_init(); \
+	return hamming_encode_word(&b, data); \
+} \
+\
+int HAMMING_CODE_DMR_NAME(b, decode_word)(uint32_t *word) { \
+	dmr_hamming_init(); \
+	return hamming_decode_word(&b, word); \
 }
 
 HAMMING_CODE(hamming_7_4_3, 7);
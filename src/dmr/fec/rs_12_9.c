@@ -1,6 +1,7 @@
 #include <string.h>
 #include "dmr/fec/rs_12_9.h"
 #include "dmr/error.h"
+#include "dmr/log.h"
 
 #define NPAR    (3U)
 /* Maximum degree of various polynomials. */
@@ -63,16 +64,69 @@ DMR_PRV const uint8_t LOG_TABLE[] = {
 	0x4F, 0xAE, 0xD5, 0xE9, 0xE6, 0xE7, 0xAD, 0xE8, 0x74, 0xD6, 0xF4, 0xEA, 0xA8, 0x50, 0x58, 0xAF
 };
 
-/* multiplication using logarithms */
+/* Generator polynomial multiplication tables, POLY[j] * x */
+DMR_PRV static const uint8_t GEN_TABLE[NPAR][256] = {
+	{
+		0x00, 0x40, 0x80, 0xC0, 0x1D, 0x5D, 0x9D, 0xDD, 0x3A, 0x7A, 0xBA, 0xFA, 0x27, 0x67, 0xA7, 0xE7,
+		0x74, 0x34, 0xF4, 0xB4, 0x69, 0x29, 0xE9, 0xA9, 0x4E, 0x0E, 0xCE, 0x8E, 0x53, 0x13, 0xD3, 0x93,
+		0xE8, 0xA8, 0x68, 0x28, 0xF5, 0xB5, 0x75, 0x35, 0xD2, 0x92, 0x52, 0x12, 0xCF, 0x8F, 0x4F, 0x0F,
+		0x9C, 0xDC, 0x1C, 0x5C, 0x81, 0xC1, 0x01, 0x41, 0xA6, 0xE6, 0x26, 0x66, 0xBB, 0xFB, 0x3B, 0x7B,
+		0xCD, 0x8D, 0x4D, 0x0D, 0xD0, 0x90, 0x50, 0x10, 0xF7, 0xB7, 0x77, 0x37, 0xEA, 0xAA, 0x6A, 0x2A,
+		0xB9, 0xF9, 0x39, 0x79, 0xA4, 0xE4, 0x24, 0x64, 0x83, 0xC3, 0x03, 0x43, 0x9E, 0xDE, 0x1E, 0x5E,
+		0x25, 0x65, 0xA5, 0xE5, 0x38, 0x78, 0xB8, 0xF8, 0x1F, 0x5F, 0x9F, 0xDF, 0x02, 0x42, 0x82, 0xC2,
+		0x51, 0x11, 0xD1, 0x91, 0x4C, 0x0C, 0xCC, 0x8C, 0x6B, 0x2B, 0xEB, 0xAB, 0x76, 0x36, 0xF6, 0xB6,
+		0x87, 0xC7, 0x07, 0x47, 0x9A, 0xDA, 0x1A, 0x5A, 0xBD, 0xFD, 0x3D, 0x7D, 0xA0, 0xE0, 0x20, 0x60,
+		0xF3, 0xB3, 0x73, 0x33, 0xEE, 0xAE, 0x6E, 0x2E, 0xC9, 0x89, 0x49, 0x09, 0xD4, 0x94, 0x54, 0x14,
+		0x6F, 0x2F, 0xEF, 0xAF, 0x72, 0x32, 0xF2, 0xB2, 0x55, 0x15, 0xD5, 0x95, 0x48, 0x08, 0xC8, 0x88,
+		0x1B, 0x5B, 0x9B, 0xDB, 0x06, 0x46, 0x86, 0xC6, 0x21, 0x61, 0xA1, 0xE1, 0x3C, 0x7C, 0xBC, 0xFC,
+		0x4A, 0x0A, 0xCA, 0x8A, 0x57, 0x17, 0xD7, 0x97, 0x70, 0x30, 0xF0, 0xB0, 0x6D, 0x2D, 0xED, 0xAD,
+		0x3E, 0x7E, 0xBE, 0xFE, 0x23, 0x63, 0xA3, 0xE3, 0x04, 0x44, 0x84, 0xC4, 0x19, 0x59, 0x99, 0xD9,
+		0xA2, 0xE2, 0x22, 0x62, 0xBF, 0xFF, 0x3F, 0x7F, 0x98, 0xD8, 0x18, 0x58, 0x85, 0xC5, 0x05, 0x45,
+		0xD6, 0x96, 0x56, 0x16, 0xCB, 0x8B, 0x4B, 0x0B, 0xEC, 0xAC, 0x6C, 0x2C, 0xF1, 0xB1, 0x71, 0x31
+	},
+	{
+		0x00, 0x38, 0x70, 0x48, 0xE0, 0xD8, 0x90, 0xA8, 0xDD, 0xE5, 0xAD, 0x95, 0x3D, 0x05, 0x4D, 0x75,
+		0xA7, 0x9F, 0xD7, 0xEF, 0x47, 0x7F, 0x37, 0x0F, 0x7A, 0x42, 0x0A, 0x32, 0x9A, 0xA2, 0xEA, 0xD2,
+		0x53, 0x6B, 0x23, 0x1B, 0xB3, 0x8B, 0xC3, 0xFB, 0x8E, 0xB6, 0xFE, 0xC6, 0x6E, 0x56, 0x1E, 0x26,
+		0xF4, 0xCC, 0x84, 0xBC, 0x14, 0x2C, 0x64, 0x5C, 0x29, 0x11, 0x59, 0x61, 0xC9, 0xF1, 0xB9, 0x81,
+		0xA6, 0x9E, 0xD6, 0xEE, 0x46, 0x7E, 0x36, 0x0E, 0x7B, 0x43, 0x0B, 0x33, 0x9B, 0xA3, 0xEB, 0xD3,
+		0x01, 0x39, 0x71, 0x49, 0xE1, 0xD9, 0x91, 0xA9, 0xDC, 0xE4, 0xAC, 0x94, 0x3C, 0x04, 0x4C, 0x74,
+		0xF5, 0xCD, 0x85, 0xBD, 0x15, 0x2D, 0x65, 0x5D, 0x28, 0x10, 0x58, 0x60, 0xC8, 0xF0, 0xB8, 0x80,
+		0x52, 0x6A, 0x22, 0x1A, 0xB2, 0x8A, 0xC2, 0xFA, 0x8F, 0xB7, 0xFF, 0xC7, 0x6F, 0x57, 0x1F, 0x27,
+		0x51, 0x69, 0x21, 0x19, 0xB1, 0x89, 0xC1, 0xF9, 0x8C, 0xB4, 0xFC, 0xC4, 0x6C, 0x54, 0x1C, 0x24,
+		0xF6, 0xCE, 0x86, 0xBE, 0x16, 0x2E, 0x66, 0x5E, 0x2B, 0x13, 0x5B, 0x63, 0xCB, 0xF3, 0xBB, 0x83,
+		0x02, 0x3A, 0x72, 0x4A, 0xE2, 0xDA, 0x92, 0xAA, 0xDF, 0xE7, 0xAF, 0x97, 0x3F, 0x07, 0x4F, 0x77,
+		0xA5, 0x9D, 0xD5, 0xED, 0x45, 0x7D, 0x35, 0x0D, 0x78, 0x40, 0x08, 0x30, 0x98, 0xA0, 0xE8, 0xD0,
+		0xF7, 0xCF, 0x87, 0xBF, 0x17, 0x2F, 0x67, 0x5F, 0x2A, 0x12, 0x5A, 0x62, 0xCA, 0xF2, 0xBA, 0x82,
+		0x50, 0x68, 0x20, 0x18, 0xB0, 0x88, 0xC0, 0xF8, 0x8D, 0xB5, 0xFD, 0xC5, 0x6D, 0x55, 0x1D, 0x25,
+		0xA4, 0x9C, 0xD4, 0xEC, 0x44, 0x7C, 0x34, 0x0C, 0x79, 0x41, 0x09, 0x31, 0x99, 0xA1, 0xE9, 0xD1,
+		0x03, 0x3B, 0x73, 0x4B, 0xE3, 0xDB, 0x93, 0xAB, 0xDE, 0xE6, 0xAE, 0x96, 0x3E, 0x06, 0x4E, 0x76
+	},
+	{
+		0x00, 0x0E, 0x1C, 0x12, 0x38, 0x36, 0x24, 0x2A, 0x70, 0x7E, 0x6C, 0x62, 0x48, 0x46, 0x54, 0x5A,
+		0xE0, 0xEE, 0xFC, 0xF2, 0xD8, 0xD6, 0xC4, 0xCA, 0x90, 0x9E, 0x8C, 0x82, 0xA8, 0xA6, 0xB4, 0xBA,
+		0xDD, 0xD3, 0xC1, 0xCF, 0xE5, 0xEB, 0xF9, 0xF7, 0xAD, 0xA3, 0xB1, 0xBF, 0x95, 0x9B, 0x89, 0x87,
+		0x3D, 0x33, 0x21, 0x2F, 0x05, 0x0B, 0x19, 0x17, 0x4D, 0x43, 0x51, 0x5F, 0x75, 0x7B, 0x69, 0x67,
+		0xA7, 0xA9, 0xBB, 0xB5, 0x9F, 0x91, 0x83, 0x8D, 0xD7, 0xD9, 0xCB, 0xC5, 0xEF, 0xE1, 0xF3, 0xFD,
+		0x47, 0x49, 0x5B, 0x55, 0x7F, 0x71, 0x63, 0x6D, 0x37, 0x39, 0x2B, 0x25, 0x0F, 0x01, 0x13, 0x1D,
+		0x7A, 0x74, 0x66, 0x68, 0x42, 0x4C, 0x5E, 0x50, 0x0A, 0x04, 0x16, 0x18, 0x32, 0x3C, 0x2E, 0x20,
+		0x9A, 0x94, 0x86, 0x88, 0xA2, 0xAC, 0xBE, 0xB0, 0xEA, 0xE4, 0xF6, 0xF8, 0xD2, 0xDC, 0xCE, 0xC0,
+		0x53, 0x5D, 0x4F, 0x41, 0x6B, 0x65, 0x77, 0x79, 0x23, 0x2D, 0x3F, 0x31, 0x1B, 0x15, 0x07, 0x09,
+		0xB3, 0xBD, 0xAF, 0xA1, 0x8B, 0x85, 0x97, 0x99, 0xC3, 0xCD, 0xDF, 0xD1, 0xFB, 0xF5, 0xE7, 0xE9,
+		0x8E, 0x80, 0x92, 0x9C, 0xB6, 0xB8, 0xAA, 0xA4, 0xFE, 0xF0, 0xE2, 0xEC, 0xC6, 0xC8, 0xDA, 0xD4,
+		0x6E, 0x60, 0x72, 0x7C, 0x56, 0x58, 0x4A, 0x44, 0x1E, 0x10, 0x02, 0x0C, 0x26, 0x28, 0x3A, 0x34,
+		0xF4, 0xFA, 0xE8, 0xE6, 0xCC, 0xC2, 0xD0, 0xDE, 0x84, 0x8A, 0x98, 0x96, 0xBC, 0xB2, 0xA0, 0xAE,
+		0x14, 0x1A, 0x08, 0x06, 0x2C, 0x22, 0x30, 0x3E, 0x64, 0x6A, 0x78, 0x76, 0x5C, 0x52, 0x40, 0x4E,
+		0x29, 0x27, 0x35, 0x3B, 0x11, 0x1F, 0x0D, 0x03, 0x59, 0x57, 0x45, 0x4B, 0x61, 0x6F, 0x7D, 0x73,
+		0xC9, 0xC7, 0xD5, 0xDB, 0xF1, 0xFF, 0xED, 0xE3, 0xB9, 0xB7, 0xA5, 0xAB, 0x81, 0x8F, 0x9D, 0x93
+	}
+};
+
+/* Multiplication using logarithms, a zero operand masks the result */
 DMR_PRV static uint8_t gmult(uint8_t a, uint8_t b)
 {
-  if (a == 0U || b == 0U)
-	  return 0U;
-
-  uint8_t i = LOG_TABLE[a];
-  uint8_t j = LOG_TABLE[b];
-
-  return EXP_TABLE[i + j];
+    uint8_t mask = -(uint8_t)((a != 0) & (b != 0));
+    return EXP_TABLE[LOG_TABLE[a] + LOG_TABLE[b]] & mask;
 }
 
 DMR_PRV static void encode(uint8_t bytes[9], uint8_t parity[NPAR])
@@ -80,14 +134,25 @@ DMR_PRV static void encode(uint8_t bytes[9], uint8_t parity[NPAR])
     // Clear parity
     memset(parity, 0, 3);
 
-    uint8_t i;
-    int8_t j;
+    uint8_t i, dbyte;
     for (i = 0; i < 9; i++) {
-        uint8_t dbyte = bytes[i] ^ parity[NPAR - 1];
-        for (j = NPAR - 1; j > 0; j--) {
-            parity[j] = parity[j - 1] ^ gmult(POLY[j], dbyte);
+        dbyte = bytes[i] ^ parity[2];
+        parity[2] = parity[1] ^ GEN_TABLE[2][dbyte];
+        parity[1] = parity[0] ^ GEN_TABLE[1][dbyte];
+        parity[0] = GEN_TABLE[0][dbyte];
+    }
+}
+
+/* Evaluate the received word at the roots of the generator, a^1 to a^3. The
+ * first byte is the coefficient of x^11. */
+DMR_PRV static void syndromes(uint8_t bytes[12], uint8_t s[NPAR])
+{
+    uint8_t i, j;
+    memset(s, 0, NPAR);
+    for (i = 0; i < 12; i++) {
+        for (j = 0; j < NPAR; j++) {
+            s[j] = gmult(s[j], EXP_TABLE[j + 1]) ^ bytes[i];
         }
-        parity[0] = gmult(POLY[0], dbyte);
     }
 }
 
@@ -96,17 +161,25 @@ DMR_API int dmr_rs_12_9_4_decode(uint8_t bytes[12])
     if (bytes == NULL)
         return dmr_error(DMR_EINVAL);
 
-    uint8_t parity[NPAR];
-    encode(bytes, parity);
-
-    if (bytes[9]  ^ parity[2] ||
-        bytes[10] ^ parity[1] ||
-        bytes[11] ^ parity[0]) {
-        dmr_log_error("Reed-Solomon(12,9): parity check failed");
-        return -1;
+    uint8_t s[NPAR];
+    syndromes(bytes, s);
+    if ((s[0] | s[1] | s[2]) == 0)
+        return 0;
+
+    /* With three parity symbols a single error can be repaired. An error
+     * with value v at x^d gives syndromes v*a^d, v*a^2d and v*a^3d, so
+     * S2/S1 locates it, S1^2/S2 is the value and S2^2 = S1*S3 must hold. */
+    if (s[0] != 0 && s[1] != 0 && gmult(s[1], s[1]) == gmult(s[0], s[2])) {
+        uint8_t d = (LOG_TABLE[s[1]] + 255 - LOG_TABLE[s[0]]) % 255;
+        if (d < 12) {
+            bytes[11 - d] ^= EXP_TABLE[(2 * LOG_TABLE[s[0]] + 255 - LOG_TABLE[s[1]]) % 255];
+            dmr_log_debug("Reed-Solomon(12,9): repaired symbol %u", 11 - d);
+            return 1;
+        }
     }
 
-    return 0;
+    dmr_log_error("Reed-Solomon(12,9): parity check failed, can't repair");
+    return -1;
 }
 
 DMR_API int dmr_rs_12_9_4_encode(uint8_t bytes[12])
@@ -36,93 +36,141 @@ static uint8_t rate_34_interleaving_schedule[98] = {
     0x5e, 0x5f
 };
 
-int dmr_trellis_rate_34_decode(dmr_packet packet, uint8_t bytes[18])
+/* Table B.8 with the symbol levels mapped to dibits */
+static const uint8_t point_dibits[16][2] = {
+    {0, 2}, {2, 2}, {1, 3}, {3, 3},
+    {3, 2}, {1, 2}, {2, 3}, {0, 3},
+    {3, 1}, {1, 1}, {2, 0}, {0, 0},
+    {0, 1}, {2, 1}, {1, 0}, {3, 0}
+};
+
+/* Viterbi over the 8 encoder states, the state being the last tribit. The
+ * encoder starts in state 0 and is flushed with a 0 tribit, so the 49 points
+ * are 48 data tribits followed by a known tail. branch holds the distance
+ * between the received pair of symbols and each constellation point. */
+static void trellis_viterbi(uint32_t branch[49][16], uint8_t bytes[18])
 {
-    if (packet == NULL || bytes == NULL)
-        return dmr_error(DMR_EINVAL);
+    uint32_t metric[8], next[8], cand, mask;
+    uint8_t survivor[49][8], i, s, t;
 
-    /* Convert payload to bits and extract info bits */
-    bool bits[DMR_PACKET_BITS], info[196];
-    dmr_bytes_to_bits(packet, DMR_PACKET_LEN, bits, DMR_PACKET_BITS);
-    memcpy(info +  0, bits +   0, 98);
-    memcpy(info + 98, bits + 166, 98);
-
-    /* Convert info bits to dibits */
-    int8_t dibits[98], deinterleaved_dibits[98];
-    uint8_t i, j, o;
-    for (i = 0; i < 196; i += 2) {
-        o = i / 2;
-        if (bits[i]) {
-            if (bits[i + 1]) {
-                dibits[o] = -3;
-            } else {
-                dibits[o] = -1;
-            }
-        } else {
-            if (bits[i + 1]) {
-                dibits[o] = 3;
-            } else {
-                dibits[o] = 1;
+    for (s = 0; s < 8; s++) {
+        metric[s] = s == 0 ? 0 : UINT32_MAX / 2;
+    }
+    for (i = 0; i < 49; i++) {
+        /* Add-compare-select, lanes are the next states so the inner loop
+         * has no data dependent branches. */
+        for (t = 0; t < 8; t++) {
+            next[t] = metric[0] + branch[i][state_transition_table[t]];
+            survivor[i][t] = 0;
+        }
+        for (s = 1; s < 8; s++) {
+            for (t = 0; t < 8; t++) {
+                cand = metric[s] + branch[i][state_transition_table[s * 8 + t]];
+                mask = -(uint32_t)(cand < next[t]);
+                next[t] = (cand & mask) | (next[t] & ~mask);
+                survivor[i][t] = (s & mask) | (survivor[i][t] & ~mask);
             }
         }
+        memcpy(metric, next, sizeof(metric));
+    }
+
+    /* Trace back from the tail state; the next state is the input tribit */
+    dmr_bitvec info[DMR_BITVEC_WORDS(144)];
+    dmr_bitvec_zero(info, 144);
+    for (s = 0, i = 48; i > 0; i--) {
+        s = survivor[i][s];
+        dmr_bitvec_insert(info, (i - 1) * 3, 3, s);
     }
 
+    /* Map 144 bits back to bytes */
+    dmr_bitvec_to_bytes(info, bytes, 18);
+}
+
+int dmr_trellis_rate_34_decode_soft(const int8_t symbols[98], uint8_t bytes[18])
+{
+    if (symbols == NULL || bytes == NULL)
+        return dmr_error(DMR_EINVAL);
+
     /* Table B.9: Interleaving schedule for rate 3⁄4 Trellis code */
+    int8_t deinterleaved[98];
+    uint8_t i, j;
     for (i = 0; i < 98; i++) {
-        deinterleaved_dibits[rate_34_interleaving_schedule[i]] = dibits[i];
+        deinterleaved[rate_34_interleaving_schedule[i]] = symbols[i];
     }
 
-    /* Table B.8: Constellation to dibit pair mapping */
-    uint8_t points[49];
-    for (i = 0; i < 98; i += 2) {
-        o = i / 2;
+    /* Squared distance to each point, scaled to the soft symbol levels */
+    uint32_t branch[49][16];
+    int32_t d0, d1;
+    for (i = 0; i < 49; i++) {
         for (j = 0; j < 16; j++) {
-            if (deinterleaved_dibits[i + 0] == constellation_point_mapping[j][0] &&
-                deinterleaved_dibits[i + 1] == constellation_point_mapping[j][1]) {
-                points[o] = j;
-                break;
-            }
+            d0 = deinterleaved[i * 2 + 0] - constellation_point_mapping[j][0] * DMR_TRELLIS_SYMBOL_SCALE;
+            d1 = deinterleaved[i * 2 + 1] - constellation_point_mapping[j][1] * DMR_TRELLIS_SYMBOL_SCALE;
+            branch[i][j] = (uint32_t)(d0 * d0 + d1 * d1);
         }
     }
 
-    /* Table B.7: Trellis encoder state transition table */
-    uint8_t tribits[48], last = 0;
-    bool match = false;
-    int8_t start;
-    for (i = 0; i < 48; i++) {
-        start = last * 8;
-        match = false;
-        for (j = start; j < (start + 8); j++) {
-            /* Check if this constellation point matches an element of this row of the state table */
-            if (points[i] == state_transition_table[j]) {
-                match = true;
-                last = j - start;
-                tribits[i] = last;
-                break;
-            }
-        }
-        if (!match) {
-            return dmr_error_set("trellis: tribit extract error at point %u", i);
-        }
+    trellis_viterbi(branch, bytes);
+    return 0;
+}
+
+int dmr_trellis_rate_34_decode(dmr_packet packet, uint8_t bytes[18])
+{
+    if (packet == NULL || bytes == NULL)
+        return dmr_error(DMR_EINVAL);
+
+    /* Extract info bits */
+    dmr_bitvec info[DMR_BITVEC_WORDS(DMR_PAYLOAD_BITS)];
+    dmr_payload_bitvec(packet, info);
+
+    /* Table B.9: Interleaving schedule for rate 3⁄4 Trellis code */
+    uint8_t dibits[98], i, j;
+    for (i = 0; i < 98; i++) {
+        dibits[rate_34_interleaving_schedule[i]] = dmr_bitvec_extract(info, i * 2, 2);
     }
 
-    /* Map 48 tribits back to 144 bits */
-    memset(info, 0, sizeof(info));
-    for (i = 0; i < 144; i += 3) {
-        o = i / 3;
-        if ((tribits[o] & 0x04) > 0) {
-            bits[i + 0] = true;
-        }
-        if ((tribits[o] & 0x02) > 0) {
-            bits[i + 1] = true;
-        }
-        if ((tribits[o] & 0x01) > 0) {
-            bits[i + 2] = true;
+    /* A hard decision gives no level information, a bit error can turn +3
+     * into -3, so the distance is the number of differing bits. */
+    uint32_t branch[49][16];
+    for (i = 0; i < 49; i++) {
+        for (j = 0; j < 16; j++) {
+            branch[i][j] = __builtin_popcount(
+                ((dibits[i * 2 + 0] ^ point_dibits[j][0]) << 2) |
+                 (dibits[i * 2 + 1] ^ point_dibits[j][1]));
         }
     }
 
-    /* Map 144 bits back to bytes */
-    dmr_bits_to_bytes(info, 144, bytes, 18);
+    trellis_viterbi(branch, bytes);
+    return 0;
+}
+
+int dmr_trellis_rate_34_encode(dmr_packet packet, uint8_t bytes[18])
+{
+    if (packet == NULL || bytes == NULL)
+        return dmr_error(DMR_EINVAL);
+
+    dmr_bitvec data[DMR_BITVEC_WORDS(144)];
+    dmr_bitvec_from_bytes(data, bytes, 18);
+
+    /* Table B.7: Trellis encoder state transition table, 48 tribits and a
+     * 0 tribit to flush the encoder */
+    uint8_t dibits[98], i, state = 0, tribit, point;
+    for (i = 0; i < 49; i++) {
+        tribit = i < 48 ? dmr_bitvec_extract(data, i * 3, 3) : 0;
+        point = state_transition_table[state * 8 + tribit];
+        state = tribit;
+
+        /* Table B.8: Constellation to dibit pair mapping */
+        dibits[i * 2 + 0] = point_dibits[point][0];
+        dibits[i * 2 + 1] = point_dibits[point][1];
+    }
+
+    /* Table B.9: Interleaving schedule for rate 3⁄4 Trellis code */
+    dmr_bitvec info[DMR_BITVEC_WORDS(DMR_PAYLOAD_BITS)];
+    dmr_bitvec_zero(info, DMR_PAYLOAD_BITS);
+    for (i = 0; i < 98; i++) {
+        dmr_bitvec_insert(info, i * 2, 2, dibits[rate_34_interleaving_schedule[i]]);
+    }
+    dmr_payload_bitvec_encode(packet, info);
 
     return 0;
 }
@@ -1,11 +1,71 @@
+#include <errno.h>
+#include <fcntl.h>
 #include <signal.h>
-#include <sys/select.h>
+#include <string.h>
+#include <sys/param.h>
 #include <sys/time.h>
+#include "dmr/config.h"
+#if defined(DMR_HAVE_EVENTFD)
+#include <sys/eventfd.h>
+#endif
+#if defined(DMR_HAVE_SIGNALFD)
+#include <sys/signalfd.h>
+#endif
 #include "dmr/error.h"
 #include "dmr/io.h"
 #include "dmr/malloc.h"
+#include "dmr/time.h"
 #include "common/byte.h"
 
+/* Wake ups use an eventfd where available, otherwise a non-blocking pipe.
+ * For an eventfd both ends are the same descriptor. */
+DMR_PRV int io_wake_open(int fd[2])
+{
+#if defined(DMR_HAVE_EVENTFD)
+    if ((fd[0] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1)
+        return dmr_error_set("io: eventfd failed: %s", strerror(errno));
+    fd[1] = fd[0];
+#else
+    if (pipe(fd) == -1)
+        return dmr_error_set("io: pipe failed: %s", strerror(errno));
+    int i;
+    for (i = 0; i < 2; i++) {
+        fcntl(fd[i], F_SETFL, fcntl(fd[i], F_GETFL) | O_NONBLOCK);
+        fcntl(fd[i], F_SETFD, FD_CLOEXEC);
+    }
+#endif
+    return 0;
+}
+
+DMR_PRV void io_wake_close(int fd[2])
+{
+    if (fd[0] != -1)
+        close(fd[0]);
+    if (fd[1] != -1 && fd[1] != fd[0])
+        close(fd[1]);
+    fd[0] = fd[1] = -1;
+}
+
+DMR_PRV void io_wake(int wfd)
+{
+#if defined(DMR_HAVE_EVENTFD)
+    uint64_t one = 1;
+    ssize_t ret = write(wfd, &one, sizeof one);
+#else
+    uint8_t one = 1;
+    ssize_t ret = write(wfd, &one, sizeof one);
+#endif
+    /* a full pipe already has a wake up pending */
+    if (ret == -1 && errno != EAGAIN && errno != EWOULDBLOCK)
+        dmr_log_error("io: wake up failed: %s", strerror(errno));
+}
+
+DMR_PRV void io_wake_drain(int rfd)
+{
+    uint8_t buf[64];
+    while (read(rfd, buf, sizeof buf) > 0);
+}
+
 DMR_API dmr_io *dmr_io_new(void)
 {
     dmr_io *io;
@@ -23,16 +83,60 @@ DMR_API dmr_io *dmr_io_new(void)
         }
         DMR_LIST_INIT(&io->entry[i]->head);
     }
-    if ((io->timer = dmr_palloc(io, dmr_io_timer_list)) == NULL) {
+    DMR_LIST_INIT(&io->removed.head);
+    io->sig[0] = io->sig[1] = -1;
+    if (io_wake_open(io->wake) != 0) {
         dmr_free(io);
-        dmr_error(DMR_ENOMEM);
         return NULL;
     }
-    DMR_LIST_INIT(&io->timer->head);
 
+#if defined(DMR_HAVE_EPOLL)
+    if ((io->epfd = epoll_create(DMR_IO_EPOLL_EVENTS)) == -1) {
+        io_wake_close(io->wake);
+        dmr_free(io);
+        dmr_error_set("io: epoll_create failed: %s", strerror(errno));
+        return NULL;
+    }
+#if defined(DMR_HAVE_TIMERFD)
+    if ((io->tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) == -1) {
+        close(io->epfd);
+        io_wake_close(io->wake);
+        dmr_free(io);
+        dmr_error_set("io: timerfd_create failed: %s", strerror(errno));
+        return NULL;
+    }
+    struct epoll_event ev;
+    byte_zero(&ev, sizeof ev);
+    ev.events = EPOLLIN;
+    ev.data.fd = io->tfd;
+    if (epoll_ctl(io->epfd, EPOLL_CTL_ADD, io->tfd, &ev) != 0) {
+        close(io->tfd);
+        close(io->epfd);
+        io_wake_close(io->wake);
+        dmr_free(io);
+        dmr_error_set("io: epoll_ctl on timerfd failed: %s", strerror(errno));
+        return NULL;
+    }
+#endif
+    struct epoll_event wev;
+    byte_zero(&wev, sizeof wev);
+    wev.events = EPOLLIN;
+    wev.data.fd = io->wake[0];
+    if (epoll_ctl(io->epfd, EPOLL_CTL_ADD, io->wake[0], &wev) != 0) {
+#if defined(DMR_HAVE_TIMERFD)
+        close(io->tfd);
+#endif
+        close(io->epfd);
+        io_wake_close(io->wake);
+        dmr_free(io);
+        dmr_error_set("io: epoll_ctl on wake up failed: %s", strerror(errno));
+        return NULL;
+    }
+#else
     FD_ZERO(&io->readers);
     FD_ZERO(&io->writers);
     FD_ZERO(&io->errors);
+#endif
 
     io->timeout.tv_sec = 1;
     io->timeout.tv_usec = 0;
@@ -67,66 +171,248 @@ DMR_API int dmr_io_add_protocol(dmr_io *io, dmr_protocol protocol, void *instanc
     return ret;
 }
 
-DMR_PRV int io_handle_readable(dmr_io *io, int fd)
+/** Get the dispatch slot for a file descriptor.
+ * If create is set, the dispatch table is grown as needed. */
+DMR_PRV static dmr_io_fd *io_fd_slot(dmr_io *io, int fd, bool create)
 {
-    dmr_log_debug("io: fd %d readable", fd);
-    dmr_io_entry *entry, *next;
-    DMR_LIST_FOREACH_SAFE(entry, &io->entry[DMR_REQUEST_READ]->head, entries, next) {
-        if (entry->fd == fd) {
-            ((dmr_read_cb)entry->cb)(io, entry->userdata, fd);
-            /* entry may be freed by callback */
-            if (entry && entry->once) {
-                DMR_LIST_REMOVE(entry, entries);
-                io->entries--;
-                dmr_free(entry);
-                FD_CLR(fd, &io->readers);
-            }
+    if (fd < 0)
+        return NULL;
+
+    if (fd >= io->fds) {
+        if (!create)
+            return NULL;
+
+        int fds = io->fds ? io->fds : 64;
+        while (fds <= fd)
+            fds <<= 1;
+
+        dmr_io_fd **table;
+        if ((table = dmr_realloc(io, io->fd, dmr_io_fd *, fds)) == NULL) {
+            dmr_error(DMR_ENOMEM);
+            return NULL;
+        }
+        byte_zero(table + io->fds, (fds - io->fds) * sizeof(dmr_io_fd *));
+        io->fd = table;
+        io->fds = fds;
+    }
+
+    if (io->fd[fd] == NULL && create) {
+        /* Slots are allocated individually, the list heads must not move */
+        dmr_io_fd *slot;
+        if ((slot = dmr_palloc(io, dmr_io_fd)) == NULL) {
+            dmr_error(DMR_ENOMEM);
+            return NULL;
         }
+        DMR_LIST_INIT(&slot->read.head);
+        DMR_LIST_INIT(&slot->write.head);
+        DMR_LIST_INIT(&slot->error.head);
+        io->fd[fd] = slot;
     }
 
+    return io->fd[fd];
+}
+
+DMR_PRV static dmr_io_entry_list *io_fd_list(dmr_io_fd *slot, dmr_request_type type)
+{
+    switch (type) {
+    case DMR_REQUEST_READ:
+        return &slot->read;
+    case DMR_REQUEST_WRITE:
+        return &slot->write;
+    case DMR_REQUEST_ERROR:
+        return &slot->error;
+    default:
+        return NULL;
+    }
+}
+
+/** Synchronize the backend interest set with the callbacks in the slot. */
+DMR_PRV static int io_fd_update(dmr_io *io, int fd, dmr_io_fd *slot)
+{
+#if defined(DMR_HAVE_EPOLL)
+    uint32_t events = 0;
+    if (!DMR_LIST_EMPTY(&slot->read.head))
+        events |= EPOLLIN;
+    if (!DMR_LIST_EMPTY(&slot->write.head))
+        events |= EPOLLOUT;
+    if (!DMR_LIST_EMPTY(&slot->error.head))
+        events |= EPOLLPRI;
+    if (events == slot->events)
+        return 0;
+
+    struct epoll_event ev;
+    byte_zero(&ev, sizeof ev);
+    ev.events = events;
+    ev.data.fd = fd;
+
+    int op = EPOLL_CTL_MOD;
+    if (slot->events == 0)
+        op = EPOLL_CTL_ADD;
+    else if (events == 0)
+        op = EPOLL_CTL_DEL;
+
+    if (epoll_ctl(io->epfd, op, fd, &ev) != 0) {
+        /* If the fd was closed before its callbacks were removed, the kernel
+         * has already dropped it from the epoll set. */
+        if (op == EPOLL_CTL_DEL && (errno == EBADF || errno == ENOENT)) {
+            slot->events = 0;
+            return 0;
+        }
+        if (op != EPOLL_CTL_MOD || errno != ENOENT ||
+            epoll_ctl(io->epfd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+            return dmr_error_set("io: epoll_ctl on fd %d failed: %s",
+                fd, strerror(errno));
+        }
+    }
+    slot->events = events;
+#else
+    if (fd >= FD_SETSIZE)
+        return dmr_error_set("io: fd %d exceeds FD_SETSIZE", fd);
+
+    if (DMR_LIST_EMPTY(&slot->read.head))
+        FD_CLR(fd, &io->readers);
+    else
+        FD_SET(fd, &io->readers);
+    if (DMR_LIST_EMPTY(&slot->write.head))
+        FD_CLR(fd, &io->writers);
+    else
+        FD_SET(fd, &io->writers);
+    if (DMR_LIST_EMPTY(&slot->error.head))
+        FD_CLR(fd, &io->errors);
+    else
+        FD_SET(fd, &io->errors);
+#endif
+    io->maxfd = MAX(io->maxfd, fd);
     return 0;
 }
 
-DMR_PRV int io_handle_writable(dmr_io *io, int fd)
+DMR_PRV static int io_fd_add(dmr_io *io, dmr_request_type type, int fd, void *cb, void *userdata, bool once)
 {
-    dmr_log_debug("io: fd %d writable", fd);
-    dmr_io_entry *entry, *next;
-    DMR_LIST_FOREACH_SAFE(entry, &io->entry[DMR_REQUEST_WRITE]->head, entries, next) {
-        if (entry->fd == fd) {
-            ((dmr_write_cb)entry->cb)(io, entry->userdata, fd);
-            /* entry may be freed by callback */
-            if (entry && entry->once) {
-                DMR_LIST_REMOVE(entry, entries);
-                io->entries--;
-                dmr_free(entry);
-                FD_CLR(fd, &io->writers);
+    dmr_io_fd *slot;
+    if ((slot = io_fd_slot(io, fd, true)) == NULL)
+        return dmr_error(DMR_LASTERROR);
+
+    dmr_io_entry *e;
+    if ((e = dmr_malloc(dmr_io_entry)) == NULL) {
+        return dmr_error(DMR_ENOMEM);
+    }
+
+    e->handle = DMR_HANDLE_UNKNOWN;
+    e->fd = fd;
+    e->cb = cb;
+    e->userdata = userdata;
+    e->once = once;
+    DMR_LIST_INSERT_HEAD(&io->entry[type]->head, e, entries);
+    DMR_LIST_INSERT_HEAD(&io_fd_list(slot, type)->head, e, fd_entries);
+    if (io_fd_update(io, fd, slot) != 0) {
+        DMR_LIST_REMOVE(e, entries);
+        DMR_LIST_REMOVE(e, fd_entries);
+        dmr_free(e);
+        return dmr_error(DMR_LASTERROR);
+    }
+    io->entries++;
+    return 0;
+}
+
+DMR_PRV static void io_fd_unlink(dmr_io *io, dmr_io_entry *entry)
+{
+    dmr_io_fd *slot;
+    int fd = entry->fd;
+
+    DMR_LIST_REMOVE(entry, entries);
+    DMR_LIST_REMOVE(entry, fd_entries);
+    dmr_free(entry);
+    if ((slot = io_fd_slot(io, fd, false)) != NULL) {
+        io_fd_update(io, fd, slot);
+    }
+}
+
+DMR_PRV static void io_fd_remove(dmr_io *io, dmr_io_entry *entry)
+{
+    if (entry->removed)
+        return;
+
+    entry->removed = true;
+    io->entries--;
+    if (io->dispatching) {
+        /* Callbacks may remove entries while we are walking the per-fd list,
+         * unlinking is deferred until the dispatch is done. */
+        DMR_LIST_INSERT_HEAD(&io->removed.head, entry, removals);
+        return;
+    }
+    io_fd_unlink(io, entry);
+}
+
+DMR_PRV static int io_fd_del(dmr_io *io, dmr_request_type type, int fd, void *cb)
+{
+    dmr_io_fd *slot;
+    dmr_io_entry *entry;
+    if ((slot = io_fd_slot(io, fd, false)) != NULL) {
+        DMR_LIST_FOREACH(entry, &io_fd_list(slot, type)->head, fd_entries) {
+            if (entry->cb == cb && !entry->removed) {
+                io_fd_remove(io, entry);
+                return 0;
             }
-            return 1;
         }
     }
 
-    return 0;
+    dmr_log_error("io: no cb to del for fd %d", fd);
+    return 1;
 }
 
-DMR_PRV int io_handle_error(dmr_io *io, int fd)
+DMR_PRV static void io_fd_sweep(dmr_io *io)
 {
-    dmr_log_debug("io: fd %d error", fd);
     dmr_io_entry *entry, *next;
-    DMR_LIST_FOREACH_SAFE(entry, &io->entry[DMR_REQUEST_ERROR]->head, entries, next) {
-        if (entry->fd == fd) {
-            ((dmr_error_cb)entry->cb)(io, entry->userdata, fd);
-            /* entry may be freed by callback */
-            if (entry && entry->once) {
-                DMR_LIST_REMOVE(entry, entries);
-                io->entries--;
-                dmr_free(entry);
-                FD_CLR(fd, &io->writers);
-            }
-            return 1;
+    DMR_LIST_FOREACH_SAFE(entry, &io->removed.head, removals, next) {
+        DMR_LIST_REMOVE(entry, removals);
+        io_fd_unlink(io, entry);
+    }
+}
+
+/** Run all callbacks of the given type registered for fd.
+ * The most recently registered callback runs first. */
+DMR_PRV static int io_fd_dispatch(dmr_io *io, dmr_request_type type, int fd)
+{
+    dmr_io_fd *slot;
+    if ((slot = io_fd_slot(io, fd, false)) == NULL)
+        return 0;
+
+    int handled = 0;
+    dmr_io_entry *entry;
+    io->dispatching = true;
+    DMR_LIST_FOREACH(entry, &io_fd_list(slot, type)->head, fd_entries) {
+        if (entry->removed)
+            continue;
+
+        /* Read, write and error callbacks share the same signature */
+        ((dmr_read_cb)entry->cb)(io, entry->userdata, fd);
+        if (entry->once) {
+            io_fd_remove(io, entry);
         }
+        handled++;
     }
+    io->dispatching = false;
+    io_fd_sweep(io);
 
-    return 0;
+    return handled;
+}
+
+DMR_PRV int io_handle_readable(dmr_io *io, int fd)
+{
+    dmr_log_debug("io: fd %d readable", fd);
+    return io_fd_dispatch(io, DMR_REQUEST_READ, fd);
+}
+
+DMR_PRV int io_handle_writable(dmr_io *io, int fd)
+{
+    dmr_log_debug("io: fd %d writable", fd);
+    return io_fd_dispatch(io, DMR_REQUEST_WRITE, fd);
+}
+
+DMR_PRV int io_handle_error(dmr_io *io, int fd)
+{
+    dmr_log_debug("io: fd %d error", fd);
+    return io_fd_dispatch(io, DMR_REQUEST_ERROR, fd);
 }
 
 DMR_PRV int io_handle_close(dmr_io *io)
@@ -160,159 +446,459 @@ DMR_PRV int io_handle_signal(dmr_io *io, int sig)
     return 0;
 }
 
-typedef struct io_sig {
-    dmr_io              *io;
-    int                 sig;
-    DMR_LIST_ENTRY(io_sig) entries;
-} io_sig;
+/* Signals are read from a signalfd inside the loop. Without signalfd the
+ * handler only writes the signal number to a self-pipe of the loop that
+ * registered it first, everything else happens inside the loop as well. */
+#if !defined(DMR_HAVE_SIGNALFD)
+static volatile int io_sig_wfd[NSIG]; /* write end of the self-pipe + 1 */
 
-static DMR_LIST_HEAD(, io_sig) io_sig_head;
+DMR_PRV static void io_sig_handle(int sig)
+{
+    int saved = errno, wfd = io_sig_wfd[sig] - 1;
+    if (wfd >= 0) {
+        uint8_t b = (uint8_t)sig;
+        if (write(wfd, &b, 1) == -1) {
+            /* pipe full, the signal is dropped */
+        }
+    }
+    errno = saved;
+}
+#endif
 
-/** Add a signal handler callback
- * Registers io loop signal to be handled, reg indicates if the signal was
- * previously registered */
-DMR_PRV int io_sig_add(dmr_io *io, int sig, bool *reg)
+/** Watch the signal descriptor, outside of the entry count */
+DMR_PRV static int io_sig_watch(dmr_io *io)
 {
-    io_sig *entry, *next;
-    bool found = false;
-    DMR_LIST_FOREACH_SAFE(entry, &io_sig_head, entries, next) {
-        if (entry->sig == sig) {
-            found = true;
+#if defined(DMR_HAVE_EPOLL)
+    struct epoll_event ev;
+    byte_zero(&ev, sizeof ev);
+    ev.events = EPOLLIN;
+    ev.data.fd = io->sig[0];
+    if (epoll_ctl(io->epfd, EPOLL_CTL_ADD, io->sig[0], &ev) != 0)
+        return dmr_error_set("io: epoll_ctl on signals failed: %s", strerror(errno));
+#else
+    if (io->sig[0] >= FD_SETSIZE)
+        return dmr_error_set("io: fd %d exceeds FD_SETSIZE", io->sig[0]);
+#endif
+    return 0;
+}
+
+/** Start receiving a signal on the loop */
+DMR_PRV static int io_sig_add(dmr_io *io, int sig)
+{
+    if (sig <= 0 || sig >= NSIG)
+        return dmr_error(DMR_EINVAL);
+
+#if defined(DMR_HAVE_SIGNALFD)
+    if (io->sig[0] != -1 && sigismember(&io->signals, sig))
+        return 0;
+
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, sig);
+    if (pthread_sigmask(SIG_BLOCK, &mask, NULL) != 0)
+        return dmr_error_set("io: can't block signal %d", sig);
+
+    bool watch = io->sig[0] == -1;
+    if (watch)
+        sigemptyset(&io->signals);
+    sigaddset(&io->signals, sig);
+    int sfd = signalfd(io->sig[0], &io->signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (sfd == -1) {
+        sigdelset(&io->signals, sig);
+        return dmr_error_set("io: signalfd failed: %s", strerror(errno));
+    }
+    if (watch) {
+        io->sig[0] = io->sig[1] = sfd;
+        if (io_sig_watch(io) != 0) {
+            close(sfd);
+            io->sig[0] = io->sig[1] = -1;
+            return -1;
         }
-        if ((found = (entry->io == io && entry->sig == sig)))
-            break;
     }
-    if (!found) {
-        if ((entry = dmr_malloc(io_sig)) == NULL)
-            return dmr_error(DMR_ENOMEM);
-        entry->io = io;
-        entry->sig = sig;
-        DMR_LIST_INSERT_HEAD(&io_sig_head, entry, entries); 
+#else
+    if (io->sig[0] == -1) {
+        /* a pipe, the handler writes the signal number */
+        if (pipe(io->sig) == -1)
+            return dmr_error_set("io: pipe failed: %s", strerror(errno));
+        int i;
+        for (i = 0; i < 2; i++) {
+            fcntl(io->sig[i], F_SETFL, fcntl(io->sig[i], F_GETFL) | O_NONBLOCK);
+            fcntl(io->sig[i], F_SETFD, FD_CLOEXEC);
+        }
+        if (io_sig_watch(io) != 0) {
+            io_wake_close(io->sig);
+            return -1;
+        }
     }
-    *reg = !found;
+    if (io_sig_wfd[sig] == io->sig[1] + 1)
+        return 0;
+    if (io_sig_wfd[sig] != 0) {
+        dmr_log_debug("io: signal %d is handled by another loop", sig);
+        return 0;
+    }
+
+    struct sigaction sa;
+    byte_zero(&sa, sizeof sa);
+    sa.sa_handler = io_sig_handle;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    io_sig_wfd[sig] = io->sig[1] + 1;
+    if (sigaction(sig, &sa, NULL) != 0) {
+        io_sig_wfd[sig] = 0;
+        return dmr_error_set("io: sigaction failed: %s", strerror(errno));
+    }
+#endif
+    dmr_log_debug("io: receiving signal %d", sig);
     return 0;
 }
 
-/** Signal dispatcher */
-DMR_PRV void io_sig_handle(int sig)
+/** Stop receiving signals on the loop */
+DMR_PRV static void io_sig_del(dmr_io *io)
 {
-    io_sig *entry, *next;
-#if defined(DMR_DEBUG)
-    size_t i = 0;
-    DMR_LIST_FOREACH_SAFE(entry, &io_sig_head, entries, next) {
-        i++;
+    if (io->sig[0] == -1)
+        return;
+
+#if defined(DMR_HAVE_SIGNALFD)
+    pthread_sigmask(SIG_UNBLOCK, &io->signals, NULL);
+    close(io->sig[0]);
+    io->sig[0] = io->sig[1] = -1;
+#else
+    int sig;
+    for (sig = 1; sig < NSIG; sig++) {
+        if (io_sig_wfd[sig] == io->sig[1] + 1) {
+            signal(sig, SIG_DFL);
+            io_sig_wfd[sig] = 0;
+        }
     }
-    dmr_log_debug("io: received signal %d, running %zu callbacks", sig, i);
+    io_wake_close(io->sig);
 #endif
-    DMR_LIST_FOREACH_SAFE(entry, &io_sig_head, entries, next) {
-        if (entry->sig == sig) {
-            if (io_handle_signal(entry->io, sig) != 0) {
-                break;
-            }
+}
+
+/** Run callbacks for signals received on the signal descriptor */
+DMR_PRV void io_handle_signals(dmr_io *io)
+{
+#if defined(DMR_HAVE_SIGNALFD)
+    struct signalfd_siginfo info[8];
+    ssize_t n, i;
+    while ((n = read(io->sig[0], info, sizeof info)) > 0) {
+        for (i = 0; i < n / (ssize_t)sizeof(info[0]); i++) {
+            dmr_log_debug("io: received signal %u", info[i].ssi_signo);
+            io_handle_signal(io, info[i].ssi_signo);
+        }
+    }
+#else
+    uint8_t buf[64];
+    ssize_t n, i;
+    while ((n = read(io->sig[0], buf, sizeof buf)) > 0) {
+        for (i = 0; i < n; i++) {
+            dmr_log_debug("io: received signal %u", buf[i]);
+            io_handle_signal(io, buf[i]);
         }
     }
+#endif
 }
 
-/** Timer calculation */
-DMR_PRV int io_timeout(dmr_io *io, struct timeval *timeout)
+/* Timers are kept in a binary min-heap ordered on their deadline, so the
+ * next timer to expire is always at the root. */
+#define IO_TIMER_PARENT(i) (((i) - 1) / 2)
+#define IO_TIMER_NONE      ((size_t)-1)
+
+DMR_PRV static void io_timer_swap(dmr_io *io, size_t i, size_t j)
 {
-    int timers = 0;
+    dmr_io_timer *t = io->timer[i];
+    io->timer[i] = io->timer[j];
+    io->timer[j] = t;
+    io->timer[i]->index = i;
+    io->timer[j]->index = j;
+}
 
-    /* Default timeout */
-    byte_copy(timeout, &io->timeout, sizeof(struct timeval));
-    dmr_log_debug("io: default timeout %ld.%06d",
-        timeout->tv_sec, timeout->tv_usec);
+DMR_PRV static void io_timer_up(dmr_io *io, size_t i)
+{
+    while (i > 0 && io->timer[i]->deadline < io->timer[IO_TIMER_PARENT(i)]->deadline) {
+        io_timer_swap(io, i, IO_TIMER_PARENT(i));
+        i = IO_TIMER_PARENT(i);
+    }
+}
 
-    if (DMR_LIST_EMPTY(&io->timer->head))
-        return 0;
+DMR_PRV static void io_timer_down(dmr_io *io, size_t i)
+{
+    for (;;) {
+        size_t l = 2 * i + 1, r = l + 1, m = i;
+        if (l < io->timers && io->timer[l]->deadline < io->timer[m]->deadline)
+            m = l;
+        if (r < io->timers && io->timer[r]->deadline < io->timer[m]->deadline)
+            m = r;
+        if (m == i)
+            break;
+        io_timer_swap(io, i, m);
+        i = m;
+    }
+}
 
-    /* Timeout for timers */
-    dmr_io_timer *timer, *next;
-    struct timeval delta;
+DMR_PRV static int io_timer_push(dmr_io *io, dmr_io_timer *timer)
+{
+    if (io->timers == io->timers_size) {
+        size_t size = io->timers_size ? io->timers_size * 2 : 16;
+        dmr_io_timer **heap;
+        if ((heap = dmr_realloc(io, io->timer, dmr_io_timer *, size)) == NULL)
+            return dmr_error(DMR_ENOMEM);
+        io->timer = heap;
+        io->timers_size = size;
+    }
+    timer->index = io->timers++;
+    io->timer[timer->index] = timer;
+    io_timer_up(io, timer->index);
+    return 0;
+}
 
-    /* We compare the timers with both our default timeout and the
-     * delta between current wall clock and timer wall clock to find out what
-     * the smallest required timeout is. */
-    DMR_LIST_FOREACH_SAFE(timer, &io->timer->head, entries, next) {
-        if (timer == NULL)
-            continue;
+DMR_PRV static void io_timer_remove(dmr_io *io, dmr_io_timer *timer)
+{
+    size_t i = timer->index;
+    if (i == IO_TIMER_NONE || i >= io->timers || io->timer[i] != timer)
+        return;
+
+    timer->index = IO_TIMER_NONE;
+    if (i != --io->timers) {
+        io->timer[i] = io->timer[io->timers];
+        io->timer[i]->index = i;
+        io_timer_up(io, i);
+        io_timer_down(io, i);
+    }
+}
 
-        timersub(&timer->wallclock, &io->wallclock, &delta);
-        /* If we detect an expired timer, return immediately. */
-        if (delta.tv_sec < 0 || delta.tv_usec < 0) {
-            timeout->tv_sec = 0;
-            timeout->tv_usec = 0;
-            return 1;
-        }
-        /* Otherwise, see if the timer is smaller and apply. */
-        if (!timercmp(&delta, timeout, >)) {
-            /* Timer timeout is smaller than current timeout. */
-            byte_copy(timeout, &delta, sizeof(struct timeval));
-            dmr_log_debug("io: new timeout %ld.%06ld",
-                timeout->tv_sec, timeout->tv_usec);
+/** Timer calculation.
+ * Returns the number of timers, and the time to wait in nanoseconds. */
+DMR_PRV size_t io_timeout(dmr_io *io, uint64_t *timeout)
+{
+    /* Default timeout */
+    *timeout = (uint64_t)io->timeout.tv_sec * 1000000000ULL +
+               (uint64_t)io->timeout.tv_usec * 1000ULL;
+
+    if (io->timers == 0)
+        return 0;
+
+    uint64_t now = dmr_time_monotonic(), deadline = io->timer[0]->deadline;
+    if (deadline <= now) {
+        *timeout = 0;
+    } else if (deadline - now < *timeout) {
+        *timeout = deadline - now;
+    }
+    dmr_log_debug("io: timeout %" PRIu64 "ns", *timeout);
+
+#if defined(DMR_HAVE_EPOLL) && defined(DMR_HAVE_TIMERFD)
+    /* epoll_wait only has millisecond resolution, the timerfd wakes us up on
+     * the exact deadline. */
+    if (deadline != io->tfd_deadline) {
+        struct itimerspec its;
+        byte_zero(&its, sizeof its);
+        its.it_value.tv_sec = deadline / 1000000000ULL;
+        its.it_value.tv_nsec = deadline % 1000000000ULL;
+        if (timerfd_settime(io->tfd, TFD_TIMER_ABSTIME, &its, NULL) == 0) {
+            io->tfd_deadline = deadline;
         }
-        timers++;
     }
-    return timers;
+#endif
+
+    return io->timers;
 }
 
 /* Run callbacks for timers that have expired */
 DMR_PRV void io_handle_timers(dmr_io *io)
 {
-    dmr_io_timer *timer, *next;
     gettimeofday(&io->wallclock, NULL);
+    uint64_t now = dmr_time_monotonic();
 
-    /* Check for each of the timers if they are past current wall clock time,
-     * if so, execute their callback. */
-    DMR_LIST_FOREACH_SAFE(timer, &io->timer->head, entries, next) {
-        if (!timercmp(&timer->wallclock, &io->wallclock, <))
-            continue;
+    while (io->timers > 0 && io->timer[0]->deadline <= now) {
+        dmr_io_timer *timer = io->timer[0];
+        io_timer_remove(io, timer);
 
+        io->timer_running = timer;
         timer->cb(io, timer->userdata);
-        if (timer->once) {
-            DMR_LIST_REMOVE(timer, entries);
+        io->timer_running = NULL;
+
+        if (timer->once || timer->cancelled) {
+            io->entries--;
+            dmr_free(timer);
+            continue;
+        }
+
+        /* Schedule relative to the previous deadline, so periodic timers
+         * don't drift. If we fell behind, skip the missed intervals. */
+        timer->deadline += timer->interval;
+        if (timer->deadline <= now)
+            timer->deadline = now + MAX(timer->interval, 1);
+        if (io_timer_push(io, timer) != 0) {
+            dmr_log_error("io: timer: %s", dmr_error_get());
             io->entries--;
             dmr_free(timer);
-        } else {
-            /* Update next timer wakeup */
-            dmr_log_debug("io: timer: %ld.%06ld",
-                timer->wallclock.tv_sec, timer->wallclock.tv_usec);
-            timeradd(&io->wallclock, &timer->timeout, &timer->wallclock);
-            dmr_log_debug("io: timer: %ld.%06ld (new)",
-                timer->wallclock.tv_sec, timer->wallclock.tv_usec);
         }
     }
 }
 
+/* Posted callbacks are pushed on a lock-free stack, the loop takes the whole
+ * stack at once and reverses it to run them in the order they were posted. */
+typedef struct dmr_io_post {
+    dmr_post_cb         cb;
+    void                *userdata;
+    struct dmr_io_post  *next;
+} io_post;
+
+DMR_API int dmr_io_post(dmr_io *io, dmr_post_cb cb, void *userdata)
+{
+    DMR_ERROR_IF_NULL(io, DMR_EINVAL);
+    DMR_ERROR_IF_NULL(cb, DMR_EINVAL);
+
+    /* Not attached to the loop, talloc contexts are not shared between threads */
+    io_post *post = dmr_malloc(io_post);
+    if (post == NULL)
+        return dmr_error(DMR_ENOMEM);
+    post->cb = cb;
+    post->userdata = userdata;
+
+    /* Once pushed the loop may already have run and freed it, so only look
+     * at our own copy of the previous head. */
+    io_post *head = __atomic_load_n(&io->posted, __ATOMIC_RELAXED);
+    do {
+        post->next = head;
+    } while (!__atomic_compare_exchange_n(&io->posted, &head, post, true,
+        __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+    /* Only the post to an empty stack wakes up the loop, the others will be
+     * picked up with it. */
+    if (head == NULL)
+        io_wake(io->wake[1]);
+
+    return 0;
+}
+
+/** Run the callbacks posted since the last wake up */
+DMR_PRV void io_handle_posts(dmr_io *io)
+{
+    io_post *post, *next, *head = NULL;
+
+    post = __atomic_exchange_n(&io->posted, NULL, __ATOMIC_ACQUIRE);
+    while (post != NULL) {
+        next = post->next;
+        post->next = head;
+        head = post;
+        post = next;
+    }
+    for (post = head; post != NULL; post = next) {
+        next = post->next;
+        if (post->cb(io, post->userdata) != 0) {
+            dmr_log_error("io: posted callback failed: %s", dmr_error_get());
+        }
+        dmr_free(post);
+    }
+}
+
 DMR_API int dmr_io_loop(dmr_io *io)
 {
     if (io == NULL)
         return dmr_error(DMR_EINVAL);
 
     int ret, i;
-    struct timeval timeout;
+    uint64_t timeout;
+
+    /* dmr_io_close may be called from another thread */
+    __atomic_store_n(&io->closed, false, __ATOMIC_RELEASE);
+    while ((io->entries > 0 || io->persistent || __atomic_load_n(&io->posted, __ATOMIC_ACQUIRE) != NULL) &&
+           !__atomic_load_n(&io->closed, __ATOMIC_ACQUIRE)) {
+#if defined(DMR_HAVE_EPOLL)
+        int ms;
+        gettimeofday(&io->wallclock, NULL);
+
+        do {
+            if (io_timeout(io, &timeout)) {
+                /* Round up, waking up early only results in another wait */
+                ms = (int)((timeout + 999999ULL) / 1000000ULL);
+                dmr_log_debug("io: epoll_wait with timeout %dms", ms);
+            } else {
+                ms = -1;
+                dmr_log_debug("io: epoll_wait with no timeout");
+            }
+            ret = epoll_wait(io->epfd, io->events, DMR_IO_EPOLL_EVENTS, ms);
+        } while (ret == -1 && errno == EINTR);
+
+        if (ret == -1) {
+            dmr_error_set("io: epoll_wait failed: %s", strerror(errno));
+            break;
+        }
 
-    io->closed = false;
-    while (io->entries > 0 && !io->closed) {
+        io_handle_timers(io);
+        for (i = 0; i < ret; i++) {
+            int fd = io->events[i].data.fd;
+            uint32_t events = io->events[i].events;
+#if defined(DMR_HAVE_TIMERFD)
+            if (fd == io->tfd) {
+                uint64_t expirations;
+                if (read(io->tfd, &expirations, sizeof expirations) == -1 && errno != EAGAIN) {
+                    dmr_log_error("io: timerfd read: %s", strerror(errno));
+                }
+                io->tfd_deadline = 0;
+                continue;
+            }
+#endif
+            if (fd == io->wake[0]) {
+                io_wake_drain(fd);
+                io_handle_posts(io);
+                continue;
+            }
+            if (fd == io->sig[0]) {
+                io_handle_signals(io);
+                continue;
+            }
+            if (events & (EPOLLERR | EPOLLPRI)) {
+                io_handle_error(io, fd);
+            }
+            /* select reports hangups and errors as readable, so do we */
+            if (events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                io_handle_readable(io, fd);
+            }
+            if (events & EPOLLOUT) {
+                io_handle_writable(io, fd);
+            }
+        }
+#else
         fd_set rfds, wfds, efds;
         byte_copy(&rfds, &io->readers, sizeof rfds);
         byte_copy(&wfds, &io->writers, sizeof wfds);
         byte_copy(&efds, &io->errors,  sizeof efds);
+        FD_SET(io->wake[0], &rfds);
+        int nfds = MAX(io->maxfd, io->wake[0]) + 1;
+        if (io->sig[0] != -1) {
+            FD_SET(io->sig[0], &rfds);
+            nfds = MAX(nfds, io->sig[0] + 1);
+        }
         gettimeofday(&io->wallclock, NULL);
 
         do {
             if (io_timeout(io, &timeout)) {
+                struct timeval tv;
+                tv.tv_sec = timeout / 1000000000ULL;
+                tv.tv_usec = (timeout % 1000000000ULL + 999) / 1000;
                 dmr_log_debug("io: select with timeout %ld.%06ld",
-                    timeout.tv_sec, timeout.tv_usec);
-                ret = select(io->maxfd + 1, &rfds, &wfds, &efds, &timeout);
+                    tv.tv_sec, tv.tv_usec);
+                ret = select(nfds, &rfds, &wfds, &efds, &tv);
             } else {
                 dmr_log_debug("io: select with no timeout");
-                ret = select(io->maxfd + 1, &rfds, &wfds, &efds, NULL);
+                ret = select(nfds, &rfds, &wfds, &efds, NULL);
             }
         } while (ret == -1 && (errno == EAGAIN || errno == EINTR));
 
         io_handle_timers(io);
         int handled = 0;
+        if (ret > 0 && FD_ISSET(io->wake[0], &rfds)) {
+            FD_CLR(io->wake[0], &rfds);
+            io_wake_drain(io->wake[0]);
+            io_handle_posts(io);
+            handled++;
+        }
+        if (ret > 0 && io->sig[0] != -1 && FD_ISSET(io->sig[0], &rfds)) {
+            FD_CLR(io->sig[0], &rfds);
+            io_handle_signals(io);
+            handled++;
+        }
         for (i = 0; i < io->maxfd + 1; i++) {
             if (FD_ISSET(i, &efds)) {
                 io_handle_error(io, i);
@@ -331,6 +917,7 @@ DMR_API int dmr_io_loop(dmr_io *io)
         if (handled < ret) {
             dmr_log_warn("io: %d/%d events handled", handled, ret);
         }
+#endif
     }
 
     return io_handle_close(io);
@@ -339,8 +926,9 @@ DMR_API int dmr_io_loop(dmr_io *io)
 DMR_API int dmr_io_close(dmr_io *io)
 {
     DMR_ERROR_IF_NULL(io, DMR_EINVAL);
-    
-    io->closed = true;
+
+    __atomic_store_n(&io->closed, true, __ATOMIC_RELEASE);
+    io_wake(io->wake[1]);
     return 0;
 }
 
@@ -356,10 +944,23 @@ DMR_API int dmr_io_free(dmr_io *io)
             dmr_free(entry);
         }
     }
-    dmr_io_timer *timer, *tnext;
-    DMR_LIST_FOREACH_SAFE(timer, &io->timer->head, entries, tnext) {
-        dmr_free(timer);
+    size_t j;
+    for (j = 0; j < io->timers; j++) {
+        dmr_free(io->timer[j]);
     }
+    io_post *post, *pnext;
+    for (post = __atomic_exchange_n(&io->posted, NULL, __ATOMIC_ACQUIRE); post != NULL; post = pnext) {
+        pnext = post->next;
+        dmr_free(post);
+    }
+#if defined(DMR_HAVE_EPOLL)
+#if defined(DMR_HAVE_TIMERFD)
+    close(io->tfd);
+#endif
+    close(io->epfd);
+#endif
+    io_sig_del(io);
+    io_wake_close(io->wake);
     dmr_free(io);
     return 0;
 }
@@ -374,14 +975,9 @@ DMR_API int dmr_io_reg_signal(dmr_io *io, int sig, dmr_signal_cb cb, void *userd
         return dmr_error(DMR_ENOMEM);
     }
 
-    int ret = 0;
-    bool reg = false;
-    if ((ret = io_sig_add(io, sig, &reg)) != 0)
-        return dmr_error(DMR_LASTERROR);
-    
-    if (reg) {
-        dmr_log_debug("io: registering signal handler for %d", sig);
-        signal(sig, io_sig_handle);
+    if (io_sig_add(io, sig) != 0) {
+        dmr_free(e);
+        return -1;
     }
 
     e->handle = DMR_HANDLE_UNKNOWN;
@@ -399,21 +995,7 @@ DMR_API int dmr_io_reg_read(dmr_io *io, int fd, dmr_read_cb cb, void *userdata,
     if (io == NULL)
         return dmr_error(DMR_EINVAL);
 
-    dmr_io_entry *e;
-    if ((e = dmr_malloc(dmr_io_entry)) == NULL) {
-        return dmr_error(DMR_ENOMEM);
-    }
-
-    e->handle = DMR_HANDLE_UNKNOWN;
-    e->fd = fd;
-    e->cb = cb;
-    e->userdata = userdata;
-    e->once = once;
-    DMR_LIST_INSERT_HEAD(&io->entry[DMR_REQUEST_READ]->head, e, entries);
-    io->entries++;
-    FD_SET(fd, &io->readers);
-    io->maxfd = MAX(io->maxfd, fd);
-    return 0;
+    return io_fd_add(io, DMR_REQUEST_READ, fd, cb, userdata, once);
 }
 
 DMR_API int dmr_io_del_read(dmr_io *io, int fd, dmr_read_cb cb)
@@ -421,19 +1003,7 @@ DMR_API int dmr_io_del_read(dmr_io *io, int fd, dmr_read_cb cb)
     if (io == NULL)
         return dmr_error(DMR_EINVAL);
 
-    dmr_io_entry *entry, *next;
-    DMR_LIST_FOREACH_SAFE(entry, &io->entry[DMR_REQUEST_READ]->head, entries, next) {
-        if (entry->fd == fd && entry->cb == cb) {
-            DMR_LIST_REMOVE(entry, entries);
-            io->entries--;
-            dmr_free(entry);
-            FD_CLR(fd, &io->readers);
-            return 0;
-        }
-    }
-
-    dmr_log_error("io: no cb to del for fd %d", fd);
-    return 1;
+    return io_fd_del(io, DMR_REQUEST_READ, fd, cb);
 }
 
 DMR_API int dmr_io_reg_write(dmr_io *io, int fd, dmr_write_cb cb, void *userdata, bool once)
@@ -441,41 +1011,15 @@ DMR_API int dmr_io_reg_write(dmr_io *io, int fd, dmr_write_cb cb, void *userdata
     if (io == NULL)
         return dmr_error(DMR_EINVAL);
 
-    dmr_io_entry *e;
-    if ((e = dmr_malloc(dmr_io_entry)) == NULL) {
-        return dmr_error(DMR_ENOMEM);
-    }
-
-    e->handle = DMR_HANDLE_UNKNOWN;
-    e->fd = fd;
-    e->cb = cb;
-    e->userdata = userdata;
-    e->once = once;
-    DMR_LIST_INSERT_HEAD(&io->entry[DMR_REQUEST_WRITE]->head, e, entries);
-    io->entries++;
-    FD_SET(fd, &io->writers);
-    io->maxfd = MAX(io->maxfd, fd);
-    return 0;
+    return io_fd_add(io, DMR_REQUEST_WRITE, fd, cb, userdata, once);
 }
 
-DMR_API int dmr_io_del_write(dmr_io *io, int fd, dmr_read_cb cb)
+DMR_API int dmr_io_del_write(dmr_io *io, int fd, dmr_write_cb cb)
 {
     if (io == NULL)
         return dmr_error(DMR_EINVAL);
 
-    dmr_io_entry *entry, *next;
-    DMR_LIST_FOREACH_SAFE(entry, &io->entry[DMR_REQUEST_WRITE]->head, entries, next) {
-        if (entry->fd == fd && entry->cb == cb) {
-            DMR_LIST_REMOVE(entry, entries);
-            io->entries--;
-            dmr_free(entry);
-            FD_CLR(fd, &io->writers);
-            return 0;
-        }
-    }
-
-    dmr_log_error("io: no cb to del for fd %d", fd);
-    return 1;
+    return io_fd_del(io, DMR_REQUEST_WRITE, fd, cb);
 }
 
 DMR_API int dmr_io_reg_error(dmr_io *io, int fd, dmr_error_cb cb, void *userdata, bool once)
@@ -483,41 +1027,15 @@ DMR_API int dmr_io_reg_error(dmr_io *io, int fd, dmr_error_cb cb, void *userdata
     if (io == NULL)
         return dmr_error(DMR_EINVAL);
 
-    dmr_io_entry *e;
-    if ((e = dmr_malloc(dmr_io_entry)) == NULL) {
-        return dmr_error(DMR_ENOMEM);
-    }
-
-    e->handle = DMR_HANDLE_UNKNOWN;
-    e->fd = fd;
-    e->cb = cb;
-    e->userdata = userdata;
-    e->once = once;
-    DMR_LIST_INSERT_HEAD(&io->entry[DMR_REQUEST_ERROR]->head, e, entries);
-    io->entries++;
-    FD_SET(fd, &io->errors);
-    io->maxfd = MAX(io->maxfd, fd);
-    return 0;
+    return io_fd_add(io, DMR_REQUEST_ERROR, fd, cb, userdata, once);
 }
 
-DMR_API int dmr_io_del_error(dmr_io *io, int fd, dmr_read_cb cb)
+DMR_API int dmr_io_del_error(dmr_io *io, int fd, dmr_error_cb cb)
 {
     if (io == NULL)
         return dmr_error(DMR_EINVAL);
 
-    dmr_io_entry *entry, *next;
-    DMR_LIST_FOREACH_SAFE(entry, &io->entry[DMR_REQUEST_ERROR]->head, entries, next) {
-        if (entry->fd == fd && entry->cb == cb) {
-            DMR_LIST_REMOVE(entry, entries);
-            io->entries--;
-            dmr_free(entry);
-            FD_CLR(fd, &io->errors);
-            return 0;
-        }
-    }
-
-    dmr_log_error("io: no cb to del for fd %d", fd);
-    return 1;
+    return io_fd_del(io, DMR_REQUEST_ERROR, fd, cb);
 }
 
 DMR_API int dmr_io_reg_close(dmr_io *io, dmr_close_cb cb, void *userdata)
@@ -539,26 +1057,53 @@ DMR_API int dmr_io_reg_close(dmr_io *io, dmr_close_cb cb, void *userdata)
     return 0;
 }
 
-DMR_API int dmr_io_reg_timer(dmr_io *io, struct timeval timeout, dmr_timer_cb cb, void *userdata, bool once)
+DMR_API dmr_io_timer *dmr_io_reg_timer(dmr_io *io, struct timeval timeout, dmr_timer_cb cb, void *userdata, bool once)
 {
-    if (io == NULL)
-        return dmr_error(DMR_EINVAL);
+    if (io == NULL || cb == NULL) {
+        dmr_error(DMR_EINVAL);
+        return NULL;
+    }
 
     dmr_io_timer *t;
     if ((t = dmr_malloc(dmr_io_timer)) == NULL) {
-        return dmr_error(DMR_ENOMEM);
+        dmr_error(DMR_ENOMEM);
+        return NULL;
     }
 
     dmr_log_debug("io: register timer interval %ld.%06lds",
         timeout.tv_sec, timeout.tv_usec);
 
     byte_copy(&t->timeout, &timeout, sizeof timeout);
-    timeradd(&io->wallclock, &t->timeout, &t->wallclock);
+    t->interval = (uint64_t)timeout.tv_sec * 1000000000ULL +
+                  (uint64_t)timeout.tv_usec * 1000ULL;
+    t->deadline = dmr_time_monotonic() + t->interval;
     t->cb = cb;
     t->userdata = userdata;
     t->once = once;
-    DMR_LIST_INSERT_HEAD(&io->timer->head, t, entries);
+    if (io_timer_push(io, t) != 0) {
+        dmr_free(t);
+        return NULL;
+    }
     io->entries++;
+    return t;
+}
+
+DMR_API int dmr_io_cancel_timer(dmr_io *io, dmr_io_timer *timer)
+{
+    if (io == NULL || timer == NULL)
+        return dmr_error(DMR_EINVAL);
+
+    if (timer == io->timer_running) {
+        /* Freed by io_handle_timers after the callback returns */
+        timer->cancelled = true;
+        return 0;
+    }
+    if (timer->index >= io->timers || io->timer[timer->index] != timer)
+        return dmr_error(DMR_EINVAL);
+
+    io_timer_remove(io, timer);
+    io->entries--;
+    dmr_free(timer);
     return 0;
 }
 
@@ -567,14 +1112,13 @@ DMR_API int dmr_io_del_timer(dmr_io *io, dmr_timer_cb cb)
     if (io == NULL)
         return dmr_error(DMR_EINVAL);
 
-    dmr_io_timer *timer, *next;
-    DMR_LIST_FOREACH_SAFE(timer, &io->timer->head, entries, next) {
-        if (timer->cb == cb) {
-            DMR_LIST_REMOVE(timer, entries);
-            io->entries--;
-            dmr_free(timer);
-            return 0;
-        }
+    if (io->timer_running != NULL && io->timer_running->cb == cb && !io->timer_running->cancelled)
+        return dmr_io_cancel_timer(io, io->timer_running);
+
+    size_t i;
+    for (i = 0; i < io->timers; i++) {
+        if (io->timer[i]->cb == cb)
+            return dmr_io_cancel_timer(io, io->timer[i]);
     }
 
     return 0;
@@ -0,0 +1,326 @@
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "dmr/config.h"
+#if defined(DMR_HAVE_SCHED_SETAFFINITY)
+#include <sched.h>
+#endif
+#include "dmr/error.h"
+#include "dmr/io.h"
+#include "dmr/log.h"
+#include "dmr/malloc.h"
+
+/* Defined in io.c */
+DMR_PRV int io_wake_open(int fd[2]);
+DMR_PRV void io_wake_close(int fd[2]);
+DMR_PRV void io_wake(int wfd);
+DMR_PRV void io_wake_drain(int rfd);
+
+/* Handoff */
+
+DMR_PRV static int io_handoff_readable(dmr_io *io, void *handoffptr, int fd)
+{
+    dmr_io_handoff *handoff = (dmr_io_handoff *)handoffptr;
+    dmr_parsed_packet parsed;
+    size_t n = 0;
+
+    io_wake_drain(fd);
+
+    /* Clear pending before draining the ring: a packet sent after this point
+     * either shows up in the loop below or triggers a new wake up. */
+    __atomic_store_n(&handoff->pending, false, __ATOMIC_SEQ_CST);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    /* Don't starve the other callbacks on this loop, if the producer keeps
+     * up with us we continue on the next iteration. */
+    while (n < handoff->ring->size && dmr_packetq_ring_shift(handoff->ring, &parsed) == 0) {
+        handoff->cb(io, handoff->userdata, &parsed);
+        n++;
+    }
+    if (n == handoff->ring->size && dmr_packetq_ring_len(handoff->ring) > 0 &&
+        !__atomic_exchange_n(&handoff->pending, true, __ATOMIC_SEQ_CST)) {
+        io_wake(handoff->wfd);
+    }
+
+    return 0;
+}
+
+DMR_API dmr_io_handoff *dmr_io_handoff_new(dmr_io *io, size_t size, dmr_io_handoff_cb cb, void *userdata)
+{
+    if (io == NULL || cb == NULL) {
+        dmr_error(DMR_EINVAL);
+        return NULL;
+    }
+    if (size == 0)
+        size = DMR_IO_HANDOFF_SIZE;
+
+    DMR_MALLOC_CHECK(dmr_io_handoff, handoff);
+    handoff->io = io;
+    handoff->cb = cb;
+    handoff->userdata = userdata;
+    handoff->rfd = handoff->wfd = -1;
+    DMR_NULL_CHECK_FREE(handoff->ring = dmr_packetq_ring_new(size, DMR_PACKETQ_REJECT), handoff);
+    talloc_steal(handoff, handoff->ring);
+
+    int fd[2];
+    if (io_wake_open(fd) != 0) {
+        dmr_free(handoff);
+        return NULL;
+    }
+    handoff->rfd = fd[0];
+    handoff->wfd = fd[1];
+    if (dmr_io_reg_read(io, handoff->rfd, io_handoff_readable, handoff, false) != 0) {
+        io_wake_close(fd);
+        dmr_free(handoff);
+        return NULL;
+    }
+
+    return handoff;
+}
+
+DMR_API void dmr_io_handoff_free(dmr_io_handoff *handoff)
+{
+    if (handoff == NULL)
+        return;
+
+    int fd[2] = { handoff->rfd, handoff->wfd };
+    dmr_io_del_read(handoff->io, handoff->rfd, io_handoff_readable);
+    io_wake_close(fd);
+    dmr_free(handoff);
+}
+
+DMR_API int dmr_io_handoff_send(dmr_io_handoff *handoff, dmr_parsed_packet *parsed)
+{
+    DMR_ERROR_IF_NULL(handoff, DMR_EINVAL);
+    DMR_ERROR_IF_NULL(parsed, DMR_EINVAL);
+
+    if (dmr_packetq_ring_add(handoff->ring, parsed) != 0)
+        return -1;
+
+    /* Only the first packet after the consumer drained the ring wakes it up */
+    if (!__atomic_exchange_n(&handoff->pending, true, __ATOMIC_SEQ_CST))
+        io_wake(handoff->wfd);
+
+    return 0;
+}
+
+/* Group */
+
+typedef struct {
+    dmr_io_group *group;
+    size_t       loop;
+} io_group_arg;
+
+/* dmr_io_loop resets the closed flag when it starts, closing from within the
+ * loop also works for a close that raced with the thread starting up. */
+DMR_PRV static int io_group_close_loop(dmr_io *io, void *unused)
+{
+    DMR_UNUSED(unused);
+    return dmr_io_close(io);
+}
+
+DMR_PRV static void io_group_pin(size_t loop, int cpu)
+{
+#if defined(DMR_HAVE_SCHED_SETAFFINITY)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof set, &set) == -1) {
+        dmr_log_error("io: loop %zu: can't pin to CPU %d: %s",
+            loop, cpu, strerror(errno));
+    } else {
+        dmr_log_debug("io: loop %zu: pinned to CPU %d", loop, cpu);
+    }
+#else
+    dmr_log_warn("io: loop %zu: CPU affinity not supported, not pinning to CPU %d",
+        loop, cpu);
+#endif
+}
+
+DMR_PRV static int io_group_thread(void *argptr)
+{
+    io_group_arg *arg = (io_group_arg *)argptr;
+    dmr_io_group *group = arg->group;
+    size_t loop = arg->loop;
+    char name[16];
+
+    snprintf(name, sizeof name, "dmr-io/%zu", loop);
+    dmr_thread_name_set(name);
+    if (group->cpu[loop] >= 0)
+        io_group_pin(loop, group->cpu[loop]);
+
+    dmr_log_debug("io: loop %zu: running", loop);
+    return dmr_io_loop(group->io[loop]);
+}
+
+DMR_API dmr_io_group *dmr_io_group_new(size_t loops)
+{
+    size_t i;
+
+    if (loops == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        loops = cpus > 0 ? (size_t)cpus : 1;
+    }
+
+    DMR_MALLOC_CHECK(dmr_io_group, group);
+    group->loops = loops;
+    DMR_NULL_CHECK_FREE(group->io = dmr_palloc_size(group, loops * sizeof(dmr_io *)), group);
+    DMR_NULL_CHECK_FREE(group->cpu = dmr_palloc_size(group, loops * sizeof(int)), group);
+    DMR_NULL_CHECK_FREE(group->protocols = dmr_palloc_size(group, loops * sizeof(size_t)), group);
+    DMR_NULL_CHECK_FREE(group->thread = dmr_palloc_size(group, loops * sizeof(dmr_thread_t)), group);
+
+    for (i = 0; i < loops; i++) {
+        group->cpu[i] = -1;
+    }
+    for (i = 0; i < loops; i++) {
+        if ((group->io[i] = dmr_io_new()) == NULL)
+            goto bail;
+        talloc_steal(group, group->io[i]);
+        /* loops without protocols wait for posted work, until closed */
+        group->io[i]->persistent = true;
+    }
+
+    return group;
+
+bail:
+    dmr_io_group_free(group);
+    return NULL;
+}
+
+DMR_API int dmr_io_group_free(dmr_io_group *group)
+{
+    if (group == NULL)
+        return 0;
+    if (group->running) {
+        dmr_log_error("io: can't free group with running loops");
+        return dmr_error(DMR_EINVAL);
+    }
+
+    size_t i;
+    for (i = 0; i < group->loops; i++) {
+        if (group->io[i] != NULL)
+            dmr_io_free(group->io[i]);
+    }
+    dmr_free(group);
+    return 0;
+}
+
+DMR_API int dmr_io_group_affinity(dmr_io_group *group, size_t loop, int cpu)
+{
+    DMR_ERROR_IF_NULL(group, DMR_EINVAL);
+    if (loop >= group->loops || group->running)
+        return dmr_error(DMR_EINVAL);
+
+    group->cpu[loop] = cpu;
+    return 0;
+}
+
+DMR_API dmr_io *dmr_io_group_loop(dmr_io_group *group, size_t loop)
+{
+    if (group == NULL || loop >= group->loops) {
+        dmr_error(DMR_EINVAL);
+        return NULL;
+    }
+    return group->io[loop];
+}
+
+DMR_API int dmr_io_group_add_protocol(dmr_io_group *group, dmr_protocol protocol, void *instance)
+{
+    DMR_ERROR_IF_NULL(group, DMR_EINVAL);
+    if (group->running) {
+        /* the loops are not thread safe */
+        dmr_log_error("io: can't add protocol %s to running group", protocol.name);
+        return dmr_error(DMR_EINVAL);
+    }
+
+    size_t i, loop = 0;
+    for (i = 1; i < group->loops; i++) {
+        if (group->protocols[i] < group->protocols[loop])
+            loop = i;
+    }
+
+    if (dmr_io_add_protocol(group->io[loop], protocol, instance) != 0)
+        return -1;
+
+    group->protocols[loop]++;
+    dmr_log_debug("io: protocol %s on loop %zu", protocol.name, loop);
+    return loop;
+}
+
+DMR_API int dmr_io_group_start(dmr_io_group *group)
+{
+    DMR_ERROR_IF_NULL(group, DMR_EINVAL);
+    if (group->running)
+        return dmr_error(DMR_EINVAL);
+
+#if !defined(_DMR_THREAD_WIN32_)
+    /* The loop threads inherit a fully blocked mask, so process directed
+     * signals are never delivered to them and stay pending for the signalfd,
+     * or go to the calling thread that runs the self-pipe handler. */
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+#endif
+
+    size_t i;
+    for (i = 0; i < group->loops; i++) {
+        io_group_arg *arg = dmr_palloc(group, io_group_arg);
+        if (arg == NULL) {
+            dmr_error(DMR_ENOMEM);
+            break;
+        }
+        arg->group = group;
+        arg->loop = i;
+        if (dmr_thread_create(&group->thread[i], io_group_thread, arg) != dmr_thread_success) {
+            dmr_error_set("io: can't start thread for loop %zu", i);
+            break;
+        }
+    }
+#if !defined(_DMR_THREAD_WIN32_)
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+#endif
+
+    group->running = true;
+    if (i < group->loops) {
+        /* stop what we've started */
+        size_t started = i;
+        dmr_io_group_close(group);
+        for (i = 0; i < started; i++) {
+            dmr_thread_join(group->thread[i], NULL);
+        }
+        group->running = false;
+        return -1;
+    }
+
+    return 0;
+}
+
+DMR_API int dmr_io_group_close(dmr_io_group *group)
+{
+    DMR_ERROR_IF_NULL(group, DMR_EINVAL);
+
+    size_t i;
+    int ret = 0;
+    for (i = 0; i < group->loops; i++) {
+        if (dmr_io_post(group->io[i], io_group_close_loop, NULL) != 0)
+            ret = -1;
+    }
+    return ret;
+}
+
+DMR_API int dmr_io_group_join(dmr_io_group *group)
+{
+    DMR_ERROR_IF_NULL(group, DMR_EINVAL);
+    if (!group->running)
+        return 0;
+
+    size_t i;
+    int ret = 0, res;
+    for (i = 0; i < group->loops; i++) {
+        if (dmr_thread_join(group->thread[i], &res) != dmr_thread_success || res != 0)
+            ret = -1;
+    }
+    group->running = false;
+    return ret;
+}
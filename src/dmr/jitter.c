@@ -0,0 +1,277 @@
+#include "dmr/bits.h"
+#include "dmr/config.h"
+#include "dmr/error.h"
+#include "dmr/jitter.h"
+#include "dmr/log.h"
+#include "dmr/malloc.h"
+#include "dmr/payload/emb.h"
+#include "dmr/payload/sync.h"
+#include "common/byte.h"
+
+#define JITTER_BURST_NS ((int64_t)DMR_JITTER_BURST_MS * 1000000LL)
+
+/* Sequence numbers are 8 bits and wrap, their difference is signed. */
+#define SEQ_DIFF(a,b)   ((int8_t)((uint8_t)(a) - (uint8_t)(b)))
+
+/* A silent AMBE+2 frame, as 72 interleaved bits. */
+static const uint8_t ambe_silence[9] = {
+    0xb9, 0xe8, 0x81, 0x52, 0x61, 0x73, 0x00, 0x2a, 0x6b
+};
+
+DMR_API dmr_jitter *dmr_jitter_new(void)
+{
+    DMR_MALLOC_CHECK(dmr_jitter, jitter);
+    dmr_ts ts;
+    for (ts = 0; ts < DMR_TS_INVALID; ts++) {
+        jitter->ts[ts].stats.delay_ms = DMR_JITTER_MIN_MS;
+    }
+    return jitter;
+}
+
+DMR_API void dmr_jitter_free(dmr_jitter *jitter)
+{
+    dmr_free(jitter);
+}
+
+/* Drop the buffered bursts and forget the stream. */
+static void jitter_end_stream(dmr_jitter_ts *t)
+{
+    memset(t->used, 0, sizeof(t->used));
+    t->stats.depth = 0;
+    t->active = false;
+    t->ended = true;
+    t->playing = false;
+    t->have_last = false;
+}
+
+static void jitter_new_stream(dmr_jitter_ts *t, dmr_parsed_packet *parsed, uint64_t now)
+{
+    t->stats.overflow += t->stats.depth;
+    jitter_end_stream(t);
+    t->stream_id = parsed->stream_id;
+    t->active = true;
+    t->ended = false;
+    t->next = parsed->sequence;
+    t->highest = parsed->sequence;
+    t->last_sequence = parsed->sequence;
+    t->concealed = 0;
+    t->starved = 0;
+    t->color_code = parsed->color_code;
+    t->first_arrival = now;
+    t->last_arrival = now;
+    t->stats.streams++;
+}
+
+/* Interarrival jitter as in RFC 3550, the difference between the arrival
+ * spacing and the burst spacing of two in order bursts, smoothed. */
+static void jitter_update_delay(dmr_jitter_ts *t, uint8_t sequence, uint64_t now)
+{
+    int64_t d = (int64_t)(now - t->last_arrival) -
+                SEQ_DIFF(sequence, t->last_sequence) * JITTER_BURST_NS;
+    if (d < 0)
+        d = -d;
+
+    t->jitter += d - ((t->jitter + 8) >> 4);
+    t->last_arrival = now;
+    t->last_sequence = sequence;
+
+    unsigned jitter_ms = (unsigned)((t->jitter >> 4) / 1000000ULL);
+    t->stats.jitter_ms = jitter_ms;
+    t->stats.delay_ms = min(DMR_JITTER_MAX_MS, DMR_JITTER_MIN_MS + 2 * jitter_ms);
+}
+
+DMR_API int dmr_jitter_add(dmr_jitter *jitter, dmr_parsed_packet *parsed, uint64_t now)
+{
+    DMR_ERROR_IF_NULL(jitter, DMR_EINVAL);
+    DMR_ERROR_IF_NULL(parsed, DMR_EINVAL);
+    if (parsed->ts >= DMR_TS_INVALID)
+        return dmr_error(DMR_EINVAL);
+
+    dmr_jitter_ts *t = &jitter->ts[parsed->ts];
+    uint8_t sequence = parsed->sequence;
+
+    if (t->active ? parsed->stream_id != t->stream_id
+                  : !(t->ended && parsed->stream_id == t->stream_id)) {
+        jitter_new_stream(t, parsed, now);
+    } else if (!t->active) {
+        dmr_log_trace("jitter: %s burst %u after the end of stream 0x%08x",
+            dmr_ts_name(parsed->ts), sequence, parsed->stream_id);
+        t->stats.late++;
+        return 0;
+    }
+    t->stats.received++;
+
+    int8_t ahead = SEQ_DIFF(sequence, t->next);
+    if (ahead < 0) {
+        if (t->playing) {
+            dmr_log_trace("jitter: %s burst %u late, playing %u",
+                dmr_ts_name(parsed->ts), sequence, t->next);
+            t->stats.late++;
+            return 0;
+        }
+        /* arrived before the burst playout would have started with */
+        t->next = sequence;
+        ahead = 0;
+    }
+    /* a gap longer than the buffer, give up on the oldest bursts */
+    while (ahead >= DMR_JITTER_SLOTS) {
+        uint8_t i = t->next & DMR_JITTER_MASK;
+        if (t->used[i]) {
+            t->used[i] = false;
+            t->stats.depth--;
+            t->stats.overflow++;
+        } else {
+            t->stats.lost++;
+        }
+        t->next++;
+        ahead--;
+    }
+
+    uint8_t i = sequence & DMR_JITTER_MASK;
+    if (t->used[i]) {
+        t->stats.duplicate++;
+        return 0;
+    }
+
+    if (SEQ_DIFF(sequence, t->highest) < 0) {
+        t->stats.reordered++;
+    } else {
+        t->highest = sequence;
+        if (sequence != t->last_sequence)
+            jitter_update_delay(t, sequence, now);
+    }
+
+    byte_copy(&t->slot[i], parsed, sizeof(dmr_parsed_packet));
+    t->used[i] = true;
+    t->stats.depth++;
+    return 0;
+}
+
+/* Write the three AMBE frames around the sync or EMB in the middle. */
+static void jitter_silence(dmr_packet packet)
+{
+    uint8_t voice[27], i;
+    for (i = 0; i < 3; i++) {
+        byte_copy(voice + i * 9, ambe_silence, sizeof(ambe_silence));
+    }
+    byte_copy(packet, voice, 13);
+    packet[13] = (voice[13] & 0xf0) | (packet[13] & 0x0f);
+    packet[19] = (packet[19] & 0xf0) | (voice[13] & 0x0f);
+    byte_copy(packet + 20, voice + 14, 13);
+}
+
+/* Fill in for a lost voice burst, the next one in the superframe. */
+static void jitter_conceal(dmr_jitter_ts *t, dmr_parsed_packet *parsed_out)
+{
+    byte_copy(parsed_out, &t->last, sizeof(dmr_parsed_packet));
+    parsed_out->sequence = t->next;
+    parsed_out->voice_frame = (t->last.voice_frame + 1) % 6;
+    if (t->concealed >= DMR_JITTER_REPEAT_MAX)
+        jitter_silence(parsed_out->packet);
+
+    if (parsed_out->voice_frame == 0) {
+        parsed_out->data_type = DMR_DATA_TYPE_VOICE_SYNC;
+        dmr_sync_pattern_encode(parsed_out->packet, DMR_SYNC_PATTERN_BS_SOURCED_VOICE);
+    } else {
+        /* the embedded LC fragment is lost with the burst, send null EMB */
+        dmr_emb emb = {
+            .color_code = t->color_code,
+            .pi         = false,
+            .lcss       = DMR_EMB_LCSS_SINGLE_FRAGMENT
+        };
+        parsed_out->data_type = DMR_DATA_TYPE_VOICE;
+        dmr_emb_lcss_fragment_encode(parsed_out->packet, &emb, NULL, 0);
+    }
+
+    byte_copy(&t->last, parsed_out, sizeof(dmr_parsed_packet));
+    t->concealed++;
+    t->stats.concealed++;
+}
+
+DMR_API int dmr_jitter_shift(dmr_jitter *jitter, dmr_ts ts, dmr_parsed_packet *parsed_out, uint64_t now)
+{
+    DMR_ERROR_IF_NULL(jitter, DMR_EINVAL);
+    DMR_ERROR_IF_NULL(parsed_out, DMR_EINVAL);
+    if (ts >= DMR_TS_INVALID)
+        return dmr_error(DMR_EINVAL);
+
+    dmr_jitter_ts *t = &jitter->ts[ts];
+    if (!t->active)
+        return -1;
+
+    if (!t->playing) {
+        /* wait for the delay, or until that many bursts are buffered */
+        if (t->stats.depth == 0)
+            return -1;
+        if (t->stats.depth * DMR_JITTER_BURST_MS <= t->stats.delay_ms &&
+            now - t->first_arrival < (uint64_t)t->stats.delay_ms * 1000000ULL)
+            return -1;
+        t->playing = true;
+    }
+
+    for (;;) {
+        uint8_t i = t->next & DMR_JITTER_MASK;
+        if (t->used[i]) {
+            byte_copy(parsed_out, &t->slot[i], sizeof(dmr_parsed_packet));
+            t->used[i] = false;
+            t->stats.depth--;
+            t->stats.played++;
+            t->next++;
+            t->concealed = 0;
+            t->starved = 0;
+
+            switch (parsed_out->data_type) {
+            case DMR_DATA_TYPE_VOICE: {
+                    dmr_emb emb;
+                    if (dmr_emb_decode(parsed_out->packet, &emb) == 0)
+                        t->color_code = emb.color_code;
+                }
+                /* fall through */
+            case DMR_DATA_TYPE_VOICE_SYNC:
+                byte_copy(&t->last, parsed_out, sizeof(dmr_parsed_packet));
+                if (parsed_out->data_type == DMR_DATA_TYPE_VOICE_SYNC)
+                    t->last.voice_frame = 0;
+                t->have_last = true;
+                break;
+            case DMR_DATA_TYPE_TERMINATOR_WITH_LC:
+                jitter_end_stream(t);
+                break;
+            default:
+                break;
+            }
+            return 0;
+        }
+
+        if (t->stats.depth == 0 && ++t->starved > DMR_JITTER_STARVE_MAX) {
+            dmr_log_debug("jitter: %s stream 0x%08x ended without terminator",
+                dmr_ts_name(ts), t->stream_id);
+            jitter_end_stream(t);
+            return -1;
+        }
+
+        if (t->have_last) {
+            t->stats.lost++;
+            t->stats.played++;
+            jitter_conceal(t, parsed_out);
+            t->next++;
+            return 0;
+        }
+
+        /* nothing to conceal a lost header or data burst with, skip it */
+        if (t->stats.depth == 0)
+            return -1;
+        t->stats.lost++;
+        t->next++;
+    }
+}
+
+DMR_API int dmr_jitter_stats_get(dmr_jitter *jitter, dmr_ts ts, dmr_jitter_stats *stats)
+{
+    DMR_ERROR_IF_NULL(jitter, DMR_EINVAL);
+    DMR_ERROR_IF_NULL(stats, DMR_EINVAL);
+    if (ts >= DMR_TS_INVALID)
+        return dmr_error(DMR_EINVAL);
+
+    byte_copy(stats, &jitter->ts[ts].stats, sizeof(dmr_jitter_stats));
+    return 0;
+}
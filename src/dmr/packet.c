@@ -6,6 +6,8 @@
 #include "dmr/error.h"
 #include "dmr/log.h"
 #include "dmr/packet.h"
+#include "dmr/pool.h"
+#include "dmr/thread.h"
 #include "dmr/payload/lc.h"
 #include "dmr/payload/sync.h"
 #include "dmr/fec/golay_20_8.h"
@@ -56,9 +58,10 @@ DMR_PRV static char *ts_name[] = {
 #define PACKET_DUMP_COLS 11
 DMR_API void dmr_dump_packet(dmr_packet packet)
 {
-    dmr_sync_pattern pattern = dmr_sync_pattern_decode(packet);
+    uint8_t distance;
+    dmr_sync_pattern pattern = dmr_sync_pattern_classify(packet, &distance);
     if (pattern != DMR_SYNC_PATTERN_UNKNOWN) {
-        dmr_log_debug("packet: sync pattern: %s", dmr_sync_pattern_name(pattern));
+        dmr_log_debug("packet: sync pattern: %s (%u bit errors)", dmr_sync_pattern_name(pattern), distance);
     }
 
     dmr_data_type data_type;
@@ -200,10 +203,91 @@ DMR_API void dmr_dump_parsed_packet(dmr_parsed_packet *parsed)
     fflush(stdout);
 }
 
+/* Parsed packets are recycled through a pool per thread. */
+DMR_PRV static _dmr_thread_local dmr_pool *parsed_packet_pool = NULL;
+
+DMR_API dmr_pool *dmr_parsed_packet_pool(void)
+{
+    return dmr_pool_local(&parsed_packet_pool, sizeof(dmr_parsed_packet));
+}
+
+DMR_API dmr_parsed_packet *dmr_parsed_packet_new(void)
+{
+    return dmr_pool_get(dmr_parsed_packet_pool());
+}
+
+DMR_API void dmr_parsed_packet_free(dmr_parsed_packet *parsed)
+{
+    dmr_pool_put(dmr_parsed_packet_pool(), parsed);
+}
+
+DMR_PRV static _dmr_thread_local dmr_pool *packet_ref_pool = NULL;
+
+DMR_API dmr_packet_ref *dmr_packet_ref_new(dmr_parsed_packet *parsed)
+{
+    if (parsed == NULL) {
+        dmr_error(DMR_EINVAL);
+        return NULL;
+    }
+
+    dmr_packet_ref *ref = dmr_pool_get(dmr_pool_local(&packet_ref_pool, sizeof(dmr_packet_ref)));
+    if (ref == NULL)
+        return NULL;
+
+    ref->parsed = parsed;
+    ref->refs = 1;
+    return ref;
+}
+
+DMR_API dmr_packet_ref *dmr_packet_ref_get(dmr_packet_ref *ref)
+{
+    if (ref != NULL)
+        __atomic_add_fetch(&ref->refs, 1, __ATOMIC_RELAXED);
+    return ref;
+}
+
+DMR_API void dmr_packet_ref_put(dmr_packet_ref *ref)
+{
+    if (ref == NULL)
+        return;
+    if (__atomic_sub_fetch(&ref->refs, 1, __ATOMIC_ACQ_REL) > 0)
+        return;
+
+    dmr_parsed_packet_free(ref->parsed);
+    dmr_pool_put(dmr_pool_local(&packet_ref_pool, sizeof(dmr_packet_ref)), ref);
+}
+
+DMR_API dmr_parsed_packet *dmr_packet_ref_writable(dmr_packet_ref **ref)
+{
+    if (ref == NULL || *ref == NULL) {
+        dmr_error(DMR_EINVAL);
+        return NULL;
+    }
+
+    dmr_packet_ref *shared = *ref;
+    if (__atomic_load_n(&shared->refs, __ATOMIC_ACQUIRE) == 1)
+        return shared->parsed;
+
+    dmr_parsed_packet *parsed = dmr_parsed_packet_new();
+    if (parsed == NULL)
+        return NULL;
+    byte_copy(parsed, shared->parsed, sizeof(dmr_parsed_packet));
+
+    dmr_packet_ref *copy = dmr_packet_ref_new(parsed);
+    if (copy == NULL) {
+        dmr_parsed_packet_free(parsed);
+        return NULL;
+    }
+
+    dmr_packet_ref_put(shared);
+    *ref = copy;
+    return parsed;
+}
+
 dmr_parsed_packet *dmr_packet_decode(dmr_packet packet)
 {
     dmr_parsed_packet *parsed;
-    if ((parsed = talloc_zero(NULL, dmr_parsed_packet)) == NULL) {
+    if ((parsed = dmr_parsed_packet_new()) == NULL) {
         dmr_error(DMR_ENOMEM);
         return NULL;
     }
@@ -265,6 +349,32 @@ DMR_API int dmr_payload_bits(dmr_packet packet, void *bits)
     return 0;
 }
 
+DMR_API int dmr_payload_bitvec(dmr_packet packet, dmr_bitvec bits[DMR_BITVEC_WORDS(DMR_PAYLOAD_BITS)])
+{
+    if (packet == NULL || bits == NULL)
+        return dmr_error(DMR_EINVAL);
+
+    dmr_bitvec data[DMR_BITVEC_WORDS(DMR_PACKET_BITS)];
+    dmr_bitvec_from_bytes(data, packet, DMR_PACKET_LEN);
+    dmr_bitvec_zero(bits, DMR_PAYLOAD_BITS);
+    dmr_bitvec_copy(bits,  0, data,   0, 98);
+    dmr_bitvec_copy(bits, 98, data, 166, 98);
+    return 0;
+}
+
+DMR_API int dmr_payload_bitvec_encode(dmr_packet packet, const dmr_bitvec bits[DMR_BITVEC_WORDS(DMR_PAYLOAD_BITS)])
+{
+    if (packet == NULL || bits == NULL)
+        return dmr_error(DMR_EINVAL);
+
+    dmr_bitvec data[DMR_BITVEC_WORDS(DMR_PACKET_BITS)];
+    dmr_bitvec_from_bytes(data, packet, DMR_PACKET_LEN);
+    dmr_bitvec_copy(data,   0, bits,  0, 98);
+    dmr_bitvec_copy(data, 166, bits, 98, 98);
+    dmr_bitvec_to_bytes(data, packet, DMR_PACKET_LEN);
+    return 0;
+}
+
 DMR_API char *dmr_fid_name(dmr_fid fid)
 {
     uint8_t i;
@@ -353,6 +463,17 @@ char *dmr_data_type_name_short(dmr_data_type data_type)
     }
 }
 
+/* See Table E.1: Transmit bit order for BPTC general data burst with SYNC */
+DMR_PRV static void slot_type_bytes(dmr_packet packet, uint8_t bytes[3])
+{
+    bytes[0]  = (packet[12] << 2) & B11111100;
+    bytes[0] |= (packet[13] >> 6) & B00000011;
+    bytes[1]  = (packet[13] << 2) & B11000000;
+    bytes[1] |= (packet[19] << 2) & B00111100;
+    bytes[1] |= (packet[20] >> 6) & B00000011;
+    bytes[2]  = (packet[20] << 2) & B11110000;
+}
+
 DMR_API int dmr_slot_type_decode(dmr_packet packet, dmr_color_code *color_code, dmr_data_type *data_type)
 {
     dmr_log_trace("packet: slot type decode");
@@ -360,14 +481,7 @@ DMR_API int dmr_slot_type_decode(dmr_packet packet, dmr_color_code *color_code,
         return dmr_error(DMR_EINVAL);
 
     uint8_t bytes[3];
-    memset(bytes, 0, sizeof(bytes));
-    /* See Table E.1: Transmit bit order for BPTC general data burst with SYNC */
-    bytes[0]  = (packet[12] << 2) & B11111100;
-    bytes[0] |= (packet[13] >> 6) & B00000011;
-    bytes[1]  = (packet[13] << 2) & B11000000;
-    bytes[1] |= (packet[19] << 2) & B11110000;
-    bytes[1] |= (packet[20] >> 6) & B00000011;
-    bytes[2]  = (packet[20] << 2) & B11110000;
+    slot_type_bytes(packet, bytes);
 
     uint8_t code = dmr_golay_20_8_decode(bytes);
     dmr_log_debug("packet: slot type Golay(20, 8) code: 0x%02x%02x%02x -> 0x%02x",
@@ -386,6 +500,34 @@ DMR_API int dmr_slot_type_decode(dmr_packet packet, dmr_color_code *color_code,
     return 0;
 }
 
+DMR_API int dmr_slot_type_decode_batch(dmr_packet *packets, size_t n, dmr_color_code *color_code, dmr_data_type *data_type)
+{
+    if (packets == NULL || (n > 0 && (color_code == NULL || data_type == NULL)))
+        return dmr_error(DMR_EINVAL);
+
+    uint32_t code[DMR_GOLAY_20_8_BATCH];
+    uint8_t slot_type[DMR_GOLAY_20_8_BATCH], bytes[3];
+    size_t i, len;
+    while (n > 0) {
+        len = n < DMR_GOLAY_20_8_BATCH ? n : DMR_GOLAY_20_8_BATCH;
+        for (i = 0; i < len; i++) {
+            slot_type_bytes(packets[i], bytes);
+            code[i] = DMR_GOLAY_20_8_CODE(bytes);
+        }
+        dmr_golay_20_8_decode_batch(code, slot_type, len);
+        for (i = 0; i < len; i++) {
+            color_code[i] = (slot_type[i] & B11110000) >> 4;
+            data_type[i] = (slot_type[i] & B00001111);
+        }
+        packets += len;
+        color_code += len;
+        data_type += len;
+        n -= len;
+    }
+
+    return 0;
+}
+
 DMR_API int dmr_slot_type_encode(dmr_packet packet, dmr_color_code color_code, dmr_data_type data_type)
 {
     dmr_log_trace("packet: slot type encode");
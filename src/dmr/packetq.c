@@ -2,8 +2,28 @@
 #include "dmr/config.h"
 #include "dmr/error.h"
 #include "dmr/packetq.h"
+#include "dmr/pool.h"
+#include "dmr/thread.h"
 #include "common/byte.h"
 
+/* Queue entries are recycled through a pool per thread. */
+DMR_PRV static _dmr_thread_local dmr_pool *packetq_entry_pool = NULL;
+
+DMR_API dmr_pool *dmr_packetq_entry_pool(void)
+{
+    return dmr_pool_local(&packetq_entry_pool, sizeof(dmr_packetq_entry));
+}
+
+DMR_PRV static int packetq_destructor(dmr_packetq *q)
+{
+    dmr_packetq_entry *entry, *next;
+    DMR_TAILQ_FOREACH_SAFE(entry, &q->head, entries, next) {
+        DMR_TAILQ_REMOVE(&q->head, entry, entries);
+        dmr_pool_put(dmr_packetq_entry_pool(), entry);
+    }
+    return 0;
+}
+
 DMR_API dmr_packetq *dmr_packetq_new(void)
 {
     dmr_packetq *q = talloc_zero(NULL, dmr_packetq);
@@ -11,6 +31,7 @@ DMR_API dmr_packetq *dmr_packetq_new(void)
         return NULL;
     }
     DMR_TAILQ_INIT(&q->head);
+    talloc_set_destructor(q, packetq_destructor);
     return q;    
 }
 
@@ -19,7 +40,7 @@ DMR_API int dmr_packetq_add(dmr_packetq *q, dmr_parsed_packet *parsed)
     if (q == NULL || parsed == NULL)
         return dmr_error(DMR_EINVAL);
 
-    dmr_packetq_entry *e = talloc_zero(q, dmr_packetq_entry);
+    dmr_packetq_entry *e = dmr_pool_get(dmr_packetq_entry_pool());
     if (e == NULL) {
         return DMR_OOM();
     }
@@ -35,7 +56,7 @@ DMR_API int dmr_packetq_add_packet(dmr_packetq *q, dmr_packet packet)
     if (q == NULL || packet == NULL)
         return dmr_error(DMR_EINVAL);
     
-    dmr_parsed_packet *parsed = talloc_zero(NULL, dmr_parsed_packet);
+    dmr_parsed_packet *parsed = dmr_parsed_packet_new();
     if (parsed == NULL) {
         return DMR_OOM();
     }
@@ -43,7 +64,11 @@ DMR_API int dmr_packetq_add_packet(dmr_packetq *q, dmr_packet packet)
     byte_copy(parsed->packet, packet, sizeof(dmr_packet));
     parsed->parsed = false;
 
-    return dmr_packetq_add(q, parsed);
+    if (dmr_packetq_add(q, parsed) != 0) {
+        dmr_parsed_packet_free(parsed);
+        return -1;
+    }
+    return 0;
 }
 
 DMR_API int dmr_packetq_shift(dmr_packetq *q, dmr_parsed_packet **parsed_out)
@@ -57,7 +82,7 @@ DMR_API int dmr_packetq_shift(dmr_packetq *q, dmr_parsed_packet **parsed_out)
     dmr_packetq_entry *e = DMR_TAILQ_FIRST(&q->head);
     DMR_TAILQ_REMOVE(&q->head, e, entries);
     dmr_parsed_packet *parsed = e->parsed;
-    TALLOC_FREE(e);
+    dmr_pool_put(dmr_packetq_entry_pool(), e);
 
     *parsed_out = parsed;
     return 0;
@@ -73,7 +98,7 @@ int dmr_packetq_shift_packet(dmr_packetq *q, dmr_packet packet_out)
 
     byte_copy(packet_out, parsed->packet, sizeof(dmr_packet));
 
-    TALLOC_FREE(parsed);
+    dmr_parsed_packet_free(parsed);
     return 0;
 }
 
@@ -85,8 +110,8 @@ int dmr_packetq_flush(dmr_packetq *q)
     dmr_packetq_entry *entry, *next;
     DMR_TAILQ_FOREACH_SAFE(entry, &q->head, entries, next) {
         DMR_TAILQ_REMOVE(&q->head, entry, entries);
-        TALLOC_FREE(entry->parsed);
-        TALLOC_FREE(entry);
+        dmr_parsed_packet_free(entry->parsed);
+        dmr_pool_put(dmr_packetq_entry_pool(), entry);
     }
 
     return 0;
@@ -0,0 +1,146 @@
+#include "dmr/config.h"
+#include "dmr/error.h"
+#include "dmr/malloc.h"
+#include "dmr/packetq.h"
+#include "common/byte.h"
+
+/* The producer owns head, the consumer owns tail. Both indices increase
+ * monotonically and are masked on slot access, so head - tail is the number
+ * of queued packets.
+ *
+ * With DMR_PACKETQ_DROP_OLDEST the producer also advances tail when the ring
+ * is full. The consumer therefore copies a slot first and then claims it with
+ * a compare-and-swap on tail; if the producer dropped the slot in the
+ * meantime, the copy may be torn, so the consumer discards it and retries. */
+#define RING_LOAD(p)        __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define RING_STORE(p,v)     __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#define RING_CAS(p,e,v)     __atomic_compare_exchange_n(p, e, v, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+
+DMR_API dmr_packetq_ring *dmr_packetq_ring_new(size_t size, dmr_packetq_policy policy)
+{
+    if (size < 2)
+        size = 2;
+
+    size_t slots = 1;
+    while (slots < size)
+        slots <<= 1;
+
+    DMR_MALLOC_CHECK(dmr_packetq_ring, r);
+    DMR_NULL_CHECK_FREE(r->slot = talloc_zero_array(r, dmr_parsed_packet, slots), r);
+    r->size = slots;
+    r->mask = slots - 1;
+    r->policy = policy;
+    return r;
+}
+
+DMR_API void dmr_packetq_ring_free(dmr_packetq_ring *r)
+{
+    dmr_free(r);
+}
+
+DMR_API int dmr_packetq_ring_add(dmr_packetq_ring *r, dmr_parsed_packet *parsed)
+{
+    if (r == NULL || parsed == NULL)
+        return dmr_error(DMR_EINVAL);
+
+    size_t head = r->head;
+    size_t tail = RING_LOAD(&r->tail);
+    if (head - tail >= r->size) {
+        if (r->policy == DMR_PACKETQ_REJECT) {
+            r->dropped++;
+            return -1;
+        }
+
+        /* If this fails, the consumer took the oldest packet and there is
+         * room now, so nothing was dropped. */
+        if (RING_CAS(&r->tail, &tail, tail + 1))
+            r->dropped++;
+    }
+
+    byte_copy(&r->slot[head & r->mask], parsed, sizeof(dmr_parsed_packet));
+    RING_STORE(&r->head, head + 1);
+
+    size_t len = head + 1 - RING_LOAD(&r->tail);
+    if (len > r->hwm)
+        r->hwm = len;
+
+    return 0;
+}
+
+DMR_API int dmr_packetq_ring_add_packet(dmr_packetq_ring *r, dmr_packet packet)
+{
+    if (r == NULL || packet == NULL)
+        return dmr_error(DMR_EINVAL);
+
+    dmr_parsed_packet parsed;
+    byte_zero(&parsed, sizeof parsed);
+    byte_copy(parsed.packet, packet, sizeof(dmr_packet));
+    parsed.parsed = false;
+
+    return dmr_packetq_ring_add(r, &parsed);
+}
+
+DMR_API int dmr_packetq_ring_shift(dmr_packetq_ring *r, dmr_parsed_packet *parsed_out)
+{
+    if (r == NULL || parsed_out == NULL)
+        return dmr_error(DMR_EINVAL);
+
+    size_t tail = RING_LOAD(&r->tail);
+    for (;;) {
+        if (tail == RING_LOAD(&r->head))
+            return -1;
+
+        byte_copy(parsed_out, &r->slot[tail & r->mask], sizeof(dmr_parsed_packet));
+        if (RING_CAS(&r->tail, &tail, tail + 1))
+            return 0;
+        /* tail was advanced by the producer, it now holds the new value */
+    }
+}
+
+DMR_API int dmr_packetq_ring_shift_packet(dmr_packetq_ring *r, dmr_packet packet_out)
+{
+    dmr_parsed_packet parsed;
+    int ret;
+
+    if ((ret = dmr_packetq_ring_shift(r, &parsed)) != 0)
+        return ret;
+
+    byte_copy(packet_out, parsed.packet, sizeof(dmr_packet));
+    return 0;
+}
+
+DMR_API int dmr_packetq_ring_foreach(dmr_packetq_ring *r, dmr_parsed_packet_cb cb, void *userdata)
+{
+    if (r == NULL || cb == NULL)
+        return dmr_error(DMR_EINVAL);
+
+    size_t pos, head = RING_LOAD(&r->head);
+    int ret;
+    for (pos = RING_LOAD(&r->tail); pos != head; pos++) {
+        if ((ret = cb(&r->slot[pos & r->mask], userdata)) != 0)
+            return ret;
+    }
+    return 0;
+}
+
+DMR_API int dmr_packetq_ring_foreach_packet(dmr_packetq_ring *r, dmr_packet_cb cb, void *userdata)
+{
+    if (r == NULL || cb == NULL)
+        return dmr_error(DMR_EINVAL);
+
+    size_t pos, head = RING_LOAD(&r->head);
+    int ret;
+    for (pos = RING_LOAD(&r->tail); pos != head; pos++) {
+        if ((ret = cb(r->slot[pos & r->mask].packet, userdata)) != 0)
+            return ret;
+    }
+    return 0;
+}
+
+DMR_API size_t dmr_packetq_ring_len(dmr_packetq_ring *r)
+{
+    if (r == NULL)
+        return 0;
+
+    return RING_LOAD(&r->head) - RING_LOAD(&r->tail);
+}
@@ -58,12 +58,7 @@ char *dmr_sap_name(dmr_sap sap)
 
 static uint16_t data_header_crc(uint8_t bytes[10])
 {
-    uint16_t crc = 0;
-    uint8_t i;
-    for (i = 0; i < 10; i++) {
-        dmr_crc16(&crc, bytes[i]);
-    }
-    dmr_crc16_finish(&crc);
+    uint16_t crc = dmr_crc16_block(bytes, 10);
     // Inverting according to the inversion polynomial.
     // Apply CRC mask, Table B.21: Data Type CRC Mask
     return (~crc) ^ 0xcccc;
@@ -78,19 +73,13 @@ int dmr_data_header_decode(dmr_packet packet, dmr_data_header *header, dmr_data_
     memset(bytes, 0, sizeof(bytes));
 
     // BPTC(196, 96) decode data
-    dmr_bptc_196_96 *bptc = talloc_zero(NULL, dmr_bptc_196_96);
-    if (bptc == NULL) {
-        dmr_log_error("data: BPTC(196,96) init failed: out of memory");
-        return dmr_error(DMR_ENOMEM);
-    }
+    dmr_bptc_196_96 bptc;
 
     dmr_log_trace("data: decoding BPTC(196, 96)");
-    if (dmr_bptc_196_96_decode(packet, bptc, bytes) != 0) {
+    if (dmr_bptc_196_96_decode(packet, &bptc, bytes) != 0) {
         dmr_log_error("data: BPTC(196,96) decode failed: %s", dmr_error_get());
-        TALLOC_FREE(bptc);
         return dmr_error(DMR_LASTERROR);
     }
-    TALLOC_FREE(bptc);
     dmr_dump_hex(bytes, 12);
 
     /* Bit field order is not guaranteed, we still have to parse */
@@ -184,7 +173,7 @@ int dmr_data_block_decode(dmr_packet packet, dmr_data_block *block, bool confirm
                 dmr_crc9(&crc, block->data[i], 8);
             }
             dmr_crc9(&crc, block->serial, 7);
-            dmr_crc9_finish(&crc, 8);
+            dmr_crc9_finish(&crc, 9);
             crc  = ~crc;
             crc &= 0x01ff;
             crc ^= 0x01ff;
@@ -28,7 +28,7 @@ int dmr_emb_decode(dmr_packet packet, dmr_emb *emb)
     /* See Table E.6: Transmit bit order for voice burst with embedded signalling fragment 1 */
     emb->color_code = (emb_bytes[0] >> 4) & 0x0f;
     emb->pi         = (emb_bytes[0] & 0x08) == 0x08;
-    emb->lcss       = (emb_bytes[0] >> 5) & 0x07;
+    emb->lcss       = (emb_bytes[0] >> 1) & 0x03;
 
     return 0;
 }
@@ -42,6 +42,10 @@ int dmr_emb_bytes_decode(dmr_packet packet, uint8_t bytes[4])
     bytes[0] |= (packet[15] >> 4) & 0x0f;
     bytes[1]  = (packet[15] << 4) & 0xf0;
     bytes[1] |= (packet[16] >> 4) & 0x0f;
+    bytes[2]  = (packet[16] << 4) & 0xf0;
+    bytes[2] |= (packet[17] >> 4) & 0x0f;
+    bytes[3]  = (packet[17] << 4) & 0xf0;
+    bytes[3] |= (packet[18] >> 4) & 0x0f;
     return 0;
 }
 
@@ -61,9 +65,9 @@ int dmr_emb_encode(dmr_packet packet, dmr_emb *emb)
         return dmr_error(DMR_EINVAL);
 
     uint8_t emb_bytes[2];
-    emb_bytes[0]  = (emb->color_code & 0x0f);
-    emb_bytes[0] |= (emb->pi  ? 0x01 : 0x00) << 4;
-    emb_bytes[0] |= (emb->lcss       & 0x03) << 5;
+    emb_bytes[0]  = (emb->color_code & 0x0f) << 4;
+    emb_bytes[0] |= (emb->pi  ? 0x01 : 0x00) << 3;
+    emb_bytes[0] |= (emb->lcss       & 0x03) << 1;
     emb_bytes[1]  = 0; // Will be calculated
     dmr_qr_16_7_encode(emb_bytes);
 
@@ -83,31 +87,16 @@ dmr_emb_signalling_lc_bits *dmr_emb_signalling_lc_interlave(dmr_emb_signalling_l
     if (interleaved == NULL)
         return NULL;
 
-    bool *bits = (bool *)interleaved;
+    /* The checksum bits follow the first 32 bits, then every 10 bits */
     uint8_t i, j;
-
-    for (i = 0, j = 0; i < sizeof(dmr_emb_signalling_lc_bits); i++) {
-        switch (i) {
-        case 32:
-            bits[i] = emb_bits->checksum[0];
-            break;
-        case 43:
-            bits[i] = emb_bits->checksum[1];
-            break;
-        case 54:
-            bits[i] = emb_bits->checksum[2];
-            break;
-        case 65:
-            bits[i] = emb_bits->checksum[3];
-            break;
-        case 76:
-            bits[i] = emb_bits->checksum[4];
-            break;
-        default:
-            bits[i] = emb_bits->bits[j++];
-            break;
-        }
+    dmr_bitvec_zero(interleaved->bits, 77);
+    dmr_bitvec_copy(interleaved->bits, 0, emb_bits->bits, 0, 32);
+    for (i = 0, j = 32; i < 5; i++, j += 10) {
+        dmr_bitvec_set(interleaved->bits, j + i, (emb_bits->checksum >> (4 - i)) & 1);
+        if (i < 4)
+            dmr_bitvec_copy(interleaved->bits, j + i + 1, emb_bits->bits, j, 10);
     }
+    interleaved->checksum = 0;
 
     return interleaved;
 }
@@ -122,11 +111,9 @@ static int dmr_emb_encode_signalling_lc_bytes(uint8_t *bytes, dmr_emb_signalling
     for (i = 0; i < 9; i++) {
         checksum += (uint16_t)bytes[i];
     }
-    checksum %= 31;
-    for (i = 0; i < 5; i++)
-        emb_bits->checksum[i] = (checksum >> (4 - i)) > 0;
+    emb_bits->checksum = checksum % 31;
 
-    dmr_bytes_to_bits(bytes, sizeof(bytes), emb_bits->bits, sizeof(bytes) * 8);
+    dmr_bitvec_from_bytes(emb_bits->bits, bytes, 9);
     return 0;
 }
 
@@ -183,16 +170,15 @@ int dmr_emb_lcss_fragment_encode(dmr_packet packet, dmr_emb *emb, dmr_vbptc_16_1
     if (emb == NULL || packet == NULL)
         return dmr_error(DMR_EINVAL);
 
-    bool bits[32];
+    dmr_bitvec bits[DMR_BITVEC_WORDS(32)];
     uint8_t lc_bytes[4];
-    memset(lc_bytes, 0, sizeof(lc_bytes));
     uint16_t offset = (uint16_t)(fragment) * 32;
-    memset(bits, 0, sizeof(bits));
+    dmr_bitvec_zero(bits, 32);
 
     if (vbptc != NULL && dmr_vbptc_16_11_get_fragment(vbptc, bits, offset, 32) != 0) {
        return dmr_error(DMR_LASTERROR);
     }
-    dmr_bits_to_bytes(bits, sizeof(bits), lc_bytes, sizeof(lc_bytes));
+    dmr_bitvec_to_bytes(bits, lc_bytes, sizeof(lc_bytes));
 
     packet[14] = (packet[14] & 0xf0) | (lc_bytes[0] >> 4);
     packet[15] = (lc_bytes[0]  << 4) | (lc_bytes[1] >> 4);
@@ -202,3 +188,119 @@ int dmr_emb_lcss_fragment_encode(dmr_packet packet, dmr_emb *emb, dmr_vbptc_16_1
 
     return dmr_emb_encode(packet, emb);
 }
+
+static void dmr_emb_lc_slot_reset(dmr_emb_lc_slot *slot, uint32_t stream_id)
+{
+    slot->stream_id    = stream_id;
+    slot->fragments    = 0;
+    slot->vbptc.matrix = slot->matrix;
+    slot->vbptc.rows   = DMR_EMB_LC_ROWS;
+    dmr_vbptc_16_11_wipe(&slot->vbptc);
+}
+
+void dmr_emb_lc_assembler_init(dmr_emb_lc_assembler *assembler)
+{
+    if (assembler == NULL)
+        return;
+
+    uint8_t ts;
+    for (ts = DMR_TS1; ts < DMR_TS_INVALID; ts++) {
+        dmr_emb_lc_slot_reset(&assembler->slot[ts], 0);
+    }
+}
+
+static int dmr_emb_lc_slot_decode(dmr_emb_lc_slot *slot, dmr_full_lc *lc)
+{
+    dmr_bitvec interleaved[DMR_BITVEC_WORDS(77)], bits[DMR_BITVEC_WORDS(72)];
+    uint8_t bytes[9], checksum = 0, i, j;
+    uint16_t sum = 0;
+
+    if (!dmr_vbptc_16_11_check_and_repair(&slot->vbptc))
+        return -1;
+    if (dmr_vbptc_16_11_decode(&slot->vbptc, interleaved, 77) != 0)
+        return -1;
+
+    /* Reverse of dmr_emb_signalling_lc_interlave */
+    dmr_bitvec_copy(bits, 0, interleaved, 0, 32);
+    for (i = 0, j = 32; i < 5; i++, j += 10) {
+        checksum = (checksum << 1) | dmr_bitvec_get(interleaved, j + i);
+        if (i < 4)
+            dmr_bitvec_copy(bits, j, interleaved, j + i + 1, 10);
+    }
+    dmr_bitvec_to_bytes(bits, bytes, sizeof(bytes));
+
+    for (i = 0; i < 9; i++) {
+        sum += bytes[i];
+    }
+    if (sum % 31 != checksum) {
+        dmr_log_debug("emb: LC checksum %u, expected %u", checksum, sum % 31);
+        return -1;
+    }
+
+    memset(lc, 0, sizeof(dmr_full_lc));
+    return dmr_full_lc_decode_bytes(bytes, lc);
+}
+
+int dmr_emb_lc_assembler_add(dmr_emb_lc_assembler *assembler, dmr_parsed_packet *parsed, dmr_full_lc *lc)
+{
+    if (assembler == NULL || parsed == NULL || lc == NULL || parsed->ts >= DMR_TS_INVALID)
+        return dmr_error(DMR_EINVAL);
+
+    dmr_emb_lc_slot *slot = &assembler->slot[parsed->ts];
+    if (slot->stream_id != parsed->stream_id)
+        dmr_emb_lc_slot_reset(slot, parsed->stream_id);
+
+    /* Only voice bursts B-F carry embedded signalling */
+    if (parsed->data_type != DMR_DATA_TYPE_VOICE)
+        return 0;
+
+    dmr_emb emb;
+    if (dmr_emb_decode(parsed->packet, &emb) != 0) {
+        /* We lost a fragment, wait for the next superframe */
+        slot->fragments = 0;
+        return 0;
+    }
+
+    switch (emb.lcss) {
+    case DMR_EMB_LCSS_FIRST_FRAGMENT:
+        dmr_emb_lc_slot_reset(slot, parsed->stream_id);
+        break;
+    case DMR_EMB_LCSS_CONTINUATION:
+        if (slot->fragments == 0 || slot->fragments == DMR_EMB_LC_FRAGMENTS - 1) {
+            slot->fragments = 0;
+            return 0;
+        }
+        break;
+    case DMR_EMB_LCSS_LAST_FRAGMENT:
+        if (slot->fragments != DMR_EMB_LC_FRAGMENTS - 1) {
+            slot->fragments = 0;
+            return 0;
+        }
+        break;
+    default:
+        /* Single fragments carry reverse channel or null signalling */
+        return 0;
+    }
+
+    dmr_bitvec bits[DMR_BITVEC_WORDS(32)];
+    uint8_t bytes[4];
+    dmr_emb_bytes_decode(parsed->packet, bytes);
+    dmr_bitvec_from_bytes(bits, bytes, sizeof(bytes));
+    if (dmr_vbptc_16_11_add(&slot->vbptc, bits, 32) != 0) {
+        slot->fragments = 0;
+        return dmr_error(DMR_LASTERROR);
+    }
+    if (++slot->fragments < DMR_EMB_LC_FRAGMENTS)
+        return 0;
+
+    slot->fragments = 0;
+    if (dmr_emb_lc_slot_decode(slot, lc) != 0) {
+        dmr_log_debug("emb: LC in stream %08x on %s failed to decode",
+            parsed->stream_id, dmr_ts_name(parsed->ts));
+        return 0;
+    }
+
+    dmr_log_trace("emb: LC in stream %08x on %s, %u->%u",
+        parsed->stream_id, dmr_ts_name(parsed->ts), lc->src_id, lc->dst_id);
+    return 1;
+}
@@ -30,14 +30,10 @@ int dmr_full_lc_decode(dmr_packet packet, dmr_full_lc *lc, dmr_data_type data_ty
     memset(bytes, 0, sizeof(bytes));
 
     // BPTC(196, 96) decode data
-    dmr_bptc_196_96 *bptc = talloc_zero(NULL, dmr_bptc_196_96);
-    if (bptc == NULL) {
-        dmr_log_error("lc: BPTC(196,96) init failed: out of memory");
-        return dmr_error(DMR_ENOMEM);
-    }
+    dmr_bptc_196_96 bptc;
 
     dmr_log_trace("lc: decoding BPTC(196, 96)");
-    if (dmr_bptc_196_96_decode(packet, bptc, bytes) != 0) {
+    if (dmr_bptc_196_96_decode(packet, &bptc, bytes) != 0) {
         dmr_log_error("lc: BPTC(196,96) decode failed: %s", dmr_error_get());
         return dmr_error(DMR_LASTERROR);
     }
@@ -50,7 +46,7 @@ int dmr_full_lc_decode(dmr_packet packet, dmr_full_lc *lc, dmr_data_type data_ty
     bytes[11] ^= dmr_crc_mask_lc[data_type];
 
     dmr_log_trace("lc: performing Reed-Solomon(12, 9, 4) check on data");
-    if (dmr_rs_12_9_4_decode(bytes) != 0) {
+    if (dmr_rs_12_9_4_decode(bytes) < 0) {
         dmr_log_error("LC: parity check failed");
 #if defined(DMR_DEBUG_LC)
         dmr_log_debug("LC: parities received:");
@@ -68,13 +64,7 @@ int dmr_full_lc_decode(dmr_packet packet, dmr_full_lc *lc, dmr_data_type data_ty
         return -1;
     }
 
-    TALLOC_FREE(bptc);
-
-    lc->flco_pdu = (bytes[0] & 0x3f);
-    lc->pf       = 0; // (bytes[0] & 0x80) == 0x80;
-    lc->fid      = (bytes[1]);
-    lc->dst_id   = (bytes[3] << 16) | (bytes[4] << 8) | (bytes[5]);
-    lc->src_id   = (bytes[6] << 16) | (bytes[7] << 8) | (bytes[8]);
+    dmr_full_lc_decode_bytes(bytes, lc);
     memcpy(lc->crc, bytes + 9, 3);
 
     if (dmr_log_priority() <= DMR_LOG_PRIORITY_DEBUG) {
@@ -85,6 +75,19 @@ int dmr_full_lc_decode(dmr_packet packet, dmr_full_lc *lc, dmr_data_type data_ty
     return 0;
 }
 
+int dmr_full_lc_decode_bytes(const uint8_t bytes[9], dmr_full_lc *lc)
+{
+    if (bytes == NULL || lc == NULL)
+        return dmr_error(DMR_EINVAL);
+
+    lc->flco_pdu = (bytes[0] & 0x3f);
+    lc->pf       = 0; // (bytes[0] & 0x80) == 0x80;
+    lc->fid      = (bytes[1]);
+    lc->dst_id   = (bytes[3] << 16) | (bytes[4] << 8) | (bytes[5]);
+    lc->src_id   = (bytes[6] << 16) | (bytes[7] << 8) | (bytes[8]);
+    return 0;
+}
+
 int dmr_full_lc_encode_bytes(dmr_full_lc *lc, uint8_t bytes[12])
 {
     if (lc == NULL || bytes == NULL)
@@ -43,30 +43,54 @@ uint8_t dmr_bit_diff(const uint8_t *a, const uint8_t *b)
     return delta;
 }
 
-dmr_sync_pattern dmr_sync_pattern_decode(dmr_packet packet)
+/* The patterns above as 48-bit words, indexed by dmr_sync_pattern */
+static const uint64_t dmr_sync_pattern_word[DMR_SYNC_PATTERN_UNKNOWN] = {
+    0x755FD7DF75F7ULL, /* bs sourced voice */
+    0xDFF57D75DF5DULL, /* bs sourced data */
+    0x7F7D5DD57DFDULL, /* ms sourced voice */
+    0xD5D7F77FD757ULL, /* ms sourced data */
+    0x77D55F7DFD77ULL, /* ms sourced rc */
+    0x5D577F7757FFULL, /* direct voice ts1 */
+    0xF7FDD5DDFD55ULL, /* direct data ts1 */
+    0x7DFFD5F55D5FULL, /* direct voice ts2 */
+    0xD7557F5FF7F5ULL  /* direct data ts2 */
+};
+
+/* The sync field starts in the low nibble of byte 13 and ends in the high
+ * nibble of byte 19. */
+static inline uint64_t dmr_sync_word(const uint8_t *buf)
 {
-    const uint8_t *buf = (const uint8_t *)(packet + 13);
+    uint64_t word = ((uint64_t)buf[0] << 48) | ((uint64_t)buf[1] << 40) |
+                    ((uint64_t)buf[2] << 32) | ((uint64_t)buf[3] << 24) |
+                    ((uint64_t)buf[4] << 16) | ((uint64_t)buf[5] <<  8) |
+                    ((uint64_t)buf[6]);
+    return (word >> 4) & 0xFFFFFFFFFFFFULL;
+}
 
-    if (dmr_bit_diff(buf, dmr_sync_pattern_bs_sourced_voice) < dmr_sync_delta_max)
-        return DMR_SYNC_PATTERN_BS_SOURCED_VOICE;
-    if (dmr_bit_diff(buf, dmr_sync_pattern_bs_sourced_data) < dmr_sync_delta_max)
-        return DMR_SYNC_PATTERN_BS_SOURCED_DATA;
-    if (dmr_bit_diff(buf, dmr_sync_pattern_ms_sourced_voice) < dmr_sync_delta_max)
-        return DMR_SYNC_PATTERN_MS_SOURCED_VOICE;
-    if (dmr_bit_diff(buf, dmr_sync_pattern_ms_sourced_data) < dmr_sync_delta_max)
-        return DMR_SYNC_PATTERN_MS_SOURCED_DATA;
-    if (dmr_bit_diff(buf, dmr_sync_pattern_ms_sourced_rc) < dmr_sync_delta_max)
-        return DMR_SYNC_PATTERN_MS_SOURCED_RC;
-    if (dmr_bit_diff(buf, dmr_sync_pattern_direct_voice_ts1) < dmr_sync_delta_max)
-        return DMR_SYNC_PATTERN_DIRECT_VOICE_TS1;
-    if (dmr_bit_diff(buf, dmr_sync_pattern_direct_data_ts1) < dmr_sync_delta_max)
-        return DMR_SYNC_PATTERN_DIRECT_DATA_TS1;
-    if (dmr_bit_diff(buf, dmr_sync_pattern_direct_voice_ts2) < dmr_sync_delta_max)
-        return DMR_SYNC_PATTERN_DIRECT_VOICE_TS2;
-    if (dmr_bit_diff(buf, dmr_sync_pattern_direct_data_ts2) < dmr_sync_delta_max)
-        return DMR_SYNC_PATTERN_DIRECT_DATA_TS2;
+dmr_sync_pattern dmr_sync_pattern_classify(dmr_packet packet, uint8_t *distance)
+{
+    uint64_t word = dmr_sync_word((const uint8_t *)(packet + 13));
+    dmr_sync_pattern pattern, match = DMR_SYNC_PATTERN_UNKNOWN;
+    uint8_t best = DMR_SYNC_PATTERN_BITS + 1, delta;
 
-    return DMR_SYNC_PATTERN_UNKNOWN;
+    for (pattern = 0; pattern < DMR_SYNC_PATTERN_UNKNOWN; pattern++) {
+        delta = __builtin_popcountll(word ^ dmr_sync_pattern_word[pattern]);
+        if (delta < best) {
+            best = delta;
+            match = pattern;
+        }
+    }
+
+    if (distance != NULL)
+        *distance = best;
+    if (best >= dmr_sync_delta_max)
+        return DMR_SYNC_PATTERN_UNKNOWN;
+    return match;
+}
+
+dmr_sync_pattern dmr_sync_pattern_decode(dmr_packet packet)
+{
+    return dmr_sync_pattern_classify(packet, NULL);
 }
 
 char *dmr_sync_pattern_name(dmr_sync_pattern sync_pattern)
@@ -0,0 +1,129 @@
+#include <sys/param.h>
+#include "dmr/config.h"
+#include "dmr/error.h"
+#include "dmr/malloc.h"
+#include "dmr/pool.h"
+#include "dmr/thread.h"
+#include "common/byte.h"
+
+/* Objects on the free list are owned by the pool's talloc context and linked
+ * through their first word, objects that are handed out have no parent. */
+typedef struct pool_object {
+    struct pool_object *next;
+} pool_object;
+
+DMR_PRV static dmr_locals_t pool_locals;
+DMR_PRV static dmr_once_flag pool_locals_once = DMR_ONCE_FLAG_INIT;
+
+DMR_API dmr_pool *dmr_pool_new(void *parent, size_t size, size_t prefill)
+{
+    DMR_PALLOC_CHECK(dmr_pool, pool, parent);
+    pool->size = MAX(size, sizeof(pool_object));
+    if (dmr_pool_prefill(pool, prefill) != 0) {
+        dmr_free(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+DMR_API void dmr_pool_free(dmr_pool *pool)
+{
+    dmr_free(pool);
+}
+
+DMR_API int dmr_pool_prefill(dmr_pool *pool, size_t n)
+{
+    DMR_ERROR_IF_NULL(pool, DMR_EINVAL);
+
+    while (pool->stats.available < n) {
+        pool_object *obj = dmr_palloc_size(pool, pool->size);
+        DMR_ERROR_IF_NULL(obj, DMR_ENOMEM);
+        obj->next = pool->head;
+        pool->head = obj;
+        pool->stats.available++;
+    }
+    return 0;
+}
+
+DMR_API void *dmr_pool_get(dmr_pool *pool)
+{
+    if (pool == NULL) {
+        dmr_error(DMR_EINVAL);
+        return NULL;
+    }
+
+    pool_object *obj = pool->head;
+    if (obj != NULL) {
+        pool->head = obj->next;
+        pool->stats.available--;
+        talloc_steal(NULL, obj);
+        byte_zero(obj, pool->size);
+    } else {
+        pool->stats.misses++;
+        if ((obj = dmr_malloc_size(pool->size)) == NULL) {
+            dmr_error(DMR_ENOMEM);
+            return NULL;
+        }
+    }
+
+    pool->stats.in_use++;
+    pool->stats.peak = MAX(pool->stats.peak, pool->stats.in_use);
+    return obj;
+}
+
+DMR_API void dmr_pool_put(dmr_pool *pool, void *ptr)
+{
+    if (ptr == NULL)
+        return;
+    if (pool == NULL) {
+        talloc_free(ptr);
+        return;
+    }
+
+    /* objects may be handed back by another thread's pool */
+    if (pool->stats.in_use > 0)
+        pool->stats.in_use--;
+
+    if (pool->limit > 0 && pool->stats.available >= pool->limit) {
+        talloc_free(ptr);
+        return;
+    }
+
+    pool_object *obj = talloc_steal(pool, ptr);
+    obj->next = pool->head;
+    pool->head = obj;
+    pool->stats.available++;
+}
+
+DMR_PRV static void pool_locals_free(void *ctx)
+{
+    talloc_free(ctx);
+}
+
+DMR_PRV static void pool_locals_init(void)
+{
+    dmr_locals_create(&pool_locals, pool_locals_free);
+}
+
+DMR_API dmr_pool *dmr_pool_local(dmr_pool **pool, size_t size)
+{
+    if (pool == NULL) {
+        dmr_error(DMR_EINVAL);
+        return NULL;
+    }
+    if (*pool != NULL)
+        return *pool;
+
+    /* all pools of a thread hang off one context, released at thread exit */
+    dmr_call_once(&pool_locals_once, pool_locals_init);
+    void *ctx = dmr_locals_get(pool_locals);
+    if (ctx == NULL) {
+        if ((ctx = talloc_named_const(NULL, 0, "dmr_pool_local")) == NULL) {
+            dmr_error(DMR_ENOMEM);
+            return NULL;
+        }
+        dmr_locals_set(pool_locals, ctx);
+    }
+
+    return (*pool = dmr_pool_new(ctx, size, 0));
+}
@@ -22,6 +22,13 @@ DMR_PRV static const char *homebrew_url = "https://github.com/pd0mz/dmrlib";
 DMR_PRV static int homebrew_send_config(dmr_homebrew *homebrew);
 DMR_PRV static int homebrew_send_key(dmr_homebrew *homebrew);
 
+/* Defined in homebrew_io.c */
+DMR_PRV int homebrew_io_queue(dmr_homebrew *homebrew, dmr_raw *raw);
+
+/* Shared with homebrew_master.c */
+DMR_PRV void homebrew_key(const uint8_t nonce[8], const char *secret, uint8_t digest[SHA256_DIGEST_LENGTH]);
+DMR_PRV void homebrew_dmrd_decode(const uint8_t *buf, dmr_parsed_packet *parsed);
+
 DMR_API dmr_homebrew *dmr_homebrew_new(dmr_id repeater_id, uint8_t peer_ip[16], uint16_t peer_port, uint8_t bind_ip[16], uint16_t bind_port)
 {
     /* Setup homebrew struct */
@@ -46,6 +53,7 @@ DMR_API dmr_homebrew *dmr_homebrew_new(dmr_id repeater_id, uint8_t peer_ip[16],
     byte_copy(homebrew->peer_ip, peer_ip, 16);
     byte_copy(homebrew->bind_ip, bind_ip, 16);
     homebrew->bind_port = bind_port;
+    homebrew->batch = DMR_HOMEBREW_BATCH;
 
     char bind_str[FORMAT_IP6_LEN], peer_str[FORMAT_IP6_LEN];
     byte_zero(bind_str, sizeof bind_str);
@@ -153,6 +161,11 @@ DMR_API int dmr_homebrew_send_raw(dmr_homebrew *homebrew, dmr_raw *raw)
         return dmr_error(DMR_EINVAL);
     }
 
+    /* Running in an I/O loop, the transmit queue is flushed in batches */
+    if (homebrew->io != NULL) {
+        return homebrew_io_queue(homebrew, raw);
+    }
+
     int ret = 0;
     do {
         ret = socket_send(sock, raw->buf, raw->len, homebrew->peer_ip, homebrew->peer_port);
@@ -171,24 +184,42 @@ DMR_API int dmr_homebrew_send_raw(dmr_homebrew *homebrew, dmr_raw *raw)
 
 DMR_API int dmr_homebrew_read(dmr_homebrew *homebrew, dmr_parsed_packet **parsed_out)
 {
+    DMR_ERROR_IF_NULL(homebrew, DMR_EINVAL);
+
     socket_t *sock = (socket_t *)homebrew->sock;
-    /* max packet size by a repeater is a DMRD frame of 53 bytes */
-    dmr_raw *raw = dmr_raw_new(53); 
-    DMR_ERROR_IF_NULL(raw, DMR_ENOMEM);
+    uint8_t buf[DMR_HOMEBREW_FRAME_MAX];
     ip6_t peer_ip;
     uint16_t peer_port;
-    ssize_t len = socket_recv(sock, raw->buf, raw->allocated, peer_ip, &peer_port);
+    ssize_t len = socket_recv(sock, buf, sizeof buf, peer_ip, &peer_port);
     if (len < 0) {
         DMR_HB_ERROR("recv: %s", strerror(errno));
         return -1;
-    } else if (len < 14) {
+    }
+
+    return dmr_homebrew_process(homebrew, buf, len, parsed_out);
+}
+
+DMR_API int dmr_homebrew_process(dmr_homebrew *homebrew, uint8_t *buf, size_t len, dmr_parsed_packet **parsed_out)
+{
+    DMR_ERROR_IF_NULL(homebrew, DMR_EINVAL);
+    DMR_ERROR_IF_NULL(buf, DMR_EINVAL);
+
+    if (parsed_out != NULL)
+        *parsed_out = NULL;
+
+    if (len < 14) {
         /* shortest packet the repeater can send is a 14 byte MSTACK/MSTNAK */
         DMR_HB_WARN("repeater sent short packet");
         return 0;
-    } else {
-        raw->len = (uint64_t)len;
     }
 
+    /* wrap the buffer, no need to copy */
+    dmr_raw frame, *raw = &frame;
+    byte_zero(raw, sizeof frame);
+    raw->buf = buf;
+    raw->allocated = len;
+    raw->len = len;
+
 #if defined(DMR_TRACE)
     DMR_HB_DEBUG("recv([%s]:%u): %lu bytes",
         format_ip6s(homebrew->peer_ip), homebrew->peer_port, raw->len);
@@ -237,6 +268,16 @@ DMR_API int dmr_homebrew_read(dmr_homebrew *homebrew, dmr_parsed_packet **parsed
                 ret = -1;
             }
 
+        } else if (len == 13 && !byte_cmp(raw->buf + 3, "CL", 2)) { /* MSTCL */
+            DMR_HB_ERROR("master closed the link");
+            homebrew->state = DMR_HOMEBREW_AUTH_NONE;
+            /* request closing from the I/O loop */
+            ret = -1;
+
+        } else if (len == 15 && !byte_cmp(raw->buf + 3, "PONG", 4)) { /* MSTPONG */
+            gettimeofday(&homebrew->last_pong, NULL);
+            DMR_HB_DEBUG("master pong");
+
         } else if (len == 22) { /* MSTACK (with nonce) */
             if (!byte_cmp(raw->buf + 3, "ACK", 3)) {
                 DMR_HB_DEBUG("repeater ACK with nonce");
@@ -271,7 +312,6 @@ DMR_API int dmr_homebrew_read(dmr_homebrew *homebrew, dmr_parsed_packet **parsed
              raw->len, raw->buf);
     }
 
-    dmr_raw_free(raw);
     return ret;
 }
 
@@ -280,14 +320,29 @@ DMR_API int dmr_homebrew_send(dmr_homebrew *homebrew, dmr_parsed_packet *parsed)
     DMR_ERROR_IF_NULL(homebrew, DMR_EINVAL);
     DMR_ERROR_IF_NULL(parsed, DMR_EINVAL);
 
-    /* construct 53 byte DMRD frame */
-    dmr_raw *raw = dmr_raw_new(53); /* malloc, freed by send_raw */
-    DMR_ERROR_IF_NULL(raw, DMR_ENOMEM);
+    dmr_homebrew_dmrd dmrd;
+    dmr_homebrew_dmrd_encode(&dmrd, parsed);
+    return dmr_homebrew_send_dmrd(homebrew, &dmrd);
+}
+
+/* Multi byte fields are packed least significant byte first, like the
+ * dmr_raw_add_uint* functions. */
+DMR_PRV static void homebrew_dmrd_pack(uint8_t *buf, uint32_t in, size_t size)
+{
+    size_t i;
+    for (i = 0; i < size; i++) {
+        buf[i] = (in & 0xff);
+        in >>= 8;
+    }
+}
+
+DMR_API int dmr_homebrew_dmrd_encode(dmr_homebrew_dmrd *dmrd, dmr_parsed_packet *parsed)
+{
+    DMR_ERROR_IF_NULL(dmrd, DMR_EINVAL);
+    DMR_ERROR_IF_NULL(parsed, DMR_EINVAL);
 
+    /* the timeslot bit is added per peer, see dmr_homebrew_send_dmrd */
     uint8_t slot_info = 0;
-    /* handle DMO mode */
-    if (homebrew->config.rx_freq != homebrew->config.tx_freq)
-        slot_info |= parsed->ts;
     if (parsed->flco == DMR_FLCO_PRIVATE)
         slot_info |= 0x02;
     if (parsed->data_type == DMR_DATA_TYPE_INVALID ||
@@ -302,16 +357,69 @@ DMR_API int dmr_homebrew_send(dmr_homebrew *homebrew, dmr_parsed_packet *parsed)
         slot_info |= (parsed->data_type) << 4;
     }
 
-    dmr_raw_add(raw, "DMRD", 4);
-    dmr_raw_add_uint8(raw, parsed->sequence & 0xff);
-    dmr_raw_add_uint24(raw, parsed->src_id);
-    dmr_raw_add_uint24(raw, parsed->dst_id);
-    dmr_raw_add_uint32(raw, parsed->repeater_id);
-    dmr_raw_add_uint8(raw, slot_info);
-    dmr_raw_add_uint32(raw, parsed->stream_id);
-    dmr_raw_add(raw, parsed->packet, DMR_PACKET_LEN);
-    
-    return dmr_homebrew_send_raw(homebrew, raw);
+    byte_copy(dmrd->head, "DMRD", 4);
+    dmrd->head[4] = parsed->sequence & 0xff;
+    homebrew_dmrd_pack(dmrd->head + 5, parsed->src_id, 3);
+    homebrew_dmrd_pack(dmrd->head + 8, parsed->dst_id, 3);
+    homebrew_dmrd_pack(dmrd->head + 11, parsed->repeater_id, 4);
+    dmrd->head[15] = slot_info;
+    homebrew_dmrd_pack(dmrd->head + 16, parsed->stream_id, 4);
+    dmrd->ts = parsed->ts;
+    dmrd->parsed = parsed;
+    return 0;
+}
+
+DMR_API void dmr_homebrew_dmrd_repeater_id(dmr_homebrew_dmrd *dmrd, dmr_id repeater_id)
+{
+    if (dmrd != NULL)
+        homebrew_dmrd_pack(dmrd->head + 11, repeater_id, 4);
+}
+
+DMR_API int dmr_homebrew_send_dmrd(dmr_homebrew *homebrew, dmr_homebrew_dmrd *dmrd)
+{
+    DMR_ERROR_IF_NULL(homebrew, DMR_EINVAL);
+    DMR_ERROR_IF_NULL(dmrd, DMR_EINVAL);
+    DMR_ERROR_IF_NULL(dmrd->parsed, DMR_EINVAL);
+
+    uint8_t slot_info = dmrd->head[15];
+    /* handle DMO mode */
+    if (homebrew->config.rx_freq != homebrew->config.tx_freq)
+        slot_info |= dmrd->ts;
+
+    /* Running in an I/O loop, the frame is queued and has to outlive the
+     * packet, copy it into a raw buffer */
+    if (homebrew->io != NULL) {
+        dmr_raw *raw = dmr_raw_new(DMR_HOMEBREW_DMRD_LEN); /* malloc, freed by send_raw */
+        DMR_ERROR_IF_NULL(raw, DMR_ENOMEM);
+        byte_copy(raw->buf, dmrd->head, DMR_HOMEBREW_DMRD_HEAD);
+        raw->buf[15] = slot_info;
+        byte_copy(raw->buf + DMR_HOMEBREW_DMRD_HEAD, dmrd->parsed->packet, DMR_PACKET_LEN);
+        raw->len = DMR_HOMEBREW_DMRD_LEN;
+        return dmr_homebrew_send_raw(homebrew, raw);
+    }
+
+    socket_t *sock = (socket_t *)homebrew->sock;
+    if (sock == NULL) {
+        DMR_HB_ERROR("can't send, protocol not setup");
+        return dmr_error(DMR_EINVAL);
+    }
+
+    uint8_t buf[DMR_HOMEBREW_DMRD_LEN];
+    byte_copy(buf, dmrd->head, DMR_HOMEBREW_DMRD_HEAD);
+    buf[15] = slot_info;
+    byte_copy(buf + DMR_HOMEBREW_DMRD_HEAD, dmrd->parsed->packet, DMR_PACKET_LEN);
+
+    int ret;
+    do {
+        ret = socket_send(sock, buf, sizeof buf, homebrew->peer_ip, homebrew->peer_port);
+    } while (ret == -1 && (errno == EINVAL || errno == EAGAIN));
+    if (ret == -1) {
+        DMR_HB_ERROR("send([%s]:%u,%zu): %s",
+            format_ip6s(homebrew->peer_ip), homebrew->peer_port,
+            sizeof buf, strerror(errno));
+        return -1;
+    }
+    return 0;
 }
 
 DMR_API int dmr_homebrew_parse_dmrd(dmr_homebrew *homebrew, dmr_raw *raw, dmr_parsed_packet **parsed_out)
@@ -326,29 +434,9 @@ DMR_API int dmr_homebrew_parse_dmrd(dmr_homebrew *homebrew, dmr_raw *raw, dmr_pa
     }
 
     dmr_parsed_packet *parsed;
-    DMR_ERROR_IF_NULL(parsed = dmr_malloc(dmr_parsed_packet), DMR_ENOMEM);
-
-    /* parse DMRD frame */
-    parsed->sequence = raw->buf[4];
-    parsed->src_id = uint24(raw->buf + 5);
-    parsed->dst_id = uint24(raw->buf + 8);
-    parsed->repeater_id = uint32(raw->buf + 11); 
-    parsed->ts = (dmr_ts)(raw->buf[15] & 0x01);
-    parsed->flco = (dmr_flco)((raw->buf[15] & 0x02) >> 1);
-    switch ((raw->buf[15] >> 2) & 0x03) {
-    case 0x00:
-        parsed->data_type = DMR_DATA_TYPE_VOICE;
-        parsed->voice_frame = (raw->buf[15] >> 4);
-        break;
-    case 0x01:
-        parsed->data_type = DMR_DATA_TYPE_VOICE_SYNC;
-        break;
-    case 0x02:
-        parsed->data_type = (raw->buf[15] >> 4);
-        break;
-    }
-    parsed->stream_id = uint32(raw->buf + 16);
-    byte_copy(parsed->packet, raw->buf + 20, DMR_PACKET_LEN);
+    DMR_ERROR_IF_NULL(parsed = dmr_parsed_packet_new(), DMR_ENOMEM);
+
+    homebrew_dmrd_decode(raw->buf, parsed);
 
     const char *src_call = dmr_id_name(parsed->src_id);
     const char *dst_call = dmr_id_name(parsed->dst_id);
@@ -365,6 +453,40 @@ DMR_API int dmr_homebrew_parse_dmrd(dmr_homebrew *homebrew, dmr_raw *raw, dmr_pa
 
 /* Private functions */
 
+DMR_PRV void homebrew_dmrd_decode(const uint8_t *buf, dmr_parsed_packet *parsed)
+{
+    parsed->sequence = buf[4];
+    parsed->src_id = uint24(buf + 5);
+    parsed->dst_id = uint24(buf + 8);
+    parsed->repeater_id = uint32(buf + 11); 
+    parsed->ts = (dmr_ts)(buf[15] & 0x01);
+    parsed->flco = (dmr_flco)((buf[15] & 0x02) >> 1);
+    switch ((buf[15] >> 2) & 0x03) {
+    case 0x00:
+        parsed->data_type = DMR_DATA_TYPE_VOICE;
+        parsed->voice_frame = (buf[15] >> 4);
+        break;
+    case 0x01:
+        parsed->data_type = DMR_DATA_TYPE_VOICE_SYNC;
+        break;
+    case 0x02:
+        parsed->data_type = (buf[15] >> 4);
+        break;
+    }
+    parsed->stream_id = uint32(buf + 16);
+    byte_copy(parsed->packet, buf + 20, DMR_PACKET_LEN);
+}
+
+/* The key is the SHA256 digest of the nonce followed by the secret. */
+DMR_PRV void homebrew_key(const uint8_t nonce[8], const char *secret, uint8_t digest[SHA256_DIGEST_LENGTH])
+{
+    sha256_t sha256ctx;
+    sha256_init(&sha256ctx);
+    sha256_update(&sha256ctx, nonce, 8);
+    sha256_update(&sha256ctx, (const uint8_t *)secret, strlen(secret));
+    sha256_final(&sha256ctx, digest);
+}
+
 DMR_PRV static int homebrew_send_config(dmr_homebrew *homebrew)
 {
     dmr_raw *raw;
@@ -402,21 +524,16 @@ DMR_PRV static int homebrew_send_config(dmr_homebrew *homebrew)
 DMR_PRV static int homebrew_send_key(dmr_homebrew *homebrew)
 {
     uint8_t digest[SHA256_DIGEST_LENGTH];
-    sha256_t sha256ctx;
     dmr_raw *raw;
     DMR_ERROR_IF_NULL(raw = dmr_raw_new(76), DMR_ENOMEM);
 
     DMR_HB_DEBUG("sending key");
 
-    sha256_init(&sha256ctx);
-    sha256_update(&sha256ctx, homebrew->nonce, 8);
-    sha256_update(&sha256ctx, (const uint8_t *)homebrew->secret, strlen(homebrew->secret));
-    sha256_final(&sha256ctx, digest);
+    homebrew_key(homebrew->nonce, homebrew->secret, digest);
 
     dmr_raw_add(raw, "RPTK", 4);
     dmr_raw_add_xuint32(raw, homebrew->config.repeater_id);
     dmr_raw_add_hex(raw, digest, SHA256_DIGEST_LENGTH);
-    raw->len += SHA256_DIGEST_LENGTH;
 
     homebrew->state = DMR_HOMEBREW_AUTH_INIT;
     return dmr_homebrew_send_raw(homebrew, raw);
@@ -1,14 +1,254 @@
+#include <string.h>
+#include <sys/param.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
 #include "dmr.h"
 #include "dmr/protocol/homebrew.h"
+#include "dmr/error.h"
 #include "dmr/io.h"
 #include "dmr/malloc.h"
+#include "common/byte.h"
+#include "common/format.h"
 #include "common/socket.h"
 
 DMR_PRV static int homebrew_io_ping_timer(dmr_io *io, void *homebrewptr);
 DMR_PRV static int homebrew_io_readable(dmr_io *io, void *homebrewptr, int fd);
+DMR_PRV static int homebrew_io_writable(dmr_io *io, void *homebrewptr, int fd);
 DMR_PRV static int homebrew_io_error(dmr_io *io, void *homebrewptr, int fd);
 DMR_PRV static int homebrew_io_close(dmr_io *io, void *homebrewptr);
 
+/* Preallocated buffers for batched receive and send. With recvmmsg and
+ * sendmmsg a whole batch is transferred with a single system call, otherwise
+ * we fall back to a non-blocking recvfrom/sendto per datagram. */
+typedef struct {
+    size_t                  size;
+    int                     family;     /* address family of the socket */
+    uint8_t                 (*buf)[DMR_HOMEBREW_FRAME_MAX];
+    size_t                  *len;
+    struct sockaddr_storage *addr;
+    struct sockaddr_storage peer;
+    socklen_t               peerlen;
+    struct iovec            *iov;
+#if defined(DMR_HAVE_RECVMMSG) || defined(DMR_HAVE_SENDMMSG)
+    struct mmsghdr          *msg;
+#endif
+} homebrew_ring;
+
+DMR_PRV static homebrew_ring *homebrew_io_ring_new(dmr_homebrew *homebrew, int fd)
+{
+    homebrew_ring *ring;
+    size_t size = homebrew->batch;
+    if (size == 0)
+        size = DMR_HOMEBREW_BATCH;
+    if (size > DMR_HOMEBREW_BATCH_MAX)
+        size = DMR_HOMEBREW_BATCH_MAX;
+
+    DMR_NULL_CHECK(ring = dmr_palloc(homebrew, homebrew_ring));
+    ring->size = size;
+    DMR_NULL_CHECK_FREE(ring->buf = dmr_palloc_size(ring, size * DMR_HOMEBREW_FRAME_MAX), ring);
+    DMR_NULL_CHECK_FREE(ring->len = dmr_palloc_size(ring, size * sizeof(size_t)), ring);
+    DMR_NULL_CHECK_FREE(ring->addr = dmr_palloc_size(ring, size * sizeof(struct sockaddr_storage)), ring);
+    DMR_NULL_CHECK_FREE(ring->iov = dmr_palloc_size(ring, size * sizeof(struct iovec)), ring);
+#if defined(DMR_HAVE_RECVMMSG) || defined(DMR_HAVE_SENDMMSG)
+    DMR_NULL_CHECK_FREE(ring->msg = dmr_palloc_size(ring, size * sizeof(struct mmsghdr)), ring);
+#endif
+
+    /* socket_udp6 may have fallen back to an IPv4 socket */
+    struct sockaddr_storage local;
+    socklen_t locallen = sizeof local;
+    byte_zero(&local, sizeof local);
+    if (getsockname(fd, (struct sockaddr *)&local, &locallen) == 0) {
+        ring->family = local.ss_family;
+    } else {
+        ring->family = AF_INET6;
+    }
+
+    byte_zero(&ring->peer, sizeof ring->peer);
+    if (ring->family == AF_INET) {
+        struct sockaddr_in *sin = (struct sockaddr_in *)&ring->peer;
+        sin->sin_family = AF_INET;
+        sin->sin_port = htons(homebrew->peer_port);
+        byte_copy(&sin->sin_addr, homebrew->peer_ip + 12, 4);
+        ring->peerlen = sizeof(struct sockaddr_in);
+    } else {
+        struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)&ring->peer;
+        sin6->sin6_family = AF_INET6;
+        sin6->sin6_port = htons(homebrew->peer_port);
+        byte_copy(&sin6->sin6_addr, homebrew->peer_ip, 16);
+        ring->peerlen = sizeof(struct sockaddr_in6);
+    }
+
+    return ring;
+}
+
+/** Receive up to one batch of datagrams, returns the number received. */
+DMR_PRV static int homebrew_io_recv(dmr_homebrew *homebrew, int fd)
+{
+    homebrew_ring *ring = (homebrew_ring *)homebrew->ring;
+    size_t n = 0;
+
+#if defined(DMR_HAVE_RECVMMSG)
+    size_t i;
+    for (i = 0; i < ring->size; i++) {
+        ring->iov[i].iov_base = ring->buf[i];
+        ring->iov[i].iov_len = DMR_HOMEBREW_FRAME_MAX;
+        byte_zero(&ring->msg[i], sizeof(struct mmsghdr));
+        ring->msg[i].msg_hdr.msg_iov = &ring->iov[i];
+        ring->msg[i].msg_hdr.msg_iovlen = 1;
+        ring->msg[i].msg_hdr.msg_name = &ring->addr[i];
+        ring->msg[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+    }
+
+    int ret;
+    do {
+        ret = recvmmsg(fd, ring->msg, ring->size, MSG_DONTWAIT, NULL);
+    } while (ret == -1 && errno == EINTR);
+    if (ret == -1) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            return 0;
+        DMR_HB_ERROR("recvmmsg: %s", strerror(errno));
+        return -1;
+    }
+    for (n = 0; n < (size_t)ret; n++) {
+        ring->len[n] = ring->msg[n].msg_len;
+    }
+#else
+    for (n = 0; n < ring->size; n++) {
+        socklen_t addrlen = sizeof(struct sockaddr_storage);
+        ssize_t len = recvfrom(fd, ring->buf[n], DMR_HOMEBREW_FRAME_MAX, MSG_DONTWAIT,
+            (struct sockaddr *)&ring->addr[n], &addrlen);
+        if (len == -1) {
+            if (errno == EINTR) {
+                n--;
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            DMR_HB_ERROR("recvfrom: %s", strerror(errno));
+            if (n == 0)
+                return -1;
+            break;
+        }
+        ring->len[n] = len;
+    }
+#endif
+
+    if (n > 0) {
+        homebrew->stats.rx_batches++;
+        homebrew->stats.rx_frames += n;
+        if (n == ring->size)
+            homebrew->stats.rx_full++;
+        if (n > homebrew->stats.rx_max)
+            homebrew->stats.rx_max = n;
+    }
+    return n;
+}
+
+/** Send the transmit queue in batches.
+ * Returns 0 if the queue was flushed, 1 if the socket would block. */
+DMR_PRV static int homebrew_io_flush(dmr_homebrew *homebrew)
+{
+    homebrew_ring *ring = (homebrew_ring *)homebrew->ring;
+    socket_t *sock = (socket_t *)homebrew->sock;
+    dmr_raw *raw[DMR_HOMEBREW_BATCH_MAX];
+    size_t i, n, sent;
+    int ret = 0;
+
+    while (!dmr_rawq_empty(homebrew->trq)) {
+        for (n = 0; n < ring->size; n++) {
+            if ((raw[n] = dmr_rawq_shift(homebrew->trq)) == NULL)
+                break;
+            ring->iov[n].iov_base = raw[n]->buf;
+            ring->iov[n].iov_len = raw[n]->len;
+        }
+
+#if defined(DMR_HAVE_SENDMMSG)
+        for (i = 0; i < n; i++) {
+            byte_zero(&ring->msg[i], sizeof(struct mmsghdr));
+            ring->msg[i].msg_hdr.msg_iov = &ring->iov[i];
+            ring->msg[i].msg_hdr.msg_iovlen = 1;
+            ring->msg[i].msg_hdr.msg_name = &ring->peer;
+            ring->msg[i].msg_hdr.msg_namelen = ring->peerlen;
+        }
+        do {
+            ret = sendmmsg(sock->fd, ring->msg, n, MSG_DONTWAIT);
+        } while (ret == -1 && errno == EINTR);
+        sent = ret > 0 ? (size_t)ret : 0;
+#else
+        for (sent = 0; sent < n; sent++) {
+            do {
+                ret = sendto(sock->fd, ring->iov[sent].iov_base, ring->iov[sent].iov_len,
+                    MSG_DONTWAIT, (struct sockaddr *)&ring->peer, ring->peerlen);
+            } while (ret == -1 && errno == EINTR);
+            if (ret == -1)
+                break;
+        }
+#endif
+
+        if (sent > 0) {
+            homebrew->stats.tx_batches++;
+            homebrew->stats.tx_frames += sent;
+            if (sent == ring->size)
+                homebrew->stats.tx_full++;
+            if (sent > homebrew->stats.tx_max)
+                homebrew->stats.tx_max = sent;
+        }
+        for (i = 0; i < sent; i++) {
+            dmr_raw_free(raw[i]);
+        }
+        if (sent == n)
+            continue;
+
+        if (ret == -1 && errno != EAGAIN && errno != EWOULDBLOCK) {
+            /* drop the datagram that failed, so we don't retry it forever */
+            DMR_HB_ERROR("send([%s]:%u,%llu): %s",
+                format_ip6s(homebrew->peer_ip), homebrew->peer_port,
+                raw[sent]->len, strerror(errno));
+            homebrew->stats.tx_dropped++;
+            dmr_raw_free(raw[sent]);
+            sent++;
+        }
+        /* requeue what we didn't send, in order */
+        for (i = n; i > sent; i--) {
+            dmr_rawq_unshift(homebrew->trq, raw[i - 1]);
+        }
+        if (ret == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            homebrew->stats.tx_again++;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+DMR_PRV static int homebrew_io_want_write(dmr_homebrew *homebrew)
+{
+    if (homebrew->tx_pending)
+        return 0;
+
+    socket_t *sock = (socket_t *)homebrew->sock;
+    homebrew->tx_pending = true;
+    return dmr_io_reg_write(homebrew->io, sock->fd, homebrew_io_writable, homebrew, true);
+}
+
+/** Queue a raw frame for the next flush. */
+DMR_PRV int homebrew_io_queue(dmr_homebrew *homebrew, dmr_raw *raw)
+{
+    if (dmr_rawq_add(homebrew->trq, raw) != 0) {
+        /* queue full, make room */
+        homebrew_io_flush(homebrew);
+        if (dmr_rawq_add(homebrew->trq, raw) != 0) {
+            DMR_HB_WARN("transmit queue full, dropping frame");
+            homebrew->stats.tx_dropped++;
+            dmr_raw_free(raw);
+            return dmr_error(DMR_EWRITE);
+        }
+    }
+
+    return homebrew_io_want_write(homebrew);
+}
+
 DMR_PRV static int homebrew_io_init(dmr_io *io, void *homebrewptr)
 {
     DMR_ERROR_IF_NULL(io, DMR_EINVAL);
@@ -27,15 +267,23 @@ DMR_PRV static int homebrew_io_init(dmr_io *io, void *homebrewptr)
     DMR_ERROR_IF_NULL(homebrew->rxq = dmr_packetq_new(), DMR_ENOMEM);
     DMR_ERROR_IF_NULL(homebrew->txq = dmr_packetq_new(), DMR_ENOMEM);
     DMR_ERROR_IF_NULL(homebrew->rrq = dmr_rawq_new(32), DMR_ENOMEM);
-    DMR_ERROR_IF_NULL(homebrew->trq = dmr_rawq_new(32), DMR_ENOMEM);
+    DMR_ERROR_IF_NULL(homebrew->trq = dmr_rawq_new(MAX(32, 4 * homebrew->batch)), DMR_ENOMEM);
+    DMR_ERROR_IF_NULL(homebrew->ring = homebrew_io_ring_new(homebrew, sock->fd), DMR_ENOMEM);
 
     return 0;
 }
 
 DMR_PRV static int homebrew_io_stop(dmr_io *io, dmr_homebrew *homebrew, int fd)
 {
-    DMR_UNUSED(homebrew);
-    dmr_io_del_timer(io,     homebrew_io_ping_timer);
+    if (homebrew->tx_pending) {
+        dmr_io_del_write(io, fd, homebrew_io_writable);
+        homebrew->tx_pending = false;
+    }
+    homebrew->io = NULL;
+    if (homebrew->ping_timer != NULL) {
+        dmr_io_cancel_timer(io, homebrew->ping_timer);
+        homebrew->ping_timer = NULL;
+    }
     dmr_io_del_read (io, fd, homebrew_io_readable);
     dmr_io_del_error(io, fd, homebrew_io_error);
     return 0;
@@ -54,8 +302,10 @@ DMR_PRV int homebrew_io_register(dmr_io *io, void *homebrewptr)
     /* ping the repeater every 5 seconds */
     struct timeval ping_timer = { 5, 0 };
 
-    /* register events, no write event, because datagram sockets are always writable */
-    dmr_io_reg_timer(io, ping_timer, homebrew_io_ping_timer, homebrew, false);
+    /* register events, the write event is only registered if there is data
+     * queued, because datagram sockets are almost always writable */
+    homebrew->io = io;
+    homebrew->ping_timer = dmr_io_reg_timer(io, ping_timer, homebrew_io_ping_timer, homebrew, false);
     dmr_io_reg_read (io, sock->fd,   homebrew_io_readable,   homebrew, false);
     dmr_io_reg_error(io, sock->fd,   homebrew_io_error,      homebrew, false);
 
@@ -96,25 +346,46 @@ DMR_PRV static int homebrew_io_ping_timer(dmr_io *io, void *homebrewptr)
 DMR_PRV static int homebrew_io_readable(dmr_io *io, void *homebrewptr, int fd)
 {
     DMR_UNUSED(io);
-    DMR_UNUSED(fd);
     DMR_ERROR_IF_NULL(homebrewptr, DMR_EINVAL);
 
     dmr_homebrew *homebrew = (dmr_homebrew *)homebrewptr;
-    dmr_parsed_packet **parsed;
-    DMR_ERROR_IF_NULL(parsed = dmr_malloc(dmr_parsed_packet *), DMR_ENOMEM);
+    homebrew_ring *ring = (homebrew_ring *)homebrew->ring;
+    int i, n, ret = 0;
 
-    int ret = dmr_homebrew_read(homebrew, parsed);
-    if (ret == 0 && *parsed != NULL) {
-        dmr_log_debug("homebrew io: queued parsed packet");
-        ret = dmr_packetq_add(homebrew->rxq, *parsed);
-    } else {
-        dmr_log_debug("homebrew io: no parsed packet");
+    if ((n = homebrew_io_recv(homebrew, fd)) < 0)
+        return -1;
+
+    dmr_log_debug("homebrew io: received %d datagrams", n);
+    for (i = 0; i < n; i++) {
+        dmr_parsed_packet *parsed = NULL;
+        if (dmr_homebrew_process(homebrew, ring->buf[i], ring->len[i], &parsed) != 0)
+            ret = -1;
+        if (parsed != NULL && dmr_packetq_add(homebrew->rxq, parsed) != 0) {
+            dmr_parsed_packet_free(parsed);
+            ret = -1;
+        }
     }
 
-    dmr_free(parsed);
     return ret;
 }
 
+DMR_PRV static int homebrew_io_writable(dmr_io *io, void *homebrewptr, int fd)
+{
+    DMR_UNUSED(io);
+    DMR_UNUSED(fd);
+    DMR_ERROR_IF_NULL(homebrewptr, DMR_EINVAL);
+
+    dmr_homebrew *homebrew = (dmr_homebrew *)homebrewptr;
+    homebrew->tx_pending = false;
+    homebrew_io_flush(homebrew);
+    if (!dmr_rawq_empty(homebrew->trq)) {
+        /* socket would block, wait until it is writable again */
+        return homebrew_io_want_write(homebrew);
+    }
+
+    return 0;
+}
+
 DMR_PRV static int homebrew_io_error(dmr_io *io, void *homebrewptr, int fd)
 {
     DMR_UNUSED(fd);
@@ -123,9 +394,10 @@ DMR_PRV static int homebrew_io_error(dmr_io *io, void *homebrewptr, int fd)
 
     dmr_homebrew *homebrew = (dmr_homebrew *)homebrewptr;
     dmr_log_critical("homebrew io: socket error");
+    int ret = homebrew_io_stop(io, homebrew, fd);
     dmr_free(homebrew);
 
-    return homebrew_io_stop(io, homebrew, fd);
+    return ret;
 }
 
 DMR_PRV static int homebrew_io_close(dmr_io *io, void *homebrewptr)
@@ -138,6 +410,12 @@ DMR_PRV static int homebrew_io_close(dmr_io *io, void *homebrewptr)
     if (sock == NULL)
         return 0; /* nothing to do */
 
+    /* the loop has ended, send what's left and close directly */
+    if (homebrew->ring != NULL)
+        homebrew_io_flush(homebrew);
+    homebrew->io = NULL;
+    homebrew->tx_pending = false;
+
     return dmr_homebrew_close(homebrew);
 }
 
@@ -0,0 +1,618 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include "dmr.h"
+#include "dmr/error.h"
+#include "dmr/malloc.h"
+#include "dmr/id.h"
+#include "dmr/time.h"
+#include "dmr/protocol/homebrew_master.h"
+#include "common/byte.h"
+#include "common/format.h"
+#include "common/sha256.h"
+#include "common/socket.h"
+
+/* Defined in homebrew.c */
+DMR_PRV void homebrew_key(const uint8_t nonce[8], const char *secret, uint8_t digest[SHA256_DIGEST_LENGTH]);
+DMR_PRV void homebrew_dmrd_decode(const uint8_t *buf, dmr_parsed_packet *parsed);
+
+/* Initial size of the peer hash table, it doubles when it gets full. */
+#define MASTER_BUCKETS 64
+
+DMR_PRV static uint64_t master_nonce_seed(void)
+{
+    uint64_t seed = 0;
+    int fd = open("/dev/urandom", O_RDONLY);
+    if (fd != -1) {
+        if (read(fd, &seed, sizeof seed) != sizeof seed)
+            seed = 0;
+        close(fd);
+    }
+    if (seed == 0)
+        seed = dmr_time_monotonic() ^ ((uint64_t)getpid() << 32);
+    return seed;
+}
+
+/* splitmix64 */
+DMR_PRV static uint64_t master_nonce_next(dmr_homebrew_master *master)
+{
+    uint64_t z = (master->nonce_state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+DMR_API dmr_homebrew_master *dmr_homebrew_master_new(uint8_t bind_ip[16], uint16_t bind_port, char *secret)
+{
+    DMR_MALLOC_CHECK(dmr_homebrew_master, master);
+
+    if (bind_port == 0)
+        bind_port = DMR_HOMEBREW_PORT;
+
+    DMR_NULL_CHECK_FREE(master->id = dmr_palloc_size(master, 32), master);
+    snprintf(master->id, 32, "homebrew master[%u]", bind_port);
+    if (secret != NULL)
+        DMR_NULL_CHECK_FREE(master->secret = dmr_strdup(master, secret), master);
+    master->peers_max = DMR_HOMEBREW_MASTER_PEERS;
+    master->timeout = DMR_HOMEBREW_MASTER_TIMEOUT * 1000000000ULL;
+    master->nonce_state = master_nonce_seed();
+    byte_copy(master->bind_ip, bind_ip, 16);
+    master->bind_port = bind_port;
+    DMR_TAILQ_INIT(&master->lru);
+
+    master->buckets = MASTER_BUCKETS;
+    DMR_NULL_CHECK_FREE(master->bucket = dmr_palloc_size(master,
+        master->buckets * sizeof(struct dmr_homebrew_peer_list)), master);
+    DMR_NULL_CHECK_FREE(master->rxq = dmr_packetq_new(), master);
+    talloc_steal(master, master->rxq);
+
+    socket_t *sock = socket_udp6(0);
+    DMR_NULL_CHECK_FREE(sock, master);
+    if (socket_bind(sock, master->bind_ip, master->bind_port) == -1) {
+        DMR_HM_FATAL("bind to [%s]:%u failed: %s",
+            format_ip6s(master->bind_ip), master->bind_port,
+            strerror(errno));
+        socket_close(sock);
+        dmr_free(master);
+        return NULL;
+    }
+    master->sock = sock;
+
+    DMR_HM_INFO("listening on [%s]:%u",
+        format_ip6s(master->bind_ip), master->bind_port);
+    return master;
+}
+
+DMR_API void dmr_homebrew_master_free(dmr_homebrew_master *master)
+{
+    if (master == NULL)
+        return;
+    if (master->sock != NULL) {
+        socket_close((socket_t *)master->sock);
+        master->sock = NULL;
+    }
+    dmr_free(master);
+}
+
+/* Peer table */
+
+/** Key an address as IPv6 address and port, IPv4 addresses are mapped. */
+DMR_PRV static int master_addr_key(const struct sockaddr *addr, uint8_t ip[16], uint16_t *port)
+{
+    switch (addr->sa_family) {
+    case AF_INET6: {
+            const struct sockaddr_in6 *sin6 = (const struct sockaddr_in6 *)addr;
+            byte_copy(ip, &sin6->sin6_addr, 16);
+            *port = ntohs(sin6->sin6_port);
+            return 0;
+        }
+    case AF_INET: {
+            const struct sockaddr_in *sin = (const struct sockaddr_in *)addr;
+            byte_zero(ip, 10);
+            ip[10] = 0xff;
+            ip[11] = 0xff;
+            byte_copy(ip + 12, &sin->sin_addr, 4);
+            *port = ntohs(sin->sin_port);
+            return 0;
+        }
+    default:
+        return -1;
+    }
+}
+
+/* FNV-1a */
+DMR_PRV static uint32_t master_hash(const uint8_t ip[16], uint16_t port)
+{
+    uint32_t hash = 0x811c9dc5;
+    size_t i;
+    for (i = 0; i < 16; i++) {
+        hash ^= ip[i];
+        hash *= 0x01000193;
+    }
+    hash ^= (port >> 8);
+    hash *= 0x01000193;
+    hash ^= (port & 0xff);
+    hash *= 0x01000193;
+    return hash;
+}
+
+DMR_PRV static struct dmr_homebrew_peer_list *master_bucket(dmr_homebrew_master *master, const uint8_t ip[16], uint16_t port)
+{
+    return &master->bucket[master_hash(ip, port) & (master->buckets - 1)];
+}
+
+DMR_PRV static dmr_homebrew_peer *master_peer_find(dmr_homebrew_master *master, const uint8_t ip[16], uint16_t port)
+{
+    dmr_homebrew_peer *peer;
+    DMR_LIST_FOREACH(peer, master_bucket(master, ip, port), hash) {
+        if (peer->port == port && byte_equal(peer->ip, ip, 16))
+            return peer;
+    }
+    return NULL;
+}
+
+/** Double the hash table, all peers are rehashed. */
+DMR_PRV static int master_grow(dmr_homebrew_master *master)
+{
+    size_t buckets = master->buckets << 1;
+    struct dmr_homebrew_peer_list *bucket = dmr_palloc_size(master,
+        buckets * sizeof(struct dmr_homebrew_peer_list));
+    DMR_ERROR_IF_NULL(bucket, DMR_ENOMEM);
+
+    dmr_free(master->bucket);
+    master->bucket = bucket;
+    master->buckets = buckets;
+
+    dmr_homebrew_peer *peer;
+    DMR_TAILQ_FOREACH(peer, &master->lru, entries) {
+        DMR_LIST_INSERT_HEAD(master_bucket(master, peer->ip, peer->port), peer, hash);
+    }
+    return 0;
+}
+
+DMR_PRV static dmr_homebrew_peer *master_peer_add(dmr_homebrew_master *master, const struct sockaddr *addr, socklen_t addrlen, const uint8_t ip[16], uint16_t port)
+{
+    if (master->peers_max > 0 && master->peers >= master->peers_max) {
+        DMR_HM_WARN("peer limit of %zu reached", master->peers_max);
+        return NULL;
+    }
+    if (master->peers >= master->buckets && master_grow(master) != 0)
+        return NULL;
+
+    dmr_homebrew_peer *peer = dmr_palloc(master, dmr_homebrew_peer);
+    if (peer == NULL) {
+        dmr_error(DMR_ENOMEM);
+        return NULL;
+    }
+    byte_copy(peer->ip, ip, 16);
+    peer->port = port;
+    byte_copy(&peer->addr, addr, MIN(addrlen, sizeof peer->addr));
+    peer->addrlen = addrlen;
+    peer->state = DMR_HOMEBREW_AUTH_NONE;
+    peer->last_seen = dmr_time_monotonic();
+    DMR_LIST_INSERT_HEAD(master_bucket(master, ip, port), peer, hash);
+    DMR_TAILQ_INSERT_TAIL(&master->lru, peer, entries);
+    master->peers++;
+    return peer;
+}
+
+DMR_PRV static void master_peer_remove(dmr_homebrew_master *master, dmr_homebrew_peer *peer)
+{
+    DMR_LIST_REMOVE(peer, hash);
+    DMR_TAILQ_REMOVE(&master->lru, peer, entries);
+    master->peers--;
+    dmr_free(peer);
+}
+
+/** Mark a peer as seen, the least recently seen peers are swept first. */
+DMR_PRV static void master_peer_touch(dmr_homebrew_master *master, dmr_homebrew_peer *peer, uint64_t now)
+{
+    peer->last_seen = now;
+    if (DMR_TAILQ_NEXT(peer, entries) != NULL) {
+        DMR_TAILQ_REMOVE(&master->lru, peer, entries);
+        DMR_TAILQ_INSERT_TAIL(&master->lru, peer, entries);
+    }
+}
+
+DMR_API dmr_homebrew_peer *dmr_homebrew_master_peer(dmr_homebrew_master *master, const struct sockaddr *addr)
+{
+    uint8_t ip[16];
+    uint16_t port;
+
+    if (master == NULL || addr == NULL || master_addr_key(addr, ip, &port) != 0) {
+        dmr_error(DMR_EINVAL);
+        return NULL;
+    }
+    return master_peer_find(master, ip, port);
+}
+
+DMR_API int dmr_homebrew_master_sweep(dmr_homebrew_master *master)
+{
+    DMR_ERROR_IF_NULL(master, DMR_EINVAL);
+
+    uint64_t now = dmr_time_monotonic();
+    dmr_homebrew_peer *peer;
+    int removed = 0;
+    while ((peer = DMR_TAILQ_FIRST(&master->lru)) != NULL &&
+            now - peer->last_seen > master->timeout) {
+        DMR_HM_INFO("peer %u at [%s]:%u timed out",
+            peer->repeater_id, format_ip6s(peer->ip), peer->port);
+        master_peer_remove(master, peer);
+        removed++;
+    }
+    return removed;
+}
+
+/* Protocol */
+
+DMR_PRV static int master_send(dmr_homebrew_master *master, const struct sockaddr *addr, socklen_t addrlen, const void *buf, size_t len)
+{
+    socket_t *sock = (socket_t *)master->sock;
+    ssize_t ret;
+    do {
+        ret = sendto(sock->fd, buf, len, MSG_DONTWAIT, addr, addrlen);
+    } while (ret == -1 && errno == EINTR);
+    if (ret == -1) {
+        DMR_HM_ERROR("send(%zu): %s", len, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+/** Send a command followed by the hex repeater ID, and the nonce if given. */
+DMR_PRV static int master_reply(dmr_homebrew_master *master, const struct sockaddr *addr, socklen_t addrlen, const char *command, dmr_id repeater_id, const uint8_t *nonce)
+{
+    uint8_t buf[32];
+    size_t len = strlen(command);
+    byte_copy(buf, command, len);
+    snprintf((char *)buf + len, 9, "%08x", repeater_id);
+    len += 8;
+    if (nonce != NULL) {
+        byte_copy(buf + len, nonce, 8);
+        len += 8;
+    }
+    return master_send(master, addr, addrlen, buf, len);
+}
+
+DMR_PRV static int master_unhex(uint8_t c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+/** Parse an 8 digit hex repeater ID. */
+DMR_PRV static int master_parse_id(const uint8_t *buf, dmr_id *repeater_id)
+{
+    dmr_id id = 0;
+    size_t i;
+    for (i = 0; i < 8; i++) {
+        int v = master_unhex(buf[i]);
+        if (v < 0)
+            return -1;
+        id = (id << 4) | v;
+    }
+    *repeater_id = id;
+    return 0;
+}
+
+/** Parse a 9 digit frequency, as sent in the config. */
+DMR_PRV static uint32_t master_parse_freq(const uint8_t *buf)
+{
+    uint32_t freq = 0;
+    size_t i;
+    for (i = 0; i < 9 && buf[i] >= '0' && buf[i] <= '9'; i++) {
+        freq = freq * 10 + (buf[i] - '0');
+    }
+    return freq;
+}
+
+/** Check the RPTK hex digest against the expected digest, in constant time. */
+DMR_PRV static bool master_check_key(const uint8_t *hex, const uint8_t digest[SHA256_DIGEST_LENGTH])
+{
+    uint8_t diff = 0;
+    size_t i;
+    for (i = 0; i < SHA256_DIGEST_LENGTH; i++) {
+        int hi = master_unhex(hex[i * 2]), lo = master_unhex(hex[i * 2 + 1]);
+        if (hi < 0 || lo < 0)
+            return false;
+        diff |= ((hi << 4) | lo) ^ digest[i];
+    }
+    return diff == 0;
+}
+
+DMR_PRV static int master_nak(dmr_homebrew_master *master, const struct sockaddr *addr, socklen_t addrlen, dmr_homebrew_peer *peer, dmr_id repeater_id)
+{
+    if (peer != NULL)
+        master_peer_remove(master, peer);
+    return master_reply(master, addr, addrlen, "MSTNAK", repeater_id, NULL);
+}
+
+DMR_PRV static int master_login(dmr_homebrew_master *master, const struct sockaddr *addr, socklen_t addrlen, dmr_homebrew_peer *peer, const uint8_t ip[16], uint16_t port, dmr_id repeater_id)
+{
+    if (peer == NULL && (peer = master_peer_add(master, addr, addrlen, ip, port)) == NULL)
+        return master_nak(master, addr, addrlen, NULL, repeater_id);
+
+    uint64_t nonce = master_nonce_next(master);
+    byte_copy(peer->nonce, &nonce, 8);
+    peer->repeater_id = repeater_id;
+    peer->state = DMR_HOMEBREW_AUTH_INIT;
+    DMR_HM_DEBUG("peer %u at [%s]:%u login", repeater_id, format_ip6s(ip), port);
+    return master_reply(master, addr, addrlen, "MSTACK", repeater_id, peer->nonce);
+}
+
+DMR_PRV static int master_key(dmr_homebrew_master *master, const struct sockaddr *addr, socklen_t addrlen, dmr_homebrew_peer *peer, const uint8_t *buf)
+{
+    const char *secret = master->secret;
+    if (master->secret_cb != NULL)
+        secret = master->secret_cb(master, peer->repeater_id, master->secret_data);
+
+    uint8_t digest[SHA256_DIGEST_LENGTH];
+    if (secret == NULL) {
+        DMR_HM_WARN("peer %u refused, no secret", peer->repeater_id);
+        return master_nak(master, addr, addrlen, peer, peer->repeater_id);
+    }
+    homebrew_key(peer->nonce, secret, digest);
+    if (!master_check_key(buf + 12, digest)) {
+        DMR_HM_WARN("peer %u at [%s]:%u sent an invalid key",
+            peer->repeater_id, format_ip6s(peer->ip), peer->port);
+        return master_nak(master, addr, addrlen, peer, peer->repeater_id);
+    }
+
+    peer->state = DMR_HOMEBREW_AUTH_CONFIG;
+    return master_reply(master, addr, addrlen, "MSTACK", peer->repeater_id, NULL);
+}
+
+DMR_PRV static int master_config(dmr_homebrew_master *master, const struct sockaddr *addr, socklen_t addrlen, dmr_homebrew_peer *peer, const uint8_t *buf)
+{
+    size_t i;
+    byte_copy(peer->call, buf + 4, 8);
+    for (i = 8; i > 0 && (peer->call[i - 1] == ' ' || peer->call[i - 1] == 0); i--);
+    peer->call[i] = 0;
+    peer->rx_freq = master_parse_freq(buf + 20);
+    peer->tx_freq = master_parse_freq(buf + 29);
+    peer->state = DMR_HOMEBREW_AUTH_DONE;
+
+    DMR_HM_INFO("peer %u (%s) at [%s]:%u logged in, %zu peers",
+        peer->repeater_id, peer->call, format_ip6s(peer->ip), peer->port,
+        master->peers);
+    return master_reply(master, addr, addrlen, "MSTACK", peer->repeater_id, NULL);
+}
+
+DMR_API int dmr_homebrew_master_process(dmr_homebrew_master *master, const struct sockaddr *addr, socklen_t addrlen, uint8_t *buf, size_t len)
+{
+    DMR_ERROR_IF_NULL(master, DMR_EINVAL);
+    DMR_ERROR_IF_NULL(addr, DMR_EINVAL);
+    DMR_ERROR_IF_NULL(buf, DMR_EINVAL);
+
+    uint8_t ip[16];
+    uint16_t port;
+    if (master_addr_key(addr, ip, &port) != 0)
+        return dmr_error(DMR_EINVAL);
+
+    dmr_homebrew_peer *peer = master_peer_find(master, ip, port);
+    if (peer != NULL)
+        master_peer_touch(master, peer, dmr_time_monotonic());
+
+    dmr_id repeater_id = 0;
+    if (len == 53 && byte_equal(buf, "DMRD", 4)) {
+        if (peer == NULL || peer->state != DMR_HOMEBREW_AUTH_DONE)
+            return master_nak(master, addr, addrlen, peer, 0);
+
+        dmr_parsed_packet *parsed = dmr_parsed_packet_new();
+        DMR_ERROR_IF_NULL(parsed, DMR_ENOMEM);
+        homebrew_dmrd_decode(buf, parsed);
+        if (dmr_packetq_add(master->rxq, parsed) != 0) {
+            dmr_parsed_packet_free(parsed);
+            return -1;
+        }
+        return 0;
+    }
+
+    /* the repeater ID follows the 7 byte commands and the call in the config */
+    size_t offset = 4;
+    if (len == 15)
+        offset = 7;
+    else if (len == 306)
+        offset = 12;
+    if (len < 12 || master_parse_id(buf + offset, &repeater_id) != 0) {
+        DMR_HM_WARN("[%s]:%u sent unknown frame \"%.*s\"",
+            format_ip6s(ip), port, (int)MIN(len, 7), buf);
+        return 0;
+    }
+    if (peer != NULL && peer->state != DMR_HOMEBREW_AUTH_NONE && peer->repeater_id != repeater_id) {
+        DMR_HM_WARN("[%s]:%u sent repeater ID %u, expected %u",
+            format_ip6s(ip), port, repeater_id, peer->repeater_id);
+        return master_nak(master, addr, addrlen, peer, repeater_id);
+    }
+
+    if (len == 12 && byte_equal(buf, "RPTL", 4))
+        return master_login(master, addr, addrlen, peer, ip, port, repeater_id);
+
+    if (len == 12 && byte_equal(buf, "RPTC", 4)) {
+        /* RPTC without config closes the link */
+        if (peer != NULL) {
+            DMR_HM_INFO("peer %u at [%s]:%u closed the link",
+                repeater_id, format_ip6s(ip), port);
+            master_peer_remove(master, peer);
+        }
+        return 0;
+    }
+
+    if (peer == NULL)
+        return master_nak(master, addr, addrlen, NULL, repeater_id);
+
+    if (len == 76 && byte_equal(buf, "RPTK", 4)) {
+        if (peer->state != DMR_HOMEBREW_AUTH_INIT)
+            return master_nak(master, addr, addrlen, peer, repeater_id);
+        return master_key(master, addr, addrlen, peer, buf);
+    }
+
+    /* "RPTC" followed by the 302 byte config */
+    if (len == 306 && byte_equal(buf, "RPTC", 4)) {
+        if (peer->state != DMR_HOMEBREW_AUTH_CONFIG)
+            return master_nak(master, addr, addrlen, peer, repeater_id);
+        return master_config(master, addr, addrlen, peer, buf);
+    }
+
+    if (len == 15 && (byte_equal(buf, "RPTPING", 7) || byte_equal(buf, "MSTPING", 7))) {
+        if (peer->state != DMR_HOMEBREW_AUTH_DONE)
+            return master_nak(master, addr, addrlen, peer, repeater_id);
+        return master_reply(master, addr, addrlen, "MSTPONG", repeater_id, NULL);
+    }
+
+    if (len == 15 && byte_equal(buf, "RPTSBKN", 7))
+        return 0;
+
+    DMR_HM_WARN("peer %u sent unknown frame \"%.*s\"",
+        peer->repeater_id, (int)MIN(len, 7), buf);
+    return 0;
+}
+
+DMR_API int dmr_homebrew_master_read(dmr_homebrew_master *master)
+{
+    DMR_ERROR_IF_NULL(master, DMR_EINVAL);
+
+    socket_t *sock = (socket_t *)master->sock;
+    uint8_t buf[DMR_HOMEBREW_FRAME_MAX];
+    struct sockaddr_storage addr;
+    socklen_t addrlen = sizeof addr;
+    ssize_t len;
+    do {
+        len = recvfrom(sock->fd, buf, sizeof buf, 0, (struct sockaddr *)&addr, &addrlen);
+    } while (len == -1 && errno == EINTR);
+    if (len < 0) {
+        DMR_HM_ERROR("recv: %s", strerror(errno));
+        return -1;
+    }
+
+    return dmr_homebrew_master_process(master, (struct sockaddr *)&addr, addrlen, buf, len);
+}
+
+DMR_API int dmr_homebrew_master_close(dmr_homebrew_master *master)
+{
+    DMR_ERROR_IF_NULL(master, DMR_EINVAL);
+
+    dmr_homebrew_peer *peer;
+    while ((peer = DMR_TAILQ_FIRST(&master->lru)) != NULL) {
+        if (peer->state == DMR_HOMEBREW_AUTH_DONE) {
+            master_reply(master, (struct sockaddr *)&peer->addr, peer->addrlen,
+                "MSTCL", peer->repeater_id, NULL);
+        }
+        master_peer_remove(master, peer);
+    }
+    return 0;
+}
+
+/* DMR frames */
+
+/** Prepare the iovecs for a DMRD frame. The slot info byte is the only byte
+ * that differs between peers, everything else is shared. */
+DMR_PRV static void master_dmrd_iov(dmr_homebrew_dmrd *dmrd, dmr_homebrew_peer *peer, const uint8_t slot_info[2], struct iovec iov[4])
+{
+    /* same rule as dmr_homebrew_send_dmrd */
+    bool ts = peer->rx_freq != peer->tx_freq;
+    iov[0].iov_base = dmrd->head;
+    iov[0].iov_len = 15;
+    iov[1].iov_base = (void *)&slot_info[ts];
+    iov[1].iov_len = 1;
+    iov[2].iov_base = dmrd->head + 16;
+    iov[2].iov_len = DMR_HOMEBREW_DMRD_HEAD - 16;
+    iov[3].iov_base = dmrd->parsed->packet;
+    iov[3].iov_len = DMR_PACKET_LEN;
+}
+
+DMR_API int dmr_homebrew_master_send(dmr_homebrew_master *master, dmr_homebrew_peer *peer, dmr_homebrew_dmrd *dmrd)
+{
+    DMR_ERROR_IF_NULL(master, DMR_EINVAL);
+    DMR_ERROR_IF_NULL(peer, DMR_EINVAL);
+    DMR_ERROR_IF_NULL(dmrd, DMR_EINVAL);
+    DMR_ERROR_IF_NULL(dmrd->parsed, DMR_EINVAL);
+
+    socket_t *sock = (socket_t *)master->sock;
+    uint8_t slot_info[2] = { dmrd->head[15], dmrd->head[15] | dmrd->ts };
+    struct iovec iov[4];
+    struct msghdr msg;
+    byte_zero(&msg, sizeof msg);
+    master_dmrd_iov(dmrd, peer, slot_info, iov);
+    msg.msg_name = &peer->addr;
+    msg.msg_namelen = peer->addrlen;
+    msg.msg_iov = iov;
+    msg.msg_iovlen = 4;
+
+    ssize_t ret;
+    do {
+        ret = sendmsg(sock->fd, &msg, MSG_DONTWAIT);
+    } while (ret == -1 && errno == EINTR);
+    if (ret == -1) {
+        DMR_HM_ERROR("send to %u: %s", peer->repeater_id, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+DMR_API int dmr_homebrew_master_broadcast(dmr_homebrew_master *master, dmr_homebrew_dmrd *dmrd, dmr_homebrew_peer *except)
+{
+    DMR_ERROR_IF_NULL(master, DMR_EINVAL);
+    DMR_ERROR_IF_NULL(dmrd, DMR_EINVAL);
+    DMR_ERROR_IF_NULL(dmrd->parsed, DMR_EINVAL);
+
+    dmr_homebrew_peer *peer;
+    int sent = 0;
+#if defined(DMR_HAVE_SENDMMSG)
+    socket_t *sock = (socket_t *)master->sock;
+    uint8_t slot_info[2] = { dmrd->head[15], dmrd->head[15] | dmrd->ts };
+    struct iovec iov[DMR_HOMEBREW_BATCH][4];
+    struct mmsghdr msg[DMR_HOMEBREW_BATCH];
+    size_t i, n;
+
+    peer = DMR_TAILQ_FIRST(&master->lru);
+    while (peer != NULL) {
+        for (n = 0; peer != NULL && n < DMR_HOMEBREW_BATCH; peer = DMR_TAILQ_NEXT(peer, entries)) {
+            if (peer == except || peer->state != DMR_HOMEBREW_AUTH_DONE)
+                continue;
+            master_dmrd_iov(dmrd, peer, slot_info, iov[n]);
+            byte_zero(&msg[n], sizeof msg[n]);
+            msg[n].msg_hdr.msg_name = &peer->addr;
+            msg[n].msg_hdr.msg_namelen = peer->addrlen;
+            msg[n].msg_hdr.msg_iov = iov[n];
+            msg[n].msg_hdr.msg_iovlen = 4;
+            n++;
+        }
+        for (i = 0; i < n;) {
+            int ret = sendmmsg(sock->fd, msg + i, n - i, MSG_DONTWAIT);
+            if (ret == -1) {
+                if (errno == EINTR)
+                    continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    DMR_HM_WARN("broadcast: socket would block, dropped %zu frames", n - i);
+                    return sent;
+                }
+                /* skip the peer that failed */
+                DMR_HM_ERROR("broadcast: %s", strerror(errno));
+                i++;
+                continue;
+            }
+            i += ret;
+            sent += ret;
+        }
+    }
+#else
+    DMR_TAILQ_FOREACH(peer, &master->lru, entries) {
+        if (peer == except || peer->state != DMR_HOMEBREW_AUTH_DONE)
+            continue;
+        if (dmr_homebrew_master_send(master, peer, dmrd) == 0)
+            sent++;
+    }
+#endif
+    return sent;
+}
@@ -0,0 +1,225 @@
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include "dmr.h"
+#include "dmr/protocol/homebrew_master.h"
+#include "dmr/error.h"
+#include "dmr/io.h"
+#include "dmr/malloc.h"
+#include "common/byte.h"
+#include "common/socket.h"
+
+DMR_PRV static int homebrew_master_io_sweep_timer(dmr_io *io, void *masterptr);
+DMR_PRV static int homebrew_master_io_readable(dmr_io *io, void *masterptr, int fd);
+DMR_PRV static int homebrew_master_io_error(dmr_io *io, void *masterptr, int fd);
+
+/* Preallocated receive buffers, a whole batch of datagrams from any number of
+ * peers is received with a single recvmmsg call. */
+typedef struct {
+    size_t                  size;
+    uint8_t                 (*buf)[DMR_HOMEBREW_FRAME_MAX];
+    size_t                  *len;
+    struct sockaddr_storage *addr;
+    socklen_t               *addrlen;
+#if defined(DMR_HAVE_RECVMMSG)
+    struct iovec            *iov;
+    struct mmsghdr          *msg;
+#endif
+} homebrew_master_ring;
+
+DMR_PRV static homebrew_master_ring *homebrew_master_io_ring_new(dmr_homebrew_master *master)
+{
+    homebrew_master_ring *ring;
+    size_t size = DMR_HOMEBREW_BATCH;
+
+    DMR_NULL_CHECK(ring = dmr_palloc(master, homebrew_master_ring));
+    ring->size = size;
+    DMR_NULL_CHECK_FREE(ring->buf = dmr_palloc_size(ring, size * DMR_HOMEBREW_FRAME_MAX), ring);
+    DMR_NULL_CHECK_FREE(ring->len = dmr_palloc_size(ring, size * sizeof(size_t)), ring);
+    DMR_NULL_CHECK_FREE(ring->addr = dmr_palloc_size(ring, size * sizeof(struct sockaddr_storage)), ring);
+    DMR_NULL_CHECK_FREE(ring->addrlen = dmr_palloc_size(ring, size * sizeof(socklen_t)), ring);
+#if defined(DMR_HAVE_RECVMMSG)
+    DMR_NULL_CHECK_FREE(ring->iov = dmr_palloc_size(ring, size * sizeof(struct iovec)), ring);
+    DMR_NULL_CHECK_FREE(ring->msg = dmr_palloc_size(ring, size * sizeof(struct mmsghdr)), ring);
+#endif
+    return ring;
+}
+
+/** Receive up to one batch of datagrams, returns the number received. */
+DMR_PRV static int homebrew_master_io_recv(dmr_homebrew_master *master, int fd)
+{
+    homebrew_master_ring *ring = (homebrew_master_ring *)master->ring;
+    size_t n = 0;
+
+#if defined(DMR_HAVE_RECVMMSG)
+    size_t i;
+    for (i = 0; i < ring->size; i++) {
+        ring->iov[i].iov_base = ring->buf[i];
+        ring->iov[i].iov_len = DMR_HOMEBREW_FRAME_MAX;
+        byte_zero(&ring->msg[i], sizeof(struct mmsghdr));
+        ring->msg[i].msg_hdr.msg_iov = &ring->iov[i];
+        ring->msg[i].msg_hdr.msg_iovlen = 1;
+        ring->msg[i].msg_hdr.msg_name = &ring->addr[i];
+        ring->msg[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+    }
+
+    int ret;
+    do {
+        ret = recvmmsg(fd, ring->msg, ring->size, MSG_DONTWAIT, NULL);
+    } while (ret == -1 && errno == EINTR);
+    if (ret == -1) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            return 0;
+        DMR_HM_ERROR("recvmmsg: %s", strerror(errno));
+        return -1;
+    }
+    for (n = 0; n < (size_t)ret; n++) {
+        ring->len[n] = ring->msg[n].msg_len;
+        ring->addrlen[n] = ring->msg[n].msg_hdr.msg_namelen;
+    }
+#else
+    for (n = 0; n < ring->size; n++) {
+        ring->addrlen[n] = sizeof(struct sockaddr_storage);
+        ssize_t len = recvfrom(fd, ring->buf[n], DMR_HOMEBREW_FRAME_MAX, MSG_DONTWAIT,
+            (struct sockaddr *)&ring->addr[n], &ring->addrlen[n]);
+        if (len == -1) {
+            if (errno == EINTR) {
+                n--;
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            DMR_HM_ERROR("recvfrom: %s", strerror(errno));
+            if (n == 0)
+                return -1;
+            break;
+        }
+        ring->len[n] = len;
+    }
+#endif
+
+    return n;
+}
+
+DMR_PRV static int homebrew_master_io_init(dmr_io *io, void *masterptr)
+{
+    DMR_ERROR_IF_NULL(io, DMR_EINVAL);
+    DMR_ERROR_IF_NULL(masterptr, DMR_EINVAL);
+
+    dmr_log_debug("homebrew master io: init io");
+
+    dmr_homebrew_master *master = (dmr_homebrew_master *)masterptr;
+    if (master->sock == NULL) {
+        dmr_log_critical("homebrew master io: can't initialize for I/O loop, protocol not setup");
+        return dmr_error(DMR_EINVAL);
+    }
+
+    DMR_ERROR_IF_NULL(master->ring = homebrew_master_io_ring_new(master), DMR_ENOMEM);
+    return 0;
+}
+
+DMR_PRV static int homebrew_master_io_stop(dmr_io *io, dmr_homebrew_master *master, int fd)
+{
+    master->io = NULL;
+    if (master->sweep_timer != NULL) {
+        dmr_io_cancel_timer(io, master->sweep_timer);
+        master->sweep_timer = NULL;
+    }
+    dmr_io_del_read (io, fd, homebrew_master_io_readable);
+    dmr_io_del_error(io, fd, homebrew_master_io_error);
+    return 0;
+}
+
+DMR_PRV static int homebrew_master_io_register(dmr_io *io, void *masterptr)
+{
+    DMR_ERROR_IF_NULL(io, DMR_EINVAL);
+    DMR_ERROR_IF_NULL(masterptr, DMR_EINVAL);
+
+    dmr_log_debug("homebrew master io: register io");
+
+    dmr_homebrew_master *master = (dmr_homebrew_master *)masterptr;
+    socket_t *sock = (socket_t *)master->sock;
+
+    /* a single timer expires peers for the whole table, peers are kept in
+     * least recently seen order so a sweep only visits expired peers */
+    struct timeval sweep_timer = { DMR_HOMEBREW_MASTER_SWEEP, 0 };
+
+    master->io = io;
+    master->sweep_timer = dmr_io_reg_timer(io, sweep_timer, homebrew_master_io_sweep_timer, master, false);
+    dmr_io_reg_read (io, sock->fd, homebrew_master_io_readable, master, false);
+    dmr_io_reg_error(io, sock->fd, homebrew_master_io_error,    master, false);
+
+    return 0;
+}
+
+/* I/O callbacks */
+
+DMR_PRV static int homebrew_master_io_sweep_timer(dmr_io *io, void *masterptr)
+{
+    DMR_UNUSED(io);
+    DMR_ERROR_IF_NULL(masterptr, DMR_EINVAL);
+
+    dmr_homebrew_master *master = (dmr_homebrew_master *)masterptr;
+    int removed = dmr_homebrew_master_sweep(master);
+    if (removed > 0)
+        DMR_HM_INFO("%d peers timed out, %zu peers", removed, master->peers);
+
+    return 0;
+}
+
+DMR_PRV static int homebrew_master_io_readable(dmr_io *io, void *masterptr, int fd)
+{
+    DMR_UNUSED(io);
+    DMR_ERROR_IF_NULL(masterptr, DMR_EINVAL);
+
+    dmr_homebrew_master *master = (dmr_homebrew_master *)masterptr;
+    homebrew_master_ring *ring = (homebrew_master_ring *)master->ring;
+    int i, n;
+
+    if ((n = homebrew_master_io_recv(master, fd)) < 0)
+        return -1;
+
+    /* errors from a single peer should not stop the master */
+    for (i = 0; i < n; i++) {
+        dmr_homebrew_master_process(master, (struct sockaddr *)&ring->addr[i],
+            ring->addrlen[i], ring->buf[i], ring->len[i]);
+    }
+
+    return 0;
+}
+
+DMR_PRV static int homebrew_master_io_error(dmr_io *io, void *masterptr, int fd)
+{
+    DMR_ERROR_IF_NULL(io, DMR_EINVAL);
+    DMR_ERROR_IF_NULL(masterptr, DMR_EINVAL);
+
+    dmr_homebrew_master *master = (dmr_homebrew_master *)masterptr;
+    dmr_log_critical("homebrew master io: socket error");
+    int ret = homebrew_master_io_stop(io, master, fd);
+    dmr_homebrew_master_free(master);
+
+    return ret;
+}
+
+DMR_PRV static int homebrew_master_io_close(dmr_io *io, void *masterptr)
+{
+    DMR_ERROR_IF_NULL(io, DMR_EINVAL);
+    DMR_ERROR_IF_NULL(masterptr, DMR_EINVAL);
+
+    dmr_homebrew_master *master = (dmr_homebrew_master *)masterptr;
+    if (master->sock == NULL)
+        return 0; /* nothing to do */
+
+    master->io = NULL;
+    master->sweep_timer = NULL;
+    return dmr_homebrew_master_close(master);
+}
+
+DMR_API dmr_protocol dmr_homebrew_master_protocol = {
+    .type        = DMR_PROTOCOL_HOMEBREW_MASTER,
+    .name        = "Homebrew IPSC master",
+    .init_io     = homebrew_master_io_init,
+    .register_io = homebrew_master_io_register,
+    .close_io    = homebrew_master_io_close,
+};
@@ -141,6 +141,7 @@ DMR_API dmr_mmdvm *dmr_mmdvm_new(const char *port, int baud, dmr_mmdvm_model mod
 
     mmdvm->started = false;
     mmdvm->serial = serial;
+    mmdvm->tx_jitter_ms = DMR_MMDVM_TX_JITTER_MS;
     mmdvm->model = model;
     mmdvm->color_code = color_code;
 
@@ -196,7 +197,27 @@ error:
     return dmr_error(DMR_EINVAL);
 }
 
-DMR_API int dmr_mmdvm_parse_frame(dmr_mmdvm *mmdvm, dmr_mmdvm_frame frame, dmr_parsed_packet **parsed_out)
+/* Shortest frame that carries all the fields of a command, header included */
+DMR_PRV static size_t mmdvm_frame_min_len(uint8_t command)
+{
+    switch (command) {
+    case DMR_MMDVM_GET_VERSION:
+        return 4;
+    case DMR_MMDVM_GET_STATUS:
+        return 10;
+    case DMR_MMDVM_DMR_DATA1:
+    case DMR_MMDVM_DMR_DATA2:
+        return 4 + DMR_PACKET_LEN;
+    case DMR_MMDVM_ACK:
+        return 4;
+    case DMR_MMDVM_NAK:
+        return 5;
+    default:
+        return 3;
+    }
+}
+
+DMR_API int dmr_mmdvm_parse_frame(dmr_mmdvm *mmdvm, dmr_mmdvm_frame frame, size_t len, dmr_parsed_packet **parsed_out)
 {
     DMR_ERROR_IF_NULL(mmdvm, DMR_EINVAL);
     DMR_ERROR_IF_NULL(frame, DMR_EINVAL);
@@ -205,9 +226,14 @@ DMR_API int dmr_mmdvm_parse_frame(dmr_mmdvm *mmdvm, dmr_mmdvm_frame frame, dmr_p
         DMR_MM_DEBUG("no frame start, can't parse");
         return -1;
     }
+    if (len < 3 || len != frame[1] || len < mmdvm_frame_min_len(frame[2])) {
+        DMR_MM_DEBUG("%s frame of %zu bytes is too short, can't parse",
+            dmr_mmdvm_command_name(frame[2]), len);
+        return -1;
+    }
 
     DMR_MM_DEBUG("parse %u bytes %s command (%#02x)",
-        mmdvm->frame[1], dmr_mmdvm_command_name(mmdvm->frame[2]), mmdvm->frame[2]);
+        frame[1], dmr_mmdvm_command_name(frame[2]), frame[2]);
 
     dmr_parsed_packet *parsed;
     switch (frame[2]) {
@@ -216,8 +242,8 @@ DMR_API int dmr_mmdvm_parse_frame(dmr_mmdvm *mmdvm, dmr_mmdvm_frame frame, dmr_p
             TALLOC_FREE(mmdvm->description);
         }
         mmdvm->protocol_version = frame[3];
-        mmdvm->description = talloc_zero_size(mmdvm, frame[1] - 3);
-        byte_copy(mmdvm->description, frame + 4, frame[1] - 4);
+        mmdvm->description = talloc_zero_size(mmdvm, len - 3);
+        byte_copy(mmdvm->description, frame + 4, len - 4);
         return 0;
 
     case DMR_MMDVM_GET_STATUS:
@@ -231,6 +257,10 @@ DMR_API int dmr_mmdvm_parse_frame(dmr_mmdvm *mmdvm, dmr_mmdvm_frame frame, dmr_p
             mmdvm->tx_on ? "on" : "off",
             mmdvm->buffer_size[DMR_MMDVM_BUFSIZE_DMR_TS1],
             mmdvm->buffer_size[DMR_MMDVM_BUFSIZE_DMR_TS2]);
+        mmdvm->tx[DMR_TS1].space = mmdvm->buffer_size[DMR_MMDVM_BUFSIZE_DMR_TS1];
+        mmdvm->tx[DMR_TS2].space = mmdvm->buffer_size[DMR_MMDVM_BUFSIZE_DMR_TS2];
+        mmdvm->tx[DMR_TS1].reported = true;
+        mmdvm->tx[DMR_TS2].reported = true;
         break;
 
     case DMR_MMDVM_DMR_DATA1:
@@ -238,7 +268,7 @@ DMR_API int dmr_mmdvm_parse_frame(dmr_mmdvm *mmdvm, dmr_mmdvm_frame frame, dmr_p
         if ((parsed = dmr_packet_decode(frame + 4)) == NULL) {
             return dmr_error(DMR_ENOMEM);
         }
-        parsed->ts = frame[3] == 0x1a;
+        parsed->ts = frame[2] == DMR_MMDVM_DMR_DATA2 ? DMR_TS2 : DMR_TS1;
         *parsed_out = parsed;
         DMR_MM_DEBUG("received DMR packet on %s %u->%u",
             dmr_ts_name(parsed->ts), parsed->src_id, parsed->dst_id);
@@ -246,8 +276,9 @@ DMR_API int dmr_mmdvm_parse_frame(dmr_mmdvm *mmdvm, dmr_mmdvm_frame frame, dmr_p
 
     case DMR_MMDVM_ACK:
         DMR_MM_INFO("modem sent ACK in reply to %s",
-            dmr_mmdvm_command_name(mmdvm->frame[3]));
-        mmdvm->ack[mmdvm->frame[3]] = true;
+            dmr_mmdvm_command_name(frame[3]));
+        if (frame[3] < DMR_MMDVM_SET_MAX)
+            mmdvm->ack[frame[3]] = true;
 #if defined(DMR_DEBUG)
         dmr_dump_hex((void *)mmdvm->ack, sizeof(mmdvm->ack));
 #endif
@@ -255,8 +286,15 @@ DMR_API int dmr_mmdvm_parse_frame(dmr_mmdvm *mmdvm, dmr_mmdvm_frame frame, dmr_p
 
     case DMR_MMDVM_NAK:
         DMR_MM_WARN("modem sent NAK in reply to %s, reason: %s",
-            dmr_mmdvm_command_name(mmdvm->frame[3]),
-            dmr_mmdvm_reason_name(mmdvm->frame[4]));
+            dmr_mmdvm_command_name(frame[3]),
+            dmr_mmdvm_reason_name(frame[4]));
+        if (frame[4] == DMR_MMDVM_NOT_ENOUGH_SPACE &&
+            (frame[3] == DMR_MMDVM_DMR_DATA1 || frame[3] == DMR_MMDVM_DMR_DATA2)) {
+            dmr_ts ts = frame[3] == DMR_MMDVM_DMR_DATA2 ? DMR_TS2 : DMR_TS1;
+            mmdvm->tx[ts].space = 0;
+            mmdvm->tx[ts].reported = true;
+            mmdvm->stats.tx_overruns++;
+        }
         break;
 
     default:
@@ -266,71 +304,149 @@ DMR_API int dmr_mmdvm_parse_frame(dmr_mmdvm *mmdvm, dmr_mmdvm_frame frame, dmr_p
     return 0;
 }
 
-DMR_API int dmr_mmdvm_read(dmr_mmdvm *mmdvm, dmr_parsed_packet **parsed_out)
+DMR_API size_t dmr_mmdvm_feed(dmr_mmdvm *mmdvm, const uint8_t *buf, size_t len)
 {
-    serial_t *serial = (serial_t *)mmdvm->serial;
-    bool again = true;
-    int ret, retry;
-    size_t len = DMR_MMDVM_FRAME_MAX - mmdvm->pos;
+    if (mmdvm == NULL || buf == NULL)
+        return 0;
 
-read_again:
-    errno = 0;
-    retry = 0;
-    do {
-        ret = serial_read_nonblock(serial, mmdvm->frame + mmdvm->pos, len);
-        if (ret <= 0 && errno != 0) {
-            DMR_MM_ERROR("read: %s", strerror(errno));
-        }
-        if (++retry > 16)
+    size_t i, n = min(len, DMR_MMDVM_RING_SIZE - (mmdvm->ring_wr - mmdvm->ring_rd));
+    for (i = 0; i < n; i++) {
+        mmdvm->ring[(mmdvm->ring_wr + i) & DMR_MMDVM_RING_MASK] = buf[i];
+    }
+    mmdvm->ring_wr += n;
+    mmdvm->stats.rx_bytes += n;
+    return n;
+}
+
+/* Offset of the next FRAME_START byte in the ring, or used if there is none */
+DMR_PRV static size_t mmdvm_ring_find_start(dmr_mmdvm *mmdvm, size_t used)
+{
+    size_t rd = mmdvm->ring_rd & DMR_MMDVM_RING_MASK;
+    size_t n = min(used, DMR_MMDVM_RING_SIZE - rd);
+    const uint8_t *p;
+
+    if ((p = memchr(mmdvm->ring + rd, DMR_MMDVM_FRAME_START, n)) != NULL)
+        return p - (mmdvm->ring + rd);
+    if (used > n && (p = memchr(mmdvm->ring, DMR_MMDVM_FRAME_START, used - n)) != NULL)
+        return n + (p - mmdvm->ring);
+    return used;
+}
+
+DMR_API int dmr_mmdvm_deframe(dmr_mmdvm *mmdvm, dmr_packetq *q)
+{
+    DMR_ERROR_IF_NULL(mmdvm, DMR_EINVAL);
+    DMR_ERROR_IF_NULL(q, DMR_EINVAL);
+
+    int queued = 0;
+    for (;;) {
+        size_t used = mmdvm->ring_wr - mmdvm->ring_rd;
+        size_t rd = mmdvm->ring_rd & DMR_MMDVM_RING_MASK, skip, len;
+        uint8_t command;
+        if (used == 0)
             break;
-    } while (ret <= 0 && (errno == EAGAIN || errno == EINTR));
-    if (ret <= 0)
-        return ret;
 
-#if defined(DMR_DEBUG)
-    dmr_dump_hex(mmdvm->frame + mmdvm->pos, ret);
-#endif
+        /* Skip to the next FRAME_START byte */
+        if (mmdvm->ring[rd] != DMR_MMDVM_FRAME_START) {
+            skip = mmdvm_ring_find_start(mmdvm, used);
+            DMR_MM_DEBUG("resync, dropped %zu bytes", skip);
+            mmdvm->ring_rd += skip;
+            mmdvm->stats.rx_resyncs++;
+            mmdvm->stats.rx_dropped += skip;
+            continue;
+        }
 
-    /* Shift the buffer until we have a FRAME_START byte */
-    mmdvm->pos += ret;
-    while (mmdvm->frame[0] != DMR_MMDVM_FRAME_START &&
-           mmdvm->pos != 0) {
-        memmove(mmdvm->frame, mmdvm->frame + 1, DMR_MMDVM_FRAME_MAX);
-        mmdvm->pos--;
-    }
+        /* Wait for the header and the rest of the frame, a frame too short
+         * for its command is taken to be a stray FRAME_START byte */
+        if (used < 3)
+            break;
+        len = mmdvm->ring[(rd + 1) & DMR_MMDVM_RING_MASK];
+        command = mmdvm->ring[(rd + 2) & DMR_MMDVM_RING_MASK];
+        if (len < mmdvm_frame_min_len(command)) {
+            DMR_MM_DEBUG("resync, invalid %s frame length %zu",
+                dmr_mmdvm_command_name(command), len);
+            mmdvm->ring_rd++;
+            mmdvm->stats.rx_resyncs++;
+            mmdvm->stats.rx_dropped++;
+            continue;
+        }
+        if (used < len)
+            break;
 
-    DMR_MM_DEBUG("buffer pos %lu", mmdvm->pos);
-    
-    /* If the frame length doesn't match, wait for the next read */
-    if (mmdvm->pos < 3) {
-        DMR_MM_DEBUG("waiting for more data");
-        if (again) {
-            again = false;
-            goto read_again;
+        /* Frames that wrap around the end of the ring are copied out */
+        uint8_t *frame = mmdvm->ring + rd;
+        if (rd + len > DMR_MMDVM_RING_SIZE) {
+            skip = DMR_MMDVM_RING_SIZE - rd;
+            byte_copy(mmdvm->frame, mmdvm->ring + rd, skip);
+            byte_copy(mmdvm->frame + skip, mmdvm->ring, len - skip);
+            frame = mmdvm->frame;
         }
-        return 0;
-    }
-    if (mmdvm->pos < mmdvm->frame[1]) {
-        DMR_MM_DEBUG("not enough data received, at %u/%u", mmdvm->pos, mmdvm->frame[1]);
-        return 0;
+        mmdvm->ring_rd += len;
+        mmdvm->stats.rx_frames++;
+
+        dmr_parsed_packet *parsed = NULL;
+        if (dmr_mmdvm_parse_frame(mmdvm, frame, len, &parsed) != 0 || parsed == NULL)
+            continue;
+        if (dmr_packetq_add(q, parsed) != 0) {
+            dmr_parsed_packet_free(parsed);
+            return -1;
+        }
+        queued++;
     }
 
-    ret = dmr_mmdvm_parse_frame(mmdvm, mmdvm->frame, parsed_out);
+    return queued;
+}
 
-    /* Shift the buffer */
-    size_t i;
-    len = mmdvm->frame[1];
-    for (i = 0; i < len; i++) {
-        mmdvm->frame[i] = mmdvm->frame[i + len];
-    }
-    byte_zero(mmdvm->frame + len, DMR_MMDVM_FRAME_MAX - len);
-        
-    if (mmdvm->pos >= len)
-        mmdvm->pos -= len;
-    else
-        mmdvm->pos = 0;
+DMR_API int dmr_mmdvm_read(dmr_mmdvm *mmdvm, dmr_packetq *q)
+{
+    DMR_ERROR_IF_NULL(mmdvm, DMR_EINVAL);
+    DMR_ERROR_IF_NULL(q, DMR_EINVAL);
 
-    return ret;
+    serial_t *serial = (serial_t *)mmdvm->serial;
+    int ret, queued = 0;
+    bool full;
+
+    do {
+        /* Read until the modem is drained or the ring is full */
+        full = false;
+        for (;;) {
+            size_t used = mmdvm->ring_wr - mmdvm->ring_rd;
+            size_t wr = mmdvm->ring_wr & DMR_MMDVM_RING_MASK;
+            size_t len = min(DMR_MMDVM_RING_SIZE - used, DMR_MMDVM_RING_SIZE - wr);
+            if (used == DMR_MMDVM_RING_SIZE) {
+                full = true;
+                break;
+            }
+
+            errno = 0;
+            ret = serial_read_nonblock(serial, mmdvm->ring + wr, len);
+            if (ret < 0 && errno == EINTR)
+                continue;
+            if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                break;
+            if (ret < 0) {
+                DMR_MM_ERROR("read: %s", strerror(errno));
+                return -1;
+            }
+            if (ret == 0)
+                break;
+
+#if defined(DMR_DEBUG)
+            dmr_dump_hex(mmdvm->ring + wr, ret);
+#endif
+            mmdvm->ring_wr += ret;
+            mmdvm->stats.rx_bytes += ret;
+            if ((size_t)ret < len)
+                break;
+        }
+
+        if ((ret = dmr_mmdvm_deframe(mmdvm, q)) < 0)
+            return ret;
+        queued += ret;
+    } while (full);
+
+    DMR_MM_DEBUG("read %d packets, %zu bytes buffered",
+        queued, (size_t)(mmdvm->ring_wr - mmdvm->ring_rd));
+    return queued;
 }
 
 DMR_API int dmr_mmdvm_write(dmr_mmdvm *mmdvm)
@@ -382,9 +498,10 @@ DMR_API int dmr_mmdvm_send(dmr_mmdvm *mmdvm, dmr_parsed_packet *parsed)
         break;
     }
 
-    /* DVMEGA works on TS2 */
+    /* DVMEGA works on TS2, the packet may be shared so leave it alone */
+    dmr_ts ts = parsed->ts;
     if (mmdvm->model == DMR_MMDVM_MODEL_DVMEGA) {
-        parsed->ts = DMR_TS2;
+        ts = DMR_TS2;
         if (parsed->data_type == DMR_DATA_TYPE_VOICE) {
             control |= 0x20;
         }
@@ -395,13 +512,88 @@ DMR_API int dmr_mmdvm_send(dmr_mmdvm *mmdvm, dmr_parsed_packet *parsed)
     DMR_ERROR_IF_NULL(raw, DMR_ENOMEM);
     dmr_raw_add_uint8(raw, DMR_MMDVM_FRAME_START);
     dmr_raw_add_uint8(raw, 37);
-    dmr_raw_add_uint8(raw, parsed->ts == DMR_TS1
+    dmr_raw_add_uint8(raw, ts == DMR_TS1
         ? DMR_MMDVM_DMR_DATA1
         : DMR_MMDVM_DMR_DATA2);
     dmr_raw_add_uint8(raw, control);
     dmr_raw_add(raw, parsed->packet, DMR_PACKET_LEN);
-    return dmr_mmdvm_send_raw(mmdvm, raw);
-    //return dmr_rawq_add(mmdvm->trq, raw);
+    if (!mmdvm->tx_scheduled)
+        return dmr_mmdvm_send_raw(mmdvm, raw);
+
+    /* Queue for the scheduler, keep the latency bounded by dropping the
+     * oldest burst when the timeslot queue is full */
+    dmr_mmdvm_tx_slot *slot = &mmdvm->tx[ts];
+    if (slot->queue == NULL && (slot->queue = dmr_rawq_new(DMR_MMDVM_TX_QUEUE)) == NULL) {
+        dmr_raw_free(raw);
+        return dmr_error(DMR_ENOMEM);
+    }
+    if (dmr_rawq_add(slot->queue, raw) != 0) {
+        DMR_MM_DEBUG("tx: %s queue full, dropping oldest burst", dmr_ts_name(ts));
+        dmr_raw_free(dmr_rawq_shift(slot->queue));
+        mmdvm->stats.tx_dropped++;
+        if (dmr_rawq_add(slot->queue, raw) != 0) {
+            dmr_raw_free(raw);
+            return dmr_error(DMR_LASTERROR);
+        }
+    }
+    return 0;
+}
+
+DMR_API int dmr_mmdvm_tx_tick(dmr_mmdvm *mmdvm)
+{
+    DMR_ERROR_IF_NULL(mmdvm, DMR_EINVAL);
+
+    size_t target = (mmdvm->tx_jitter_ms + DMR_MMDVM_TX_INTERVAL_MS - 1) / DMR_MMDVM_TX_INTERVAL_MS;
+    int released = 0;
+    dmr_ts ts;
+
+    for (ts = DMR_TS1; ts < DMR_TS_INVALID; ts++) {
+        dmr_mmdvm_tx_slot *slot = &mmdvm->tx[ts];
+        size_t depth = dmr_rawq_empty(slot->queue) ? 0 : dmr_rawq_size(slot->queue), n;
+
+        if (!slot->active) {
+            if (depth == 0) {
+                slot->wait = 0;
+                continue;
+            }
+            /* Prime the jitter buffer, short transmissions start after
+             * waiting for as long as the target */
+            if (depth < target && ++slot->wait < target)
+                continue;
+            DMR_MM_DEBUG("tx: %s start with %zu bursts queued", dmr_ts_name(ts), depth);
+            slot->active = true;
+            slot->wait = 0;
+        }
+        if (depth == 0) {
+            DMR_MM_DEBUG("tx: %s underrun", dmr_ts_name(ts));
+            mmdvm->stats.tx_underruns++;
+            slot->active = false;
+            continue;
+        }
+
+        /* Catch up if the network delivered a burst of bursts */
+        for (n = depth > 2 * target ? 2 : 1; n > 0 && !dmr_rawq_empty(slot->queue); n--) {
+            if (slot->reported && slot->space == 0) {
+                mmdvm->stats.tx_overruns++;
+                break;
+            }
+
+            dmr_raw *raw = dmr_rawq_shift(slot->queue);
+            if (raw->buf[3] == (DMR_MMDVM_DMR_DATA_SYNC | DMR_DATA_TYPE_TERMINATOR_WITH_LC))
+                slot->active = false;
+            if (dmr_rawq_add(mmdvm->trq, raw) != 0) {
+                dmr_raw_free(raw);
+                mmdvm->stats.tx_dropped++;
+                continue;
+            }
+            if (slot->reported)
+                slot->space--;
+            mmdvm->stats.tx_frames++;
+            released++;
+        }
+    }
+
+    return released;
 }
 
 DMR_API int dmr_mmdvm_send_raw(dmr_mmdvm *mmdvm, dmr_raw *raw)
@@ -432,14 +624,8 @@ DMR_API int dmr_mmdvm_send_raw(dmr_mmdvm *mmdvm, dmr_raw *raw)
         ret = 0;
     }
 
-    /* Every 6th DMR data frame we request the modem status to check if there
-     * is sufficient buffer size. */
-    if (raw->len > 3 && (raw->buf[2] == DMR_MMDVM_DMR_DATA2)) {
-        if ((++mmdvm->sent) % 6 == 0) {
-            dmr_mmdvm_get_status(mmdvm);
-            dmr_mmdvm_get_version(mmdvm);
-        }
-    }
+    if (raw->len > 3 && (raw->buf[2] == DMR_MMDVM_DMR_DATA1 || raw->buf[2] == DMR_MMDVM_DMR_DATA2))
+        mmdvm->sent++;
 
     dmr_raw_free(raw);
     return ret;
@@ -545,6 +731,15 @@ DMR_API int dmr_mmdvm_close(dmr_mmdvm *mmdvm)
         serial_close(serial);
         serial_free(serial);
     }
+
+    /* Discard bursts the scheduler did not get to */
+    dmr_ts ts;
+    for (ts = DMR_TS1; ts < DMR_TS_INVALID; ts++) {
+        dmr_raw *raw;
+        while ((raw = dmr_rawq_shift(mmdvm->tx[ts].queue)) != NULL)
+            dmr_raw_free(raw);
+        dmr_free(mmdvm->tx[ts].queue);
+    }
     TALLOC_FREE(mmdvm);
     return 0;
 }
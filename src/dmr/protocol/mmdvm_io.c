@@ -8,6 +8,7 @@
 #include "common/serial.h"
 
 DMR_PRV static int mmdvm_io_status_timer(dmr_io *io, void *mmdvmptr);
+DMR_PRV static int mmdvm_io_tx_timer(dmr_io *io, void *mmdvmptr);
 DMR_PRV static int mmdvm_io_readable(dmr_io *io, void *mmdvmptr, int fd);
 //DMR_PRV static int mmdvm_io_writable(dmr_io *io, void *mmdvmptr, int fd);
 DMR_PRV static int mmdvm_io_error(dmr_io *io, void *mmdvmptr, int fd);
@@ -49,9 +50,16 @@ DMR_PRV static int mmdvm_io_init(dmr_io *io, void *mmdvmptr)
 
 DMR_PRV static int mmdvm_io_stop(dmr_io *io, dmr_mmdvm *mmdvm, int fd)
 {
-    DMR_UNUSED(mmdvm);
-
     /* unregister events */
+    mmdvm->tx_scheduled = false;
+    if (mmdvm->tx_timer != NULL) {
+        dmr_io_cancel_timer(io, mmdvm->tx_timer);
+        mmdvm->tx_timer = NULL;
+    }
+    if (mmdvm->status_timer != NULL) {
+        dmr_io_cancel_timer(io, mmdvm->status_timer);
+        mmdvm->status_timer = NULL;
+    }
     dmr_io_del_read (io, fd, mmdvm_io_readable);
     dmr_io_del_error(io, fd, mmdvm_io_error);
 
@@ -69,12 +77,17 @@ DMR_PRV static int mmdvm_io_register(dmr_io *io, void *mmdvmptr)
 
     serial_t *serial = (serial_t *)mmdvm->serial;
 
-    /* poll the modem status every second */
-    //struct timeval status_timer = { 3, 0 };
-    
+    /* poll the modem status for its free buffer space, and pace the
+     * transmitted bursts at the TDMA cadence */
+    struct timeval status_timer = { 0, DMR_MMDVM_STATUS_INTERVAL_MS * 1000 };
+    struct timeval tx_timer = { 0, DMR_MMDVM_TX_INTERVAL_MS * 1000 };
+
     /* register events */
-    (void)mmdvm_io_status_timer;
-    //dmr_io_reg_timer(io, status_timer, mmdvm_io_status_timer, mmdvm, false);
+    if ((mmdvm->status_timer = dmr_io_reg_timer(io, status_timer, mmdvm_io_status_timer, mmdvm, false)) == NULL)
+        return dmr_error(DMR_LASTERROR);
+    if ((mmdvm->tx_timer = dmr_io_reg_timer(io, tx_timer, mmdvm_io_tx_timer, mmdvm, false)) == NULL)
+        return dmr_error(DMR_LASTERROR);
+    mmdvm->tx_scheduled = true;
     dmr_io_reg_read (io, serial->fd,   mmdvm_io_readable,     mmdvm, false);
     dmr_io_reg_error(io, serial->fd,   mmdvm_io_error,        mmdvm, false);
 
@@ -104,6 +117,21 @@ DMR_PRV static int mmdvm_io_status_timer(dmr_io *io, void *mmdvmptr)
     return ret;
 }
 
+DMR_PRV static int mmdvm_io_tx_timer(dmr_io *io, void *mmdvmptr)
+{
+    DMR_ERROR_IF_NULL(io, DMR_EINVAL);
+    DMR_ERROR_IF_NULL(mmdvmptr, DMR_EINVAL);
+
+    dmr_mmdvm *mmdvm = (dmr_mmdvm *)mmdvmptr;
+
+    DMR_MM_TRACE("io: tx timer");
+
+    if (dmr_mmdvm_tx_tick(mmdvm) <= 0)
+        return 0;
+
+    return dmr_mmdvm_write(mmdvm);
+}
+
 DMR_PRV static int mmdvm_io_readable(dmr_io *io, void *mmdvmptr, int fd)
 {
     DMR_UNUSED(fd);
@@ -114,20 +142,12 @@ DMR_PRV static int mmdvm_io_readable(dmr_io *io, void *mmdvmptr, int fd)
 
     DMR_MM_TRACE("io: readable");
 
-    dmr_parsed_packet **parsed;
-    DMR_ERROR_IF_NULL(parsed = dmr_malloc(dmr_parsed_packet *), DMR_ENOMEM);
+    int ret = dmr_mmdvm_read(mmdvm, mmdvm->rxq);
+    if (ret < 0)
+        return ret;
 
-    int ret = dmr_mmdvm_read(mmdvm, parsed);
-    if (ret == 0 && *parsed != NULL) {
-        DMR_MM_DEBUG("io: queued parsed packet");
-        ret = dmr_packetq_add(mmdvm->rxq, *parsed);
-        dmr_free(*parsed);
-    } else {
-        DMR_MM_DEBUG("io: no parsed packet");
-    }
-
-    dmr_free(parsed);
-    return ret;
+    DMR_MM_DEBUG("io: queued %d parsed packets", ret);
+    return 0;
 }
 
 DMR_PRV static int mmdvm_io_error(dmr_io *io, void *mmdvmptr, int fd)
@@ -141,9 +161,10 @@ DMR_PRV static int mmdvm_io_error(dmr_io *io, void *mmdvmptr, int fd)
     DMR_MM_TRACE("io: error");
 
     DMR_MM_FATAL("io: serial error");
-    dmr_mmdvm_close(mmdvm);
+    /* unregister before the close frees the modem */
+    mmdvm_io_stop(io, mmdvm, fd);
 
-    return mmdvm_io_stop(io, mmdvm, fd);
+    return dmr_mmdvm_close(mmdvm);
 }
 
 DMR_API dmr_protocol dmr_mmdvm_protocol = {
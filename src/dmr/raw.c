@@ -106,11 +106,11 @@ DMR_API int dmr_raw_add_uint32_le(dmr_raw *raw, uint32_t in)
 DMR_API int dmr_raw_add_x##type(dmr_raw *raw, AT(type) in) \
 { \
     DMR_ERROR_IF_NULL(raw, DMR_EINVAL); \
-    if (dmr_raw_grow_add(raw, size) != 0) \
+    /* +1 because snprintf adds NULL bytes */ \
+    if (dmr_raw_grow_add(raw, size + 1) != 0) \
         return dmr_error(DMR_LASTERROR);\
     \
-    byte_zero(raw->buf + raw->len, size); \
-    snprintf((char *)(raw->buf + raw->len), size, fmt, in); \
+    snprintf((char *)(raw->buf + raw->len), size + 1, fmt, in); \
     raw->len += size; \
     return 0; \
 }
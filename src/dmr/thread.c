@@ -771,9 +771,9 @@ int dmr_thread_name_set(char *buf)
     return pthread_setname_np(buf);
 #else
     // On Linux, the name size is restricted to 16 characters including NUL
-    static char thread_name[16];
+    char thread_name[16];
     memset(thread_name, 0, sizeof(thread_name));
-    strncpy(thread_name, buf, sizeof(thread_name));
+    strncpy(thread_name, buf, sizeof(thread_name) - 1);
     return pthread_setname_np(dmr_thread_current(), thread_name);
 #endif
 }
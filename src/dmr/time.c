@@ -1,4 +1,5 @@
 #include <stddef.h>
+#include <time.h>
 #include "dmr/time.h"
 #include "dmr/platform.h"
 
@@ -29,3 +30,18 @@ uint32_t dmr_time_ms_since(struct timeval tv)
     timersub(&now, &tv, &res);
     return (res.tv_sec * 1000) + ((res.tv_usec + 500) / 1000);
 }
+
+uint64_t dmr_time_monotonic(void)
+{
+#if defined(DMR_PLATFORM_WINDOWS)
+    LARGE_INTEGER count, freq;
+    QueryPerformanceCounter(&count);
+    QueryPerformanceFrequency(&freq);
+    return (uint64_t)(count.QuadPart / freq.QuadPart) * 1000000000ULL +
+           (uint64_t)(count.QuadPart % freq.QuadPart) * 1000000000ULL / freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+#endif
+}
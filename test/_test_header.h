@@ -34,14 +34,13 @@ void flip_random_byte(uint8_t *buf, uint8_t len, uint8_t count)
     }
 }
 
-dmr_packet_t *test_packet(void)
+uint8_t *test_packet(void)
 {
-    dmr_packet_t *packet = talloc_zero(NULL, dmr_packet_t);
+    uint8_t *packet = talloc_zero_size(NULL, sizeof(dmr_packet));
     if (packet == NULL) {
         printf("out of memory\n");
         exit(1);
     }
-    memset(packet, 0, sizeof(dmr_packet_t));
     return packet;
 }
 
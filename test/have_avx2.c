@@ -0,0 +1,17 @@
+#include <immintrin.h>
+
+__attribute__((target("avx2")))
+static int avx2(int a)
+{
+    __m256i x = _mm256_set1_epi32(a);
+    x = _mm256_srai_epi32(_mm256_slli_epi32(x, 31), 31);
+    return _mm256_extract_epi32(x, 7);
+}
+
+int main()
+{
+    /* Only check the compiler, the CPU is checked at run time */
+    if (__builtin_cpu_supports("avx2"))
+        return avx2(1) == -1 ? 0 : 42;
+    return 0;
+}
@@ -0,0 +1,16 @@
+#include <stdint.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+int main()
+{
+    uint64_t value = 1;
+    int efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (efd == -1) {
+        return 42;
+    }
+    if (write(efd, &value, sizeof value) != sizeof value) {
+        return 42;
+    }
+    return 0;
+}
@@ -0,0 +1,17 @@
+#include <stdint.h>
+#include <immintrin.h>
+
+__attribute__((target("pclmul,ssse3")))
+static uint64_t clmul(uint64_t a, uint64_t b)
+{
+    __m128i x = _mm_clmulepi64_si128(_mm_cvtsi64_si128(a), _mm_cvtsi64_si128(b), 0x00);
+    return (uint64_t)_mm_cvtsi128_si64(_mm_shuffle_epi8(x, x));
+}
+
+int main()
+{
+    /* Only check the compiler, the CPU is checked at run time */
+    if (__builtin_cpu_supports("pclmul") && __builtin_cpu_supports("ssse3"))
+        return clmul(0, 0) == 0 ? 0 : 42;
+    return 0;
+}
@@ -0,0 +1,12 @@
+#define _GNU_SOURCE
+#include <sched.h>
+
+int main()
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof set, &set) == -1) {
+        return 42;
+    }
+    return sched_setaffinity(0, sizeof set, &set) == -1 ? 42 : 0;
+}
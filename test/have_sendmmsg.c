@@ -0,0 +1,16 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+int main()
+{
+    struct mmsghdr msgs[2];
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd == -1) {
+        return 42;
+    }
+    memset(msgs, 0, sizeof(msgs));
+    return sendmmsg(fd, msgs, 0, MSG_DONTWAIT) == -1 ? 0 : 0;
+}
@@ -0,0 +1,19 @@
+#include <signal.h>
+#include <sys/signalfd.h>
+#include <unistd.h>
+
+int main()
+{
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGUSR1);
+    if (sigprocmask(SIG_BLOCK, &mask, NULL) == -1) {
+        return 42;
+    }
+    int sfd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (sfd == -1) {
+        return 42;
+    }
+    close(sfd);
+    return 0;
+}
@@ -0,0 +1,17 @@
+#include <immintrin.h>
+
+__attribute__((target("sse2")))
+static int sse2(int a)
+{
+    __m128i x = _mm_set1_epi32(a);
+    x = _mm_srai_epi32(_mm_slli_epi32(x, 31), 31);
+    return _mm_cvtsi128_si32(x);
+}
+
+int main()
+{
+    /* Only check the compiler, the CPU is checked at run time */
+    if (__builtin_cpu_supports("sse2"))
+        return sse2(1) == -1 ? 0 : 42;
+    return 0;
+}
@@ -0,0 +1,17 @@
+#include <stdlib.h>
+#include <inttypes.h>
+#include <time.h>
+#include <sys/timerfd.h>
+
+int main()
+{
+    struct itimerspec its = { { 0, 0 }, { 0, 1000 } };
+    int tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    if (tfd == -1) {
+        return 42;
+    }
+    if (timerfd_settime(tfd, TFD_TIMER_ABSTIME, &its, NULL) == -1) {
+        return 42;
+    }
+    return 0;
+}
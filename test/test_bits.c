@@ -0,0 +1,81 @@
+#include <dmr/bits.h>
+#include "_test_header.h"
+
+bool test_bytes(void)
+{
+    uint8_t bytes[DMR_PACKET_LEN], test[DMR_PACKET_LEN];
+    dmr_bitvec v[DMR_BITVEC_WORDS(DMR_PACKET_BITS)];
+    bool bits[DMR_PACKET_BITS];
+    size_t i;
+
+    for (i = 0; i < sizeof(bytes); i++) {
+        bytes[i] = rand();
+    }
+    dmr_bitvec_from_bytes(v, bytes, sizeof(bytes));
+    dmr_bytes_to_bits(bytes, sizeof(bytes), bits, DMR_PACKET_BITS);
+    for (i = 0; i < DMR_PACKET_BITS; i++) {
+        eq(dmr_bitvec_get(v, i) == bits[i], "bit %zu differs", i);
+    }
+    dmr_bitvec_to_bytes(v, test, sizeof(test));
+    eq(!memcmp(bytes, test, sizeof(bytes)), "bytes differ");
+
+    size_t count = 0;
+    for (i = 0; i < 100; i++) {
+        count += bits[i];
+    }
+    eq(dmr_bitvec_popcount(v, 100) == count, "popcount");
+    return true;
+}
+
+bool test_extract_insert(void)
+{
+    dmr_bitvec v[DMR_BITVEC_WORDS(256)], w[DMR_BITVEC_WORDS(256)];
+    size_t offset, i;
+    uint8_t len;
+
+    for (i = 0; i < 500; i++) {
+        uint64_t value = ((uint64_t)rand() << 40) ^ ((uint64_t)rand() << 20) ^ rand();
+        len = 1 + rand() % 64;
+        offset = rand() % (256 - len);
+        value &= len == 64 ? ~0ULL : ((1ULL << len) - 1);
+
+        dmr_bitvec_zero(v, 256);
+        memset(w, 0xff, sizeof(w));
+        dmr_bitvec_insert(v, offset, len, value);
+        dmr_bitvec_insert(w, offset, len, value);
+        eq(dmr_bitvec_extract(v, offset, len) == value, "extract %u bits at %zu", len, offset);
+        eq(dmr_bitvec_popcount(v, 256) == (size_t)__builtin_popcountll(value), "insert touched other bits");
+        eq(dmr_bitvec_popcount(w, 256) == 256 - len + (size_t)__builtin_popcountll(value), "insert touched other bits");
+    }
+    return true;
+}
+
+bool test_interleave(void)
+{
+    dmr_bitvec v[DMR_BITVEC_WORDS(100)], i1[DMR_BITVEC_WORDS(100)], i2[DMR_BITVEC_WORDS(100)];
+    uint8_t schedule[100];
+    size_t i;
+
+    for (i = 0; i < 100; i++) {
+        schedule[i] = (i * 37) % 100;
+        dmr_bitvec_set(v, i, rand() & 1);
+    }
+    dmr_bitvec_interleave(i1, v, schedule, 100);
+    for (i = 0; i < 100; i++) {
+        eq(dmr_bitvec_get(i1, schedule[i]) == dmr_bitvec_get(v, i), "interleave bit %zu", i);
+    }
+    dmr_bitvec_deinterleave(i2, i1, schedule, 100);
+    for (i = 0; i < 100; i++) {
+        eq(dmr_bitvec_get(i2, i) == dmr_bitvec_get(v, i), "deinterleave bit %zu", i);
+    }
+    return true;
+}
+
+static test_t tests[] = {
+    {"bit vector from and to bytes", test_bytes},
+    {"bit vector extract and insert", test_extract_insert},
+    {"bit vector interleave", test_interleave},
+    {NULL, NULL} /* sentinel */
+};
+
+#include "_test_footer.h"
@@ -0,0 +1,60 @@
+#include <dmr/crc.h>
+#include "_test_header.h"
+
+static const uint8_t check[] = "123456789";
+
+bool test_check(void)
+{
+    eq(dmr_crc9_block(check, 9) == 0x011c, "CRC-9 %#05x", dmr_crc9_block(check, 9));
+    eq(dmr_crc16_block(check, 9) == 0x31c3, "CRC-16 %#06x", dmr_crc16_block(check, 9));
+    eq(dmr_crc32_block(check, 9) == 0x89a1897f, "CRC-32 %#010x", dmr_crc32_block(check, 9));
+    return true;
+}
+
+bool test_bytewise(void)
+{
+    uint8_t buf[1500];
+    uint16_t crc9, crc16;
+    uint32_t crc32;
+    size_t i, len;
+
+    for (i = 0; i < sizeof buf; i++) {
+        buf[i] = rand();
+    }
+    for (len = 0; len < sizeof buf; len += 1 + (rand() % 37)) {
+        crc9 = crc16 = crc32 = 0;
+        for (i = 0; i < len; i++) {
+            dmr_crc9(&crc9, buf[i], 8);
+            dmr_crc16(&crc16, buf[i]);
+            dmr_crc32(&crc32, buf[i]);
+        }
+        dmr_crc9_finish(&crc9, 9);
+        dmr_crc16_finish(&crc16);
+        dmr_crc32_finish(&crc32);
+        eq(crc9 == dmr_crc9_block(buf, len), "CRC-9 mismatch at length %zu", len);
+        eq(crc16 == dmr_crc16_block(buf, len), "CRC-16 mismatch at length %zu", len);
+        eq(crc32 == dmr_crc32_block(buf, len), "CRC-32 mismatch at length %zu", len);
+    }
+    return true;
+}
+
+bool test_crc9_bits(void)
+{
+    uint16_t a = 0, b = 0;
+
+    /* A full byte in two parts is the same as the byte */
+    dmr_crc9(&a, 0xa5, 8);
+    dmr_crc9(&b, 0x0a, 4);
+    dmr_crc9(&b, 0x05, 4);
+    eq(a == b, "CRC-9 %#05x != %#05x", a, b);
+    return true;
+}
+
+static test_t tests[] = {
+    {"CRC check values", test_check},
+    {"CRC bytewise and block", test_bytewise},
+    {"CRC-9 partial bytes", test_crc9_bits},
+    {NULL, NULL} /* sentinel */
+};
+
+#include "_test_footer.h"
@@ -7,16 +7,17 @@ bool test_all(void)
     uint8_t i, j;
     for (i = 0; i < 20; i++) {
         uint8_t data[12], test[12];
-        dmr_bptc_196_96_t bptc;
-        dmr_packet_t *packet = test_packet();
+        dmr_bptc_196_96 bptc;
+        dmr_packet packet;
 
+        memset(packet, 0, sizeof(packet));
         for (j = 0; j < 12; j++) {
             data[j] = rand();
         }
 
-        go(dmr_bptc_196_96_encode(&bptc, packet, data), "encode");
-        go(dmr_bptc_196_96_decode(&bptc, packet, test), "decode");
-        talloc_free(packet);
+        go(dmr_bptc_196_96_encode(packet, &bptc, data), "encode");
+        go(dmr_bptc_196_96_decode(packet, &bptc, test), "decode");
+        eq(bptc.repaired == 0, "%u bits repaired on a clean packet", bptc.repaired);
 
         if (memcmp(data, test, 12)) {
             printf("input data:\n");
@@ -31,31 +32,36 @@ bool test_all(void)
     return true;
 }
 
+/* Flip bit i of the 196 payload bits, skipping the slot type and sync */
+static void flip_payload_bit(dmr_packet packet, uint8_t i)
+{
+    uint16_t b = i < 98 ? i : i + 68;
+    packet[b >> 3] ^= 0x80 >> (b & 7);
+}
+
 bool test_noise(void)
 {
-    return true; // FIXME
-    uint8_t i, j, n, p;
+    uint8_t i, j, n, p[2];
     for (i = 0; i < 20; i++) {
         uint8_t data[12], test[12];
-        dmr_bptc_196_96_t bptc;
-        dmr_packet_t *packet = test_packet();
+        dmr_bptc_196_96 bptc;
+        dmr_packet packet;
 
+        memset(packet, 0, sizeof(packet));
         for (j = 0; j < 12; j++) {
             data[j] = rand();
         }
 
-        go(dmr_bptc_196_96_encode(&bptc, packet, data), "encode");
-        if ((rand() % 0xff) > 0x7f) {
-            p = 0;
-        } else {
-            p = 32;
+        go(dmr_bptc_196_96_encode(packet, &bptc, data), "encode");
+        for (n = 0; n < 2; n++) {
+            do {
+                p[n] = rand() % 196;
+            } while (n > 0 && p[n] == p[0]);
+            flip_payload_bit(packet, p[n]);
         }
-        n = packet->payload[p];
-        packet->payload[p] = flip_random_bit(packet->payload[p]);
-        dmr_log_trace("%s: flipped random bit at %u: %#02x -> %#02x",
-            prog, p, n, packet->payload[p]);
-        go(dmr_bptc_196_96_decode(&bptc, packet, test), "decode");
-        talloc_free(packet);
+        dmr_log_trace("%s: flipped payload bits %u and %u", prog, p[0], p[1]);
+        go(dmr_bptc_196_96_decode(packet, &bptc, test), "decode");
+        eq(bptc.repaired >= 1, "no bits repaired");
 
         if (memcmp(data, test, 12)) {
             printf("input data:\n");
@@ -67,6 +73,28 @@ bool test_noise(void)
         }
     }
 
+    return true;
+}
+
+/* Two errors in the same row can only be repaired by the columns */
+bool test_noise_row(void)
+{
+    uint8_t data[12], test[12], j;
+    dmr_bptc_196_96 bptc;
+    dmr_packet packet;
+
+    memset(packet, 0, sizeof(packet));
+    for (j = 0; j < 12; j++) {
+        data[j] = rand();
+    }
+
+    go(dmr_bptc_196_96_encode(packet, &bptc, data), "encode");
+    /* matrix bits 20 and 27 (row 1) are at these interleaved positions */
+    flip_payload_bit(packet, ((20 + 1) * 181) % 196);
+    flip_payload_bit(packet, ((27 + 1) * 181) % 196);
+    go(dmr_bptc_196_96_decode(packet, &bptc, test), "decode");
+    eq(bptc.repaired >= 2, "expected at least 2 bits repaired, got %u", bptc.repaired);
+    eq(memcmp(data, test, 12) == 0, "output corrupt");
 
     return true;
 }
@@ -74,6 +102,7 @@ bool test_noise(void)
 static test_t tests[] = {
     {"BPTC(196,96) encode & verify", test_all},
     {"BPTC(196,96) encode & verify with noise", test_noise},
+    {"BPTC(196,96) encode & verify with row errors", test_noise_row},
     {NULL, NULL} /* sentinel */
 };
 
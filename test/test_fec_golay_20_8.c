@@ -16,9 +16,36 @@ bool test_all(void)
     return true;
 }
 
+bool test_batch(void)
+{
+    uint8_t buf[3], data[300], test[300], i;
+    uint32_t code[300];
+    size_t n;
+
+    for (n = 0; n < 300; n++) {
+        buf[0] = rand();
+        buf[1] = 0;
+        buf[2] = 0;
+        dmr_golay_20_8_encode(buf);
+        /* up to 2 errors in the bits used by the decoder */
+        for (i = 0; i < n % 3; i++) {
+            buf[rand() % 2] ^= 1 << (rand() % 8);
+        }
+        code[n] = DMR_GOLAY_20_8_CODE(buf);
+        data[n] = dmr_golay_20_8_decode(buf);
+    }
+
+    /* odd lengths to run the scalar tail after the vector loop */
+    for (n = 1; n <= 300; n += 37) {
+        dmr_golay_20_8_decode_batch(code, test, n);
+        eq(memcmp(data, test, n) == 0, "batch of %zu differs from single decode", n);
+    }
+    return true;
+}
 
 static test_t tests[] = {
     {"Golay(20,8) encode & decode", test_all},
+    {"Golay(20,8) batch decode", test_batch},
     {NULL, NULL} /* sentinel */
 };
 
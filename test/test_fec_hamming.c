@@ -24,6 +24,39 @@ void fill_random(bool *buf, size_t len)
     return true; \
 }
 
+/* Every single bit error in a packed codeword is repaired */
+#define HAMMING_CODE_WORD_NAME(b)   test_##b##_word
+#define HAMMING_CODE_WORD(b,_n,_k)  bool HAMMING_CODE_WORD_NAME(b)(void) { \
+    uint8_t i, j; \
+    for (i = 0; i < 20; i++) { \
+        uint32_t data = rand() & ((1UL << _k) - 1), word, test; \
+        word = HAMMING_CODE_DMR_NAME(b,encode_word)(data); \
+        eq((word >> (_n - _k)) == data, "encode"); \
+        test = word; \
+        eq(HAMMING_CODE_DMR_NAME(b,decode_word)(&test) == 0 && test == word, "decode"); \
+        for (j = 0; j < _n; j++) { \
+            test = word ^ (1UL << j); \
+            eq(HAMMING_CODE_DMR_NAME(b,decode_word)(&test) == 1, "decode with bit %u flipped", j); \
+            eq(test == word, "repair bit %u", j); \
+        } \
+    } \
+    return true; \
+}
+
+/* Hamming(16,11,4) detects all double bit errors */
+bool test_hamming_16_11_4_double(void)
+{
+    uint8_t i, j;
+    uint32_t word = dmr_hamming_16_11_4_encode_word(rand() & 0x7ff), test;
+    for (i = 0; i < 16; i++) {
+        for (j = i + 1; j < 16; j++) {
+            test = word ^ (1UL << i) ^ (1UL << j);
+            eq(dmr_hamming_16_11_4_decode_word(&test) == -1, "bits %u and %u flipped", i, j);
+        }
+    }
+    return true;
+}
+
 /*
 bool test_hamming_13_9_3_parity(void)
 {
@@ -48,6 +81,11 @@ HAMMING_CODE(hamming_13_9_3, 13);
 HAMMING_CODE(hamming_15_11_3, 15);
 HAMMING_CODE(hamming_16_11_4, 16);
 HAMMING_CODE(hamming_17_12_3, 17);
+HAMMING_CODE_WORD(hamming_7_4_3, 7, 4);
+HAMMING_CODE_WORD(hamming_13_9_3, 13, 9);
+HAMMING_CODE_WORD(hamming_15_11_3, 15, 11);
+HAMMING_CODE_WORD(hamming_16_11_4, 16, 11);
+HAMMING_CODE_WORD(hamming_17_12_3, 17, 12);
 
 static test_t tests[] = {
     {"Hamming(7,4,3) encode & verify", test_hamming_7_4_3},
@@ -55,6 +93,12 @@ static test_t tests[] = {
     {"Hamming(15,11,3) encode & verify", test_hamming_15_11_3},
     {"Hamming(16,11,4) encode & verify", test_hamming_16_11_4},
     {"Hamming(17,12,3) encode & verify", test_hamming_17_12_3},
+    {"Hamming(7,4,3) packed repair", test_hamming_7_4_3_word},
+    {"Hamming(13,9,3) packed repair", test_hamming_13_9_3_word},
+    {"Hamming(15,11,3) packed repair", test_hamming_15_11_3_word},
+    {"Hamming(16,11,4) packed repair", test_hamming_16_11_4_word},
+    {"Hamming(17,12,3) packed repair", test_hamming_17_12_3_word},
+    {"Hamming(16,11,4) double error detection", test_hamming_16_11_4_double},
     {NULL, NULL} /* sentinel */
 };
 
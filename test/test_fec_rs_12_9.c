@@ -17,8 +17,43 @@ bool test_simple(void)
     return true;
 }
 
+bool test_repair(void)
+{
+    uint8_t bytes[12], test[12], i, j;
+    for (i = 0; i < 12; i++) {
+        for (j = 0; j < 9; j++) {
+            bytes[j] = rand();
+        }
+        dmr_rs_12_9_4_encode(bytes);
+        memcpy(test, bytes, 12);
+        test[i] ^= 1 + (rand() % 0xff);
+        eq(dmr_rs_12_9_4_decode(test) == 1, "symbol %u not repaired", i);
+        eq(memcmp(bytes, test, 12) == 0, "symbol %u repaired wrong", i);
+    }
+    return true;
+}
+
+bool test_detect(void)
+{
+    uint8_t bytes[12], test[12], i, j, k;
+    for (i = 0; i < 12; i++) {
+        for (j = 0; j < 9; j++) {
+            bytes[j] = rand();
+        }
+        dmr_rs_12_9_4_encode(bytes);
+        memcpy(test, bytes, 12);
+        k = (i + 1 + (rand() % 11)) % 12;
+        test[i] ^= 1 + (rand() % 0xff);
+        test[k] ^= 1 + (rand() % 0xff);
+        eq(dmr_rs_12_9_4_decode(test) == -1, "errors in symbols %u and %u not detected", i, k);
+    }
+    return true;
+}
+
 static test_t tests[] = {
     {"Reed-Solomon(12,9,4) encode & decode (verify)", test_simple},
+    {"Reed-Solomon(12,9,4) repair single symbol", test_repair},
+    {"Reed-Solomon(12,9,4) detect two symbols", test_detect},
     {NULL, NULL} /* sentinel */
 };
 
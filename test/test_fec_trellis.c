@@ -0,0 +1,211 @@
+#include <dmr/bits.h>
+#include <dmr/time.h>
+#include <dmr/fec/trellis.h>
+#include "_test_header.h"
+
+#define BENCH_BLOCKS 20000
+#define BENCH_ERRORS 2
+
+/* Table B.7: Trellis encoder state transition table */
+static uint8_t state_transition_table[] = {
+    0,  8, 4, 12, 2, 10, 6, 14,
+    4, 12, 2, 10, 6, 14, 0,  8,
+    1,  9, 5, 13, 3, 11, 7, 15,
+    5, 13, 3, 11, 7, 15, 1,  9,
+    3, 11, 7, 15, 1,  9, 5, 13,
+    7, 15, 1,  9, 5, 13, 3, 11,
+    2, 10, 6, 14, 0,  8, 4, 12,
+    6, 14, 0,  8, 4, 12, 2, 10
+};
+
+/* Table B.8: Constellation to dibit pair mapping */
+static int8_t constellation_point_mapping[16][2] = {
+    {+1, -1}, {-1, -1}, {+3, -3}, {-3, -3},
+    {-3, -1}, {+3, -1}, {-1, -3}, {+1, -3},
+    {-3, +3}, {+3, +3}, {-1, +1}, {+1, +1},
+    {+1, +3}, {-1, +3}, {+3, +1}, {-3, +1}
+};
+
+/* Table B.9: Interleaving schedule for rate 3⁄4 Trellis code */
+static uint8_t rate_34_interleaving_schedule[98] = {
+    0x00, 0x01, 0x08, 0x09, 0x10, 0x11, 0x18, 0x19, 0x20, 0x21, 0x28, 0x29,
+    0x30, 0x31, 0x38, 0x39, 0x40, 0x41, 0x48, 0x49, 0x50, 0x51, 0x58, 0x59,
+    0x60, 0x61, 0x02, 0x03, 0x0a, 0x0b, 0x12, 0x13, 0x1a, 0x1b, 0x22, 0x23,
+    0x2a, 0x2b, 0x32, 0x33, 0x3a, 0x3b, 0x42, 0x43, 0x4a, 0x4b, 0x52, 0x53,
+    0x5a, 0x5b, 0x04, 0x05, 0x0c, 0x0d, 0x14, 0x15, 0x1c, 0x1d, 0x24, 0x25,
+    0x2c, 0x2d, 0x34, 0x35, 0x3c, 0x3d, 0x44, 0x45, 0x4c, 0x4d, 0x54, 0x55,
+    0x5c, 0x5d, 0x06, 0x07, 0x0e, 0x0f, 0x16, 0x17, 0x1e, 0x1f, 0x26, 0x27,
+    0x2e, 0x2f, 0x36, 0x37, 0x3e, 0x3f, 0x46, 0x47, 0x4e, 0x4f, 0x56, 0x57,
+    0x5e, 0x5f
+};
+
+static const int8_t dibit_symbol[4] = { +1, +3, -1, -3 };
+
+/* The hard decision state walk the Viterbi decoder replaced, kept as the
+ * reference for the benchmark. */
+static int hard_decode(dmr_packet packet, uint8_t bytes[18])
+{
+    dmr_bitvec info[DMR_BITVEC_WORDS(DMR_PAYLOAD_BITS)];
+    int8_t dibits[98], deinterleaved_dibits[98];
+    uint8_t i, j, points[49], tribits[48], last = 0;
+    bool match;
+
+    dmr_payload_bitvec(packet, info);
+    for (i = 0; i < 98; i++) {
+        dibits[i] = dibit_symbol[dmr_bitvec_extract(info, i * 2, 2)];
+    }
+    for (i = 0; i < 98; i++) {
+        deinterleaved_dibits[rate_34_interleaving_schedule[i]] = dibits[i];
+    }
+    for (i = 0; i < 98; i += 2) {
+        for (j = 0; j < 16; j++) {
+            if (deinterleaved_dibits[i + 0] == constellation_point_mapping[j][0] &&
+                deinterleaved_dibits[i + 1] == constellation_point_mapping[j][1]) {
+                points[i / 2] = j;
+                break;
+            }
+        }
+    }
+    for (i = 0; i < 48; i++) {
+        match = false;
+        for (j = 0; j < 8; j++) {
+            if (points[i] == state_transition_table[last * 8 + j]) {
+                match = true;
+                last = j;
+                tribits[i] = last;
+                break;
+            }
+        }
+        if (!match)
+            return -1;
+    }
+
+    dmr_bitvec_zero(info, 144);
+    for (i = 0; i < 48; i++) {
+        dmr_bitvec_insert(info, i * 3, 3, tribits[i]);
+    }
+    dmr_bitvec_to_bytes(info, bytes, 18);
+    return 0;
+}
+
+/* Flip bit i of the 196 payload bits, skipping the slot type and sync */
+static void flip_payload_bit(dmr_packet packet, uint8_t i)
+{
+    uint16_t b = i < 98 ? i : i + 68;
+    packet[b >> 3] ^= 0x80 >> (b & 7);
+}
+
+static void random_block(dmr_packet packet, uint8_t data[18])
+{
+    uint8_t i;
+    memset(packet, 0, sizeof(dmr_packet));
+    for (i = 0; i < 18; i++) {
+        data[i] = rand();
+    }
+    dmr_trellis_rate_34_encode(packet, data);
+}
+
+bool test_all(void)
+{
+    uint8_t data[18], test[18], i;
+    dmr_packet packet;
+
+    for (i = 0; i < 50; i++) {
+        random_block(packet, data);
+        go(hard_decode(packet, test), "hard decode");
+        eq(memcmp(data, test, 18) == 0, "encoder does not match the reference decoder");
+        go(dmr_trellis_rate_34_decode(packet, test), "decode");
+        eq(memcmp(data, test, 18) == 0, "output corrupt");
+    }
+
+    return true;
+}
+
+bool test_noise(void)
+{
+    uint8_t data[18], test[18], i;
+    dmr_packet packet;
+
+    for (i = 0; i < 50; i++) {
+        random_block(packet, data);
+        flip_payload_bit(packet, rand() % 196);
+        go(dmr_trellis_rate_34_decode(packet, test), "decode");
+        eq(memcmp(data, test, 18) == 0, "output corrupt");
+    }
+
+    return true;
+}
+
+bool test_soft(void)
+{
+    dmr_bitvec info[DMR_BITVEC_WORDS(DMR_PAYLOAD_BITS)];
+    uint8_t data[18], test[18], i, j;
+    int8_t symbols[98];
+    dmr_packet packet;
+
+    for (i = 0; i < 50; i++) {
+        random_block(packet, data);
+        dmr_payload_bitvec(packet, info);
+        for (j = 0; j < 98; j++) {
+            /* noise up to just under the decision threshold */
+            symbols[j] = dibit_symbol[dmr_bitvec_extract(info, j * 2, 2)] * DMR_TRELLIS_SYMBOL_SCALE
+                + (rand() % DMR_TRELLIS_SYMBOL_SCALE) - DMR_TRELLIS_SYMBOL_SCALE / 2;
+        }
+        /* and one symbol pushed past it */
+        j = rand() % 98;
+        symbols[j] += symbols[j] > 0 ? -DMR_TRELLIS_SYMBOL_SCALE * 3 / 2 : DMR_TRELLIS_SYMBOL_SCALE * 3 / 2;
+        go(dmr_trellis_rate_34_decode_soft(symbols, test), "decode");
+        eq(memcmp(data, test, 18) == 0, "output corrupt");
+    }
+
+    return true;
+}
+
+bool test_benchmark(void)
+{
+    static dmr_packet packets[BENCH_BLOCKS];
+    static uint8_t data[BENCH_BLOCKS][18];
+    uint8_t test[18];
+    uint64_t start, hard_ns, viterbi_ns;
+    size_t i, j, hard_errors = 0, viterbi_errors = 0;
+
+    for (i = 0; i < BENCH_BLOCKS; i++) {
+        random_block(packets[i], data[i]);
+        for (j = 0; j < BENCH_ERRORS; j++) {
+            flip_payload_bit(packets[i], rand() % 196);
+        }
+    }
+
+    start = dmr_time_monotonic();
+    for (i = 0; i < BENCH_BLOCKS; i++) {
+        if (hard_decode(packets[i], test) != 0 || memcmp(data[i], test, 18))
+            hard_errors++;
+    }
+    hard_ns = dmr_time_monotonic() - start;
+
+    start = dmr_time_monotonic();
+    for (i = 0; i < BENCH_BLOCKS; i++) {
+        if (dmr_trellis_rate_34_decode(packets[i], test) != 0 || memcmp(data[i], test, 18))
+            viterbi_errors++;
+    }
+    viterbi_ns = dmr_time_monotonic() - start;
+
+    printf("\n  %d blocks, %d bit errors per block\n", BENCH_BLOCKS, BENCH_ERRORS);
+    printf("  hard:    %10.0f blocks/s, block error rate %.4f\n",
+        BENCH_BLOCKS * 1e9 / (hard_ns + 1), (double)hard_errors / BENCH_BLOCKS);
+    printf("  viterbi: %10.0f blocks/s, block error rate %.4f\n  ",
+        BENCH_BLOCKS * 1e9 / (viterbi_ns + 1), (double)viterbi_errors / BENCH_BLOCKS);
+    eq(viterbi_errors < hard_errors, "Viterbi decoder did not improve the block error rate");
+
+    return true;
+}
+
+static test_t tests[] = {
+    {"trellis rate 3/4 encode & decode", test_all},
+    {"trellis rate 3/4 decode with noise", test_noise},
+    {"trellis rate 3/4 soft decision decode", test_soft},
+    {"trellis rate 3/4 benchmark", test_benchmark},
+    {NULL, NULL} /* sentinel */
+};
+
+#include "_test_footer.h"
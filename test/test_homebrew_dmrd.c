@@ -0,0 +1,45 @@
+#include <dmr/protocol/homebrew.h>
+#include "_test_header.h"
+
+bool test_encode(void) {
+    dmr_homebrew_dmrd dmrd;
+    dmr_parsed_packet parsed;
+    uint8_t head[DMR_HOMEBREW_DMRD_HEAD] = {
+        'D', 'M', 'R', 'D', 0x2a,
+        0x66, 0x29, 0x1f,               /* src_id */
+        0x5b, 0x50, 0x00,               /* dst_id */
+        0x46, 0xc6, 0x1f, 0x00,         /* repeater_id */
+        0x12,                           /* slot_info */
+        0x78, 0x56, 0x34, 0x12          /* stream_id */
+    };
+
+    memset(&parsed, 0, sizeof parsed);
+    memset(parsed.packet, 0xa5, sizeof parsed.packet);
+    parsed.sequence = 0x2a;
+    parsed.src_id = 2042214;
+    parsed.dst_id = 20571;
+    parsed.repeater_id = 2082374;
+    parsed.ts = DMR_TS2;
+    parsed.flco = DMR_FLCO_PRIVATE;
+    parsed.data_type = DMR_DATA_TYPE_VOICE;
+    parsed.voice_frame = 1;
+    parsed.stream_id = 0x12345678;
+
+    go(dmr_homebrew_dmrd_encode(&dmrd, &parsed),    "encode");
+    eq(memcmp(dmrd.head, head, sizeof head) == 0,   "unexpected DMRD header");
+    eq(dmrd.parsed == &parsed,                      "packet was copied");
+    eq(dmrd.ts == DMR_TS2,                          "expected TS2");
+
+    dmr_homebrew_dmrd_repeater_id(&dmrd, 204);
+    eq(dmrd.head[11] == 204 && dmrd.head[12] == 0,  "repeater_id not patched");
+    eq(memcmp(dmrd.head + 15, head + 15, 5) == 0,   "repeater_id patch overflow");
+
+    return true;
+}
+
+static test_t tests[] = {
+    {"DMRD encode", test_encode},
+    {NULL, NULL} /* sentinel */
+};
+
+#include "_test_footer.h"
@@ -0,0 +1,165 @@
+#include <dmr/malloc.h>
+#include <dmr/protocol/homebrew.h>
+#include <dmr/protocol/homebrew_master.h>
+#include "_test_header.h"
+
+#define MASTER_PORT 62131
+
+static uint8_t loopback[16] = {
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0xff, 0xff, 0x7f, 0x00, 0x00, 0x01
+};
+
+/* Run one round trip, the master handles a frame and the client the reply. */
+static bool round_trip(dmr_homebrew_master *master, dmr_homebrew *homebrew)
+{
+    return dmr_homebrew_master_read(master) == 0 &&
+           dmr_homebrew_read(homebrew, NULL) == 0;
+}
+
+static bool login(dmr_homebrew_master *master, dmr_homebrew *homebrew, char *secret)
+{
+    if (dmr_homebrew_auth(homebrew, secret) != 0)
+        return false;
+    return round_trip(master, homebrew) &&  /* RPTL, MSTACK with nonce */
+           round_trip(master, homebrew) &&  /* RPTK, MSTACK */
+           round_trip(master, homebrew);    /* RPTC, MSTACK */
+}
+
+bool test_login(void) {
+    dmr_homebrew_master *master;
+    dmr_homebrew *homebrew;
+    dmr_homebrew_peer *peer;
+
+    ne((master = dmr_homebrew_master_new(loopback, MASTER_PORT, "passw0rd")) == NULL, "master_new");
+    ne((homebrew = dmr_homebrew_new(2042214, loopback, MASTER_PORT, loopback, 62132)) == NULL, "new");
+    homebrew->config.call = "PD0MZ";
+    homebrew->config.rx_freq = 430087500;
+    homebrew->config.tx_freq = 439487500;
+
+    eq(login(master, homebrew, "passw0rd"), "login failed");
+    eq(homebrew->state == DMR_HOMEBREW_AUTH_DONE, "client not logged in");
+    eq(master->peers == 1, "expected 1 peer");
+    peer = DMR_TAILQ_FIRST(&master->lru);
+    eq(peer->state == DMR_HOMEBREW_AUTH_DONE, "peer not logged in");
+    eq(peer->repeater_id == 2042214, "unexpected repeater_id");
+    eq(!strcmp(peer->call, "PD0MZ"), "unexpected call");
+    eq(peer->rx_freq == 430087500 && peer->tx_freq == 439487500, "unexpected frequencies");
+
+    /* DMR frames from logged in peers end up in the receive queue */
+    dmr_parsed_packet parsed, *received;
+    memset(&parsed, 0, sizeof parsed);
+    memset(parsed.packet, 0xa5, sizeof parsed.packet);
+    parsed.src_id = 2042214;
+    parsed.dst_id = 204;
+    parsed.repeater_id = 2042214;
+    parsed.ts = DMR_TS2;
+    parsed.flco = DMR_FLCO_GROUP;
+    parsed.data_type = DMR_DATA_TYPE_VOICE_LC;
+    parsed.stream_id = 0x12345678;
+    go(dmr_homebrew_send(homebrew, &parsed), "send");
+    go(dmr_homebrew_master_read(master), "master read DMRD");
+    go(dmr_packetq_shift(master->rxq, &received), "no packet received");
+    eq(received->src_id == 2042214 && received->dst_id == 204, "unexpected src_id/dst_id");
+    eq(received->stream_id == 0x12345678, "unexpected stream_id");
+    eq(!memcmp(received->packet, parsed.packet, DMR_PACKET_LEN), "unexpected payload");
+    dmr_parsed_packet_free(received);
+
+    /* and back to all peers */
+    dmr_homebrew_dmrd dmrd;
+    go(dmr_homebrew_dmrd_encode(&dmrd, &parsed), "encode");
+    eq(dmr_homebrew_master_broadcast(master, &dmrd, NULL) == 1, "broadcast");
+    go(dmr_homebrew_read(homebrew, &received), "read DMRD");
+    eq(received != NULL, "no packet received");
+    eq(received->ts == DMR_TS2, "unexpected ts");
+    eq(received->stream_id == 0x12345678, "unexpected stream_id");
+    eq(!memcmp(received->packet, parsed.packet, DMR_PACKET_LEN), "unexpected payload");
+    dmr_parsed_packet_free(received);
+    eq(dmr_homebrew_master_broadcast(master, &dmrd, peer) == 0, "broadcast to excluded peer");
+
+    /* RPTC without config closes the link */
+    go(dmr_homebrew_close(homebrew), "close");
+    go(dmr_homebrew_master_read(master), "master read RPTC");
+    eq(master->peers == 0, "peer not removed");
+
+    dmr_free(homebrew);
+    dmr_homebrew_master_free(master);
+    return true;
+}
+
+bool test_login_refused(void) {
+    dmr_homebrew_master *master;
+    dmr_homebrew *homebrew;
+
+    ne((master = dmr_homebrew_master_new(loopback, MASTER_PORT, "passw0rd")) == NULL, "master_new");
+    ne((homebrew = dmr_homebrew_new(2042214, loopback, MASTER_PORT, loopback, 62133)) == NULL, "new");
+
+    go(dmr_homebrew_auth(homebrew, "hunter2"), "auth");
+    eq(round_trip(master, homebrew), "RPTL");
+    go(dmr_homebrew_master_read(master), "master read RPTK");
+    eq(dmr_homebrew_read(homebrew, NULL) == -1, "expected NAK");
+    eq(homebrew->state == DMR_HOMEBREW_AUTH_NONE, "client logged in");
+    eq(master->peers == 0, "peer not removed");
+
+    dmr_free(homebrew);
+    dmr_homebrew_master_free(master);
+    return true;
+}
+
+bool test_sweep(void) {
+    dmr_homebrew_master *master;
+    struct sockaddr_in6 addr;
+    uint8_t buf[13];
+    size_t i;
+
+    ne((master = dmr_homebrew_master_new(loopback, MASTER_PORT, "passw0rd")) == NULL, "master_new");
+    master->peers_max = 200;
+
+    /* enough peers to grow the table a couple of times */
+    memset(&addr, 0, sizeof addr);
+    addr.sin6_family = AF_INET6;
+    memcpy(&addr.sin6_addr, loopback, 16);
+    for (i = 0; i < 200; i++) {
+        addr.sin6_port = htons(40000 + i);
+        snprintf((char *)buf, sizeof buf, "RPTL%08x", (unsigned)(1000 + i));
+        go(dmr_homebrew_master_process(master, (struct sockaddr *)&addr, sizeof addr, buf, 12), "process RPTL");
+    }
+    eq(master->peers == 200, "expected 200 peers");
+    for (i = 0; i < 200; i++) {
+        dmr_homebrew_peer *peer;
+        addr.sin6_port = htons(40000 + i);
+        ne((peer = dmr_homebrew_master_peer(master, (struct sockaddr *)&addr)) == NULL, "peer not found");
+        eq(peer->repeater_id == 1000 + i, "wrong peer");
+    }
+
+    /* the limit is enforced */
+    addr.sin6_port = htons(40000 + i);
+    go(dmr_homebrew_master_process(master, (struct sockaddr *)&addr, sizeof addr, buf, 12), "process RPTL");
+    eq(master->peers == 200, "peer limit exceeded");
+    eq(dmr_homebrew_master_peer(master, (struct sockaddr *)&addr) == NULL, "peer over limit added");
+
+    /* nothing expired yet */
+    eq(dmr_homebrew_master_sweep(master) == 0, "swept active peers");
+
+    /* peers seen last are swept last */
+    addr.sin6_port = htons(40000);
+    snprintf((char *)buf, sizeof buf, "RPTL%08x", 1000);
+    go(dmr_homebrew_master_process(master, (struct sockaddr *)&addr, sizeof addr, buf, 12), "process RPTL");
+    eq(DMR_TAILQ_LAST(&master->lru, dmr_homebrew_peer_lru)->repeater_id == 1000, "peer not moved to the tail");
+
+    master->timeout = 0;
+    eq(dmr_homebrew_master_sweep(master) == 200, "expected 200 peers swept");
+    eq(master->peers == 0, "peers left");
+
+    dmr_homebrew_master_free(master);
+    return true;
+}
+
+static test_t tests[] = {
+    {"login", test_login},
+    {"login refused", test_login_refused},
+    {"peer table and sweep", test_sweep},
+    {NULL, NULL} /* sentinel */
+};
+
+#include "_test_footer.h"
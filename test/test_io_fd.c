@@ -0,0 +1,172 @@
+#include <sys/socket.h>
+#include <dmr/io.h>
+#include "_test_header.h"
+
+/* Fails the test if the loop gets stuck waiting for an event */
+static dmr_io_timer *watchdog;
+static bool timed_out;
+
+static int watchdog_cb(dmr_io *io, void *userdata)
+{
+    DMR_UNUSED(userdata);
+    timed_out = true;
+    return dmr_io_close(io);
+}
+
+static int watchdog_start(dmr_io *io)
+{
+    struct timeval tv = { 2, 0 };
+    timed_out = false;
+    if ((watchdog = dmr_io_reg_timer(io, tv, watchdog_cb, NULL, true)) == NULL)
+        return -1;
+    return 0;
+}
+
+static void watchdog_stop(dmr_io *io)
+{
+    if (watchdog != NULL) {
+        dmr_io_cancel_timer(io, watchdog);
+        watchdog = NULL;
+    }
+}
+
+static size_t first_calls, second_calls;
+
+static int second_cb(dmr_io *io, void *userdata, int fd)
+{
+    DMR_UNUSED(io);
+    DMR_UNUSED(userdata);
+    DMR_UNUSED(fd);
+    second_calls++;
+    return 0;
+}
+
+static int first_cb(dmr_io *io, void *userdata, int fd)
+{
+    DMR_UNUSED(userdata);
+    char c;
+    first_calls++;
+    if (read(fd, &c, 1) != 1)
+        return -1;
+
+    /* remove the other callback on this fd, which is next in the dispatch,
+     * and ourselves */
+    dmr_io_del_read(io, fd, second_cb);
+    dmr_io_del_read(io, fd, first_cb);
+    watchdog_stop(io);
+    return 0;
+}
+
+bool test_remove(void) {
+    dmr_io *io;
+    int sv[2];
+
+    ne((io = dmr_io_new()) == NULL, "io_new");
+    go(socketpair(AF_UNIX, SOCK_STREAM, 0, sv), "socketpair");
+    go(watchdog_start(io), "watchdog");
+
+    /* the most recently registered callback runs first */
+    go(dmr_io_reg_read(io, sv[0], second_cb, NULL, false), "reg second");
+    go(dmr_io_reg_read(io, sv[0], first_cb, NULL, false), "reg first");
+    eq(write(sv[1], "x", 1) == 1, "write");
+
+    go(dmr_io_loop(io), "loop");
+    eq(!timed_out, "timed out");
+    eq(first_calls == 1, "expected 1 call, got %zu", first_calls);
+    eq(second_calls == 0, "removed callback called %zu times", second_calls);
+    eq(io->entries == 0, "expected no entries, got %zd", io->entries);
+    eq(DMR_LIST_EMPTY(&io->removed.head), "removed entries not swept");
+    eq(DMR_LIST_EMPTY(&io->fd[sv[0]]->read.head), "read callbacks not unlinked");
+
+    /* the fd can be registered again after its callbacks were removed */
+    eq(write(sv[1], "y", 1) == 1, "write");
+    go(watchdog_start(io), "watchdog");
+    go(dmr_io_reg_read(io, sv[0], second_cb, NULL, false), "reg second");
+    go(dmr_io_reg_read(io, sv[0], first_cb, NULL, false), "reg first");
+    go(dmr_io_loop(io), "loop");
+    eq(!timed_out, "timed out");
+    eq(first_calls == 2, "expected 2 calls, got %zu", first_calls);
+    eq(second_calls == 0, "removed callback called %zu times", second_calls);
+
+    close(sv[0]);
+    close(sv[1]);
+    go(dmr_io_free(io), "free");
+    return true;
+}
+
+#define READD_BYTES 5
+
+static size_t once_calls, readd_calls;
+
+static int once_cb(dmr_io *io, void *userdata, int fd)
+{
+    DMR_UNUSED(userdata);
+    char c;
+    if (read(fd, &c, 1) != 1)
+        return -1;
+
+    /* a once callback registering itself again, for the next byte */
+    if (++once_calls < READD_BYTES)
+        return dmr_io_reg_read(io, fd, once_cb, NULL, true);
+    if (readd_calls == READD_BYTES)
+        watchdog_stop(io);
+    return 0;
+}
+
+static int readd_cb(dmr_io *io, void *userdata, int fd)
+{
+    DMR_UNUSED(userdata);
+    char c;
+    if (read(fd, &c, 1) != 1)
+        return -1;
+
+    /* remove and add back a persistent callback */
+    dmr_io_del_read(io, fd, readd_cb);
+    if (++readd_calls < READD_BYTES)
+        return dmr_io_reg_read(io, fd, readd_cb, NULL, false);
+    if (once_calls == READD_BYTES)
+        watchdog_stop(io);
+    return 0;
+}
+
+bool test_readd(void) {
+    dmr_io *io;
+    int sv[2], sw[2];
+
+    ne((io = dmr_io_new()) == NULL, "io_new");
+    go(socketpair(AF_UNIX, SOCK_STREAM, 0, sv), "socketpair");
+    go(socketpair(AF_UNIX, SOCK_STREAM, 0, sw), "socketpair");
+    go(watchdog_start(io), "watchdog");
+
+    go(dmr_io_reg_read(io, sv[0], once_cb, NULL, true), "reg once");
+    go(dmr_io_reg_read(io, sw[0], readd_cb, NULL, false), "reg readd");
+    eq(write(sv[1], "abcde", READD_BYTES) == READD_BYTES, "write");
+    eq(write(sw[1], "abcde", READD_BYTES) == READD_BYTES, "write");
+
+    /* each dispatch reads one byte, the fds stay readable until all are read */
+    go(dmr_io_loop(io), "loop");
+    eq(!timed_out, "timed out, %zu once and %zu re-added calls", once_calls, readd_calls);
+    eq(once_calls == READD_BYTES, "expected %d once calls, got %zu", READD_BYTES, once_calls);
+    eq(readd_calls == READD_BYTES, "expected %d re-added calls, got %zu", READD_BYTES, readd_calls);
+    eq(io->entries == 0, "expected no entries, got %zd", io->entries);
+
+    close(sv[0]);
+    close(sv[1]);
+    close(sw[0]);
+    close(sw[1]);
+    go(dmr_io_free(io), "free");
+    return true;
+}
+
+static test_t tests[] = {
+#if defined(DMR_HAVE_EPOLL)
+    {"epoll remove during dispatch", test_remove},
+    {"epoll add during dispatch", test_readd},
+#else
+    {"select remove during dispatch", test_remove},
+    {"select add during dispatch", test_readd},
+#endif
+    {NULL, NULL} /* sentinel */
+};
+
+#include "_test_footer.h"
@@ -0,0 +1,8 @@
+/* The fd dispatch tests from test_io_fd.c, against the select backend. The
+ * library is built with the best backend available, so the loop is compiled
+ * in here with epoll disabled. */
+#include <dmr/config.h>
+#undef DMR_HAVE_EPOLL
+#undef DMR_HAVE_TIMERFD
+#include "../src/dmr/io.c"
+#include "test_io_fd.c"
@@ -0,0 +1,70 @@
+#include <sched.h>
+#include <dmr/io.h>
+#include "_test_header.h"
+
+#define HANDOFF_PACKETS 10000
+
+static dmr_io_group *group;
+static size_t received;
+static bool in_order = true;
+static bool on_loop = true;
+static dmr_thread_t producer;
+
+static int handoff_cb(dmr_io *io, void *userdata, dmr_parsed_packet *parsed)
+{
+    DMR_UNUSED(userdata);
+    if (io != dmr_io_group_loop(group, 1) || dmr_thread_equal(dmr_thread_current(), producer))
+        on_loop = false;
+    if (parsed->stream_id != received)
+        in_order = false;
+    if (++received == HANDOFF_PACKETS)
+        dmr_io_group_close(group);
+    return 0;
+}
+
+bool test_start_close(void) {
+    ne((group = dmr_io_group_new(4)) == NULL, "group_new");
+    eq(group->loops == 4, "expected 4 loops");
+    go(dmr_io_group_affinity(group, 0, 0), "affinity");
+    go(dmr_io_group_start(group), "start");
+    go(dmr_io_group_close(group), "close");
+    go(dmr_io_group_join(group), "join");
+    go(dmr_io_group_free(group), "free");
+    return true;
+}
+
+bool test_handoff(void) {
+    dmr_io_handoff *handoff;
+    dmr_parsed_packet parsed;
+    size_t i, full = 0;
+
+    ne((group = dmr_io_group_new(2)) == NULL, "group_new");
+    ne((handoff = dmr_io_handoff_new(dmr_io_group_loop(group, 1), 64, handoff_cb, NULL)) == NULL, "handoff_new");
+    producer = dmr_thread_current();
+    go(dmr_io_group_start(group), "start");
+
+    memset(&parsed, 0, sizeof parsed);
+    for (i = 0; i < HANDOFF_PACKETS; i++) {
+        parsed.stream_id = i;
+        while (dmr_io_handoff_send(handoff, &parsed) != 0) {
+            full++;
+            sched_yield();
+        }
+    }
+
+    go(dmr_io_group_join(group), "join");
+    eq(received == HANDOFF_PACKETS, "expected %d packets, got %zu", HANDOFF_PACKETS, received);
+    eq(in_order, "packets out of order");
+    eq(on_loop, "callback ran on the wrong thread");
+    dmr_io_handoff_free(handoff);
+    go(dmr_io_group_free(group), "free");
+    return true;
+}
+
+static test_t tests[] = {
+    {"start and close", test_start_close},
+    {"handoff", test_handoff},
+    {NULL, NULL} /* sentinel */
+};
+
+#include "_test_footer.h"
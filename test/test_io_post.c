@@ -0,0 +1,124 @@
+#include <dmr/io.h>
+#include <dmr/time.h>
+#include "_test_header.h"
+
+#define POST_PRODUCERS 4
+#define POST_CALLBACKS 10000
+
+typedef struct {
+    dmr_io       *io;
+    size_t       producer;
+    size_t       seq;
+} post_arg;
+
+static dmr_thread_t loop_thread;
+static size_t next_seq[POST_PRODUCERS];
+static size_t received;
+static bool in_order = true;
+static bool on_loop = true;
+static post_arg args[POST_PRODUCERS][POST_CALLBACKS];
+
+static int post_cb(dmr_io *io, void *argptr)
+{
+    post_arg *arg = (post_arg *)argptr;
+    if (!dmr_thread_equal(dmr_thread_current(), loop_thread))
+        on_loop = false;
+    if (arg->seq != next_seq[arg->producer]++)
+        in_order = false;
+    if (++received == POST_PRODUCERS * POST_CALLBACKS)
+        dmr_io_close(io);
+    return 0;
+}
+
+static int producer(void *argptr)
+{
+    post_arg *arg = (post_arg *)argptr;
+    size_t i;
+    for (i = 0; i < POST_CALLBACKS; i++) {
+        if (dmr_io_post(arg[i].io, post_cb, &arg[i]) != 0)
+            return -1;
+    }
+    return 0;
+}
+
+static int loop(void *ioptr)
+{
+    loop_thread = dmr_thread_current();
+    return dmr_io_loop((dmr_io *)ioptr);
+}
+
+bool test_post(void) {
+    dmr_io *io;
+    dmr_thread_t thread, producers[POST_PRODUCERS];
+    size_t i, j;
+    int ret;
+
+    ne((io = dmr_io_new()) == NULL, "io_new");
+    io->persistent = true;
+    for (i = 0; i < POST_PRODUCERS; i++) {
+        for (j = 0; j < POST_CALLBACKS; j++) {
+            args[i][j].io = io;
+            args[i][j].producer = i;
+            args[i][j].seq = j;
+        }
+    }
+
+    eq(dmr_thread_create(&thread, loop, io) == dmr_thread_success, "loop thread");
+    for (i = 0; i < POST_PRODUCERS; i++) {
+        eq(dmr_thread_create(&producers[i], producer, args[i]) == dmr_thread_success, "producer thread");
+    }
+    for (i = 0; i < POST_PRODUCERS; i++) {
+        eq(dmr_thread_join(producers[i], &ret) == dmr_thread_success && ret == 0, "producer failed");
+    }
+    eq(dmr_thread_join(thread, &ret) == dmr_thread_success && ret == 0, "loop failed");
+
+    eq(received == POST_PRODUCERS * POST_CALLBACKS, "expected %d callbacks, got %zu",
+        POST_PRODUCERS * POST_CALLBACKS, received);
+    eq(in_order, "callbacks out of order");
+    eq(on_loop, "callback ran on the wrong thread");
+    go(dmr_io_free(io), "free");
+    return true;
+}
+
+static uint64_t posted_at, woken_at;
+
+static int wake_cb(dmr_io *io, void *unused)
+{
+    DMR_UNUSED(unused);
+    woken_at = dmr_time_monotonic();
+    return dmr_io_close(io);
+}
+
+static int wake_loop(void *ioptr)
+{
+    return dmr_io_loop((dmr_io *)ioptr);
+}
+
+bool test_wake(void) {
+    dmr_io *io;
+    dmr_thread_t thread;
+    struct timespec ts = { 0, 50000000 };
+    int ret;
+
+    ne((io = dmr_io_new()) == NULL, "io_new");
+    io->persistent = true;
+    eq(dmr_thread_create(&thread, wake_loop, io) == dmr_thread_success, "loop thread");
+
+    /* give the loop time to go to sleep, without a wake up it would sleep forever */
+    nanosleep(&ts, NULL);
+    posted_at = dmr_time_monotonic();
+    go(dmr_io_post(io, wake_cb, NULL), "post");
+    eq(dmr_thread_join(thread, &ret) == dmr_thread_success && ret == 0, "loop failed");
+    eq(woken_at - posted_at < 50000000ULL, "wake up took %lluns",
+        (unsigned long long)(woken_at - posted_at));
+    go(dmr_io_free(io), "free");
+    return true;
+}
+
+static test_t tests[] = {
+    {"post from threads", test_post},
+    {"wake up", test_wake},
+    {NULL, NULL} /* sentinel */
+};
+
+#include "_test_footer.h"
@@ -0,0 +1,117 @@
+#include <signal.h>
+#include <dmr/io.h>
+#include "_test_header.h"
+
+static size_t hups, usr1s;
+
+static int hup_cb(dmr_io *io, void *userdata, int sig)
+{
+    DMR_UNUSED(io);
+    DMR_UNUSED(userdata);
+    if (sig == SIGHUP && ++hups < 3)
+        kill(getpid(), SIGHUP);
+    else
+        kill(getpid(), SIGUSR1);
+    return 0;
+}
+
+static int usr1_cb(dmr_io *io, void *userdata, int sig)
+{
+    DMR_UNUSED(userdata);
+    if (sig == SIGUSR1)
+        usr1s++;
+    return dmr_io_close(io);
+}
+
+static int start_cb(dmr_io *io, void *userdata)
+{
+    DMR_UNUSED(io);
+    DMR_UNUSED(userdata);
+    kill(getpid(), SIGHUP);
+    return 0;
+}
+
+bool test_signal(void) {
+    dmr_io *io;
+    struct timeval tv = { 0, 10000 };
+
+    ne((io = dmr_io_new()) == NULL, "io_new");
+    go(dmr_io_reg_signal(io, SIGHUP, hup_cb, NULL, false), "reg SIGHUP");
+    go(dmr_io_reg_signal(io, SIGUSR1, usr1_cb, NULL, true), "reg SIGUSR1");
+    ne(dmr_io_reg_timer(io, tv, start_cb, NULL, true) == NULL, "reg timer");
+
+    go(dmr_io_loop(io), "loop");
+    eq(hups == 3, "expected 3 SIGHUP callbacks, got %zu", hups);
+    eq(usr1s == 1, "expected 1 SIGUSR1 callback, got %zu", usr1s);
+    /* once callbacks are removed */
+    eq(DMR_LIST_EMPTY(&io->entry[DMR_REQUEST_SIGNAL]->head) == false, "SIGHUP callback removed");
+    eq(DMR_LIST_FIRST(&io->entry[DMR_REQUEST_SIGNAL]->head)->fd == SIGHUP, "SIGUSR1 callback not removed");
+
+    go(dmr_io_free(io), "free");
+    return true;
+}
+
+#define GROUP_SIGNALS 10
+
+static size_t usr2s;
+
+static int usr2_cb(dmr_io *io, void *userdata, int sig)
+{
+    DMR_UNUSED(userdata);
+    if (sig == SIGUSR2 && ++usr2s < GROUP_SIGNALS) {
+        kill(getpid(), SIGUSR2);
+        return 0;
+    }
+    return dmr_io_close(io);
+}
+
+static int usr2_start_cb(dmr_io *io, void *userdata)
+{
+    DMR_UNUSED(io);
+    DMR_UNUSED(userdata);
+    kill(getpid(), SIGUSR2);
+    return 0;
+}
+
+bool test_group(void) {
+    dmr_io_group *group;
+    dmr_io *io;
+    struct timeval tv = { 0, 10000 };
+
+    /* loop threads started before the signal is registered must not take
+     * it, the default action for SIGUSR2 would terminate the test */
+    ne((group = dmr_io_group_new(2)) == NULL, "io_group_new");
+    go(dmr_io_group_start(group), "group start");
+
+    ne((io = dmr_io_new()) == NULL, "io_new");
+    go(dmr_io_reg_signal(io, SIGUSR2, usr2_cb, NULL, false), "reg SIGUSR2");
+    ne(dmr_io_reg_timer(io, tv, usr2_start_cb, NULL, true) == NULL, "reg timer");
+    go(dmr_io_loop(io), "loop");
+    eq(usr2s == GROUP_SIGNALS, "expected %d SIGUSR2 callbacks, got %zu", GROUP_SIGNALS, usr2s);
+
+    go(dmr_io_group_close(group), "group close");
+    go(dmr_io_group_join(group), "group join");
+    go(dmr_io_group_free(group), "group free");
+    go(dmr_io_free(io), "free");
+    return true;
+}
+
+bool test_invalid(void) {
+    dmr_io *io;
+
+    ne((io = dmr_io_new()) == NULL, "io_new");
+    eq(dmr_io_reg_signal(io, 0, hup_cb, NULL, false) != 0, "signal 0 accepted");
+    eq(dmr_io_reg_signal(io, NSIG, hup_cb, NULL, false) != 0, "signal NSIG accepted");
+    eq(io->entries == 0, "invalid signal registered");
+    go(dmr_io_free(io), "free");
+    return true;
+}
+
+static test_t tests[] = {
+    {"signal delivery in the loop", test_signal},
+    {"signal with loop threads running", test_group},
+    {"invalid signal", test_invalid},
+    {NULL, NULL} /* sentinel */
+};
+
+#include "_test_footer.h"
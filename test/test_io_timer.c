@@ -0,0 +1,163 @@
+#include <dmr/io.h>
+#include <dmr/time.h>
+#include "_test_header.h"
+
+#define MS(ms) ((uint64_t)(ms) * 1000000ULL)
+
+static struct timeval timeval_ms(unsigned ms)
+{
+    struct timeval tv = { ms / 1000, (ms % 1000) * 1000 };
+    return tv;
+}
+
+static char order[8];
+static size_t fired;
+
+static int order_cb(dmr_io *io, void *userdata)
+{
+    DMR_UNUSED(io);
+    if (fired < sizeof(order) - 1)
+        order[fired++] = *(char *)userdata;
+    return 0;
+}
+
+bool test_order(void) {
+    static char name[] = "dacb";
+    static const unsigned ms[] = { 40, 10, 30, 20 };
+    dmr_io *io;
+    size_t i;
+
+    ne((io = dmr_io_new()) == NULL, "io_new");
+    for (i = 0; i < 4; i++) {
+        ne(dmr_io_reg_timer(io, timeval_ms(ms[i]), order_cb, &name[i], true) == NULL, "reg timer %zu", i);
+    }
+    eq(io->timers == 4, "expected 4 timers, got %zu", io->timers);
+
+    /* the loop returns once the last once timer has fired */
+    go(dmr_io_loop(io), "loop");
+    eq(strcmp(order, "abcd") == 0, "expected order abcd, got %s", order);
+    eq(io->timers == 0 && io->entries == 0, "once timers not removed, %zu timers, %zd entries",
+        io->timers, io->entries);
+
+    go(dmr_io_free(io), "free");
+    return true;
+}
+
+#define REPEAT_MS    20
+#define REPEAT_COUNT 10
+
+static dmr_io_timer *repeat_timer;
+static uint64_t deadline[REPEAT_COUNT];
+static size_t repeats;
+
+static int repeat_cb(dmr_io *io, void *userdata)
+{
+    DMR_UNUSED(userdata);
+    struct timespec busy = { 0, 5000000 };
+
+    deadline[repeats] = repeat_timer->deadline;
+    if (++repeats == REPEAT_COUNT)
+        return dmr_io_cancel_timer(io, repeat_timer);
+
+    /* a slow callback does not push back the next deadline */
+    nanosleep(&busy, NULL);
+    return 0;
+}
+
+bool test_repeat(void) {
+    dmr_io *io;
+    uint64_t start;
+    size_t i;
+
+    ne((io = dmr_io_new()) == NULL, "io_new");
+    start = dmr_time_monotonic();
+    ne((repeat_timer = dmr_io_reg_timer(io, timeval_ms(REPEAT_MS), repeat_cb, NULL, false)) == NULL, "reg timer");
+
+    /* cancelled from its own callback, after which the loop has nothing left */
+    go(dmr_io_loop(io), "loop");
+    eq(repeats == REPEAT_COUNT, "expected %d callbacks, got %zu", REPEAT_COUNT, repeats);
+    eq(io->timers == 0 && io->entries == 0, "timer not removed");
+
+    eq(deadline[0] >= start + MS(REPEAT_MS), "first deadline too early");
+    for (i = 1; i < REPEAT_COUNT; i++) {
+        eq(deadline[i] - deadline[i - 1] == MS(REPEAT_MS), "deadline %zu drifted by %lldns", i,
+            (long long)(deadline[i] - deadline[i - 1]) - (long long)MS(REPEAT_MS));
+    }
+
+    go(dmr_io_free(io), "free");
+    return true;
+}
+
+static dmr_io_timer *victim;
+static size_t cancel_fired, victim_fired, shared_fired, self_fired;
+static int cancel_ret;
+
+static int victim_cb(dmr_io *io, void *userdata)
+{
+    DMR_UNUSED(io);
+    DMR_UNUSED(userdata);
+    victim_fired++;
+    return 0;
+}
+
+static int shared_cb(dmr_io *io, void *userdata)
+{
+    DMR_UNUSED(io);
+    DMR_UNUSED(userdata);
+    shared_fired++;
+    return 0;
+}
+
+static int self_cb(dmr_io *io, void *userdata)
+{
+    DMR_UNUSED(userdata);
+    if (++self_fired == 3)
+        return dmr_io_del_timer(io, self_cb);
+    return 0;
+}
+
+static int cancel_cb(dmr_io *io, void *userdata)
+{
+    DMR_UNUSED(userdata);
+    cancel_fired++;
+    /* cancel a pending timer by handle, and one of two by callback */
+    cancel_ret |= dmr_io_cancel_timer(io, victim);
+    cancel_ret |= dmr_io_del_timer(io, shared_cb);
+    return 0;
+}
+
+bool test_cancel(void) {
+    dmr_io *io;
+
+    ne((io = dmr_io_new()) == NULL, "io_new");
+    ne(dmr_io_reg_timer(io, timeval_ms(10), cancel_cb, NULL, true) == NULL, "reg cancel timer");
+    ne((victim = dmr_io_reg_timer(io, timeval_ms(30), victim_cb, NULL, false)) == NULL, "reg victim timer");
+    ne(dmr_io_reg_timer(io, timeval_ms(40), shared_cb, NULL, true) == NULL, "reg shared timer");
+    ne(dmr_io_reg_timer(io, timeval_ms(50), shared_cb, NULL, true) == NULL, "reg shared timer");
+    ne(dmr_io_reg_timer(io, timeval_ms(15), self_cb, NULL, false) == NULL, "reg self timer");
+    eq(io->entries == 5, "expected 5 entries, got %zd", io->entries);
+
+    go(dmr_io_loop(io), "loop");
+    eq(cancel_fired == 1, "cancel timer fired %zu times", cancel_fired);
+    eq(cancel_ret == 0, "cancel failed");
+    eq(victim_fired == 0, "cancelled timer fired %zu times", victim_fired);
+    eq(shared_fired == 1, "expected 1 of 2 shared timers, got %zu", shared_fired);
+    eq(self_fired == 3, "timer deleted from its own callback fired %zu times", self_fired);
+    eq(io->timers == 0 && io->entries == 0, "timers not removed");
+
+    /* nothing left to delete */
+    go(dmr_io_del_timer(io, shared_cb), "del nothing");
+    ne(dmr_io_cancel_timer(io, NULL) == 0, "cancel NULL");
+
+    go(dmr_io_free(io), "free");
+    return true;
+}
+
+static test_t tests[] = {
+    {"timer order", test_order},
+    {"timer repeat", test_repeat},
+    {"timer cancel", test_cancel},
+    {NULL, NULL} /* sentinel */
+};
+
+#include "_test_footer.h"
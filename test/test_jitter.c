@@ -0,0 +1,184 @@
+#include <dmr/jitter.h>
+#include <dmr/payload/sync.h>
+#include "_test_header.h"
+
+#define MS(ms) ((uint64_t)(ms) * 1000000ULL)
+
+/* A voice burst of a superframe, carrying seq in its first byte */
+static void burst(dmr_parsed_packet *parsed, dmr_ts ts, uint32_t stream_id, uint8_t seq)
+{
+    uint8_t i;
+    memset(parsed, 0, sizeof(dmr_parsed_packet));
+    for (i = 0; i < DMR_PACKET_LEN; i++) {
+        parsed->packet[i] = rand();
+    }
+    parsed->packet[0] = seq;
+    parsed->ts = ts;
+    parsed->stream_id = stream_id;
+    parsed->sequence = seq;
+    parsed->voice_frame = seq % 6;
+    if (parsed->voice_frame == 0) {
+        parsed->data_type = DMR_DATA_TYPE_VOICE_SYNC;
+        dmr_sync_pattern_encode(parsed->packet, DMR_SYNC_PATTERN_BS_SOURCED_VOICE);
+    } else {
+        parsed->data_type = DMR_DATA_TYPE_VOICE;
+    }
+}
+
+static bool add(dmr_jitter *jitter, dmr_ts ts, uint32_t stream_id, uint8_t seq, uint64_t now)
+{
+    dmr_parsed_packet parsed;
+    burst(&parsed, ts, stream_id, seq);
+    go(dmr_jitter_add(jitter, &parsed, now), "add %u", seq);
+    return true;
+}
+
+bool test_reorder(void)
+{
+    static const uint8_t order[] = { 0, 2, 1, 3, 4, 5, 6, 8, 7, 9, 10, 11 };
+    dmr_parsed_packet parsed;
+    dmr_jitter_stats stats;
+    dmr_jitter *jitter;
+    uint64_t now = MS(1000);
+    uint8_t i, played = 0;
+
+    ne((jitter = dmr_jitter_new()) == NULL, "alloc");
+    for (i = 0; i < sizeof(order); i++, now += MS(60)) {
+        eq(add(jitter, DMR_TS2, 0x1234, order[i], now), "add");
+        if (dmr_jitter_shift(jitter, DMR_TS2, &parsed, now) == 0) {
+            eq(parsed.sequence == played, "expected burst %u, got %u", played, parsed.sequence);
+            eq(parsed.packet[0] == played, "burst %u payload", played);
+            played++;
+        }
+    }
+    /* the first burst waited for the minimum delay */
+    eq(played == sizeof(order) - 1, "expected %zu bursts, played %u", sizeof(order) - 1, played);
+    go(dmr_jitter_shift(jitter, DMR_TS2, &parsed, now), "last burst");
+    eq(parsed.sequence == 11, "expected burst 11, got %u", parsed.sequence);
+    ne(dmr_jitter_shift(jitter, DMR_TS1, &parsed, now) == 0, "burst on idle timeslot");
+
+    go(dmr_jitter_stats_get(jitter, DMR_TS2, &stats), "stats");
+    eq(stats.received == 12, "received %llu", (unsigned long long)stats.received);
+    eq(stats.played == 12, "played %llu", (unsigned long long)stats.played);
+    eq(stats.reordered == 2, "reordered %llu", (unsigned long long)stats.reordered);
+    eq(stats.late == 0 && stats.lost == 0, "late %llu, lost %llu",
+        (unsigned long long)stats.late, (unsigned long long)stats.lost);
+    eq(stats.depth == 0, "depth %u", stats.depth);
+
+    /* a duplicate is dropped */
+    eq(add(jitter, DMR_TS2, 0x1234, 12, now), "add");
+    eq(add(jitter, DMR_TS2, 0x1234, 12, now), "add");
+    go(dmr_jitter_stats_get(jitter, DMR_TS2, &stats), "stats");
+    eq(stats.duplicate == 1 && stats.depth == 1, "duplicate %llu, depth %u",
+        (unsigned long long)stats.duplicate, stats.depth);
+
+    dmr_jitter_free(jitter);
+    return true;
+}
+
+bool test_conceal(void)
+{
+    static const uint8_t silence[9] = { 0xb9, 0xe8, 0x81, 0x52, 0x61, 0x73, 0x00, 0x2a, 0x6b };
+    dmr_parsed_packet parsed, last;
+    dmr_jitter_stats stats;
+    dmr_jitter *jitter;
+    uint64_t now = MS(1000);
+    uint8_t seq;
+
+    ne((jitter = dmr_jitter_new()) == NULL, "alloc");
+    /* bursts 3, 4 and 5 never arrive */
+    for (seq = 0; seq < 3; seq++) {
+        eq(add(jitter, DMR_TS1, 0xcafe, seq, now + MS(seq * 60)), "add");
+    }
+    for (seq = 6; seq < 9; seq++) {
+        eq(add(jitter, DMR_TS1, 0xcafe, seq, now + MS(seq * 60)), "add");
+    }
+
+    for (seq = 0; seq < 9; seq++) {
+        go(dmr_jitter_shift(jitter, DMR_TS1, &parsed, now + MS(seq * 60 + 500)), "shift %u", seq);
+        eq(parsed.sequence == seq, "expected burst %u, got %u", seq, parsed.sequence);
+        eq(parsed.voice_frame == seq % 6, "burst %u voice frame %u", seq, parsed.voice_frame);
+        eq(parsed.data_type == (seq % 6 ? DMR_DATA_TYPE_VOICE : DMR_DATA_TYPE_VOICE_SYNC), "burst %u data type", seq);
+        if (seq == 3 || seq == 4) {
+            /* repeats the previous voice */
+            eq(memcmp(parsed.packet, last.packet, 13) == 0, "burst %u is not a repeat", seq);
+        } else if (seq == 5) {
+            eq(memcmp(parsed.packet, silence, sizeof(silence)) == 0, "burst %u is not silence", seq);
+        } else {
+            eq(parsed.packet[0] == seq, "burst %u payload", seq);
+        }
+        memcpy(&last, &parsed, sizeof(parsed));
+    }
+
+    /* too late to be played */
+    eq(add(jitter, DMR_TS1, 0xcafe, 4, now + MS(1000)), "add");
+    go(dmr_jitter_stats_get(jitter, DMR_TS1, &stats), "stats");
+    eq(stats.lost == 3, "lost %llu", (unsigned long long)stats.lost);
+    eq(stats.concealed == 3, "concealed %llu", (unsigned long long)stats.concealed);
+    eq(stats.late == 1, "late %llu", (unsigned long long)stats.late);
+    eq(stats.played == 9, "played %llu", (unsigned long long)stats.played);
+
+    /* a stream that stops without terminator is concealed for a while, then ended */
+    for (seq = 0; seq < DMR_JITTER_STARVE_MAX; seq++) {
+        go(dmr_jitter_shift(jitter, DMR_TS1, &parsed, now + MS(2000)), "conceal %u", seq);
+    }
+    ne(dmr_jitter_shift(jitter, DMR_TS1, &parsed, now + MS(2000)) == 0, "stream not ended");
+    eq(add(jitter, DMR_TS1, 0xcafe, 20, now + MS(2000)), "add");
+    ne(dmr_jitter_shift(jitter, DMR_TS1, &parsed, now + MS(2500)) == 0, "burst after the end of the stream");
+
+    /* a terminator ends the stream right away */
+    eq(add(jitter, DMR_TS1, 0xbabe, 0, now + MS(3000)), "add");
+    burst(&parsed, DMR_TS1, 0xbabe, 1);
+    parsed.data_type = DMR_DATA_TYPE_TERMINATOR_WITH_LC;
+    go(dmr_jitter_add(jitter, &parsed, now + MS(3060)), "add terminator");
+    go(dmr_jitter_shift(jitter, DMR_TS1, &parsed, now + MS(3060)), "voice");
+    go(dmr_jitter_shift(jitter, DMR_TS1, &parsed, now + MS(3120)), "terminator");
+    eq(parsed.data_type == DMR_DATA_TYPE_TERMINATOR_WITH_LC, "expected terminator");
+    ne(dmr_jitter_shift(jitter, DMR_TS1, &parsed, now + MS(3180)) == 0, "burst after terminator");
+    go(dmr_jitter_stats_get(jitter, DMR_TS1, &stats), "stats");
+    eq(stats.streams == 2, "streams %llu", (unsigned long long)stats.streams);
+
+    dmr_jitter_free(jitter);
+    return true;
+}
+
+bool test_adaptive(void)
+{
+    dmr_jitter_stats stats;
+    dmr_jitter *jitter;
+    uint64_t now = MS(1000);
+    uint8_t seq;
+
+    ne((jitter = dmr_jitter_new()) == NULL, "alloc");
+    go(dmr_jitter_stats_get(jitter, DMR_TS1, &stats), "stats");
+    eq(stats.delay_ms == DMR_JITTER_MIN_MS, "initial delay %u", stats.delay_ms);
+
+    /* bursts arrive in pairs, every other interval is 120ms */
+    for (seq = 0; seq < 100; seq++) {
+        now += (seq & 1) ? MS(0) : MS(120);
+        eq(add(jitter, DMR_TS1, 0x1, seq, now), "add");
+    }
+    go(dmr_jitter_stats_get(jitter, DMR_TS1, &stats), "stats");
+    eq(stats.jitter_ms > 40 && stats.jitter_ms <= 60, "jitter %ums", stats.jitter_ms);
+    eq(stats.delay_ms > 120 && stats.delay_ms <= DMR_JITTER_MAX_MS, "delay %ums", stats.delay_ms);
+
+    /* and relaxes when the network settles */
+    for (; seq < 200; seq++) {
+        now += MS(60);
+        eq(add(jitter, DMR_TS1, 0x2, seq, now), "add");
+    }
+    go(dmr_jitter_stats_get(jitter, DMR_TS1, &stats), "stats");
+    eq(stats.delay_ms < 80, "delay %ums", stats.delay_ms);
+
+    dmr_jitter_free(jitter);
+    return true;
+}
+
+static test_t tests[] = {
+    {"jitter buffer reorder", test_reorder},
+    {"jitter buffer loss concealment", test_conceal},
+    {"jitter buffer adaptive delay", test_adaptive},
+    {NULL, NULL} /* sentinel */
+};
+
+#include "_test_footer.h"
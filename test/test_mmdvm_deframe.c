@@ -0,0 +1,189 @@
+#include <talloc.h>
+#include <dmr/packetq.h>
+#include <dmr/payload/sync.h>
+#include <dmr/protocol/mmdvm.h>
+#include "_test_header.h"
+
+#define DMR_FRAME_LEN (4 + DMR_PACKET_LEN)
+
+static dmr_mmdvm *test_mmdvm(void)
+{
+    dmr_mmdvm *mmdvm = talloc_zero(NULL, dmr_mmdvm);
+    if (mmdvm != NULL)
+        mmdvm->id = "mmdvm[test]";
+    return mmdvm;
+}
+
+/* Construct a DMR data frame, the packet carries seq in its first byte */
+static void dmr_frame(uint8_t frame[DMR_FRAME_LEN], dmr_ts ts, uint8_t seq)
+{
+    uint8_t i;
+    frame[0] = DMR_MMDVM_FRAME_START;
+    frame[1] = DMR_FRAME_LEN;
+    frame[2] = ts == DMR_TS1 ? DMR_MMDVM_DMR_DATA1 : DMR_MMDVM_DMR_DATA2;
+    frame[3] = DMR_MMDVM_DMR_VOICE_SYNC;
+    for (i = 0; i < DMR_PACKET_LEN; i++) {
+        frame[4 + i] = rand();
+    }
+    frame[4] = seq;
+    dmr_sync_pattern_encode(frame + 4, DMR_SYNC_PATTERN_BS_SOURCED_VOICE);
+}
+
+static bool check_packets(dmr_packetq *q, size_t n)
+{
+    dmr_parsed_packet *parsed;
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        go(dmr_packetq_shift(q, &parsed), "expected packet %zu", i);
+        eq(parsed->packet[0] == (uint8_t)i, "packet %zu out of order, got %u", i, parsed->packet[0]);
+        eq(parsed->ts == (i & 1 ? DMR_TS2 : DMR_TS1), "packet %zu on the wrong timeslot", i);
+        dmr_parsed_packet_free(parsed);
+    }
+    ne(dmr_packetq_shift(q, &parsed) == 0, "more packets than expected");
+    return true;
+}
+
+bool test_batch(void)
+{
+    static const uint8_t ack[] = { DMR_MMDVM_FRAME_START, 4, DMR_MMDVM_ACK, DMR_MMDVM_SET_MODE };
+    static const uint8_t junk[] = { 0x00, 0x55, 0xaa, 0xff, 0x01 };
+    uint8_t buf[DMR_MMDVM_RING_SIZE], frame[DMR_FRAME_LEN];
+    dmr_mmdvm *mmdvm;
+    dmr_packetq *q;
+    size_t len = 0, i;
+
+    ne((mmdvm = test_mmdvm()) == NULL, "alloc");
+    ne((q = dmr_packetq_new()) == NULL, "packetq_new");
+
+    /* several frames in a single read, with line noise in between */
+    for (i = 0; i < 6; i++) {
+        if (i == 2) {
+            memcpy(buf + len, junk, sizeof(junk));
+            len += sizeof(junk);
+        }
+        if (i == 4) {
+            memcpy(buf + len, ack, sizeof(ack));
+            len += sizeof(ack);
+        }
+        dmr_frame(frame, i & 1 ? DMR_TS2 : DMR_TS1, i);
+        memcpy(buf + len, frame, sizeof(frame));
+        len += sizeof(frame);
+    }
+    /* a partial frame stays buffered */
+    dmr_frame(frame, DMR_TS1, 6);
+    memcpy(buf + len, frame, 10);
+    len += 10;
+
+    eq(dmr_mmdvm_feed(mmdvm, buf, len) == len, "feed");
+    eq(dmr_mmdvm_deframe(mmdvm, q) == 6, "expected 6 packets");
+    eq(check_packets(q, 6), "packets");
+    eq(mmdvm->ack[DMR_MMDVM_SET_MODE], "ACK not parsed");
+    eq(mmdvm->stats.rx_frames == 7, "expected 7 frames, got %llu", (unsigned long long)mmdvm->stats.rx_frames);
+    eq(mmdvm->stats.rx_resyncs == 1, "expected 1 resync, got %llu", (unsigned long long)mmdvm->stats.rx_resyncs);
+    eq(mmdvm->stats.rx_dropped == sizeof(junk), "expected %zu dropped bytes, got %llu", sizeof(junk), (unsigned long long)mmdvm->stats.rx_dropped);
+    eq(mmdvm->ring_wr - mmdvm->ring_rd == 10, "partial frame not buffered");
+
+    /* and is parsed once the rest arrives */
+    eq(dmr_mmdvm_feed(mmdvm, frame + 10, sizeof(frame) - 10) == sizeof(frame) - 10, "feed");
+    eq(dmr_mmdvm_deframe(mmdvm, q) == 1, "expected 1 packet");
+
+    talloc_free(q);
+    talloc_free(mmdvm);
+    return true;
+}
+
+bool test_wrap(void)
+{
+    uint8_t frame[DMR_FRAME_LEN];
+    dmr_mmdvm *mmdvm;
+    dmr_packetq *q;
+    size_t i, j, n = 3 * DMR_MMDVM_RING_SIZE / DMR_FRAME_LEN, queued = 0;
+    int ret;
+
+    ne((mmdvm = test_mmdvm()) == NULL, "alloc");
+    ne((q = dmr_packetq_new()) == NULL, "packetq_new");
+
+    /* frames trickle in, in odd sized chunks, and wrap around the ring */
+    for (i = 0; i < n; i++) {
+        dmr_frame(frame, i & 1 ? DMR_TS2 : DMR_TS1, i);
+        for (j = 0; j < sizeof(frame); j += 7) {
+            size_t len = min(7, sizeof(frame) - j);
+            eq(dmr_mmdvm_feed(mmdvm, frame + j, len) == len, "feed");
+            ne((ret = dmr_mmdvm_deframe(mmdvm, q)) < 0, "deframe");
+            queued += ret;
+        }
+    }
+    eq(queued == n, "expected %zu packets, got %zu", n, queued);
+    eq(check_packets(q, n), "packets");
+    eq(mmdvm->stats.rx_resyncs == 0, "unexpected resync");
+
+    talloc_free(q);
+    talloc_free(mmdvm);
+    return true;
+}
+
+static int parse(dmr_mmdvm *mmdvm, const uint8_t *buf, size_t len, dmr_parsed_packet **parsed)
+{
+    dmr_mmdvm_frame frame;
+    memset(frame, 0, sizeof(frame));
+    memcpy(frame, buf, len);
+    return dmr_mmdvm_parse_frame(mmdvm, frame, len, parsed);
+}
+
+bool test_short(void)
+{
+    static const uint8_t version[] = { DMR_MMDVM_FRAME_START, 3, DMR_MMDVM_GET_VERSION };
+    static const uint8_t status[] = { DMR_MMDVM_FRAME_START, 5, DMR_MMDVM_GET_STATUS, 0x02, 0x00 };
+    static const uint8_t nak[] = { DMR_MMDVM_FRAME_START, 4, DMR_MMDVM_NAK, DMR_MMDVM_DMR_DATA1 };
+    static const uint8_t data[] = { DMR_MMDVM_FRAME_START, 4, DMR_MMDVM_DMR_DATA1, 0x00 };
+    uint8_t frame[DMR_FRAME_LEN];
+    dmr_parsed_packet *parsed = NULL;
+    dmr_mmdvm *mmdvm;
+    dmr_packetq *q;
+
+    ne((mmdvm = test_mmdvm()) == NULL, "alloc");
+    ne((q = dmr_packetq_new()) == NULL, "packetq_new");
+
+    /* frames too short for their command are not parsed */
+    ne(parse(mmdvm, version, sizeof(version), &parsed) == 0, "short GET_VERSION parsed");
+    ne(parse(mmdvm, status, sizeof(status), &parsed) == 0, "short GET_STATUS parsed");
+    ne(parse(mmdvm, nak, sizeof(nak), &parsed) == 0, "short NAK parsed");
+    ne(parse(mmdvm, data, sizeof(data), &parsed) == 0, "short DMR_DATA1 parsed");
+    eq(parsed == NULL, "packet from a short frame");
+    eq(mmdvm->description == NULL, "description from a short frame");
+
+    /* and skipped by the deframer, which picks up the next frame */
+    eq(dmr_mmdvm_feed(mmdvm, version, sizeof(version)) == sizeof(version), "feed");
+    eq(dmr_mmdvm_feed(mmdvm, status, sizeof(status)) == sizeof(status), "feed");
+    eq(dmr_mmdvm_feed(mmdvm, nak, sizeof(nak)) == sizeof(nak), "feed");
+    dmr_frame(frame, DMR_TS1, 0);
+    eq(dmr_mmdvm_feed(mmdvm, frame, sizeof(frame)) == sizeof(frame), "feed");
+    eq(dmr_mmdvm_deframe(mmdvm, q) == 1, "expected 1 packet");
+    eq(check_packets(q, 1), "packets");
+    eq(mmdvm->description == NULL, "description from a short frame");
+    eq(mmdvm->stats.rx_frames == 1, "expected 1 frame, got %llu", (unsigned long long)mmdvm->stats.rx_frames);
+    ne(mmdvm->stats.rx_resyncs == 0, "expected resyncs");
+
+    /* a short frame at the end of the ring is not read past the ring */
+    mmdvm->ring_rd = mmdvm->ring_wr = DMR_MMDVM_RING_SIZE - 4;
+    eq(dmr_mmdvm_feed(mmdvm, data, sizeof(data)) == sizeof(data), "feed");
+    eq(dmr_mmdvm_deframe(mmdvm, q) == 0, "packet from a short frame");
+    eq(dmr_mmdvm_feed(mmdvm, frame, sizeof(frame)) == sizeof(frame), "feed");
+    eq(dmr_mmdvm_deframe(mmdvm, q) == 1, "expected 1 packet");
+    eq(check_packets(q, 1), "packets");
+    eq(mmdvm->ring_wr == mmdvm->ring_rd, "ring not drained");
+
+    talloc_free(q);
+    talloc_free(mmdvm);
+    return true;
+}
+
+static test_t tests[] = {
+    {"MMDVM deframe batch", test_batch},
+    {"MMDVM deframe around the ring", test_wrap},
+    {"MMDVM deframe short frames", test_short},
+    {NULL, NULL} /* sentinel */
+};
+
+#include "_test_footer.h"
@@ -0,0 +1,144 @@
+#include <talloc.h>
+#include <dmr/payload/sync.h>
+#include <dmr/protocol/mmdvm.h>
+#include "_test_header.h"
+
+static dmr_mmdvm *test_mmdvm(void)
+{
+    dmr_mmdvm *mmdvm = talloc_zero(NULL, dmr_mmdvm);
+    if (mmdvm == NULL)
+        return NULL;
+    mmdvm->id = "mmdvm[test]";
+    mmdvm->trq = dmr_rawq_new(DMR_MMDVM_TX_QUEUE);
+    mmdvm->tx_jitter_ms = DMR_MMDVM_TX_JITTER_MS;
+    mmdvm->tx_scheduled = true;
+    return mmdvm;
+}
+
+static int send_burst(dmr_mmdvm *mmdvm, dmr_ts ts, dmr_data_type data_type, uint8_t seq)
+{
+    dmr_parsed_packet parsed;
+    memset(&parsed, 0, sizeof(parsed));
+    parsed.ts = ts;
+    parsed.data_type = data_type;
+    parsed.packet[0] = seq;
+    dmr_sync_pattern_encode(parsed.packet, data_type == DMR_DATA_TYPE_VOICE_SYNC
+        ? DMR_SYNC_PATTERN_BS_SOURCED_VOICE
+        : DMR_SYNC_PATTERN_BS_SOURCED_DATA);
+    return dmr_mmdvm_send(mmdvm, &parsed);
+}
+
+/* Run a tick and check the released bursts */
+static bool tick(dmr_mmdvm *mmdvm, int expect, int first_seq)
+{
+    dmr_raw *raw;
+    int ret, i;
+
+    eq((ret = dmr_mmdvm_tx_tick(mmdvm)) == expect, "expected %d bursts, released %d", expect, ret);
+    for (i = 0; i < expect; i++) {
+        ne((raw = dmr_rawq_shift(mmdvm->trq)) == NULL, "burst not queued");
+        eq(raw->buf[4] == first_seq + i, "expected burst %d, got %u", first_seq + i, raw->buf[4]);
+        dmr_raw_free(raw);
+    }
+    eq(dmr_rawq_empty(mmdvm->trq), "more bursts queued than released");
+    return true;
+}
+
+bool test_pacing(void)
+{
+    dmr_mmdvm *mmdvm;
+    uint8_t i;
+
+    ne((mmdvm = test_mmdvm()) == NULL, "alloc");
+
+    /* a short transmission starts after waiting for the jitter target */
+    go(send_burst(mmdvm, DMR_TS1, DMR_DATA_TYPE_VOICE_SYNC, 0), "send");
+    go(send_burst(mmdvm, DMR_TS1, DMR_DATA_TYPE_VOICE_SYNC, 1), "send");
+    eq(tick(mmdvm, 0, 0), "tick 1");
+    eq(tick(mmdvm, 0, 0), "tick 2");
+    eq(tick(mmdvm, 1, 0), "tick 3");
+    eq(tick(mmdvm, 1, 1), "tick 4");
+    /* and the network could not keep up */
+    eq(tick(mmdvm, 0, 0), "tick 5");
+    eq(mmdvm->stats.tx_underruns == 1, "expected 1 underrun, got %llu", (unsigned long long)mmdvm->stats.tx_underruns);
+
+    /* a full jitter buffer starts right away, one burst per tick, and a
+     * terminator ends the transmission without an underrun */
+    for (i = 0; i < 3; i++) {
+        go(send_burst(mmdvm, DMR_TS2, DMR_DATA_TYPE_VOICE_SYNC, 10 + i), "send");
+    }
+    go(send_burst(mmdvm, DMR_TS2, DMR_DATA_TYPE_TERMINATOR_WITH_LC, 13), "send");
+    for (i = 0; i < 4; i++) {
+        eq(tick(mmdvm, 1, 10 + i), "tick");
+    }
+    eq(tick(mmdvm, 0, 0), "tick after terminator");
+    eq(mmdvm->stats.tx_underruns == 1, "underrun after terminator");
+    eq(mmdvm->stats.tx_frames == 6, "expected 6 bursts, got %llu", (unsigned long long)mmdvm->stats.tx_frames);
+
+    talloc_free(mmdvm->trq);
+    talloc_free(mmdvm);
+    return true;
+}
+
+bool test_modem_space(void)
+{
+    dmr_mmdvm *mmdvm;
+    uint8_t i;
+
+    ne((mmdvm = test_mmdvm()) == NULL, "alloc");
+    for (i = 0; i < 3; i++) {
+        go(send_burst(mmdvm, DMR_TS1, DMR_DATA_TYPE_VOICE_SYNC, i), "send");
+    }
+
+    /* the modem reported room for a single burst */
+    mmdvm->tx[DMR_TS1].reported = true;
+    mmdvm->tx[DMR_TS1].space = 1;
+    eq(tick(mmdvm, 1, 0), "tick 1");
+    eq(tick(mmdvm, 0, 0), "tick 2");
+    eq(mmdvm->stats.tx_overruns == 1, "expected 1 overrun, got %llu", (unsigned long long)mmdvm->stats.tx_overruns);
+
+    /* until the next status */
+    mmdvm->tx[DMR_TS1].space = 10;
+    eq(tick(mmdvm, 1, 1), "tick 3");
+    eq(tick(mmdvm, 1, 2), "tick 4");
+    eq(mmdvm->tx[DMR_TS1].space == 8, "expected 8 free slots, got %u", mmdvm->tx[DMR_TS1].space);
+
+    talloc_free(mmdvm->tx[DMR_TS1].queue);
+    talloc_free(mmdvm->trq);
+    talloc_free(mmdvm);
+    return true;
+}
+
+bool test_backlog(void)
+{
+    dmr_mmdvm *mmdvm;
+    uint8_t i;
+
+    ne((mmdvm = test_mmdvm()) == NULL, "alloc");
+
+    /* the oldest bursts are dropped from a full queue */
+    for (i = 0; i < DMR_MMDVM_TX_QUEUE + 4; i++) {
+        go(send_burst(mmdvm, DMR_TS1, DMR_DATA_TYPE_VOICE_SYNC, i), "send");
+    }
+    eq(mmdvm->stats.tx_dropped == 4, "expected 4 dropped bursts, got %llu", (unsigned long long)mmdvm->stats.tx_dropped);
+
+    /* and the backlog drains two bursts per tick, down to twice the target */
+    for (i = 0; i < 13; i++) {
+        eq(tick(mmdvm, 2, 4 + i * 2), "tick %u", i);
+    }
+    eq(tick(mmdvm, 1, 30), "tick at the target");
+
+    talloc_free(mmdvm->tx[DMR_TS1].queue);
+    talloc_free(mmdvm->trq);
+    talloc_free(mmdvm);
+    return true;
+}
+
+static test_t tests[] = {
+    {"MMDVM transmit pacing", test_pacing},
+    {"MMDVM transmit modem buffer space", test_modem_space},
+    {"MMDVM transmit backlog", test_backlog},
+    {NULL, NULL} /* sentinel */
+};
+
+#include "_test_footer.h"
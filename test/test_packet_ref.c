@@ -0,0 +1,39 @@
+#include <dmr/packet.h>
+#include "_test_header.h"
+
+bool test_share(void) {
+    dmr_parsed_packet *parsed = dmr_parsed_packet_new();
+    dmr_packet_ref *ref, *a, *b;
+
+    ne(parsed == NULL,                              "packet allocation failed");
+    parsed->src_id = 2042214;
+    ne((ref = dmr_packet_ref_new(parsed)) == NULL,  "ref allocation failed");
+    a = dmr_packet_ref_get(ref);
+    b = dmr_packet_ref_get(ref);
+    eq(ref->refs == 3,                              "expected 3 refs, got %zu", ref->refs);
+
+    /* a shared packet is copied before it is modified */
+    ne(dmr_packet_ref_writable(&a) == NULL,         "writable failed");
+    ne(a == ref,                                    "shared packet was not copied");
+    ne(a->parsed == parsed,                         "shared packet was not copied");
+    eq(a->parsed->src_id == 2042214,                "copy has src_id %u", a->parsed->src_id);
+    a->parsed->src_id = 204;
+    eq(parsed->src_id == 2042214,                   "shared packet was modified");
+    eq(ref->refs == 2,                              "expected 2 refs, got %zu", ref->refs);
+    dmr_packet_ref_put(a);
+
+    /* the last reference may modify in place */
+    dmr_packet_ref_put(ref);
+    ne(dmr_packet_ref_writable(&b) == NULL,         "writable failed");
+    eq(b == ref && b->parsed == parsed,             "private packet was copied");
+    dmr_packet_ref_put(b);
+
+    return true;
+}
+
+static test_t tests[] = {
+    {"packet ref copy-on-write", test_share},
+    {NULL, NULL} /* sentinel */
+};
+
+#include "_test_footer.h"
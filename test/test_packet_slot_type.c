@@ -2,49 +2,61 @@
 
 #include "_test_header.h"
 
+#define BATCH_BURSTS 100
+
 bool test_encode(void) {
-    dmr_packet_t *packet = test_packet();
+    dmr_packet packet;
+    dmr_color_code color_code;
+    dmr_data_type data_type;
     uint8_t i;
 
     for (i = DMR_DATA_TYPE_VOICE_LC; i < DMR_DATA_TYPE_INVALID; i++) {
-        memset(packet->payload, 0x11 * i, 33);
+        memset(packet, 0x11 * i, sizeof(packet));
 
-        packet->color_code = 1;
-        packet->data_type = i;
-        if (dmr_slot_type_encode(packet) != 0) {
-            printf("encode failed");
-            return false;
-        }
-        printf("%s .. ", dmr_data_type_name_short(packet->data_type));
-        if (packet->data_type != i) {
-            printf("expected %02x, got %02x", DMR_DATA_TYPE_VOICE_LC, packet->data_type);
-            return false;
-        }
+        go(dmr_slot_type_encode(packet, 1, i), "encode failed");
+        printf("%s .. ", dmr_data_type_name_short(i));
+        go(dmr_slot_type_decode(packet, &color_code, &data_type), "decode failed");
+        eq(data_type == i, "expected %02x, got %02x", i, data_type);
+        eq(color_code == 1, "expected color code 1, got %u", color_code);
     }
 
     /* should fail */
-    packet->color_code = 0;
-    if (dmr_slot_type_encode(packet) == 0) {
-        printf("encode color_code 0 did not fail");
-        return false;
-    }
+    ne(dmr_slot_type_encode(packet, 0, DMR_DATA_TYPE_VOICE_LC) == 0, "encode color_code 0 did not fail");
 
     return true;
 }
 
 bool test_encode_decode(void) {
-    dmr_packet_t *packet = test_packet();
-    packet->color_code = 1;
-    packet->data_type = DMR_DATA_TYPE_VOICE_LC;
+    dmr_packet packet;
+    dmr_color_code color_code;
+    dmr_data_type data_type;
 
-    if (dmr_slot_type_encode(packet) != 0) {
-        printf("encode failed");
-        return false;
+    memset(packet, 0, sizeof(packet));
+    go(dmr_slot_type_encode(packet, 1, DMR_DATA_TYPE_VOICE_LC), "encode failed");
+    go(dmr_slot_type_decode(packet, &color_code, &data_type), "decode failed");
+    eq(data_type == DMR_DATA_TYPE_VOICE_LC, "expected %02x, got %02x", DMR_DATA_TYPE_VOICE_LC, data_type);
+    return true;
+}
+
+bool test_decode_batch(void) {
+    static dmr_packet packets[BATCH_BURSTS];
+    dmr_color_code color_code[BATCH_BURSTS];
+    dmr_data_type data_type[BATCH_BURSTS], expect;
+    size_t i, j;
+
+    for (i = 0; i < BATCH_BURSTS; i++) {
+        /* random bits in the payload and sync around the slot type */
+        for (j = 0; j < sizeof(dmr_packet); j++) {
+            packets[i][j] = rand();
+        }
+        go(dmr_slot_type_encode(packets[i], 1 + (i % 15), i % DMR_DATA_TYPE_INVALID), "encode failed");
     }
 
-    if (dmr_slot_type_decode(packet) != 0) {
-        printf("decode failed");
-        return false;
+    go(dmr_slot_type_decode_batch(packets, BATCH_BURSTS, color_code, data_type), "batch decode failed");
+    for (i = 0; i < BATCH_BURSTS; i++) {
+        expect = i % DMR_DATA_TYPE_INVALID;
+        eq(color_code[i] == 1 + (i % 15), "burst %zu: expected color code %zu, got %u", i, 1 + (i % 15), color_code[i]);
+        eq(data_type[i] == expect, "burst %zu: expected data type %02x, got %02x", i, expect, data_type[i]);
     }
     return true;
 }
@@ -52,6 +64,7 @@ bool test_encode_decode(void) {
 static test_t tests[] = {
     {"slot type encode", test_encode},
     {"slot type encode & decode", test_encode_decode},
+    {"slot type batch decode", test_decode_batch},
     {NULL, NULL} /* sentinel */
 };
 
@@ -0,0 +1,57 @@
+#include <dmr/packetq.h>
+#include "_test_header.h"
+
+bool test_fifo(void) {
+    dmr_packetq_ring *r = dmr_packetq_ring_new(5, DMR_PACKETQ_REJECT);
+    dmr_parsed_packet parsed;
+    uint32_t i;
+
+    ne(r == NULL,                                   "ring allocation failed");
+    eq(r->size == 8,                                "expected size 8, got %zu", r->size);
+    for (i = 0; i < 8; i++) {
+        memset(&parsed, 0, sizeof parsed);
+        parsed.stream_id = i;
+        go(dmr_packetq_ring_add(r, &parsed),        "add %u", i);
+    }
+    eq(dmr_packetq_ring_add(r, &parsed) == -1,      "add to full ring accepted");
+    eq(r->dropped == 1,                             "expected 1 dropped, got %zu", r->dropped);
+    eq(r->hwm == 8,                                 "expected high-water mark 8, got %zu", r->hwm);
+    for (i = 0; i < 8; i++) {
+        go(dmr_packetq_ring_shift(r, &parsed),      "shift %u", i);
+        eq(parsed.stream_id == i,                   "expected stream %u, got %u", i, parsed.stream_id);
+    }
+    eq(dmr_packetq_ring_shift(r, &parsed) == -1,    "shift from empty ring");
+    dmr_packetq_ring_free(r);
+
+    return true;
+}
+
+bool test_drop_oldest(void) {
+    dmr_packetq_ring *r = dmr_packetq_ring_new(4, DMR_PACKETQ_DROP_OLDEST);
+    dmr_parsed_packet parsed;
+    uint32_t i;
+
+    ne(r == NULL,                                   "ring allocation failed");
+    for (i = 0; i < 6; i++) {
+        memset(&parsed, 0, sizeof parsed);
+        parsed.stream_id = i;
+        go(dmr_packetq_ring_add(r, &parsed),        "add %u", i);
+    }
+    eq(dmr_packetq_ring_len(r) == 4,                "expected 4 packets, got %zu", dmr_packetq_ring_len(r));
+    eq(r->dropped == 2,                             "expected 2 dropped, got %zu", r->dropped);
+    for (i = 2; i < 6; i++) {
+        go(dmr_packetq_ring_shift(r, &parsed),      "shift %u", i);
+        eq(parsed.stream_id == i,                   "expected stream %u, got %u", i, parsed.stream_id);
+    }
+    dmr_packetq_ring_free(r);
+
+    return true;
+}
+
+static test_t tests[] = {
+    {"packet ring fifo & reject", test_fifo},
+    {"packet ring drop oldest", test_drop_oldest},
+    {NULL, NULL} /* sentinel */
+};
+
+#include "_test_footer.h"
@@ -1,48 +1,152 @@
+#include <talloc.h>
 #include <dmr/payload/emb.h>
 #include "_test_header.h"
 
+static dmr_full_lc test_lc = {
+    .flco_pdu = DMR_FLCO_PDU_GROUP,
+    .fid      = 0x10,
+    .dst_id   = 2042,
+    .src_id   = 2042214
+};
+
 bool test_encode(void) {
-    dmr_packet_t *packet = test_packet();
-    dmr_emb_t emb = {
+    dmr_packet packet;
+    dmr_emb emb = {
         .color_code = 1,
         .pi         = true,
         .lcss       = DMR_EMB_LCSS_LAST_FRAGMENT,
         .crc        = 0
     };
 
-    if (dmr_emb_encode(&emb, packet) != 0) {
-        printf("encode failed");
-        return false;
-    }
-
+    memset(packet, 0, sizeof(packet));
+    go(dmr_emb_encode(packet, &emb), "encode failed");
     return true;
 }
 
 bool test_encode_decode(void) {
-    dmr_packet_t *packet = test_packet();
-    dmr_emb_t emb = {
-        .color_code = 1,
+    dmr_packet packet;
+    dmr_emb emb = {
+        .color_code = 7,
         .pi         = true,
         .lcss       = DMR_EMB_LCSS_LAST_FRAGMENT,
         .crc        = 0
     }, decode_emb;
 
-    if (dmr_emb_encode(&emb, packet) != 0) {
-        printf("encode failed");
-        return false;
+    memset(packet, 0, sizeof(packet));
+    go(dmr_emb_encode(packet, &emb),             "encode failed");
+    go(dmr_emb_decode(packet, &decode_emb),      "decode failed");
+    eq(decode_emb.color_code == 7,               "color_code %u", decode_emb.color_code);
+    eq(decode_emb.pi,                            "pi");
+    eq(decode_emb.lcss == DMR_EMB_LCSS_LAST_FRAGMENT, "lcss %u", decode_emb.lcss);
+
+    return true;
+}
+
+/* Encode the embedded LC fragments of a superframe into voice bursts B-E */
+static bool superframe(dmr_parsed_packet parsed[4], dmr_ts ts, uint32_t stream_id)
+{
+    static const dmr_emb_lcss lcss[4] = {
+        DMR_EMB_LCSS_FIRST_FRAGMENT,
+        DMR_EMB_LCSS_CONTINUATION,
+        DMR_EMB_LCSS_CONTINUATION,
+        DMR_EMB_LCSS_LAST_FRAGMENT
+    };
+    dmr_emb_signalling_lc_bits *emb_bits, *interleaved;
+    dmr_vbptc_16_11 *vbptc;
+    dmr_emb emb = { .color_code = 1 };
+    uint8_t i, j;
+
+    ne((emb_bits = talloc_zero(NULL, dmr_emb_signalling_lc_bits)) == NULL, "alloc");
+    go(dmr_emb_encode_signalling_lc_from_full_lc(&test_lc, emb_bits, DMR_DATA_TYPE_VOICE_LC), "LC encode");
+    ne((interleaved = dmr_emb_signalling_lc_interlave(emb_bits)) == NULL, "interleave");
+    ne((vbptc = dmr_vbptc_16_11_new(DMR_EMB_LC_ROWS, NULL)) == NULL, "VBPTC new");
+    go(dmr_vbptc_16_11_encode(vbptc, interleaved->bits, 77), "VBPTC encode");
+
+    for (i = 0; i < 4; i++) {
+        memset(&parsed[i], 0, sizeof(dmr_parsed_packet));
+        for (j = 0; j < DMR_PACKET_LEN; j++) {
+            parsed[i].packet[j] = rand();
+        }
+        parsed[i].ts = ts;
+        parsed[i].stream_id = stream_id;
+        parsed[i].data_type = DMR_DATA_TYPE_VOICE;
+        emb.lcss = lcss[i];
+        go(dmr_emb_lcss_fragment_encode(parsed[i].packet, &emb, vbptc, i), "fragment encode");
+    }
+
+    dmr_vbptc_16_11_free(vbptc);
+    talloc_free(interleaved);
+    talloc_free(emb_bits);
+    return true;
+}
+
+bool test_assembler(void) {
+    dmr_emb_lc_assembler assembler;
+    dmr_parsed_packet parsed[4];
+    dmr_full_lc lc;
+    uint8_t i;
+
+    dmr_emb_lc_assembler_init(&assembler);
+    eq(superframe(parsed, DMR_TS2, 0x1234), "superframe");
+    for (i = 0; i < 3; i++) {
+        eq(dmr_emb_lc_assembler_add(&assembler, &parsed[i], &lc) == 0, "LC after fragment %u", i);
+    }
+    eq(dmr_emb_lc_assembler_add(&assembler, &parsed[3], &lc) == 1, "no LC after the last fragment");
+    eq(lc.flco_pdu == test_lc.flco_pdu, "flco_pdu %u", lc.flco_pdu);
+    eq(lc.fid == test_lc.fid, "fid %02x", lc.fid);
+    eq(lc.src_id == test_lc.src_id, "src_id %u", lc.src_id);
+    eq(lc.dst_id == test_lc.dst_id, "dst_id %u", lc.dst_id);
+
+    /* a single bit error in the fragments is repaired */
+    parsed[2].packet[16] ^= 0x08;
+    for (i = 0; i < 3; i++) {
+        eq(dmr_emb_lc_assembler_add(&assembler, &parsed[i], &lc) == 0, "LC after fragment %u", i);
+    }
+    eq(dmr_emb_lc_assembler_add(&assembler, &parsed[3], &lc) == 1, "bit error not repaired");
+    eq(lc.src_id == test_lc.src_id, "src_id %u", lc.src_id);
+    return true;
+}
+
+bool test_assembler_late_entry(void) {
+    dmr_emb_lc_assembler assembler;
+    dmr_parsed_packet parsed[4], other[4];
+    dmr_full_lc lc;
+    uint8_t i;
+
+    dmr_emb_lc_assembler_init(&assembler);
+    eq(superframe(parsed, DMR_TS1, 0xcafe), "superframe");
+    eq(superframe(other, DMR_TS2, 0xbabe), "superframe");
+
+    /* joining mid superframe yields nothing until the next first fragment */
+    for (i = 2; i < 4; i++) {
+        eq(dmr_emb_lc_assembler_add(&assembler, &parsed[i], &lc) == 0, "LC from a partial superframe");
+    }
+    /* interleaved with the other timeslot */
+    for (i = 0; i < 4; i++) {
+        eq(dmr_emb_lc_assembler_add(&assembler, &other[i], &lc) == (i == 3), "TS2 fragment %u", i);
+        eq(dmr_emb_lc_assembler_add(&assembler, &parsed[i], &lc) == (i == 3), "TS1 fragment %u", i);
     }
 
-    go(dmr_emb_decode(&decode_emb, packet),      "decode failed");        
-    eq((emb.color_code == 1),                    "color_code");
-    eq((emb.pi             ),                    "pi");
-    eq((emb.lcss == DMR_EMB_LCSS_LAST_FRAGMENT), "lcss");
+    /* a lost fragment drops the superframe */
+    eq(dmr_emb_lc_assembler_add(&assembler, &parsed[0], &lc) == 0, "first fragment");
+    eq(dmr_emb_lc_assembler_add(&assembler, &parsed[1], &lc) == 0, "continuation");
+    eq(dmr_emb_lc_assembler_add(&assembler, &parsed[3], &lc) == 0, "LC with a missing fragment");
 
+    /* a new stream resets the timeslot */
+    eq(dmr_emb_lc_assembler_add(&assembler, &parsed[0], &lc) == 0, "first fragment");
+    eq(dmr_emb_lc_assembler_add(&assembler, &parsed[1], &lc) == 0, "continuation");
+    parsed[2].stream_id = 0xf00d;
+    eq(dmr_emb_lc_assembler_add(&assembler, &parsed[2], &lc) == 0, "continuation");
+    parsed[3].stream_id = 0xf00d;
+    eq(dmr_emb_lc_assembler_add(&assembler, &parsed[3], &lc) == 0, "LC across streams");
     return true;
 }
 
 static test_t tests[] = {
     {"emb encode", test_encode},
     {"emb encode & decode", test_encode_decode},
+    {"emb LC reassembly", test_assembler},
+    {"emb LC late entry", test_assembler_late_entry},
     {NULL, NULL} /* sentinel */
 };
 
@@ -1,13 +1,53 @@
 #include <dmr/payload/sync.h>
 #include "_test_header.h"
 
+/* Flip bit i of the 48 sync bits, bytes 13 (low nibble) through 19 (high nibble) */
+static void flip_sync_bit(dmr_packet packet, uint8_t i)
+{
+    uint16_t b = 108 + i;
+    packet[b >> 3] ^= 0x80 >> (b & 7);
+}
+
 bool test_all(void) {
-    dmr_sync_pattern_t pattern;
-    dmr_packet_t *packet = test_packet();
+    dmr_sync_pattern pattern;
+    dmr_packet packet;
+    uint8_t distance;
 
+    memset(packet, 0, sizeof(packet));
     for (pattern = 0; pattern < DMR_SYNC_PATTERN_UNKNOWN; pattern++) {
-        go(dmr_sync_pattern_encode(pattern, packet),   "encode");
+        go(dmr_sync_pattern_encode(packet, pattern),   "encode");
         eq(dmr_sync_pattern_decode(packet) == pattern, "sync pattern mismatch");
+        eq(dmr_sync_pattern_classify(packet, &distance) == pattern, "classify mismatch");
+        eq(distance == 0, "expected distance 0, got %u", distance);
+    }
+
+    return true;
+}
+
+bool test_noise(void) {
+    dmr_sync_pattern pattern;
+    dmr_packet packet;
+    uint8_t distance, i, errors;
+
+    for (pattern = 0; pattern < DMR_SYNC_PATTERN_UNKNOWN; pattern++) {
+        for (errors = 1; errors < 8; errors++) {
+            for (i = 0; i < sizeof(dmr_packet); i++) {
+                packet[i] = rand();
+            }
+            go(dmr_sync_pattern_encode(packet, pattern), "encode");
+            /* distinct bits, so the distance is exact */
+            for (i = 0; i < errors; i++) {
+                flip_sync_bit(packet, i * 6 + (pattern % 6));
+            }
+
+            if (errors < 4) {
+                eq(dmr_sync_pattern_classify(packet, &distance) == pattern, "classify mismatch with %u errors", errors);
+            } else {
+                eq(dmr_sync_pattern_classify(packet, &distance) == DMR_SYNC_PATTERN_UNKNOWN, "matched with %u errors", errors);
+            }
+            eq(distance == errors, "expected distance %u, got %u", errors, distance);
+            eq(dmr_sync_pattern_decode(packet) == (errors < 4 ? pattern : DMR_SYNC_PATTERN_UNKNOWN), "decode mismatch");
+        }
     }
 
     return true;
@@ -15,6 +55,7 @@ bool test_all(void) {
 
 static test_t tests[] = {
     {"sync pattern encode & decode", test_all},
+    {"sync pattern classify with noise", test_noise},
     {NULL, NULL} /* sentinel */
 };
 
@@ -16,60 +16,51 @@ static uint8_t raw[2][33] = {
 
 bool test_decode(void)
 {
-	dmr_packet_t *packet = talloc_zero(NULL, dmr_packet_t);
-	dmr_full_lc_t *full_lc = talloc_zero(NULL, dmr_full_lc_t);
+	dmr_packet packet;
+	dmr_full_lc full_lc;
 	uint8_t i;
 
 	for (i = 0; i < 1; i++) {
-		memcpy(packet->payload, raw[i], 33);
-		dmr_dump_hex(packet->payload, 33);
-		memset(full_lc, 0, sizeof(dmr_full_lc_t));
+		memcpy(packet, raw[i], 33);
+		dmr_dump_hex(packet, 33);
+		memset(&full_lc, 0, sizeof(dmr_full_lc));
 
-		eq(dmr_sync_pattern_decode(packet) != DMR_SYNC_PATTERN_BS_SOURCED_DATA, "sync pattern mismatch");
-		packet->data_type = DMR_DATA_TYPE_VOICE_LC;
-		go(dmr_full_lc_decode(full_lc, packet), "full LC decode");
+		eq(dmr_sync_pattern_decode(packet) == DMR_SYNC_PATTERN_MS_SOURCED_DATA, "sync pattern mismatch");
+		go(dmr_full_lc_decode(packet, &full_lc, DMR_DATA_TYPE_VOICE_LC), "full LC decode");
 		printf("full link control: flco_pdu=%u, fid=%u, %u->%u\n",
-			full_lc->flco_pdu, full_lc->fid, full_lc->src_id, full_lc->dst_id);
+			full_lc.flco_pdu, full_lc.fid, full_lc.src_id, full_lc.dst_id);
 	}
 
-	talloc_free(packet);
-	talloc_free(full_lc);
-
 	return true;
 }
 
 
 bool test_encode(void)
 {
-	dmr_packet_t *packet = talloc_zero(NULL, dmr_packet_t);
-	dmr_full_lc_t *full_lc = talloc_zero(NULL, dmr_full_lc_t);
-	dmr_full_lc_t *full_lc_decoded = talloc_zero(NULL, dmr_full_lc_t);
+	dmr_packet packet;
+	dmr_full_lc full_lc, full_lc_decoded;
 
-	memset(packet, 0, sizeof(dmr_packet_t));
-	packet->src_id = rand() & 0xffffff;
-	packet->dst_id = rand() & 0xffffff;
-	packet->repeater_id = rand();
-	packet->data_type = DMR_DATA_TYPE_VOICE_LC;
-	dmr_dump_hex(packet->payload, 33);
+	memset(packet, 0, sizeof(dmr_packet));
+	memset(&full_lc, 0, sizeof(dmr_full_lc));
+	memset(&full_lc_decoded, 0, sizeof(dmr_full_lc));
+	dmr_dump_hex(packet, 33);
 
-	go(dmr_sync_pattern_encode(DMR_SYNC_PATTERN_BS_SOURCED_DATA, packet), "sync pattern encode");
-	dmr_dump_hex(packet->payload, 33);
+	go(dmr_sync_pattern_encode(packet, DMR_SYNC_PATTERN_BS_SOURCED_DATA), "sync pattern encode");
+	dmr_dump_hex(packet, 33);
 
-	full_lc->src_id = packet->src_id;
-	full_lc->dst_id = packet->dst_id;
+	full_lc.src_id = rand() & 0xffffff;
+	full_lc.dst_id = rand() & 0xffffff;
 	printf("full link control: flco_pdu=%u, fid=%u, %u->%u\n",
-			full_lc->flco_pdu, full_lc->fid, full_lc->src_id, full_lc->dst_id);
-	go(dmr_full_lc_encode(full_lc, packet), "encode");
-	dmr_dump_hex(packet->payload, 33);
+			full_lc.flco_pdu, full_lc.fid, full_lc.src_id, full_lc.dst_id);
+	go(dmr_full_lc_encode(packet, &full_lc, DMR_DATA_TYPE_VOICE_LC), "encode");
+	dmr_dump_hex(packet, 33);
 
-	go(dmr_full_lc_decode(full_lc_decoded, packet), "decode");
+	go(dmr_full_lc_decode(packet, &full_lc_decoded, DMR_DATA_TYPE_VOICE_LC), "decode");
 	printf("full link control: flco_pdu=%u, fid=%u, %u->%u\n",
-			full_lc_decoded->flco_pdu, full_lc_decoded->fid,
-			full_lc_decoded->src_id, full_lc_decoded->dst_id);
-
-	talloc_free(packet);
-	talloc_free(full_lc_decoded);
-	talloc_free(full_lc);
+			full_lc_decoded.flco_pdu, full_lc_decoded.fid,
+			full_lc_decoded.src_id, full_lc_decoded.dst_id);
+	eq(full_lc_decoded.src_id == full_lc.src_id, "src_id mismatch");
+	eq(full_lc_decoded.dst_id == full_lc.dst_id, "dst_id mismatch");
 
 	return true;
 }
@@ -0,0 +1,66 @@
+#include <dmr/malloc.h>
+#include <dmr/packetq.h>
+#include <dmr/pool.h>
+#include "_test_header.h"
+
+bool test_recycle(void) {
+    dmr_pool *pool = dmr_pool_new(NULL, sizeof(dmr_parsed_packet), 4);
+    dmr_parsed_packet *parsed[6];
+    size_t i;
+
+    ne(pool == NULL,                                "pool allocation failed");
+    eq(pool->stats.available == 4,                  "expected 4 available, got %zu", pool->stats.available);
+    for (i = 0; i < 6; i++) {
+        ne((parsed[i] = dmr_pool_get(pool)) == NULL, "get %zu", i);
+        parsed[i]->stream_id = i;
+    }
+    eq(pool->stats.misses == 2,                     "expected 2 misses, got %zu", pool->stats.misses);
+    eq(pool->stats.in_use == 6,                     "expected 6 in use, got %zu", pool->stats.in_use);
+    for (i = 0; i < 6; i++)
+        dmr_pool_put(pool, parsed[i]);
+    eq(pool->stats.in_use == 0,                     "expected 0 in use, got %zu", pool->stats.in_use);
+    eq(pool->stats.peak == 6,                       "expected peak 6, got %zu", pool->stats.peak);
+    eq(pool->stats.available == 6,                  "expected 6 available, got %zu", pool->stats.available);
+    for (i = 0; i < 6; i++) {
+        ne((parsed[i] = dmr_pool_get(pool)) == NULL, "get %zu", i);
+        eq(parsed[i]->stream_id == 0,               "object %zu not zeroed", i);
+    }
+    eq(pool->stats.misses == 2,                     "expected 2 misses, got %zu", pool->stats.misses);
+    for (i = 0; i < 6; i++)
+        dmr_pool_put(pool, parsed[i]);
+    dmr_pool_free(pool);
+
+    return true;
+}
+
+bool test_packetq(void) {
+    dmr_packetq *q = dmr_packetq_new();
+    dmr_pool *pool = dmr_parsed_packet_pool();
+    dmr_packet packet;
+    size_t i, misses;
+
+    ne(q == NULL,                                   "queue allocation failed");
+    ne(pool == NULL,                                "pool allocation failed");
+    go(dmr_pool_prefill(pool, 8),                   "prefill");
+    go(dmr_pool_prefill(dmr_packetq_entry_pool(), 8), "prefill entries");
+    misses = pool->stats.misses;
+    for (i = 0; i < 64; i++) {
+        memset(packet, i, sizeof packet);
+        go(dmr_packetq_add_packet(q, packet),       "add %zu", i);
+        go(dmr_packetq_shift_packet(q, packet),     "shift %zu", i);
+        eq(packet[0] == i,                          "expected %zu, got %u", i, packet[0]);
+    }
+    eq(pool->stats.misses == misses,                "expected no misses, got %zu", pool->stats.misses - misses);
+    eq(dmr_packetq_entry_pool()->stats.misses == 0, "expected no entry misses");
+    dmr_free(q);
+
+    return true;
+}
+
+static test_t tests[] = {
+    {"object recycling", test_recycle},
+    {"packet queue", test_packetq},
+    {NULL, NULL} /* sentinel */
+};
+
+#include "_test_footer.h"
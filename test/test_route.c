@@ -0,0 +1,293 @@
+/* Route rules are part of noisebridge, the rule engine only depends on the
+ * config types so it is compiled in here. */
+#include "../src/cmd/noisebridge/route.c"
+#include "_test_header.h"
+
+static proto_t proto_a = { .name = "a" };
+static proto_t proto_b = { .name = "b" };
+static proto_t proto_c = { .name = "c" };
+
+static route_rule *parse(config_t *config, const char *line)
+{
+    char buf[256], name[16];
+    strncpy(buf, line, sizeof(buf) - 1);
+    buf[sizeof(buf) - 1] = '\0';
+    snprintf(name, sizeof(name), "%zu", config->routes);
+
+    route_rule *rule = route_rule_parse(config, name, buf);
+    if (rule != NULL)
+        config->route[config->routes++] = rule;
+    return rule;
+}
+
+static dmr_parsed_packet *packet(dmr_ts ts, dmr_flco flco, dmr_id src_id, dmr_id dst_id)
+{
+    dmr_parsed_packet *parsed = dmr_parsed_packet_new();
+    if (parsed != NULL) {
+        parsed->ts = ts;
+        parsed->flco = flco;
+        parsed->src_id = src_id;
+        parsed->dst_id = dst_id;
+        parsed->color_code = 1;
+        parsed->repeater_id = 204;
+    }
+    return parsed;
+}
+
+bool test_parse(void) {
+    static const char *invalid[] = {
+        "",
+        "forward a b",
+        "permit a",
+        "permit a b ts=3",
+        "permit a b flco=broadcast",
+        "permit a b src_id=20-10",
+        "permit a b dst_id=x",
+        "permit a b set_cc=16",
+        "permit a b color=1",
+        "permit a b ts",
+        "reject a b set_ts=2",
+        "script * * set_repeater_id=1",
+        NULL
+    };
+    config_t *config = talloc_zero(NULL, config_t);
+    route_rule *rule;
+    size_t i;
+
+    ne(config == NULL, "alloc");
+    for (i = 0; invalid[i] != NULL; i++) {
+        eq(parse(config, invalid[i]) == NULL, "accepted \"%s\"", invalid[i]);
+    }
+    eq(config->routes == 0, "invalid rules stored");
+
+    ne((rule = parse(config, "permit * b src_id=10-10 dst_id=91-99 flco=private set_cc=15")) == NULL, "parse");
+    eq(rule->action == ROUTE_RULE_PERMIT, "action %u", rule->action);
+    eq(rule->src_name == NULL && !strcmp(rule->dst_name, "b"), "protos");
+    eq(rule->match == (ROUTE_MATCH_SRC_ID | ROUTE_MATCH_DST_ID | ROUTE_MATCH_FLCO), "match %#02x", rule->match);
+    eq(rule->src_id[0] == 10 && rule->src_id[1] == 10, "src_id %u-%u", rule->src_id[0], rule->src_id[1]);
+    eq(rule->dst_id[0] == 91 && rule->dst_id[1] == 99, "dst_id %u-%u", rule->dst_id[0], rule->dst_id[1]);
+    eq(rule->flco == DMR_FLCO_PRIVATE, "flco %u", rule->flco);
+    eq(rule->rewrite == ROUTE_REWRITE_COLOR_CODE && rule->set_color_code == 15, "set_cc");
+
+    ne((rule = parse(config, "script a *")) == NULL, "parse");
+    eq(rule->action == ROUTE_RULE_SCRIPT && rule->dst_name == NULL, "script rule");
+
+    /* protos must exist */
+    config->proto[config->protos++] = &proto_a;
+    ne(route_compile(config) == 0, "unknown proto b compiled");
+    config->proto[config->protos++] = &proto_b;
+    go(route_compile(config), "compile");
+    eq(config->route[0]->src == NULL && config->route[0]->dst == &proto_b, "resolved protos");
+
+    talloc_free(config);
+    return true;
+}
+
+bool test_match(void) {
+    config_t *config = talloc_zero(NULL, config_t);
+    dmr_parsed_packet *parsed;
+    route_rule *rule[4];
+    size_t i;
+
+    ne(config == NULL, "alloc");
+    config->proto[config->protos++] = &proto_a;
+    config->proto[config->protos++] = &proto_b;
+    config->proto[config->protos++] = &proto_c;
+    ne((rule[0] = parse(config, "reject a * dst_id=9")) == NULL, "parse");
+    ne((rule[1] = parse(config, "permit a b ts=1 flco=group dst_id=91-99")) == NULL, "parse");
+    ne((rule[2] = parse(config, "permit * b")) == NULL, "parse");
+    ne((rule[3] = parse(config, "reject * c")) == NULL, "parse");
+    go(route_compile(config), "compile");
+
+    struct {
+        proto_t           *src, *dst;
+        dmr_ts            ts;
+        dmr_flco          flco;
+        dmr_id            dst_id;
+        route_rule        *rule;
+    } cases[] = {
+        /* the first matching rule wins, even if a later one matches too */
+        { &proto_a, &proto_b, DMR_TS1, DMR_FLCO_GROUP,   9,  rule[0] },
+        { &proto_a, &proto_b, DMR_TS1, DMR_FLCO_GROUP,   91, rule[1] },
+        { &proto_a, &proto_b, DMR_TS1, DMR_FLCO_GROUP,   99, rule[1] },
+        { &proto_a, &proto_b, DMR_TS1, DMR_FLCO_GROUP,   100, rule[2] },
+        { &proto_a, &proto_b, DMR_TS2, DMR_FLCO_GROUP,   91, rule[2] },
+        { &proto_a, &proto_b, DMR_TS1, DMR_FLCO_PRIVATE, 91, rule[2] },
+        /* wildcards */
+        { &proto_c, &proto_b, DMR_TS1, DMR_FLCO_GROUP,   9,  rule[2] },
+        { &proto_a, &proto_c, DMR_TS2, DMR_FLCO_GROUP,   50, rule[3] },
+        { &proto_b, &proto_c, DMR_TS2, DMR_FLCO_GROUP,   50, rule[3] },
+        /* nothing matches */
+        { &proto_b, &proto_a, DMR_TS1, DMR_FLCO_GROUP,   50, NULL    },
+    };
+    for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        ne((parsed = packet(cases[i].ts, cases[i].flco, 2042214, cases[i].dst_id)) == NULL, "alloc");
+        route_rule *match = route_match(config, cases[i].src, cases[i].dst, parsed);
+        eq(match == cases[i].rule, "case %zu: expected rule %s, got %s", i,
+            cases[i].rule == NULL ? "none" : cases[i].rule->name,
+            match == NULL ? "none" : match->name);
+        dmr_parsed_packet_free(parsed);
+    }
+
+    talloc_free(config);
+    return true;
+}
+
+bool test_apply(void) {
+    config_t *config = talloc_zero(NULL, config_t);
+    dmr_parsed_packet *parsed;
+    dmr_packet_ref *ref, *shared;
+    route_rule *rewrite, *permit, *reject;
+
+    ne(config == NULL, "alloc");
+    ne((rewrite = parse(config, "permit * * set_ts=2 set_cc=1 set_repeater_id=204")) == NULL, "parse");
+    ne((permit = parse(config, "permit * *")) == NULL, "parse");
+    ne((reject = parse(config, "reject * *")) == NULL, "parse");
+
+    ne((parsed = packet(DMR_TS1, DMR_FLCO_GROUP, 2042214, 91)) == NULL, "alloc");
+    ne((ref = dmr_packet_ref_new(parsed)) == NULL, "ref");
+    shared = dmr_packet_ref_get(ref);
+
+    /* rules that change nothing leave the shared packet alone */
+    eq(route_rule_apply(reject, &shared) == ROUTE_REJECT, "reject");
+    eq(route_rule_apply(permit, &shared) == ROUTE_PERMIT_UNMODIFIED, "permit");
+    eq(shared == ref && ref->refs == 2, "packet copied without a rewrite");
+
+    /* a rewrite copies the shared packet, only the fields that differ */
+    eq(route_rule_apply(rewrite, &shared) == ROUTE_PERMIT, "rewrite");
+    ne(shared == ref, "shared packet modified in place");
+    eq(shared->parsed->ts == DMR_TS2, "ts %u", shared->parsed->ts);
+    eq(shared->parsed->color_code == 1 && shared->parsed->repeater_id == 204, "rewritten fields");
+    eq(shared->parsed->dst_id == 91, "copy dst_id %u", shared->parsed->dst_id);
+    eq(parsed->ts == DMR_TS1 && ref->refs == 1, "original packet modified");
+
+    /* the rewritten packet already has the values */
+    dmr_packet_ref *copy = shared;
+    eq(route_rule_apply(rewrite, &shared) == ROUTE_PERMIT_UNMODIFIED, "rewrite unchanged");
+    eq(shared == copy, "packet copied again");
+
+    dmr_packet_ref_put(shared);
+    dmr_packet_ref_put(ref);
+    talloc_free(config);
+    return true;
+}
+
+static int lookup(route_cache *cache, proto_t *src, proto_t *dst, dmr_packet_ref **ref, route_policy *policy)
+{
+    /* not a policy, so a lookup that does not set it is noticed */
+    *policy = (route_policy)-1;
+    return route_cache_lookup(cache, src, dst, ref, policy);
+}
+
+bool test_cache(void) {
+    route_cache *cache = route_cache_new(NULL);
+    dmr_parsed_packet *in, *out, *parsed;
+    dmr_packet_ref *ref, *shared;
+    route_policy policy;
+
+    ne(cache == NULL, "alloc");
+    ne((in = packet(DMR_TS1, DMR_FLCO_GROUP, 2042214, 91)) == NULL, "alloc");
+    ne((out = packet(DMR_TS1, DMR_FLCO_GROUP, 2042214, 91)) == NULL, "alloc");
+    in->stream_id = out->stream_id = 0x1234;
+    out->ts = DMR_TS2;
+    out->repeater_id = 1234;
+
+    /* the header rewritten by the route, the bursts get the same delta */
+    route_cache_store(cache, &proto_a, &proto_b, in, out, ROUTE_PERMIT);
+    ne((parsed = packet(DMR_TS1, DMR_FLCO_GROUP, 2042214, 91)) == NULL, "alloc");
+    parsed->stream_id = 0x1234;
+    parsed->sequence = 1;
+    ne((ref = dmr_packet_ref_new(parsed)) == NULL, "ref");
+    shared = dmr_packet_ref_get(ref);
+    go(lookup(cache, &proto_a, &proto_b, &shared, &policy), "lookup");
+    eq(policy == ROUTE_PERMIT, "policy %u", policy);
+    ne(shared == ref, "shared packet modified in place");
+    eq(shared->parsed->ts == DMR_TS2 && shared->parsed->repeater_id == 1234, "delta not applied");
+    eq(shared->parsed->sequence == 1 && shared->parsed->color_code == 1, "copy differs");
+    eq(parsed->ts == DMR_TS1 && parsed->repeater_id == 204, "original packet modified");
+    dmr_packet_ref_put(shared);
+
+    /* not for other destinations */
+    shared = dmr_packet_ref_get(ref);
+    ne(lookup(cache, &proto_a, &proto_c, &shared, &policy) == 0, "hit for another destination");
+    ne(lookup(cache, &proto_c, &proto_b, &shared, &policy) == 0, "hit for another source");
+
+    /* a permit without changes keeps the packet shared */
+    route_cache_store(cache, &proto_a, &proto_c, in, in, ROUTE_PERMIT);
+    go(lookup(cache, &proto_a, &proto_c, &shared, &policy), "lookup");
+    eq(policy == ROUTE_PERMIT_UNMODIFIED, "policy %u", policy);
+    eq(shared == ref && ref->refs == 2, "packet copied without a rewrite");
+
+    /* as does a reject */
+    route_cache_store(cache, &proto_b, &proto_c, in, in, ROUTE_REJECT);
+    go(lookup(cache, &proto_b, &proto_c, &shared, &policy), "lookup");
+    eq(policy == ROUTE_REJECT, "policy %u", policy);
+    eq(shared == ref && ref->refs == 2, "packet copied on reject");
+    eq(cache->hits == 3 && cache->misses == 2, "%llu hits, %llu misses",
+        (unsigned long long)cache->hits, (unsigned long long)cache->misses);
+
+    dmr_packet_ref_put(shared);
+    dmr_packet_ref_put(ref);
+    dmr_parsed_packet_free(in);
+    dmr_parsed_packet_free(out);
+    talloc_free(cache);
+    return true;
+}
+
+bool test_cache_invalidate(void) {
+    route_cache *cache = route_cache_new(NULL);
+    dmr_parsed_packet *ts1, *ts2, *other;
+    dmr_packet_ref *ref;
+    route_policy policy;
+    uint32_t stream_id;
+
+    ne(cache == NULL, "alloc");
+    ne((ts1 = packet(DMR_TS1, DMR_FLCO_GROUP, 2042214, 91)) == NULL, "alloc");
+    ne((ts2 = packet(DMR_TS2, DMR_FLCO_GROUP, 2042214, 92)) == NULL, "alloc");
+    ts1->stream_id = 0x1111;
+    ts2->stream_id = 0x2222;
+    ne(route_cache_slot(cache, ts1->stream_id, &proto_a, &proto_b) ==
+       route_cache_slot(cache, ts2->stream_id, &proto_a, &proto_b), "streams share a slot");
+    route_cache_store(cache, &proto_a, &proto_b, ts1, ts1, ROUTE_PERMIT);
+    route_cache_store(cache, &proto_a, &proto_b, ts2, ts2, ROUTE_PERMIT);
+
+    /* only the verdicts for streams on the timeslot are dropped */
+    route_cache_invalidate(cache, DMR_TS1);
+    ne((ref = dmr_packet_ref_new(ts1)) == NULL, "ref");
+    ne(lookup(cache, &proto_a, &proto_b, &ref, &policy) == 0, "hit after invalidate");
+    dmr_packet_ref_put(ref);
+    ne((ref = dmr_packet_ref_new(ts2)) == NULL, "ref");
+    go(lookup(cache, &proto_a, &proto_b, &ref, &policy), "TS2 stream invalidated");
+    eq(policy == ROUTE_PERMIT_UNMODIFIED, "policy %u", policy);
+
+    /* a stream taking the slot of another one evicts it */
+    for (stream_id = ts2->stream_id + 1; stream_id != ts2->stream_id; stream_id++) {
+        if (route_cache_slot(cache, stream_id, &proto_a, &proto_b) ==
+            route_cache_slot(cache, ts2->stream_id, &proto_a, &proto_b))
+            break;
+    }
+    ne(stream_id == ts2->stream_id, "no colliding stream id");
+    ne((other = packet(DMR_TS2, DMR_FLCO_GROUP, 2042214, 93)) == NULL, "alloc");
+    other->stream_id = stream_id;
+    route_cache_store(cache, &proto_a, &proto_b, other, other, ROUTE_REJECT);
+    ne(lookup(cache, &proto_a, &proto_b, &ref, &policy) == 0, "hit for an evicted stream");
+    dmr_packet_ref_put(ref);
+    ne((ref = dmr_packet_ref_new(other)) == NULL, "ref");
+    go(lookup(cache, &proto_a, &proto_b, &ref, &policy), "colliding stream");
+    eq(policy == ROUTE_REJECT, "policy %u", policy);
+    dmr_packet_ref_put(ref);
+
+    talloc_free(cache);
+    return true;
+}
+
+static test_t tests[] = {
+    {"route rule parse", test_parse},
+    {"route rule match", test_match},
+    {"route rule apply", test_apply},
+    {"route cache", test_cache},
+    {"route cache invalidate", test_cache_invalidate},
+    {NULL, NULL} /* sentinel */
+};
+
+#include "_test_footer.h"